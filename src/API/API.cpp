@@ -3,6 +3,10 @@
 std::vector<std::pair<String, String>> handleRequestConfig(const String& path, const std::vector<std::pair<String, String>>& params);
 std::vector<std::pair<String, String>> handleRequestHomepage(const String& path, const std::vector<std::pair<String, String>>& params);
 std::vector<std::pair<String, String>> handleRequestStatus(const String& path, const std::vector<std::pair<String, String>>& params);
+std::vector<std::pair<String, String>> handleRequestMetrics(const String& path, const std::vector<std::pair<String, String>>& params);
+std::vector<std::pair<String, String>> handleRequestTrace(const String& path, const std::vector<std::pair<String, String>>& params);
+std::vector<std::pair<String, String>> handleRequestLog(const String& path, const std::vector<std::pair<String, String>>& params);
+std::vector<std::pair<String, String>> handleRequestNeighbors(const String& path, const std::vector<std::pair<String, String>>& params);
 
 std::vector<std::pair<String, String>> handleRequest(const String& path, const std::vector<std::pair<String, String>>& params) {
     if (path.startsWith("/config")) {
@@ -16,6 +20,22 @@ std::vector<std::pair<String, String>> handleRequest(const String& path, const s
         return handleRequestStatus(path, params);
     }
 
+    if (path.startsWith("/metrics")) {
+        return handleRequestMetrics(path, params);
+    }
+
+    if (path.startsWith("/trace")) {
+        return handleRequestTrace(path, params);
+    }
+
+    if (path.startsWith("/log")) {
+        return handleRequestLog(path, params);
+    }
+
+    if (path.startsWith("/neighbors")) {
+        return handleRequestNeighbors(path, params);
+    }
+
     return { { "error", "Unknown endpoint" } };
 }
 
@@ -76,3 +96,24 @@ std::vector<std::pair<String, String>> handleRequestCLI(const String& input) {
 
     return handleRequest(path, params);
 }
+
+void pollCLI(Stream& io) {
+    static String line;
+    while (io.available() > 0) {
+        char c = (char)io.read();
+        if (c == '\r') continue;
+        if (c != '\n') {
+            if (line.length() < 128) line += c;
+            continue;
+        }
+        line.trim();
+        if (line.startsWith("/")) {
+            for (const auto& kv : handleRequestCLI(line)) {
+                io.print(kv.first);
+                io.print('=');
+                io.println(kv.second);
+            }
+        }
+        line = "";
+    }
+}
@@ -5,3 +5,6 @@
 std::vector<std::pair<String, String>> handleRequest(const String& path, const std::vector<std::pair<String, String>>& params);
 std::vector<std::pair<String, String>> handleRequestHTML(const String& fullPath);
 std::vector<std::pair<String, String>> handleRequestCLI(const String& input);
+
+// Non-blocking line reader: feeds complete lines (e.g. "/metrics/get") to handleRequestCLI
+void pollCLI(Stream& io);
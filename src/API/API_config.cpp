@@ -7,7 +7,14 @@ static const std::vector<std::pair<String, String>> configKeys = {
     {"wifi_ssid", "Network to which you want to connect this device"},
     {"wifi_password", "Password for the target Wi-Fi network"},
     {"wifi_hotspot_name", "Name for this device"},
-    {"config_password", "Password required to access configuration (optional)"}
+    {"config_password", "Password required to access configuration (optional)"},
+    {"flash_budget_kb", "Daily write budget in KB for internal flash when no SD card is used (empty = default)"},
+    {"ble_binary", "Send messages as compact binary BLE frames (1 = on; older devices only read the text format)"},
+    {"ble_crc", "Send CRC32C message checksums (1 = on, default; 0 = old byte sum only, for fleets with devices that lack CRC32C support)"},
+    {"ble_groups", "Groups whose messages this device receives, comma separated (e.g. CLUB,EMERG)"},
+    {"ble_relay", "Also assemble messages addressed to other devices, for relaying (1 = on)"},
+    {"ble_prox_cal", "Distance calibration per device model: code:rssi_at_1m:exponent, comma separated (e.g. LT1:-58:2.2)"},
+    {"ble_census", "Count other BLE devices around (anonymous estimate over 1 min, 15 min and 1 h; 1 = on)"}
 };
 
 std::vector<std::pair<String, String>> handleRequestConfig(const String& path, const std::vector<std::pair<String, String>>& params) {
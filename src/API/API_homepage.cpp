@@ -1,5 +1,6 @@
 #include "API.h"
 #include <Preferences.h>
+#include "diag/heapprof.h"
 
 // === Field declarations (key, description, default) ===
 static const std::vector<std::tuple<String, String, String>> introFields = {
@@ -95,6 +96,7 @@ static String buildStatusJson()   { return ""; }
 
 // === Main handler ===
 std::vector<std::pair<String, String>> handleRequestHomepage(const String& path, const std::vector<std::pair<String, String>>& params) {
+    HEAPPROF_SCOPE("api_homepage");
     std::vector<std::pair<String, String>> response;
 
     if (path == "/homepage") {
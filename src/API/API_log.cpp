@@ -0,0 +1,51 @@
+#include "API.h"
+#include "diag/log.h"
+
+std::vector<std::pair<String, String>> handleRequestLog(const String& path, const std::vector<std::pair<String, String>>& params) {
+    std::vector<std::pair<String, String>> response;
+
+    if (path == "/log/get") {
+        for (int m = 0; m < LOGM_COUNT; ++m) {
+            response.emplace_back(String("level_") + glog_module_name((LogModule)m),
+                                  glog_level_name(glog_get_level((LogModule)m)));
+        }
+        LogStats st;
+        glog_stats(&st);
+        response.emplace_back("lines", String(st.lines));
+        response.emplace_back("dropped_full", String(st.dropped_full));
+        response.emplace_back("dropped_rate", String(st.dropped_rate));
+        response.emplace_back("file_bytes", String(st.file_bytes));
+        response.emplace_back("status", "ok");
+    }
+
+    else if (path == "/log/set") {
+        // /log/set module=ble level=debug   (module=all applies to every module)
+        String module, level;
+        for (const auto& kv : params) {
+            if (kv.first == "module") module = kv.second;
+            else if (kv.first == "level") level = kv.second;
+        }
+        int l = glog_level_from_name(level.c_str());
+        if (l < 0) {
+            response.emplace_back("error", "invalid level");
+            return response;
+        }
+        if (module == "all") {
+            for (int m = 0; m < LOGM_COUNT; ++m) glog_set_level((LogModule)m, (LogLevel)l);
+        } else {
+            int m = glog_module_from_name(module.c_str());
+            if (m < 0) {
+                response.emplace_back("error", "invalid module");
+                return response;
+            }
+            glog_set_level((LogModule)m, (LogLevel)l);
+        }
+        response.emplace_back("status", "ok");
+    }
+
+    else {
+        response.emplace_back("error", "invalid path");
+    }
+
+    return response;
+}
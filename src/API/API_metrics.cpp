@@ -0,0 +1,47 @@
+#include "API.h"
+#include "diag/metrics.h"
+#include "diag/heapprof.h"
+
+std::vector<std::pair<String, String>> handleRequestMetrics(const String& path, const std::vector<std::pair<String, String>>& params) {
+    std::vector<std::pair<String, String>> response;
+    metrics_sample();
+
+    if (path == "/metrics/get") {
+        // Flat key/value view, convenient for the CLI
+        for (int i = 0; i < M_COUNT; ++i) {
+            response.emplace_back(metric_name((MetricId)i), String(metric_get((MetricId)i)));
+        }
+        for (int i = 0; i < H_COUNT; ++i) {
+            String name = hist_name((HistId)i);
+            response.emplace_back(name + "_count", String(hist_count((HistId)i)));
+            response.emplace_back(name + "_p50", String(hist_quantile_us((HistId)i, 0.50f)));
+            response.emplace_back(name + "_p99", String(hist_quantile_us((HistId)i, 0.99f)));
+        }
+        response.emplace_back("status", "ok");
+    }
+
+    else if (path == "/metrics/prometheus") {
+        String text;
+        metrics_render_prometheus(text);
+        response.emplace_back("text", text);
+    }
+
+    else if (path == "/metrics/json") {
+        String json;
+        metrics_render_json(json);
+        response.emplace_back("json", json);
+    }
+
+    else if (path == "/metrics/heap_reset") {
+        // Zero per-site allocation counters (live bytes are kept)
+        heapprof_reset();
+        response.emplace_back("heap_profile_enabled", heapprof_enabled() ? "true" : "false");
+        response.emplace_back("status", "ok");
+    }
+
+    else {
+        response.emplace_back("error", "invalid path");
+    }
+
+    return response;
+}
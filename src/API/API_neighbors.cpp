@@ -0,0 +1,45 @@
+#include "API.h"
+#include "ble/proximity.h"
+
+static String macString(const uint8_t* m) {
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+    return String(buf);
+}
+
+std::vector<std::pair<String, String>> handleRequestNeighbors(const String& path, const std::vector<std::pair<String, String>>& params) {
+    std::vector<std::pair<String, String>> response;
+
+    if (path == "/neighbors" || path == "/neighbors/get") {
+        // Nearest first; names are [A-Za-z0-9] (Proximity::parsePing), so no escaping needed
+        std::vector<ProxNeighbor> list(PROX_MAX_NEIGHBORS);
+        int count = proximity_snapshot(list.data(), PROX_MAX_NEIGHBORS);
+        uint32_t now = millis();
+
+        String json = "{\"count\":" + String(count) + ",\"neighbors\":[";
+        for (int i = 0; i < count; i++) {
+            const ProxNeighbor& n = list[i];
+            if (i) json += ",";
+            json += "{\"mac\":\"" + macString(n.mac) + "\"";
+            json += ",\"callsign\":\"" + String(n.callsign) + "\"";
+            json += ",\"model\":\"" + String(n.model) + "\"";
+            json += ",\"calibrated\":" + String(n.modelIdx < PROX_MAX_MODELS ? "true" : "false");
+            json += ",\"rssi\":" + String(n.lastRssi);
+            json += ",\"rssi_filtered\":" + String(n.rssi, 1);
+            json += ",\"distance_m\":" + String(n.distanceM, 2);
+            json += ",\"proximity\":\"" + String(Proximity::className((ProxClass)n.cls)) + "\"";
+            json += ",\"samples\":" + String(n.samples);
+            json += ",\"last_seen_ms\":" + String(now - n.lastMs);
+            json += ",\"tracked_s\":" + String((n.lastMs - n.firstMs) / 1000);
+            json += "}";
+        }
+        json += "]}";
+        response.emplace_back("json", json);
+    }
+
+    else {
+        response.emplace_back("error", "invalid path");
+    }
+
+    return response;
+}
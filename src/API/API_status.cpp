@@ -2,6 +2,19 @@
 #include <WiFi.h>
 #include <esp_bt_device.h>
 #include "API.h"
+#include "drive/storage.h"
+#include "drive/staging.h"
+#include "drive/storageio.h"
+#include "drive/flashwear.h"
+#include "wifi/time_get.h"
+#include "ble/timesync.h"
+#include "misc/boot.h"
+#include "ble/warmcache.h"
+#include "ble/ble.h"
+#include "ble/census.h"
+#include "diag/metrics.h"
+
+extern StorageManager storage;
 
 static String getUptime() {
     const unsigned long totalSeconds = millis() / 1000;
@@ -71,13 +84,67 @@ static String getBtMac() {
 }
 
 static String getStorage() {
-    return "";
+    if (!storage.isUsingSD() && !storage.isUsingLittleFS()) return "none";
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s %llu/%llu MB used", storage.isUsingSD() ? "SD" : "LittleFS",
+             (unsigned long long)(storage.usedBytes() >> 20), (unsigned long long)(storage.totalBytes() >> 20));
+    return String(buf);
+}
+
+static String getSdBus() {
+    const StorageCardInfo& c = storage.cardInfo();
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%u-bit %s %u kHz", c.busWidth, c.ddr ? "DDR" : "SDR", (unsigned)c.freqKhz);
+    return String(buf);
 }
 
 static String getMediaCount() {
     return "";
 }
 
+static String getWarmBoot() {
+    WarmStats w;
+    warm_stats(&w);
+    if (!w.warm) return "cold (reset reason " + String(w.resetReason) + ")";
+    String out = "#" + String(w.bootCount) + ": " + String(w.msgs) + " messages, " + String(w.seen) +
+                 " dedupe, " + String(w.inflight) + " in-flight (" + String(w.parcels) + " parcels)";
+    if (w.badSections) out += ", " + String(w.badSections) + " sections dropped";
+    return out;
+}
+
+// "ble 0+212ms, storage 212+830ms, ..." (start + duration); "pending" for stages still running
+static String getBootStages() {
+    String out;
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        BootStageInfo info;
+        boot_stage_info((BootStage)i, &info);
+        if (out.length()) out += ", ";
+        out += info.name;
+        if (!info.done) {
+            out += info.startMs ? " running" : " pending";
+            continue;
+        }
+        out += " " + String(info.startMs) + "+" + String(info.durationMs) + "ms";
+        if (!info.ok) out += " failed";
+    }
+    return out;
+}
+
+// Message bytes per byte of advertisement service data, over completed messages (RX and TX)
+static String getWireEfficiency(MetricId msgBytes, MetricId advBytes) {
+    uint32_t adv = metric_get(advBytes);
+    if (adv == 0) return "n/a";
+    return String(100.0f * metric_get(msgBytes) / adv, 1);
+}
+
+// Assembled messages over all that left the assembler (completed, expired or evicted)
+static String getAssemblerCompletion() {
+    uint32_t done = metric_get(M_BLE_MSG_DONE);
+    uint32_t lost = metric_get(M_BLE_INFLIGHT_EXPIRED) + metric_get(M_BLE_INFLIGHT_EVICTED);
+    if (done + lost == 0) return "n/a";
+    return String(100.0f * done / (done + lost), 1);
+}
+
 static String getMessageCount() {
     return "";
 }
@@ -92,6 +159,97 @@ std::vector<std::pair<String, String>> handleRequestStatus(const String& path, c
         response.emplace_back("storage", getStorage());
         response.emplace_back("media_count", getMediaCount());
         response.emplace_back("message_count", getMessageCount());
+
+        response.emplace_back("boot_to_listening_ms", String(metric_get(M_BOOT_LISTEN_MS)));
+        response.emplace_back("boot_complete_ms", String(boot_complete_ms()));
+        response.emplace_back("boot_stages", getBootStages());
+        response.emplace_back("warm_boot", getWarmBoot());
+        response.emplace_back("boot_to_web_ms", String(metric_get(M_BOOT_WEB_MS)));
+        response.emplace_back("boot_to_wifi_ip_ms", String(metric_get(M_BOOT_WIFI_MS)));
+        response.emplace_back("time_valid", timeValid() ? "true" : "false");
+        response.emplace_back("boot_to_time_valid_ms", String(metric_get(M_BOOT_TIME_VALID_MS)));
+
+        const TimeSyncStats& ts = timesync_stats();
+        response.emplace_back("time_source", timesync_source());
+        response.emplace_back("time_stratum", String(ts.stratum));
+        if (ts.lastSyncMono) {
+            char mac[18];
+            snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X", ts.sourceMac[0], ts.sourceMac[1],
+                     ts.sourceMac[2], ts.sourceMac[3], ts.sourceMac[4], ts.sourceMac[5]);
+            response.emplace_back("time_mesh_source", mac);
+            response.emplace_back("time_mesh_rssi", String(ts.sourceRssi));
+            response.emplace_back("time_mesh_age_s", String((millis() - ts.lastSyncMono) / 1000));
+            response.emplace_back("time_offset_ms", String(ts.lastOffsetMs));
+            response.emplace_back("time_latency_comp_ms", String(ts.lastLatencyMs));
+            response.emplace_back("time_sync_error_est_ms", String(ts.errorEstMs));
+            response.emplace_back("time_drift_ppm", String(ts.driftPpm, 1));
+        }
+        response.emplace_back("time_beacons_rx", String(ts.beaconsRx));
+        response.emplace_back("time_beacons_tx", String(ts.beaconsTx));
+
+        response.emplace_back("wire_format", ble_wire_format_binary() ? "binary" : "text");
+        response.emplace_back("wire_text_efficiency_pct", getWireEfficiency(M_WIRE_TEXT_MSG_BYTES, M_WIRE_TEXT_ADV_BYTES));
+        response.emplace_back("wire_binary_efficiency_pct", getWireEfficiency(M_WIRE_BIN_MSG_BYTES, M_WIRE_BIN_ADV_BYTES));
+        response.emplace_back("assembler_completion_pct", getAssemblerCompletion());
+        response.emplace_back("assembler_id_shared", String(metric_get(M_BLE_INFLIGHT_ID_SHARED)));
+
+        response.emplace_back("census", census_enabled() ? "on" : "off");
+        if (census_enabled()) {
+            CensusStats cs = census_stats();
+            response.emplace_back("census_devices_1m", String(census_estimate(CENSUS_1M)));
+            response.emplace_back("census_devices_15m", String(census_estimate(CENSUS_15M)));
+            response.emplace_back("census_devices_1h", String(census_estimate(CENSUS_1H)));
+            response.emplace_back("census_rotations_linked", String(cs.linked - cs.unlinked));
+        }
+
+        if (storage.isUsingSD()) {
+            const StorageCardInfo& card = storage.cardInfo();
+            response.emplace_back("sd_card", card.name);
+            response.emplace_back("sd_bus", getSdBus());
+            response.emplace_back("sd_profile", card.profile);
+            response.emplace_back("sd_profile_source", card.profilePersisted ? "remembered" : "probed");
+            response.emplace_back("sd_probe_fallbacks", String(card.fallbacks));
+            response.emplace_back("sd_seq_read_kbps", String(card.seqReadKBps));
+            response.emplace_back("sd_seq_write_kbps", String(card.seqWriteKBps));
+            response.emplace_back("sd_mount_ms", String(card.mountMs));
+        }
+
+        if (storage.isUsingLittleFS()) {
+            WearStats wear;
+            wear_stats(&wear);
+            response.emplace_back("flash_over_budget", wear.overBudget ? "true" : "false");
+            response.emplace_back("flash_written_today_kb", String(wear.todayTotal / 1024));
+            response.emplace_back("flash_budget_kb", String(wear.budgetTotal / 1024));
+            for (int i = 0; i < WEAR_SUBSYS_COUNT; i++) {
+                String key = "flash_today_";
+                key += wear_subsys_name((WearSubsystem)i);
+                key += "_kb";
+                response.emplace_back(key, String(wear.todayBytes[i] / 1024));
+            }
+            response.emplace_back("flash_rate_kb_per_day", String(wear.ratePerDay / 1024));
+            response.emplace_back("flash_lifetime_days", wear.lifetimeDays == UINT32_MAX ? String("unknown") : String(wear.lifetimeDays));
+        }
+
+        StagingStats st;
+        staging_stats(&st);
+        response.emplace_back("usb_host_owns_storage", storage.deviceOwnsVolume() ? "false" : "true");
+        response.emplace_back("staged_bytes", String(st.bytes));
+        response.emplace_back("staged_pending_bytes", String(st.pendingBytes));
+        response.emplace_back("staged_dropped", String(st.dropped));
+        response.emplace_back("replay_last_ms", String(st.lastReplayMs));
+        response.emplace_back("replay_last_bytes", String(st.lastReplayBytes));
+
+        StorIoStats io;
+        storio_stats(&io);
+        uint32_t queued = 0;
+        for (int c = 0; c < STORIO_CLASS_COUNT; c++) {
+            queued += io.queued[c];
+            String key = "storio_";
+            key += storio_class_name((StorIoClass)c);
+            key += "_p99_us";
+            response.emplace_back(key, String(io.p99Us[c]));
+        }
+        response.emplace_back("storio_queued", String(queued));
         response.emplace_back("status", "ok");
     } else {
         response.emplace_back("error", "invalid path");
@@ -0,0 +1,30 @@
+#include "API.h"
+#include "diag/trace.h"
+
+std::vector<std::pair<String, String>> handleRequestTrace(const String& path, const std::vector<std::pair<String, String>>& params) {
+    std::vector<std::pair<String, String>> response;
+
+    if (path == "/trace/status") {
+        response.emplace_back("enabled", trace_enabled() ? "1" : "0");
+        response.emplace_back("records", String(trace_count()));
+        response.emplace_back("capacity", String(trace_enabled() ? TRACE_RING_RECORDS : 0));
+        response.emplace_back("status", "ok");
+    }
+
+    else if (path == "/trace/clear") {
+        trace_clear();
+        response.emplace_back("status", "ok");
+    }
+
+    else if (path == "/trace/dump") {
+        // USB dump: hex-framed on the serial console (HTTP uses the binary /api/trace route)
+        trace_dump_hex(Serial);
+        response.emplace_back("status", "ok");
+    }
+
+    else {
+        response.emplace_back("error", "invalid path");
+    }
+
+    return response;
+}
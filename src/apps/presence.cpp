@@ -5,9 +5,22 @@
 
  #include <Arduino.h>
  #include <ArduinoJson.h>
+ #include <algorithm>
+ #include <atomic>
  #include <map>
  #include <memory>
+ #include <new>
+ #include <vector>
+ #include "presence.h"
  #include "drive/storage.h"
+ #include "drive/storageio.h"
+ #include "drive/flashwear.h"
+ #include "diag/metrics.h"
+ #include "wifi/time_get.h"
+ #include "diag/trace.h"
+ #include "diag/log.h"
+ #include "diag/heapprof.h"
+ #include "misc/boot.h"
  
  extern StorageManager storage;
  
@@ -21,15 +34,117 @@
  
  static std::map<String, PresenceRange> activeDevices;
  
+ // While a USB host owns the SD card the day files cannot be read, and a staged rewrite
+ // would clobber them; updates are parked here and applied once the card is back.
+ struct DeferredPresence {
+     String deviceId;
+     time_t timestamp;
+ };
+ 
+ static std::vector<DeferredPresence> deferredUpdates;
+ static const size_t maxDeferred = 256;
+ 
+ static void flushPendingDays();
+ 
+ static void onStorageOwnership(bool deviceOwns) {
+     if (!deviceOwns) return;
+     std::vector<DeferredPresence> pending;
+     pending.swap(deferredUpdates);
+     for (const auto& d : pending) updatePresence(d.deviceId, d.timestamp);
+     flushPendingDays();
+ }
+ 
  static String zeroPad(int v) {
      return (v < 10 ? "0" : "") + String(v);
  }
  
+ // One file per device and day: the day's 1440 minutes as '0'/'1' characters. Firmware before
+ // this kept a JSON object per month (day -> the same string), up to ~45 KB by the end of a
+ // month; those files are still read by countPresenceMinutes() but no longer written.
+ static String getDayFilePath(const String& deviceId, int year, int month, int day) {
+     return "/" + deviceId + "/presence/" + String(year) + "/" + zeroPad(month) + "/" + zeroPad(day) + ".txt";
+ }
+ 
  static String getMonthFilePath(const String& deviceId, int year, int month) {
      return "/" + deviceId + "/presence/" + String(year) + "/" + zeroPad(month) + ".json";
  }
  
+ // Minutes are collected per device and day on the loop task and written by one job on the
+ // storage service; sightings that arrive meanwhile wait for the next job, so the loop never
+ // waits for the card. On the SD card a job goes out as soon as the previous one is done. On
+ // internal flash (no SD card) they are written every presenceFlashBatchMs; while the flash
+ // write budget is exceeded the interval is stretched by presenceThrottleFactor.
+ struct PendingDay {
+     String deviceId;
+     int year, month, day;
+     std::vector<uint16_t> minutes;
+ };
+ 
+ static std::vector<PendingDay> pendingDays;
+ static std::atomic<bool> flushInFlight(false);
+ static uint32_t lastFlashFlush = 0;
+ static const uint32_t presenceFlashBatchMs = 5 * 60 * 1000;
+ static const uint32_t presenceThrottleFactor = 4;
+ static const size_t maxPendingDays = 64;
+ 
+ static bool writePresenceMinutes(const String& deviceId, int year, int month, int day, const uint16_t* minutes, size_t count);
+ 
+ // Storage task: `ctx` is the batch taken from pendingDays, freed in flushDone()
+ static StorIoStatus flushJob(void* ctx) {
+     bool ok = true;
+     for (const auto& p : *static_cast<std::vector<PendingDay>*>(ctx)) {
+         ok = writePresenceMinutes(p.deviceId, p.year, p.month, p.day, p.minutes.data(), p.minutes.size()) && ok;
+     }
+     return ok ? STORIO_DONE : STORIO_FAILED;
+ }
+ 
+ static void flushDone(void* ctx, bool ok) {
+     if (!ok) GLOGW(LOGM_PRESENCE, "Some presence minutes could not be written");
+     delete static_cast<std::vector<PendingDay>*>(ctx);
+     flushInFlight = false;
+ }
+ 
+ static void flushPendingDays() {
+     if (pendingDays.empty() || flushInFlight || !storage.deviceOwnsVolume()) return;
+     std::vector<PendingDay>* batch = new (std::nothrow) std::vector<PendingDay>();
+     if (!batch) return;
+     batch->swap(pendingDays);
+     lastFlashFlush = millis();
+     flushInFlight = true;
+     storio_submit(STORIO_PRESENCE, flushJob, batch, flushDone);
+ }
+ 
+ static uint32_t batchInterval() {
+     if (!storage.isUsingLittleFS()) return 0;
+     return presenceFlashBatchMs * (wear_throttle(WEAR_PRESENCE) ? presenceThrottleFactor : 1);
+ }
+ 
+ void presence_tick() {
+     // Batched minutes are written on time, not only on the next sighting: when the last
+     // neighbour leaves there may be no next one before a reset
+     if (!pendingDays.empty() && millis() - lastFlashFlush >= batchInterval()) flushPendingDays();
+ }
+ 
+ static void queuePresenceMinute(const String& deviceId, int year, int month, int day, int minuteOfDay) {
+     for (auto& p : pendingDays) {
+         if (p.deviceId == deviceId && p.year == year && p.month == month && p.day == day) {
+             for (uint16_t m : p.minutes) {
+                 if (m == minuteOfDay) return;
+             }
+             p.minutes.push_back((uint16_t)minuteOfDay);
+             metric_inc(M_WEAR_PRESENCE_BATCHED);
+             return;
+         }
+     }
+     pendingDays.push_back({deviceId, year, month, day, {(uint16_t)minuteOfDay}});
+ }
+ 
  void updatePresence(const String& deviceId, time_t timestamp) {
+     HEAPPROF_SCOPE("presence_update");
+     // Minute bitmaps are keyed by wall-clock date; without valid time they would land in 1970
+     if (!timeValid()) return;
+     // Sightings arrive from loop() while storage may still be mounting on its boot task
+     if (!boot_ok(BOOT_STORAGE)) return;
      struct tm* tmInfo = localtime(&timestamp);
      if (!tmInfo) return;
  
@@ -46,52 +161,81 @@
  
      state.lastSeen = timestamp;
  
-     String path = getMonthFilePath(deviceId, year, month);
-     fs::FS& fs = storage.getActiveFS();
- 
-     std::unique_ptr<StaticJsonDocument<32 * 1024>> doc(new StaticJsonDocument<32 * 1024>);
- 
-     if (fs.exists(path)) {
-         Serial.printf("[presence] Reading file %s\n", path.c_str());
-         File f = fs.open(path, "r");
-         DeserializationError err = deserializeJson(*doc, f);
-         f.close();
-         if (err) {
-             Serial.printf("[presence] Failed to parse JSON: %s\n", err.c_str());
-             return;
+     static bool listening = false;
+     if (!listening) {
+         storage.onOwnershipChange(onStorageOwnership);
+         listening = true;
+     }
+     if (!storage.deviceOwnsVolume()) {
+         for (const auto& d : deferredUpdates) {
+             if (d.deviceId == deviceId && d.timestamp / 60 == timestamp / 60) return;
+         }
+         if (deferredUpdates.size() < maxDeferred) {
+             deferredUpdates.push_back({deviceId, timestamp});
+         } else {
+             GLOGW(LOGM_PRESENCE, "Deferred presence queue full, dropping %s", deviceId.c_str());
          }
+         return;
      }
  
-     String dayStr = String(day);
-     String bitmap;
+     queuePresenceMinute(deviceId, year, month, day, minuteOfDay);
+     if (millis() - lastFlashFlush >= batchInterval() || pendingDays.size() >= maxPendingDays) flushPendingDays();
+ }
  
-     if ((*doc).containsKey(dayStr)) {
-         bitmap = (*doc)[dayStr].as<String>();
+ // Storage task: read-modify-write of one day file (1440 bytes)
+ static bool writePresenceMinutes(const String& deviceId, int year, int month, int day, const uint16_t* minutes, size_t count) {
+     String path = getDayFilePath(deviceId, year, month, day);
+     fs::FS& fs = storage.getActiveFS();
+ 
+     char bitmap[bitmapSize];
+     memset(bitmap, '0', bitmapSize);
+     bool exists = fs.exists(path);
+     if (exists) {
+         File f = fs.open(path, "r");
+         if (!f) {
+             GLOGE(LOGM_PRESENCE, "Failed to open %s", path.c_str());
+             return false;
+         }
+         f.read((uint8_t*)bitmap, bitmapSize);     // a short file leaves the rest at '0'
+         f.close();
      } else {
-         char buf[bitmapSize + 1];
-         memset(buf, '0', bitmapSize);
-         buf[bitmapSize] = '\0';
-         bitmap = String(buf);
+         String folder = "/" + deviceId + "/presence/" + String(year);
+         fs.mkdir("/" + deviceId);
+         fs.mkdir("/" + deviceId + "/presence");
+         fs.mkdir(folder);
+         fs.mkdir(folder + "/" + zeroPad(month));
      }
  
-     if (minuteOfDay >= 0 && minuteOfDay < bitmapSize) {
-         bitmap.setCharAt(minuteOfDay, '1');
+     bool changed = !exists;
+     for (size_t i = 0; i < count; i++) {
+         if (minutes[i] < bitmapSize && bitmap[minutes[i]] != '1') {
+             bitmap[minutes[i]] = '1';
+             changed = true;
+         }
      }
- 
-     (*doc)[dayStr] = bitmap;
- 
-     String folder = "/" + deviceId + "/presence/" + String(year);
-     fs.mkdir("/" + deviceId);
-     fs.mkdir("/" + deviceId + "/presence");
-     fs.mkdir(folder);
+     if (!changed) return true;
  
      File out = fs.open(path, "w");
-     if (serializeJson(*doc, out)) {
-         Serial.printf("[presence] Updated %s\n", path.c_str());
+     TRACE_BEGIN(TR_FLASH_WRITE, 0, 0);
+     size_t written = out ? out.write((const uint8_t*)bitmap, bitmapSize) : 0;
+     TRACE_END(TR_FLASH_WRITE, written, 0);
+     if (written == bitmapSize) {
+         wear_record_active(WEAR_PRESENCE, (uint32_t)written);
+         GLOGD(LOGM_PRESENCE, "Updated %s", path.c_str());
      } else {
-         Serial.printf("[presence] Failed to write to %s\n", path.c_str());
+         GLOGE(LOGM_PRESENCE, "Failed to write to %s", path.c_str());
+     }
+     if (out) out.close();
+     return written == bitmapSize;
+ }
+ 
+ // Minutes of one day from a month file written by earlier firmware, OR-ed into `bitmap`
+ static void mergeMonthFileDay(JsonDocument& month, int day, char* bitmap) {
+     const char* old = month[String(day)].as<const char*>();
+     if (!old) return;
+     for (int i = 0; i < bitmapSize && old[i]; ++i) {
+         if (old[i] == '1') bitmap[i] = '1';
      }
-     out.close();
  }
  
  int countPresenceMinutes(const String& deviceId, time_t start, time_t end) {
@@ -100,37 +244,56 @@
      int total = 0;
  
      fs::FS& fs = storage.getActiveFS();
+     char bitmap[bitmapSize];
  
      for (int y = tmStart.tm_year + 1900; y <= tmEnd.tm_year + 1900; ++y) {
          int mStart = (y == tmStart.tm_year + 1900) ? tmStart.tm_mon + 1 : 1;
          int mEnd = (y == tmEnd.tm_year + 1900) ? tmEnd.tm_mon + 1 : 12;
  
          for (int m = mStart; m <= mEnd; ++m) {
-             String path = getMonthFilePath(deviceId, y, m);
-             if (!fs.exists(path)) continue;
- 
-             File f = fs.open(path, "r");
-             std::unique_ptr<StaticJsonDocument<32 * 1024>> doc(new StaticJsonDocument<32 * 1024>);
-             DeserializationError err = deserializeJson(*doc, f);
-             f.close();
-             if (err) continue;
+             // A full month file holds 31 x 1441 characters: size the document from the file
+             std::unique_ptr<DynamicJsonDocument> month;
+             String monthPath = getMonthFilePath(deviceId, y, m);
+             if (fs.exists(monthPath)) {
+                 File f = fs.open(monthPath, "r");
+                 month.reset(new DynamicJsonDocument(f.size() + 1024));
+                 DeserializationError err = deserializeJson(*month, f);
+                 f.close();
+                 if (err) {
+                     GLOGE(LOGM_PRESENCE, "Failed to parse %s: %s", monthPath.c_str(), err.c_str());
+                     month.reset();
+                 }
+             }
  
-             for (JsonPair kv : doc->as<JsonObject>()) {
-                 int day = String(kv.key().c_str()).toInt();
+             for (int day = 1; day <= 31; ++day) {
                  struct tm dayTm = {};
                  dayTm.tm_year = y - 1900;
                  dayTm.tm_mon = m - 1;
                  dayTm.tm_mday = day;
-                 dayTm.tm_hour = 0;
-                 dayTm.tm_min = 0;
-                 dayTm.tm_sec = 0;
+                 dayTm.tm_isdst = -1;
                  time_t dayStart = mktime(&dayTm);
                  time_t dayEnd = dayStart + 86399;
- 
+                 if (dayTm.tm_mon != m - 1) break;          // past the end of the month
                  if (dayEnd < start || dayStart > end) continue;
  
-                 const char* bitmap = kv.value().as<const char*>();
-                 if (!bitmap) continue;
+                 memset(bitmap, '0', bitmapSize);
+                 if (month) mergeMonthFileDay(*month, day, bitmap);
+                 String dayPath = getDayFilePath(deviceId, y, m, day);
+                 if (fs.exists(dayPath)) {
+                     File f = fs.open(dayPath, "r");
+                     if (f) {
+                         char chunk[64];
+                         size_t off = 0, n;
+                         while (off < (size_t)bitmapSize &&
+                                (n = f.read((uint8_t*)chunk, std::min(sizeof(chunk), bitmapSize - off))) > 0) {
+                             for (size_t i = 0; i < n; ++i) {
+                                 if (chunk[i] == '1') bitmap[off + i] = '1';
+                             }
+                             off += n;
+                         }
+                         f.close();
+                     }
+                 }
  
                  for (int i = 0; i < bitmapSize; ++i) {
                      time_t t = dayStart + i * 60;
@@ -144,4 +307,3 @@
  
      return total;
  }
- 
\ No newline at end of file
@@ -4,12 +4,22 @@
 
 /**
  * @brief Update presence data for a given device ID at a specific timestamp.
+ *
+ * Does not wait for storage: the minute is queued and written to the device's day file by a
+ * job on the storage service.
  * 
  * @param deviceId Identifier of the remote BLE device.
  * @param timestamp The current timestamp in seconds since epoch.
  */
 void updatePresence(const String& deviceId, time_t timestamp);
 
+/**
+ * @brief Write presence minutes batched for internal flash once their interval is up.
+ *
+ * Call from loop(); cheap when nothing is pending.
+ */
+void presence_tick();
+
 /**
  * @brief Count the number of minutes a device was detected between two timestamps.
  * 
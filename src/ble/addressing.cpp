@@ -0,0 +1,66 @@
+#include "addressing.h"
+
+#include <string.h>
+
+static char s_callsign[ADDR_NAME_MAX];
+static char s_groups[ADDR_MAX_GROUPS][ADDR_NAME_MAX];
+static int  s_groupCount = 0;
+static bool s_relay = false;
+
+static inline char upper(char c) { return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c; }
+
+static bool sameName(const char* name, const char* s, size_t n) {
+    size_t i = 0;
+    for (; i < n; i++) {
+        if (!name[i] || upper(name[i]) != upper(s[i])) return false;
+    }
+    return name[i] == '\0';
+}
+
+static void copyName(char* dst, const char* src, size_t n) {
+    if (n > ADDR_NAME_MAX - 1) n = ADDR_NAME_MAX - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+void addr_set_callsign(const char* callsign) {
+    copyName(s_callsign, callsign ? callsign : "", callsign ? strlen(callsign) : 0);
+}
+
+int addr_set_groups(const char* csv) {
+    s_groupCount = 0;
+    const char* p = csv ? csv : "";
+    while (*p && s_groupCount < ADDR_MAX_GROUPS) {
+        const char* end = strchr(p, ',');
+        if (!end) end = p + strlen(p);
+        const char* a = p;
+        const char* b = end;
+        while (a < b && *a == ' ') a++;
+        while (b > a && b[-1] == ' ') b--;
+        if (b > a) copyName(s_groups[s_groupCount++], a, (size_t)(b - a));
+        p = *end ? end + 1 : end;
+    }
+    return s_groupCount;
+}
+
+void addr_set_relay(bool on) { s_relay = on; }
+bool addr_relay(void) { return s_relay; }
+
+AddrClass addr_classify(const char* dest, size_t len) {
+    if (len == 0 || sameName("ANY", dest, len) || sameName("ALL", dest, len) || sameName("*", dest, len))
+        return ADDR_BROADCAST;
+    if (s_callsign[0] && sameName(s_callsign, dest, len)) return ADDR_MINE;
+    for (int i = 0; i < s_groupCount; i++) {
+        if (sameName(s_groups[i], dest, len)) return ADDR_GROUP;
+    }
+    return ADDR_OTHER;
+}
+
+const char* addr_class_name(AddrClass c) {
+    switch (c) {
+        case ADDR_MINE: return "mine";
+        case ADDR_GROUP: return "group";
+        case ADDR_BROADCAST: return "broadcast";
+        default: return "other";
+    }
+}
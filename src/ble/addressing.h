@@ -0,0 +1,49 @@
+#pragma once
+/*
+  addressing.h — Who a message is for, decided from its header parcel.
+
+  Every multi-parcel message names a destination in its header ("AA0:FROM:DEST:CKSM", or the
+  "FROM:DEST" route of a binary header frame). Ingest classifies that destination once:
+
+    ADDR_MINE       this device's callsign
+    ADDR_GROUP      one of the subscribed groups ("ble_groups" config key, comma separated)
+    ADDR_BROADCAST  ANY, ALL, * or empty
+    ADDR_OTHER      anything else
+
+  MINE, GROUP and BROADCAST messages get full processing: assembled, shown, kept across warm
+  boots. OTHER messages are assembled only in relay mode ("ble_relay" = 1) and are then posted
+  with done.addr = ADDR_OTHER for whoever forwards them; otherwise their remaining parcels are
+  dropped as they arrive, before they take an assembler slot.
+
+  Comparisons ignore case. Configure before ble_start_listening(): the scan callback reads
+  these without locking.
+
+  Plain C++ without Arduino.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef ADDR_MAX_GROUPS
+#define ADDR_MAX_GROUPS 8
+#endif
+#define ADDR_NAME_MAX   16      // callsign / group buffer, NUL included
+
+enum AddrClass : uint8_t {
+    ADDR_OTHER = 0,
+    ADDR_MINE = 1,
+    ADDR_GROUP = 2,
+    ADDR_BROADCAST = 3,
+};
+
+void addr_set_callsign(const char* callsign);
+// "CLUB,EMERG"; blanks around names are ignored. Returns the groups kept (at most ADDR_MAX_GROUPS).
+int  addr_set_groups(const char* csv);
+void addr_set_relay(bool on);
+bool addr_relay(void);
+
+// Destination of `len` bytes (need not be NUL-terminated)
+AddrClass addr_classify(const char* dest, size_t len);
+// Whether a message for `c` should be assembled at all
+inline bool addr_wanted(AddrClass c) { return c != ADDR_OTHER || addr_relay(); }
+const char* addr_class_name(AddrClass c);
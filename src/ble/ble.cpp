@@ -1,10 +1,11 @@
-// ESP32 BLE (Kolban) — ADV '>' text listener + event bus + assembler + ADV-burst TX
+// ESP32 BLE (Kolban) — ADV '>' text + binary frame listener + event bus + assemblers + ADV-burst TX
 #include "ble.h"
 
 #include <Arduino.h>
 #include <string.h>
-#include <new>
 #include <stdarg.h>
+#include <new>
+#include <esp_heap_caps.h>
 
 #include <BLEDevice.h>
 #include <BLEUtils.h>
@@ -12,6 +13,15 @@
 #include <BLEScan.h>
 
 #include "bluetoothmessage.h"
+#include "warmcache.h"
+#include "wireformat.h"
+#include "addressing.h"
+#include "inflighttable.h"
+#include "census.h"
+#include "misc/utf8.h"
+#include "diag/metrics.h"
+#include "diag/trace.h"
+#include "diag/heapprof.h"
 
 // Weak legacy hook; guard before calling.
 extern "C" void messageCompleted(const BluetoothMessage& msg) __attribute__((weak));
@@ -37,6 +47,33 @@ static const uint16_t MSG_UUID_16 = 0xFFF0;
 #ifndef BLE_EVT_DELIVER_BUDGET
 #define BLE_EVT_DELIVER_BUDGET 12
 #endif
+#ifndef BLE_INFLIGHT_SLOTS
+#define BLE_INFLIGHT_SLOTS (26 * 26)   // one entry per id, as many as the id-indexed pool had (ble.h)
+#endif
+#ifndef BLE_INFLIGHT_RESERVE
+#define BLE_INFLIGHT_RESERVE 16        // messages assembled without the heap (~12 KB static)
+#endif
+#ifndef BLE_INFLIGHT_HEAP_FLOOR
+#define BLE_INFLIGHT_HEAP_FLOOR (64u * 1024u)
+#endif
+#ifndef BLE_INFLIGHT_BUSY_MS
+#define BLE_INFLIGHT_BUSY_MS 1000
+#endif
+#ifndef BLE_PARKED_PARCELS
+#define BLE_PARKED_PARCELS 16
+#endif
+#ifndef BLE_PARCEL_BURST_MS
+#define BLE_PARCEL_BURST_MS 100
+#endif
+#ifndef BLE_SKIP_SLOTS
+#define BLE_SKIP_SLOTS 16
+#endif
+#ifndef BLE_SKIP_TTL_MS
+#define BLE_SKIP_TTL_MS 30000
+#endif
+#ifndef BLE_LEGACY_PEER_MS
+#define BLE_LEGACY_PEER_MS (30UL * 60UL * 1000UL)
+#endif
 
 // ---------- Optional logger ----------
 static void (*g_logger)(const char* line) = nullptr;
@@ -50,53 +87,6 @@ static void logf(const char* fmt, ...) {
   g_logger(buf);
 }
 
-// ---------- UTF-8 validator (allows emojis) ----------
-static inline bool is_valid_utf8_line(const char* p, size_t n) {
-  const uint8_t* s = (const uint8_t*)p;
-  size_t i = 0;
-  while (i < n) {
-    uint8_t c = s[i];
-
-    // Disallow control chars (C0 + DEL) and NUL/CR/LF/TAB
-    if (c < 0x20 || c == 0x7F) return false;
-
-    // ASCII
-    if (c < 0x80) { ++i; continue; }
-
-    // 2-byte
-    if ((c & 0xE0) == 0xC0) {
-      if (i + 1 >= n) return false;
-      uint8_t c1 = s[i+1];
-      if ((c1 & 0xC0) != 0x80) return false;
-      uint32_t cp = ((c & 0x1F) << 6) | (c1 & 0x3F);
-      if (cp < 0x80) return false; // overlong
-      i += 2; continue;
-    }
-    // 3-byte
-    if ((c & 0xF0) == 0xE0) {
-      if (i + 2 >= n) return false;
-      uint8_t c1 = s[i+1], c2 = s[i+2];
-      if (((c1 | c2) & 0xC0) != 0x80) return false;
-      uint32_t cp = ((c & 0x0F) << 12) | ((c1 & 0x3F) << 6) | (c2 & 0x3F);
-      if (cp < 0x800) return false;                 // overlong
-      if (cp >= 0xD800 && cp <= 0xDFFF) return false; // surrogates
-      i += 3; continue;
-    }
-    // 4-byte
-    if ((c & 0xF8) == 0xF0) {
-      if (i + 3 >= n) return false;
-      uint8_t c1 = s[i+1], c2 = s[i+2], c3 = s[i+3];
-      if (((c1 | c2 | c3) & 0xC0) != 0x80) return false;
-      uint32_t cp = ((c & 0x07) << 18) | ((c1 & 0x3F) << 12) |
-                    ((c2 & 0x3F) << 6)  | (c3 & 0x3F);
-      if (cp < 0x10000 || cp > 0x10FFFF) return false; // overlong/out-of-range
-      i += 4; continue;
-    }
-    return false; // invalid leading byte
-  }
-  return true;
-}
-
 static inline bool is_parcel_like(const char* s, size_t n) {
   if (n < 4) return false;
   char c0 = s[0], c1 = s[1];
@@ -108,29 +98,72 @@ static inline bool is_parcel_like(const char* s, size_t n) {
 }
 
 // ---------- Dedupe (payload-only; ignore MAC) ----------
+// Payloads are kept as 32-bit FNV-1a hashes: no heap per entry, and the window fits the
+// warm-boot cache.
 static uint32_t g_dedupe_ms = DEDUP_WINDOW_MS;
-struct SeenEntry { String key; uint32_t ts; };
+struct SeenEntry { uint32_t hash; uint32_t ts; uint8_t used; };
 static SeenEntry g_seen[128];
 static uint8_t   g_seen_head = 0;
 
-static bool seen_recently_payload(const String& key, uint32_t now_ms) {
+static inline uint32_t payload_hash(const char* s, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; ++i) { h ^= (uint8_t)s[i]; h *= 16777619u; }
+  return h;
+}
+
+static void seen_insert(uint32_t hash, uint32_t ts) {
+  const uint8_t N = (uint8_t)(sizeof(g_seen)/sizeof(g_seen[0]));
+  g_seen[g_seen_head] = { hash, ts, 1 };
+  g_seen_head = (uint8_t)((g_seen_head + 1) & (N - 1));
+}
+
+static bool seen_recently_payload(uint32_t hash, uint32_t now_ms) {
   const uint8_t N = (uint8_t)(sizeof(g_seen)/sizeof(g_seen[0]));
   for (uint8_t i = 0; i < N; ++i) {
-    if (g_seen[i].key.length() == 0) continue;
-    if ((uint32_t)(now_ms - g_seen[i].ts) > g_dedupe_ms) { g_seen[i].key = ""; continue; }
-    if (g_seen[i].key == key) return true;
+    if (!g_seen[i].used) continue;
+    if ((uint32_t)(now_ms - g_seen[i].ts) > g_dedupe_ms) { g_seen[i].used = 0; continue; }
+    if (g_seen[i].hash == hash) { metric_inc(M_BLE_DEDUPE_HIT); return true; }
   }
-  g_seen[g_seen_head] = { key, now_ms };
-  g_seen_head = (uint8_t)((g_seen_head + 1) & (N - 1));
+  seen_insert(hash, now_ms);
+  warm_seen_add(hash);
+  metric_inc(M_BLE_DEDUPE_MISS);
   return false;
 }
 
 // ---------- In-flight assembler ----------
-struct Inflight {
-  BluetoothMessage bm;
-  uint32_t lastTouchMs = 0;
-};
-static Inflight g_inflight[26*26];
+// Entries hashed by (advertiser MAC, message id), so two senders that picked the same id do
+// not fold into one message. There are as many entries as ids; each points at its message:
+// one of a static reserve for everyday traffic, or a heap one when a crowd is on the air.
+typedef InflightTable<BluetoothMessage*, BLE_INFLIGHT_SLOTS> InflightPool;
+typedef InflightPool::Entry Inflight;
+static InflightPool g_inflight;
+
+static BluetoothMessage  g_msg_reserve[BLE_INFLIGHT_RESERVE];
+static BluetoothMessage* g_msg_spare[BLE_INFLIGHT_RESERVE];
+static int               g_msg_spare_n = -1;      // filled on first use
+
+// A cleared message; nullptr once the reserve is out and the heap is down to its floor
+static BluetoothMessage* msg_alloc() {
+  if (g_msg_spare_n < 0) {
+    for (int i = 0; i < BLE_INFLIGHT_RESERVE; ++i) g_msg_spare[i] = &g_msg_reserve[i];
+    g_msg_spare_n = BLE_INFLIGHT_RESERVE;
+  }
+  if (g_msg_spare_n > 0) return g_msg_spare[--g_msg_spare_n];
+  if (heap_caps_get_free_size(MALLOC_CAP_8BIT) < BLE_INFLIGHT_HEAP_FLOOR + sizeof(BluetoothMessage)) return nullptr;
+  BluetoothMessage* bm = new (std::nothrow) BluetoothMessage();
+  if (bm) metric_inc(M_BLE_INFLIGHT_HEAP);
+  return bm;
+}
+
+static void msg_free(BluetoothMessage* bm) {
+  if (!bm) return;
+  if (bm >= g_msg_reserve && bm < g_msg_reserve + BLE_INFLIGHT_RESERVE) {
+    bm->clear();
+    g_msg_spare[g_msg_spare_n++] = bm;
+  } else {
+    delete bm;
+  }
+}
 
 static inline int inflight_index_2(const char* id2) {
   char a = id2[0], b = id2[1];
@@ -138,21 +171,185 @@ static inline int inflight_index_2(const char* id2) {
   return (a-'A')*26 + (b-'A');
 }
 
+static inline int parcel_index(const char* s) {
+  // "AA<digits>:..." (caller checked is_parcel_like)
+  int v = 0;
+  for (const char* p = s + 2; *p >= '0' && *p <= '9'; ++p) v = v * 10 + (*p - '0');
+  return v;
+}
+
+// Table stats -> metrics; cheap enough to mirror on every parcel
+static void inflight_publish() {
+  const InflightPool::Stats& st = g_inflight.stats();
+  metric_set(M_BLE_INFLIGHT, (uint32_t)g_inflight.used());
+  metric_set(M_BLE_INFLIGHT_COLLISIONS, st.collisions);
+  metric_set(M_BLE_INFLIGHT_ID_SHARED, st.idShared);
+}
+
 static void inflight_reset(Inflight& slot) {
-  slot.bm.~BluetoothMessage();
-  new (&slot.bm) BluetoothMessage();
-  slot.lastTouchMs = 0;
+  if (!slot.used) return;
+  warm_parcel_clear(slot.key);
+  msg_free(slot.value);
+  slot.value = nullptr;
+  g_inflight.erase(&slot);
+  inflight_publish();
+}
+
+// Parcels turned away by a full pool, held until their message gets an entry. Dropped, a
+// header would be gone for good: its repeats in the same burst fall in the dedupe window.
+struct ParkedParcel { uint64_t key; uint32_t ts; uint8_t len; char text[ADV_TEXT_MAX]; };   // ts 0 = free
+static ParkedParcel g_parked[BLE_PARKED_PARCELS];
+static uint8_t      g_parked_head = 0;
+
+static void parcel_park(uint64_t key, const char* content, size_t clen, uint32_t now) {
+  if (clen > ADV_TEXT_MAX) return;
+  ParkedParcel &p = g_parked[g_parked_head];
+  g_parked_head = (uint8_t)((g_parked_head + 1) % BLE_PARKED_PARCELS);
+  p.key = key;
+  p.ts = now ? now : 1;
+  p.len = (uint8_t)clen;
+  memcpy(p.text, content, clen);
+  metric_inc(M_BLE_INFLIGHT_PARKED);
+}
+
+static void parcel_unpark(Inflight& slot, uint32_t now) {
+  for (auto &p : g_parked) {
+    if (p.ts == 0 || p.key != slot.key) continue;
+    if ((uint32_t)(now - p.ts) < INFLIGHT_TTL_MS) {
+      slot.value->addMessageParcel(p.text, p.len);
+      warm_parcel_add(slot.key, parcel_index(p.text), p.text, p.len);
+    }
+    p.ts = 0;
+  }
+}
+
+// Entry of message `key`: its own, else a new one with any parcels parked for it. When no
+// message is left to start one with, the entry quiet the longest gives up its own, unless
+// even that one is still receiving: then the newcomer waits (nullptr, park the parcel),
+// rather than every message in a crowd evicting another one and none completing.
+static Inflight* inflight_slot(uint64_t key, uint32_t now) {
+  if (Inflight* slot = g_inflight.find(key)) return slot;
+  BluetoothMessage* bm = g_inflight.full() ? nullptr : msg_alloc();
+  if (!bm) {
+    Inflight* oldest = g_inflight.oldest();
+    if (!oldest || (uint32_t)(now - oldest->touchMs) < BLE_INFLIGHT_BUSY_MS) {
+      metric_inc(M_BLE_INFLIGHT_FULL);
+      return nullptr;
+    }
+    metric_inc(M_BLE_INFLIGHT_EVICTED);
+    bm = oldest->value;
+    bm->clear();
+    oldest->value = nullptr;
+    inflight_reset(*oldest);
+  }
+  Inflight* slot = g_inflight.insert(key, now);
+  slot->value = bm;
+  parcel_unpark(*slot, now);
+  inflight_publish();
+  return slot;
+}
+
+// Binary frames (wireformat.h) have their own, smaller assembler
+static WireAssembler g_wire;
+static bool g_wire_binary = false;     // ble_send_message() format
+
+// Last message completed on the old byte-sum checksum (send_message_text)
+static volatile uint32_t g_legacy_peer_ms = 0;
+static volatile bool     g_legacy_peer_heard = false;
+
+// Payload efficiency per advertisement, per format: message bytes over ADV_TEXT_MAX per parcel
+static void wire_account(bool binary, size_t parcels, size_t msgLen) {
+  metric_inc(binary ? M_WIRE_BIN_ADV_BYTES : M_WIRE_TEXT_ADV_BYTES, (uint32_t)(parcels * ADV_TEXT_MAX));
+  metric_inc(binary ? M_WIRE_BIN_MSG_BYTES : M_WIRE_TEXT_MSG_BYTES, (uint32_t)msgLen);
 }
 
 static void inflight_sweep(uint32_t now) {
+  g_wire.sweep(now);
   for (auto &slot : g_inflight) {
-    if (slot.lastTouchMs == 0) continue;
-    if (!slot.bm.isMessageCompleted() && (uint32_t)(now - slot.lastTouchMs) >= INFLIGHT_TTL_MS) {
+    if (!slot.used) continue;
+    if (!slot.value->isMessageCompleted() && (uint32_t)(now - slot.touchMs) >= INFLIGHT_TTL_MS) {
+      metric_inc(M_BLE_INFLIGHT_EXPIRED);
       inflight_reset(slot);
     }
   }
 }
 
+// ---------- Destination filter (addressing.h) ----------
+// Messages whose header said "not for us": their later parcels are dropped on arrival.
+// Keys are the assembler's (MAC, id) keys; `wire` tells binary frame ids from text ids.
+struct SkipEntry { uint64_t key; uint32_t ts; bool wire; };   // ts 0 = free
+static SkipEntry g_skip[BLE_SKIP_SLOTS];
+static uint8_t   g_skip_head = 0;
+
+static SkipEntry* skip_find(uint64_t key, bool wire, uint32_t now) {
+  for (auto &e : g_skip) {
+    if (e.ts == 0) continue;
+    if ((uint32_t)(now - e.ts) > BLE_SKIP_TTL_MS) { e.ts = 0; continue; }
+    if (e.key == key && e.wire == wire) return &e;
+  }
+  return nullptr;
+}
+
+// True (and the entry kept alive) while `key` is being skipped
+static bool skip_has(uint64_t key, bool wire, uint32_t now) {
+  SkipEntry* e = skip_find(key, wire, now);
+  if (e) e->ts = now ? now : 1;
+  return e != nullptr;
+}
+
+static void ingest_skipped(size_t parcels, size_t bytes) {
+  metric_inc(M_BLE_SKIP_PARCELS, (uint32_t)parcels);
+  metric_inc(M_BLE_SKIP_BYTES, (uint32_t)bytes);
+}
+
+// A header names `dest`: true when the message is wanted here, else `key` is skipped from now on
+static bool ingest_header_wanted(uint64_t key, bool wire, const char* dest, size_t destLen, uint32_t now) {
+  SkipEntry* e = skip_find(key, wire, now);
+  if (addr_wanted(addr_classify(dest, destLen))) {
+    if (e) e->ts = 0;
+    return true;
+  }
+  if (!e) {
+    e = &g_skip[g_skip_head];
+    g_skip_head = (uint8_t)((g_skip_head + 1) % BLE_SKIP_SLOTS);
+  }
+  *e = { key, now ? now : 1, wire };
+  metric_inc(M_BLE_SKIP_MSG);
+  return false;
+}
+
+// "AA0:FROM:DEST:CKSM" -> DEST
+static bool header_dest(const char* s, size_t n, const char** dest, size_t* destLen) {
+  const char* end = s + n;
+  const char* p1 = (const char*)memchr(s, ':', n);
+  const char* p2 = p1 ? (const char*)memchr(p1 + 1, ':', (size_t)(end - p1 - 1)) : nullptr;
+  const char* p3 = p2 ? (const char*)memchr(p2 + 1, ':', (size_t)(end - p2 - 1)) : nullptr;
+  if (!p3) return false;
+  *dest = p2 + 1;
+  *destLen = (size_t)(p3 - p2 - 1);
+  return true;
+}
+
+// Text parcels: false when the parcel belongs to a message that is not wanted here
+static bool text_parcel_admit(uint64_t key, const char* content, size_t clen, uint32_t now) {
+  const char* dest;
+  size_t destLen;
+  if (parcel_index(content) != 0 || !header_dest(content, clen, &dest, &destLen)) {
+    if (!skip_has(key, false, now)) return true;
+    ingest_skipped(1, clen);
+    return false;
+  }
+  if (ingest_header_wanted(key, false, dest, destLen, now)) return true;
+  // Data parcels that overtook the header are let go
+  size_t held = 0;
+  if (Inflight* slot = g_inflight.find(key)) {
+    held = slot->value->getReceivedBytes();
+    inflight_reset(*slot);
+  }
+  ingest_skipped(1, held);
+  return false;
+}
+
 // ---------- Event bus ----------
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
@@ -170,17 +367,22 @@ static inline bool q_empty(){ return g_evt_head == g_evt_tail; }
 
 static void q_push(const BleEvent* e) {
   portENTER_CRITICAL(&g_evt_mux);
-  if (q_full()) { g_evt_tail = Q_NEXT(g_evt_tail); ++g_evt_dropped; }
+  if (q_full()) { g_evt_tail = Q_NEXT(g_evt_tail); ++g_evt_dropped; metric_inc(M_BLE_EVT_DROPPED); }
   g_evt_q[g_evt_head] = *e;
   g_evt_head = Q_NEXT(g_evt_head);
+  uint16_t depth = (uint16_t)((g_evt_head + BLE_EVT_QUEUE_DEPTH - g_evt_tail) % BLE_EVT_QUEUE_DEPTH);
   portEXIT_CRITICAL(&g_evt_mux);
+  metric_set(M_BLE_QUEUE_DEPTH, depth);
+  TRACE_INSTANT(TR_EVT_QUEUED, e->type, depth);
 }
 
 static bool q_pop(BleEvent* out) {
   bool ok = false;
   portENTER_CRITICAL(&g_evt_mux);
   if (!q_empty()) { *out = g_evt_q[g_evt_tail]; g_evt_tail = Q_NEXT(g_evt_tail); ok = true; }
+  uint16_t depth = (uint16_t)((g_evt_head + BLE_EVT_QUEUE_DEPTH - g_evt_tail) % BLE_EVT_QUEUE_DEPTH);
   portEXIT_CRITICAL(&g_evt_mux);
+  if (ok) metric_set(M_BLE_QUEUE_DEPTH, depth);
   return ok;
 }
 
@@ -219,16 +421,98 @@ void ble_tick(void) {
   }
 }
 
+// ---------- Device census (see census.h) ----------
+static void census_rx(BLEAdvertisedDevice& d) {
+  if (!census_enabled()) return;
+  uint8_t mac[6];
+  mac_to_bytes(d.getAddress(), mac);
+  census_observe(mac, d.getAddressType() != BLE_ADDR_TYPE_PUBLIC, d.getPayload(), d.getPayloadLength());
+}
+
+// ---------- Binary frames ----------
+static void wire_rx(const std::string& sd, BLEAdvertisedDevice& d) {
+  metric_inc(M_BLE_ADV_WIRE);
+  MetricTimer timer(H_BLE_ONRESULT_US);
+  TRACE_INSTANT(TR_ADV_RX, sd.size(), (int8_t)d.getRSSI());
+
+  WireFrame f;
+  if (!wire_parse((const uint8_t*)sd.data(), sd.size(), &f)) {
+    metric_inc(M_BLE_ADV_REJECTED);
+    return;
+  }
+  uint32_t now = millis();
+  if (seen_recently_payload(payload_hash(sd.data(), sd.size()), now)) {
+    TRACE_INSTANT(TR_DEDUPE_HIT, sd.size(), 1);
+    return;
+  }
+
+  uint8_t mac[6];
+  mac_to_bytes(d.getAddress(), mac);
+  uint64_t key = InflightPool::makeKey(mac, f.id);
+  uint64_t peer = key >> 16;
+
+  // Destination filter: the header decides, later frames of a skipped message stop here
+  char from[WIRE_ID_MAX], to[WIRE_ID_MAX];
+  if (wire_header_route(f, from, to)) {
+    if (!ingest_header_wanted(key, true, to, strlen(to), now)) {
+      ingest_skipped(1, g_wire.drop(peer, f.id));
+      return;
+    }
+  } else if (skip_has(key, true, now)) {
+    ingest_skipped(1, f.payloadLen);
+    return;
+  }
+  metric_inc(M_BLE_PARCELS);
+
+  WireMessage m;
+  uint32_t crcFail = g_wire.crcFailures();
+  bool done = g_wire.add(f, peer, now, &m);
+  if (g_wire.crcFailures() != crcFail) metric_inc(M_WIRE_CRC_FAIL);
+  if (done && utf8_valid_line(m.text, m.len)) {
+    AddrClass addr = addr_classify(m.to, strlen(m.to));
+    metric_inc(M_BLE_MSG_DONE);
+    if (addr == ADDR_OTHER) metric_inc(M_BLE_MSG_OTHER);
+    TRACE_INSTANT(TR_MSG_DONE, m.id, m.len);
+    wire_account(true, f.count, m.len);
+    logf("[%s] %s", m.from, m.text);
+
+    BleEvent ev = {};
+    ev.type = BLE_EVT_MESSAGE_DONE;
+    // Same shapes as the text format: two letters for the id, the CRC-16 as 4 hex digits
+    ev.data.done.id[0] = (char)('A' + m.id % 26);
+    ev.data.done.id[1] = (char)('A' + (m.id / 26) % 26);
+    snprintf(ev.data.done.from, sizeof(ev.data.done.from), "%s", m.from);
+    snprintf(ev.data.done.to, sizeof(ev.data.done.to), "%s", m.to);
+    snprintf(ev.data.done.checksum, sizeof(ev.data.done.checksum), "%04X", m.crc);
+    ev.data.done.addr = addr;
+    ev.data.done.msg_len = (uint32_t)m.len;
+    size_t sN = (m.len < (BLE_EVT_MAX_TEXT - 1)) ? m.len : (BLE_EVT_MAX_TEXT - 1);
+    memcpy(ev.data.done.snippet, m.text, sN);
+    ev.data.done.snippet[sN] = '\0';
+    q_push(&ev);
+  } else if (done) {
+    metric_inc(M_BLE_ADV_REJECTED);
+  }
+  inflight_sweep(now);
+}
+
 // ---------- Scan / listen ----------
 static BLEScan* g_scan = nullptr;
 static bool     g_scanActive = false;
 
 class AdvCb final : public BLEAdvertisedDeviceCallbacks {
   void onResult(BLEAdvertisedDevice d) override {
-    if (!d.haveServiceData()) return;
+    metric_inc(M_BLE_ADV_SEEN);
+    if (!d.haveServiceData()) { census_rx(d); return; }
 
     std::string sd = d.getServiceData();
-    if (sd.empty() || sd[0] != '>') return;
+    if (!sd.empty() && (uint8_t)sd[0] == WIRE_VERSION_1) { wire_rx(sd, d); return; }
+    if (sd.empty() || sd[0] != '>') { census_rx(d); return; }
+
+    metric_inc(M_BLE_ADV_TEXT);
+    MetricTimer timer(H_BLE_ONRESULT_US);
+    HEAPPROF_SCOPE("ble_onResult");
+    TRACE_INSTANT(TR_ADV_RX, sd.size(), (int8_t)d.getRSSI());
 
     const char* bytes = sd.data();
     size_t total = sd.size();
@@ -238,22 +522,33 @@ class AdvCb final : public BLEAdvertisedDeviceCallbacks {
     size_t      clen    = total - 1;
 
     // ✅ Allow emojis: accept only valid UTF-8, reject control bytes and malformed sequences
-    if (!is_valid_utf8_line(content, clen)) return;
-    if ((int)clen < MIN_SINGLE_LEN) return;
+    if (!utf8_valid_line(content, clen) || (int)clen < MIN_SINGLE_LEN) {
+      metric_inc(M_BLE_ADV_REJECTED);
+      return;
+    }
 
     uint32_t now = millis();
 
     // Dedup by payload only (ignore MAC)
     String payload = String(sd.c_str()); // includes leading '>'
-    if (seen_recently_payload(payload, now)) return;
+    if (seen_recently_payload(payload_hash(bytes, total), now)) {
+      TRACE_INSTANT(TR_DEDUPE_HIT, clen, 0);
+      return;
+    }
+
+    uint8_t mac[6];
+    mac_to_bytes(d.getAddress(), mac);
+
+    // Parcels of messages addressed elsewhere stop here (no event, no assembler slot)
+    int idx = is_parcel_like(content, clen) ? inflight_index_2(content) : -1;
+    uint64_t key = idx >= 0 ? InflightPool::makeKey(mac, (uint16_t)idx) : 0;
+    if (idx >= 0 && !text_parcel_admit(key, content, clen, now)) return;
 
-    // Console echo: single-line '>' text seen (may include emoji UTF-8)
-    Serial.print("[ADV-TEXT] ");
-    Serial.print(payload);
-    Serial.print("  rssi=");
-    Serial.print(d.getRSSI());
-    Serial.print("  from=");
-    Serial.println(d.getAddress().toString().c_str());
+    // Console echo via the app logger (deferred; never blocks the scan callback)
+    if (g_logger) {
+      logf("[ADV-TEXT] %s  rssi=%d  from=%s", payload.c_str(), d.getRSSI(),
+           d.getAddress().toString().c_str());
+    }
 
     // Post SINGLE_TEXT event
     BleEvent ev = {};
@@ -263,50 +558,59 @@ class AdvCb final : public BLEAdvertisedDeviceCallbacks {
     ev.data.single.text[copyN] = '\0';
     ev.data.single.text_len = (uint16_t)copyN;
     ev.data.single.rssi = (int8_t)d.getRSSI();
-    mac_to_bytes(d.getAddress(), ev.data.single.mac);
+    memcpy(ev.data.single.mac, mac, 6);
+    ev.data.single.rx_ms = now;
     q_push(&ev);
 
     // If looks like parcel, feed assembler
-    if (is_parcel_like(content, clen)) {
-      int idx = inflight_index_2(content);
-      if (idx >= 0) {
-        Inflight &slot = g_inflight[idx];
-        String body = String(content);  // "AA<digits>:..."
-        slot.bm.addMessageParcel(body);
-        slot.lastTouchMs = now;
-        if (slot.bm.isMessageCompleted()) {
-          BleEvent ev2 = {};
-          ev2.type = BLE_EVT_MESSAGE_DONE;
-
-          ev2.data.done.id[0] = content[0];
-          ev2.data.done.id[1] = content[1];
-          ev2.data.done.id[2] = '\0';
-
-          String from = slot.bm.getIdFromSender();
-          String to   = slot.bm.getIdDestination();
-          String ck   = slot.bm.getChecksum();
-          String msg  = slot.bm.getMessage();
-
-          // Print the completed message (may include emoji)
-          Serial.print('['); Serial.print(from); Serial.print("] "); Serial.println(msg);
-
-          strncpy(ev2.data.done.from, from.c_str(), sizeof(ev2.data.done.from)-1);
-          ev2.data.done.from[sizeof(ev2.data.done.from)-1] = '\0';
-          strncpy(ev2.data.done.to, to.c_str(), sizeof(ev2.data.done.to)-1);
-          ev2.data.done.to[sizeof(ev2.data.done.to)-1] = '\0';
-          strncpy(ev2.data.done.checksum, ck.c_str(), sizeof(ev2.data.done.checksum)-1);
-          ev2.data.done.checksum[sizeof(ev2.data.done.checksum)-1] = '\0';
-
-          ev2.data.done.msg_len = (uint32_t)msg.length();
-          size_t sN = (msg.length() < (BLE_EVT_MAX_TEXT - 1)) ? msg.length() : (BLE_EVT_MAX_TEXT - 1);
-          memcpy(ev2.data.done.snippet, msg.c_str(), sN);
-          ev2.data.done.snippet[sN] = '\0';
-
-          q_push(&ev2);
-
-          if (messageCompleted) messageCompleted(slot.bm);
-          inflight_reset(slot);
+    Inflight* entry = idx >= 0 ? inflight_slot(key, now) : nullptr;
+    if (idx >= 0 && !entry) parcel_park(key, content, clen, now);
+    if (entry) {
+      Inflight &slot = *entry;
+      BluetoothMessage &bm = *slot.value;
+      bm.addMessageParcel(content, clen);  // "AA<digits>:..."
+      warm_parcel_add(key, parcel_index(content), content, clen);
+      metric_inc(M_BLE_PARCELS);
+      TRACE_INSTANT(TR_PARCEL_STORED, idx, clen);
+      slot.touchMs = now;
+      if (bm.isMessageCompleted()) {
+        const char* to = bm.getIdDestination();
+        AddrClass addr = addr_classify(to, strlen(to));
+        metric_inc(M_BLE_MSG_DONE);
+        if (addr == ADDR_OTHER) metric_inc(M_BLE_MSG_OTHER);
+        const char* msg = bm.getMessage();
+        size_t msgLen = bm.getMessageLength();
+        TRACE_INSTANT(TR_MSG_DONE, idx, msgLen);
+        wire_account(false, bm.getMessageParcelsTotal(), msgLen);
+        if (bm.isLegacyChecksum()) {
+          metric_inc(M_BLE_MSG_LEGACY_CKSUM);
+          g_legacy_peer_ms = now;
+          g_legacy_peer_heard = true;
         }
+        BleEvent ev2 = {};
+        ev2.type = BLE_EVT_MESSAGE_DONE;
+
+        ev2.data.done.id[0] = content[0];
+        ev2.data.done.id[1] = content[1];
+        ev2.data.done.id[2] = '\0';
+
+        // Echo the completed message (may include emoji)
+        logf("[%s] %s", bm.getIdFromSender(), msg);
+
+        snprintf(ev2.data.done.from, sizeof(ev2.data.done.from), "%s", bm.getIdFromSender());
+        snprintf(ev2.data.done.to, sizeof(ev2.data.done.to), "%s", bm.getIdDestination());
+        snprintf(ev2.data.done.checksum, sizeof(ev2.data.done.checksum), "%s", bm.getChecksum());
+
+        ev2.data.done.addr = addr;
+        ev2.data.done.msg_len = (uint32_t)msgLen;
+        size_t sN = (msgLen < (BLE_EVT_MAX_TEXT - 1)) ? msgLen : (BLE_EVT_MAX_TEXT - 1);
+        memcpy(ev2.data.done.snippet, msg, sN);
+        ev2.data.done.snippet[sN] = '\0';
+
+        q_push(&ev2);
+
+        if (messageCompleted && addr != ADDR_OTHER) messageCompleted(bm);
+        inflight_reset(slot);
       }
     }
 
@@ -314,7 +618,31 @@ class AdvCb final : public BLEAdvertisedDeviceCallbacks {
   }
 };
 
+// Warm boot: pick up the dedupe window and partly received messages from before the reset
+static void warm_seen_cb(uint32_t hash, uint32_t ageMs) {
+  if (ageMs <= g_dedupe_ms) seen_insert(hash, millis() - ageMs);
+}
+
+static void warm_parcel_cb(uint64_t key, const char* parcel, uint32_t ageMs) {
+  if (InflightPool::keyId(key) >= 26 * 26 || ageMs >= INFLIGHT_TTL_MS) {
+    warm_parcel_clear(key);
+    return;
+  }
+  uint32_t touch = millis() - ageMs;
+  Inflight* slot = inflight_slot(key, touch);
+  if (!slot) {
+    warm_parcel_clear(key);
+    return;
+  }
+  slot->value->addMessageParcel(parcel);
+  slot->touchMs = touch;
+  // Completed right before the reset: its event was posted then
+  if (slot->value->isMessageCompleted()) inflight_reset(*slot);
+}
+
 void ble_init(const char* devName) {
+  warm_seen_replay(warm_seen_cb);
+  warm_parcel_replay(warm_parcel_cb);
   BLEDevice::init(devName && *devName ? devName : "ESP32");
 }
 
@@ -344,14 +672,10 @@ void ble_stop_listening() {
 
 bool ble_is_listening() { return g_scanActive; }
 
-// ---------- ADV text burst TX ----------
-static void adv_send_text_burst(const String& text, uint32_t duration_ms) {
+// ---------- ADV burst TX ----------
+static void adv_send_burst(const std::string& payload, uint32_t duration_ms) {
   BLEAdvertising* adv = BLEDevice::getAdvertising();
 
-  std::string payload = text.c_str();
-  if (payload.empty() || payload[0] != '>') payload.insert(payload.begin(), '>');
-  if (payload.size() > ADV_TEXT_MAX) payload.resize(ADV_TEXT_MAX);
-
   BLEAdvertisementData advData;
   advData.setFlags(0x06);
   BLEAdvertisementData scanResp;
@@ -367,6 +691,13 @@ static void adv_send_text_burst(const String& text, uint32_t duration_ms) {
   adv->stop();
 }
 
+static void adv_send_text_burst(const String& text, uint32_t duration_ms) {
+  std::string payload = text.c_str();
+  if (payload.empty() || payload[0] != '>') payload.insert(payload.begin(), '>');
+  if (payload.size() > ADV_TEXT_MAX) payload.resize(ADV_TEXT_MAX);
+  adv_send_burst(payload, duration_ms);
+}
+
 int ble_send_text(const uint8_t* data, size_t len, bool pauseDuringSend) {
   if (!data || len == 0) return 0;
 
@@ -376,12 +707,80 @@ int ble_send_text(const uint8_t* data, size_t len, bool pauseDuringSend) {
   String txt; txt.reserve(len + 1); txt += '>';
   for (size_t i = 0; i < len; ++i) txt += (char)data[i];
 
+  TRACE_BEGIN(TR_TX, len, 0);
   adv_send_text_burst(txt, 100);
+  TRACE_END(TR_TX, len, 0);
+  metric_inc(M_BLE_TX);
 
   if (resume) ble_start_listening(true);
   return (int)len;
 }
 
+// Text format: ">AA0:FROM:DEST:CKSM", then ">AA<n>:" + as much text as fits ADV_TEXT_MAX.
+// CKSM is CRC32C (lowercase) unless a byte-sum sender was heard lately: it could not
+// complete our messages, so we talk its dialect until it has been quiet for a while.
+static int send_message_text(const char* from, const char* to, const char* text, size_t len) {
+  BluetoothMessage bm(from, to, text, false);   // id and checksum only (no heap)
+  if (!bm.isLegacyChecksum() && g_legacy_peer_heard &&
+      (uint32_t)(millis() - g_legacy_peer_ms) < BLE_LEGACY_PEER_MS) {
+    bm.setLegacyChecksum(true);
+  }
+  String id = bm.getId();
+  String header = ">" + id + "0:" + from + ":" + to + ":" + bm.getChecksum();
+  if (header.length() > ADV_TEXT_MAX) return 0;
+  adv_send_text_burst(header, BLE_PARCEL_BURST_MS);
+
+  int parcels = 1;
+  for (size_t pos = 0; pos < len; ++parcels) {
+    String prefix = ">" + id + String(parcels) + ":";
+    size_t chunk = ADV_TEXT_MAX - prefix.length();
+    if (chunk >= len - pos) {
+      chunk = len - pos;
+    } else {
+      while (chunk > 0 && ((uint8_t)text[pos + chunk] & 0xC0) == 0x80) --chunk;   // keep UTF-8 whole
+    }
+    std::string parcel = prefix.c_str();
+    parcel.append(text + pos, chunk);
+    adv_send_burst(parcel, BLE_PARCEL_BURST_MS);
+    pos += chunk;
+  }
+  return parcels;
+}
+
+static int send_message_binary(const char* from, const char* to, const char* text, size_t len) {
+  uint8_t frames[WIRE_MAX_PARCELS][WIRE_FRAME_MAX];
+  uint8_t lens[WIRE_MAX_PARCELS];
+  int n = wire_encode_message((uint16_t)esp_random(), from, to, text, len, frames, lens, WIRE_MAX_PARCELS);
+  for (int i = 0; i < n; ++i) {
+    adv_send_burst(std::string((const char*)frames[i], lens[i]), BLE_PARCEL_BURST_MS);
+  }
+  return n;
+}
+
+int ble_send_message(const char* from, const char* to, const char* text) {
+  if (!from || !to || !text || !*text) return 0;
+  size_t len = strlen(text);
+  if (!utf8_valid_line(text, len)) return 0;    // receivers would drop it anyway
+
+  bool resume = false;
+  if (ble_is_listening()) { ble_stop_listening(); resume = true; }
+
+  TRACE_BEGIN(TR_TX, len, 1);
+  int parcels = g_wire_binary ? send_message_binary(from, to, text, len)
+                              : send_message_text(from, to, text, len);
+  TRACE_END(TR_TX, len, 1);
+  if (parcels > 0) {
+    metric_inc(M_BLE_TX, parcels);
+    wire_account(g_wire_binary, parcels, len);
+  }
+
+  if (resume) ble_start_listening(true);
+  return parcels;
+}
+
+void ble_set_wire_format(bool binary) { g_wire_binary = binary; }
+bool ble_wire_format_binary(void) { return g_wire_binary; }
+
 // ---------- Tools ----------
 void ble_set_dedup_window(uint32_t ms) { g_dedupe_ms = ms ? ms : 1; }
 void ble_inflight_purge_now() { inflight_sweep(millis() + INFLIGHT_TTL_MS + 1); }
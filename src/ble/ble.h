@@ -6,6 +6,11 @@
   - Continuously scans for BLE advertisements and extracts Service Data payloads that start with '>'.
   - Single-line text (after '>') is validated (printable ASCII, min length) and de-duplicated in a sliding window.
   - Multi-parcel messages (format "AA<digits>:...") are assembled via BluetoothMessage and posted as MESSAGE_DONE.
+  - Binary frames (first byte 0xB1, see wireformat.h) are assembled too and posted as the same MESSAGE_DONE.
+  - The header parcel's destination decides what is assembled (addressing.h): messages for this
+    callsign, a subscribed group or broadcast always; others only in relay mode, otherwise
+    their parcels are dropped on arrival. done.addr tells subscribers which case it was.
+  - Every other advertisement is dropped, after feeding the device census (census.h) when it is on.
   - Provides a tiny event bus so *any* module (e.g., LVGL UI) can subscribe and react on the main loop.
   - Optional TX: send short “ADV text bursts” in Service Data (UUID 0xFFF0) for simple device-to-device text.
 
@@ -23,7 +28,7 @@
         static void on_ble_event(const BleEvent* e, void* ctx) {
           switch (e->type) {
             case BLE_EVT_SINGLE_TEXT:
-              // e->single.text (NUL-terminated), e->single.text_len, e->single.rssi, e->single.mac[6]
+              // e->single.text (NUL-terminated), e->single.text_len, e->single.rssi, e->single.mac[6], e->single.rx_ms
               // update UI here...
               break;
             case BLE_EVT_MESSAGE_DONE:
@@ -49,11 +54,28 @@
         const char* msg = ">HELLO_WORLD";
         ble_send_text((const uint8_t*)msg, strlen(msg), true);  // true = pause scan during TX
 
+  SENDING A MESSAGE
+        ble_set_wire_format(false);                 // '>' text parcels (default); true = binary frames
+        ble_send_message("X1ABCD", "ANY", "Meet at the north gate at 18h");
+    Binary frames are opt-in: peers that only know '>' ignore them. Every device receives both.
+
   TUNABLES (compile-time; see ble.cpp for defaults)
     - DEDUP_WINDOW_MS (default 2000)
     - MIN_SINGLE_LEN (default 5)
     - INFLIGHT_TTL_MS (default 10 minutes)
+    - BLE_INFLIGHT_SLOTS (default 676; messages assembled at once, keyed by sender MAC + id:
+      as many as the id-indexed pool had. ~24 B per entry; see tools/assembler_sim.cpp)
+    - BLE_INFLIGHT_RESERVE (default 16; messages kept in static memory, ~780 B each. Past
+      those, each message takes one heap block of the same size)
+    - BLE_INFLIGHT_HEAP_FLOOR (default 64 KB; free heap left alone by the assembler)
+    - BLE_INFLIGHT_BUSY_MS (default 1000; out of messages, only one quiet this long is evicted)
+    - BLE_PARKED_PARCELS (default 16; parcels turned away meanwhile, replayed to their message)
     - ADV_TEXT_MAX (default 24)
+    - BLE_PARCEL_BURST_MS (default 100)
+    - BLE_SKIP_SLOTS (default 16; messages remembered as "not addressed here")
+    - BLE_SKIP_TTL_MS (default 30000; since the last parcel of such a message)
+    - BLE_LEGACY_PEER_MS (default 30 minutes; '>' messages are sent with the old byte-sum
+      checksum this long after one was received, so pre-CRC32C peers can still read them)
     - BLE_EVT_QUEUE_DEPTH (default 32)
     - BLE_EVT_MAX_TEXT (default 192)
     - BLE_EVT_DELIVER_BUDGET (default 12)
@@ -65,8 +87,9 @@
     - ble_set_logger(fn)     // optional logger hook; if set, library may emit short diagnostics
 
   NOTE
-  - This module only inspects Service Data (UUID 0xFFF0 by default) that starts with '>'.
-    It matches what ble_send_text() emits and avoids parsing random manufacturer data.
+  - This module only inspects Service Data (UUID 0xFFF0 by default) that starts with '>' or the
+    binary frame version byte. It matches what ble_send_text()/ble_send_message() emit and
+    avoids parsing random manufacturer data.
 
   Copyright:
   - MIT-like: copy/paste freely into your projects.
@@ -98,6 +121,7 @@ typedef struct {
   uint16_t text_len;               // length not including the trailing NUL
   int8_t   rssi;
   uint8_t  mac[6];                 // advertiser address (bytes)
+  uint32_t rx_ms;                  // millis() in the scan callback (delivery is later)
 } BleEvtSingleText;
 
 typedef struct {
@@ -105,6 +129,7 @@ typedef struct {
   char     from[8];                // truncated sender ID + NUL
   char     to[8];                  // truncated destination ID + NUL
   char     checksum[5];            // truncated checksum + NUL
+  uint8_t  addr;                   // AddrClass of `to` (addressing.h): 0 = addressed elsewhere
   uint32_t msg_len;                // full message length
   char     snippet[BLE_EVT_MAX_TEXT]; // truncated preview; NUL-terminated
 } BleEvtMessageDone;
@@ -128,6 +153,12 @@ bool ble_is_listening();
 
 int  ble_send_text(const uint8_t* data, size_t len, bool pauseDuringSend);
 
+// Multi-parcel message in the format chosen by ble_set_wire_format(); pauses the scan while
+// sending. Returns the advertisements sent, 0 on failure.
+int  ble_send_message(const char* from, const char* to, const char* text);
+void ble_set_wire_format(bool binary);
+bool ble_wire_format_binary(void);
+
 // Event bus
 int  ble_subscribe(BleEventCb cb, void* user_ctx); // returns token >=1 on success, 0 on failure
 void ble_unsubscribe(int token);
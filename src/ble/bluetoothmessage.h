@@ -1,101 +1,337 @@
 #pragma once
 // bluetoothmessage.h
-// Compact C++ port of your BluetoothMessage (Arduino/ESP32 friendly)
+// Multi-parcel '>' message: sender-side id + checksum, receiver-side reassembly (Arduino/ESP32 + host)
+//
+// BasicBluetoothMessage<MaxParcels, ParcelLen> keeps everything inline, in fixed-size arrays:
+// the two-letter id, the callsigns, the checksum and one contiguous text buffer of
+// MaxParcels * ParcelLen bytes. Data parcel i is stored at (i - 1) * ParcelLen; as soon as
+// parcels 1..i are all present, parcel i is moved down to the end of the text assembled so far
+// and folded into the checksum. The buffer therefore ends up holding the message itself, and
+// reassembly never touches the heap: an instance is a plain value that can live in a static
+// pool and be reused with clear().
+//
+// BluetoothMessage is the instance ble.cpp uses (BT_MSG_MAX_PARCELS x TEXT_LENGTH_PER_PARCEL).
 
 #ifdef ARDUINO
   #include <Arduino.h>
-#else
-  #include <string>
-  // Minimal Arduino String substitute for host/unit tests (optional).
-  // In firmware builds you already have <Arduino.h>.
-  #define String std::string
-  #define millis() 0
 #endif
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include <map>
-#include <vector>
-#include <algorithm>
+#include "msgdigest.h"
 
 // Max text chars per parcel (data chunk). Adjust at build time with -DTEXT_LENGTH_PER_PARCEL=...
 #ifndef TEXT_LENGTH_PER_PARCEL
 #define TEXT_LENGTH_PER_PARCEL 20
 #endif
 
+// Data parcels per message (header excluded); longer messages are not assembled
+#ifndef BT_MSG_MAX_PARCELS
+#define BT_MSG_MAX_PARCELS 32
+#endif
+
+// The header checksum declares its algorithm by case: CRC32C letters (msgdigest.h) are sent
+// lowercase, the old byte sum uppercase. A receiver checks only the declared one, so a message
+// whose parcels were swapped cannot pass on a byte-sum coincidence. Firmware from before
+// CRC32C only knows the uppercase sum and cannot complete lowercase messages; ble.cpp
+// therefore falls back to the byte sum for a while after hearing a byte-sum sender
+// (BLE_LEGACY_PEER_MS). MSG_CHECKSUM_LEGACY_TX=1, or the "ble_crc" config key set to 0, pins
+// the byte sum for fleets that are known to be mixed.
+#ifndef MSG_CHECKSUM_LEGACY_TX
+#define MSG_CHECKSUM_LEGACY_TX 0
+#endif
+
+inline bool& msg_crc_tx() {             // true: this device sends CRC32C letters
+  static bool crc = !MSG_CHECKSUM_LEGACY_TX;
+  return crc;
+}
+inline void msg_set_crc_tx(bool crc32c) { msg_crc_tx() = crc32c; }
+
 // Optional logging macro (leave empty to silence)
 #ifndef BTM_LOGI
   #define BTM_LOGI(...) do{}while(0)
 #endif
 
-// std::map comparator for Arduino String (lexicographic)
-struct StringLess {
-  bool operator()(const String& a, const String& b) const {
-  #ifdef ARDUINO
-    return a.compareTo(b) < 0;
-  #else
-    return a < b;
-  #endif
-  }
-};
+template <int MaxParcels, int ParcelLen>
+class BasicBluetoothMessage {
+  static_assert(MaxParcels >= 1 && MaxParcels <= 255, "parcel index is one byte");
+  static_assert(ParcelLen >= 1 && ParcelLen <= 255, "parcel length is one byte");
 
-class BluetoothMessage {
 public:
+  static constexpr int    kMaxParcels  = MaxParcels;       // data parcels, header excluded
+  static constexpr int    kParcelLen   = ParcelLen;        // text bytes per data parcel
+  static constexpr size_t kTextMax     = (size_t)MaxParcels * ParcelLen;
+  static constexpr int    kIdLen       = 2;                // "AA".."ZZ"
+  static constexpr int    kCallsignMax = 15;               // longer sender/destination IDs are cut
+  static constexpr int    kChecksumLen = MSG_DIGEST_LETTERS;
+
   // Constructors
-  BluetoothMessage();
-  BluetoothMessage(const String& idFromSender,
-                   const String& idDestination,
-                   const String& messageToSend,
-                   bool singleMessage);
+  BasicBluetoothMessage() { clear(); }
+  // Sender side: random id, checksum over all of `text` (the text itself is kept up to kTextMax)
+  BasicBluetoothMessage(const char* idFromSender, const char* idDestination,
+                        const char* messageToSend, bool singleMessage);
+
+  void clear();
+  // Sender side: switch the header checksum to the old byte sum (true) or CRC32C (false)
+  void setLegacyChecksum(bool legacy);
 
   // Accessors
-  String   getChecksum()      const { return checksum; }
-  String   getId()            const { return id; }
-  String   getIdDestination() const { return idDestination; }
-  String   getIdFromSender()  const { return idFromSender; }
-  String   getMessage()       const { return message; }
-  bool     isMessageCompleted() const { return messageCompleted; }
-  uint64_t getTimeStamp()     const { return timeStamp; }
-  String   getAuthor()        const { return idFromSender; }
-
-  void setMessageCompleted(bool v)     { messageCompleted = v; }
-  void setId(const String& v)          { id = v; }
-  void setIdFromSender(const String& v){ idFromSender = v; }
-  void setIdDestination(const String& v){ idDestination = v; }
-  void setMessage(const String& v)     { message = v; }
-  void setChecksum(const String& v)    { checksum = v; }
+  const char* getChecksum()      const { return _checksum; }
+  const char* getId()            const { return _id; }
+  const char* getIdDestination() const { return _to; }
+  const char* getIdFromSender()  const { return _from; }
+  const char* getAuthor()        const { return _from; }
+  const char* getMessage()       const { return _completed ? _text : ""; }  // NUL-terminated once complete
+  size_t   getMessageLength()    const { return _completed ? _textLen : 0; }
+  bool     isMessageCompleted()  const { return _completed; }
+  uint64_t getTimeStamp()        const { return _timeStamp; }
+  uint32_t getDigest()           const { return _digest.value(); }  // CRC32C of the text (once complete)
+  void     getChecksumHex(char out[MSG_DIGEST_HEX + 1]) const { msg_digest_hex(_digest.value(), out); }
+  bool     isLegacyChecksum()    const { return _legacyChecksum; }   // declared (and checked) the old byte sum
+#ifdef ARDUINO
+  String   getChecksumHex()      const { char h[MSG_DIGEST_HEX + 1]; getChecksumHex(h); return String(h); }
+#endif
 
   // Parcels
-  int getMessageParcelsTotal() const { return (int)messageBox.size(); }
-  std::vector<String> getMessageParcels() const; // values in key order
-  const std::map<String,String,StringLess>& getMessageBox() const { return messageBox; }
-  String getOutput() const; // human-friendly dump
-
-  // Feeding / reassembly
-  void addMessageParcel(const String& messageParcel);
-
-  // Missing-IDs helpers (request/retry logic)
-  String getFirstMissingParcel() const;
-  std::vector<String> getMissingParcels() const;
+  int  getMessageParcelsTotal() const { return (_checksum[0] ? 1 : 0) + _received; }  // header included
+  bool hasParcel(int index) const;
+  int  getFirstMissingParcel() const;      // index to ask for again, -1 when none is known missing
+  size_t getReceivedBytes() const;         // text bytes held so far, folded or still waiting
 
-  // Utility (sender side) – populate header + data parcels from full text
-  // (normally called by the ctor when singleMessage==false).
-  void splitDataIntoParcels();
+  // Feeding / reassembly: "AA<n>:text", "AA0:FROM:DEST:CKSM", or a single command without ':'.
+  // Returns false when the parcel was not stored (duplicate, malformed, past the limits).
+  bool addMessageParcel(const char* parcel, size_t len);
+  bool addMessageParcel(const char* parcel) { return parcel && addMessageParcel(parcel, strlen(parcel)); }
+#ifdef ARDUINO
+  bool addMessageParcel(const String& parcel) { return addMessageParcel(parcel.c_str(), parcel.length()); }
+#endif
 
 private:
-  // State
-  bool   messageCompleted = false;
-  String id;               // 2 letters (A–Z)
-  String idFromSender;     // origin
-  String idDestination;    // destination
-  String message;          // full text when completed (or original for sender)
-  String checksum;         // 4 letters A–Z
-  std::map<String,String,StringLess> messageBox; // parcelId -> full parcel payload
-  const uint64_t timeStamp; // local creation time (ms)
-
-  // Helpers
+  bool     _completed;
+  bool     _legacyChecksum;
+  char     _id[kIdLen + 1];
+  char     _from[kCallsignMax + 1];
+  char     _to[kCallsignMax + 1];
+  char     _checksum[kChecksumLen + 1];   // empty until the header arrived
+  uint8_t  _have[(MaxParcels + 8) / 8];   // bit i: data parcel i received
+  uint8_t  _len[MaxParcels];              // text bytes of data parcel i + 1
+  uint8_t  _received;                     // data parcels received
+  uint8_t  _folded;                       // data parcels 1.._folded moved into the text
+  size_t   _textLen;                      // bytes of text assembled so far
+  uint32_t _legacySum;
+  MsgDigest _digest;
+  uint64_t _timeStamp;                    // local creation time (ms)
+  char     _text[kTextMax + 1];           // assembled text, then pending parcels in their slots
+
+  void foldParcels();
+  void tryComplete();
+  static void copyField(char* dst, size_t cap, const char* src, size_t n);
+  static void checksumLetters(uint32_t v, char out[kChecksumLen + 1]) { msg_digest_letters(v, out); }
+  static void crcLetters(uint32_t v, char out[kChecksumLen + 1]) {
+    msg_digest_letters(v, out);
+    for (int i = 0; i < kChecksumLen; ++i) out[i] = (char)(out[i] - 'A' + 'a');
+  }
   static uint64_t currentMillis64();
-  static bool     isSingleCommand(const String& s);
-  static void     splitByColon(const String& src, std::vector<String>& out, int maxParts);
-  String          idPrefix() const;
-  String          calculateChecksum(const String& data) const;
-  static String   generateRandomId();
+  static char randomLetter();
+};
+
+// ---------- implementation ----------
+
+template <int M, int P>
+uint64_t BasicBluetoothMessage<M, P>::currentMillis64() {
+#ifdef ARDUINO
+  return (uint64_t)millis();
+#else
+  return 0;
+#endif
+}
+
+template <int M, int P>
+char BasicBluetoothMessage<M, P>::randomLetter() {
+#ifdef ARDUINO
+  return char('A' + (int)random(0, 26));
+#else
+  return char('A' + rand() % 26);
+#endif
+}
+
+template <int M, int P>
+void BasicBluetoothMessage<M, P>::clear() {
+  _completed = false;
+  _legacyChecksum = false;
+  _id[0] = _from[0] = _to[0] = _checksum[0] = '\0';
+  memset(_have, 0, sizeof(_have));
+  _received = 0;
+  _folded = 0;
+  _textLen = 0;
+  _legacySum = 0;
+  _digest.reset();
+  _timeStamp = currentMillis64();
+  _text[0] = '\0';
+}
+
+template <int M, int P>
+BasicBluetoothMessage<M, P>::BasicBluetoothMessage(const char* idFromSender, const char* idDestination,
+                                                   const char* messageToSend, bool singleMessage) {
+  clear();
+  _id[0] = randomLetter();
+  _id[1] = randomLetter();
+  _id[2] = '\0';
+  copyField(_from, sizeof(_from), idFromSender, idFromSender ? strlen(idFromSender) : 0);
+  copyField(_to, sizeof(_to), idDestination, idDestination ? strlen(idDestination) : 0);
+
+  size_t len = messageToSend ? strlen(messageToSend) : 0;
+  _digest.update(messageToSend ? messageToSend : "", len);
+  for (size_t i = 0; i < len; ++i) _legacySum += (unsigned char)messageToSend[i];
+  setLegacyChecksum(!msg_crc_tx());
+  _received = singleMessage ? 0 : (uint8_t)((len + P - 1) / P < (size_t)M ? (len + P - 1) / P : M);
+
+  _textLen = len < kTextMax ? len : kTextMax;
+  if (len) memcpy(_text, messageToSend, _textLen);
+  _text[_textLen] = '\0';
+  _completed = true;
+}
+
+template <int M, int P>
+void BasicBluetoothMessage<M, P>::setLegacyChecksum(bool legacy) {
+  // Both start at 0 for an empty text: "AAAA" / "aaaa"
+  if (legacy) checksumLetters(_legacySum, _checksum);
+  else crcLetters(_digest.value(), _checksum);
+  _legacyChecksum = legacy;
+}
+
+template <int M, int P>
+void BasicBluetoothMessage<M, P>::copyField(char* dst, size_t cap, const char* src, size_t n) {
+  if (n > cap - 1) n = cap - 1;
+  if (n) memcpy(dst, src, n);
+  dst[n] = '\0';
+}
+
+template <int M, int P>
+bool BasicBluetoothMessage<M, P>::hasParcel(int index) const {
+  if (index == 0) return _checksum[0] != '\0';
+  if (index < 1 || index > M) return false;
+  return (_have[index / 8] >> (index % 8)) & 1;
+}
+
+template <int M, int P>
+int BasicBluetoothMessage<M, P>::getFirstMissingParcel() const {
+  if (_completed) return -1;
+  if (!_checksum[0]) return 0;
+  // Past the last one received nothing is known to be missing, except parcel 1 of an empty box
+  int last = 0;
+  for (int i = 1; i <= M; ++i) if (hasParcel(i)) last = i;
+  for (int i = 1; i < last; ++i) if (!hasParcel(i)) return i;
+  return last == 0 ? 1 : -1;
+}
+
+template <int M, int P>
+size_t BasicBluetoothMessage<M, P>::getReceivedBytes() const {
+  size_t n = _textLen;
+  if (_completed) return n;
+  for (int i = _folded + 1; i <= M; ++i) if (hasParcel(i)) n += _len[i - 1];
+  return n;
+}
+
+template <int M, int P>
+bool BasicBluetoothMessage<M, P>::addMessageParcel(const char* parcel, size_t len) {
+  if (_completed || !parcel || len == 0) return false;
+
+  const char* colon = (const char*)memchr(parcel, ':', len);
+  if (!colon) {
+    // single command (no ':')
+    if (len > kTextMax) return false;
+    memcpy(_text, parcel, len);
+    _text[len] = '\0';
+    _textLen = len;
+    _digest.update(parcel, len);
+    _completed = true;
+    return true;
+  }
+
+  // "AA<digits>:"
+  size_t head = (size_t)(colon - parcel);
+  if (head < 3 || parcel[0] < 'A' || parcel[0] > 'Z' || parcel[1] < 'A' || parcel[1] > 'Z') {
+    BTM_LOGI("Invalid parcel ID: %.*s", (int)head, parcel);
+    return false;
+  }
+  int index = 0;
+  for (size_t i = 2; i < head; ++i) {
+    if (parcel[i] < '0' || parcel[i] > '9') return false;
+    index = index * 10 + (parcel[i] - '0');
+    if (index > M) return false;
+  }
+  if (!_id[0]) {
+    _id[0] = parcel[0];
+    _id[1] = parcel[1];
+    _id[2] = '\0';
+  } else if (_id[0] != parcel[0] || _id[1] != parcel[1]) {
+    return false;
+  }
+
+  const char* body = colon + 1;
+  size_t bodyLen = len - head - 1;
+  if (index == 0) {
+    // "<id>0:<from>:<dest>:<checksum>"
+    if (_checksum[0]) return false;
+    const char* p2 = (const char*)memchr(body, ':', bodyLen);
+    if (!p2) return false;
+    const char* end = body + bodyLen;
+    const char* p3 = (const char*)memchr(p2 + 1, ':', (size_t)(end - p2 - 1));
+    if (!p3 || end - (p3 + 1) != kChecksumLen) return false;
+    copyField(_from, sizeof(_from), body, (size_t)(p2 - body));
+    copyField(_to, sizeof(_to), p2 + 1, (size_t)(p3 - p2 - 1));
+    copyField(_checksum, sizeof(_checksum), p3 + 1, kChecksumLen);
+  } else {
+    if (hasParcel(index) || bodyLen > (size_t)P) return false;
+    memcpy(_text + (size_t)(index - 1) * P, body, bodyLen);
+    _len[index - 1] = (uint8_t)bodyLen;
+    _have[index / 8] |= (uint8_t)(1u << (index % 8));
+    ++_received;
+    foldParcels();
+  }
+  tryComplete();
+  return true;
+}
+
+template <int M, int P>
+void BasicBluetoothMessage<M, P>::foldParcels() {
+  // Parcel i sits at (i - 1) * P >= _textLen, and later parcels start past i * P: moving it
+  // down never touches a parcel that is still pending
+  while (_folded < M && hasParcel(_folded + 1)) {
+    size_t n = _len[_folded];
+    char* dst = _text + _textLen;
+    memmove(dst, _text + (size_t)_folded * P, n);
+    _digest.update(dst, n);
+    for (size_t i = 0; i < n; ++i) _legacySum += (unsigned char)dst[i];
+    _textLen += n;
+    ++_folded;
+  }
+}
+
+template <int M, int P>
+void BasicBluetoothMessage<M, P>::tryComplete() {
+  if (!_checksum[0] || _folded == 0) return;      // wait for header + one data
+  if (_folded != _received) return;               // parcels past a gap are waiting
+
+  // The text has no parcel count: the message is complete once the declared checksum matches
+  char cs[kChecksumLen + 1];
+  bool legacy = !(_checksum[0] >= 'a' && _checksum[0] <= 'z');   // uppercase: old byte sum
+  if (legacy) checksumLetters(_legacySum, cs);
+  else crcLetters(_digest.value(), cs);
+  if (memcmp(cs, _checksum, kChecksumLen) != 0) return;
+  _legacyChecksum = legacy;
+  _text[_textLen] = '\0';
+  _completed = true;
+}
+
+extern template class BasicBluetoothMessage<BT_MSG_MAX_PARCELS, TEXT_LENGTH_PER_PARCEL>;
+
+// The original name. A class rather than a typedef so that `struct BluetoothMessage`
+// forward declarations (the weak messageCompleted() hook in ble.h) keep compiling.
+class BluetoothMessage : public BasicBluetoothMessage<BT_MSG_MAX_PARCELS, TEXT_LENGTH_PER_PARCEL> {
+public:
+  using BasicBluetoothMessage<BT_MSG_MAX_PARCELS, TEXT_LENGTH_PER_PARCEL>::BasicBluetoothMessage;
 };
@@ -0,0 +1,290 @@
+#include "census.h"
+
+#include <string.h>
+#include <math.h>
+
+#define TICK_MS     (CENSUS_TICK_S * 1000UL)
+#define STAMPS      255                 // stamp values 1..255; 0 = never set
+
+static_assert(3600 / CENSUS_TICK_S < STAMPS, "the 1 h window must fit the stamp range");
+
+// Moremur-style finaliser: every input bit reaches every output bit
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 27;
+    x *= 0x3C79AC492BA7B653ull;
+    x ^= x >> 33;
+    x *= 0x1C69B3F74AC4AE35ull;
+    x ^= x >> 27;
+    return x;
+}
+
+static inline uint32_t fnv(uint32_t h, uint8_t b) { return (h ^ b) * 16777619u; }
+
+Census::Census(uint64_t salt) {
+    memset(_stamp, 0, sizeof(_stamp));
+    memset(&_st, 0, sizeof(_st));
+    _tick = 0;
+    _salt = salt;
+}
+
+uint32_t Census::windowTicks(CensusWindow w) {
+    switch (w) {
+        case CENSUS_1M: return 60 / CENSUS_TICK_S;
+        case CENSUS_15M: return 15 * 60 / CENSUS_TICK_S;
+        default: return 3600 / CENSUS_TICK_S;
+    }
+}
+
+const char* Census::windowName(CensusWindow w) {
+    switch (w) {
+        case CENSUS_1M: return "1m";
+        case CENSUS_15M: return "15m";
+        default: return "1h";
+    }
+}
+
+bool Census::isRotating(bool randomAddr, const uint8_t mac[6]) {
+    return randomAddr && (mac[0] & 0xC0) != 0xC0;
+}
+
+uint32_t Census::fingerprint(const uint8_t* p, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i = 0;
+    while (i + 1 < len) {
+        uint8_t n = p[i];
+        if (n == 0 || i + 1 + n > len) break;
+        uint8_t type = p[i + 1];
+        const uint8_t* data = p + i + 2;
+        size_t dlen = n - 1;
+        h = fnv(h, type);
+        switch (type) {
+            case 0x01:                          // flags
+            case 0x02: case 0x03:               // 16-bit service UUIDs
+            case 0x04: case 0x05:               // 32-bit
+            case 0x06: case 0x07:               // 128-bit
+            case 0x08: case 0x09:               // name
+            case 0x0A:                          // TX power
+            case 0x19:                          // appearance
+                h = fnv(h, (uint8_t)dlen);
+                for (size_t k = 0; k < dlen; k++) h = fnv(h, data[k]);
+                break;
+            case 0x16:                          // service data: its UUID, not the (changing) data
+            case 0xFF:                          // manufacturer data: the company id
+                for (size_t k = 0; k < dlen && k < 2; k++) h = fnv(h, data[k]);
+                break;
+            default:
+                break;
+        }
+        i += 1 + n;
+    }
+    return h;
+}
+
+void Census::advance(uint32_t nowMs) {
+    uint32_t tick = nowMs / TICK_MS;
+    uint32_t gap = tick - _tick;
+    if (!gap) return;
+    // Ages against the previous tick are exact (all within the 1 h horizon), so the stamps
+    // can be re-based after any gap
+    uint32_t horizon = windowTicks(CENSUS_1H);
+    uint8_t cur = (uint8_t)(1 + _tick % STAMPS);
+    for (int j = 0; j < kRegisters; j++) {
+        for (int r = 0; r < CENSUS_RANKS; r++) {
+            uint8_t s = _stamp[j][r];
+            if (!s) continue;
+            uint32_t age = (uint32_t)((cur + STAMPS - s) % STAMPS);
+            if (age + gap >= horizon) _stamp[j][r] = 0;
+        }
+    }
+    _tick = tick;
+}
+
+void Census::add(uint32_t identity) {
+    uint32_t j = identity >> (32 - CENSUS_P);
+    uint32_t w = identity << CENSUS_P;
+    int rank = w ? __builtin_clz(w) + 1 : 32 - CENSUS_P + 1;
+    if (rank > CENSUS_RANKS) rank = CENSUS_RANKS;
+    _stamp[j][rank - 1] = (uint8_t)(1 + _tick % STAMPS);
+}
+
+void Census::resolve(Aliases::Entry* e) {
+    // The predecessor went silent by the time this address appeared, and not long before
+    Alias& a = e->value;
+    Aliases::Entry* from = nullptr;
+    for (auto& c : _aliases) {
+        if (!c.used || &c == e || c.value.state == ALIAS_PENDING || c.value.heir || c.value.fp != a.fp) continue;
+        int32_t before = (int32_t)(a.firstMs - c.touchMs);
+        if (before < 0 || (uint32_t)before > CENSUS_LINK_WINDOW_MS) continue;
+        if (!from || (int32_t)(c.touchMs - from->touchMs) > 0) from = &c;
+    }
+    if (from) {
+        a.identity = from->value.identity;
+        a.state = ALIAS_LINKED;
+        from->value.heir = e->key;
+        _st.linked++;
+    } else {
+        a.state = ALIAS_OWN;
+    }
+    add(a.identity);
+}
+
+bool Census::aliasIdentity(uint64_t addrKey, uint32_t fp, uint32_t nowMs, uint32_t* identity) {
+    Aliases::Entry* e = _aliases.find(addrKey);
+    if (!e) {
+        // First sight: decided once it has settled, when its predecessor has had time to fall silent
+        if (_aliases.full()) {
+            // More private addresses around than remembered: an unsettled one is counted as
+            // itself rather than lost
+            Aliases::Entry* o = _aliases.oldest();
+            if (o->value.state == ALIAS_PENDING) add(o->value.identity);
+            _aliases.erase(o);
+            _st.aliasFull++;
+        }
+        e = _aliases.insert(addrKey, nowMs);
+        e->value.identity = *identity;
+        e->value.fp = fp;
+        e->value.heir = 0;
+        e->value.firstMs = nowMs;
+        e->value.state = ALIAS_PENDING;
+        return false;
+    }
+    Alias& a = e->value;
+    e->touchMs = nowMs;
+    if (a.heir) {
+        // This address handed its identity on but is still talking: two devices after all
+        Aliases::Entry* h = _aliases.find(a.heir);
+        if (h && h->value.state == ALIAS_LINKED && h->value.identity == a.identity) {
+            h->value.identity = (uint32_t)(a.heir >> 32);
+            h->value.state = ALIAS_OWN;
+            add(h->value.identity);
+            _st.unlinked++;
+        }
+        a.heir = 0;
+    }
+    if (a.state == ALIAS_PENDING) {
+        if (nowMs - a.firstMs < CENSUS_LINK_SETTLE_MS) return false;
+        resolve(e);
+    }
+    *identity = a.identity;
+    return true;
+}
+
+void Census::observe(const uint8_t mac[6], bool rotating, uint32_t fingerprint, uint32_t nowMs) {
+    advance(nowMs);
+    uint64_t a = 0;
+    for (int i = 0; i < 6; i++) a = (a << 8) | mac[i];
+    uint64_t addrKey = mix64(a ^ _salt);
+    uint32_t identity = (uint32_t)(addrKey >> 32);
+    _st.adverts++;
+    if (rotating) {
+        _st.rotating++;
+        if (!aliasIdentity(addrKey, fingerprint, nowMs, &identity)) return;
+    }
+    add(identity);
+}
+
+uint32_t Census::estimate(CensusWindow w, uint32_t nowMs) {
+    advance(nowMs);
+    uint32_t ticks = windowTicks(w);
+    uint8_t cur = (uint8_t)(1 + _tick % STAMPS);
+    double sum = 0;
+    int zeros = 0;
+    for (int j = 0; j < kRegisters; j++) {
+        int rank = 0;
+        for (int r = CENSUS_RANKS - 1; r >= 0; r--) {
+            uint8_t s = _stamp[j][r];
+            if (s && (uint32_t)((cur + STAMPS - s) % STAMPS) < ticks) {
+                rank = r + 1;
+                break;
+            }
+        }
+        sum += ldexp(1.0, -rank);
+        zeros += rank == 0;
+    }
+    double m = kRegisters;
+    double e = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros) e = m * log(m / zeros);     // linear counting for small crowds
+    return (uint32_t)(e + 0.5);
+}
+
+void Census::expire(uint32_t nowMs) {
+    advance(nowMs);
+    for (auto& e : _aliases) {
+        if (!e.used) continue;
+        if (e.value.state == ALIAS_PENDING && nowMs - e.value.firstMs >= CENSUS_LINK_SETTLE_MS) resolve(&e);
+        if (nowMs - e.touchMs >= CENSUS_ALIAS_TTL_MS) _aliases.erase(&e);
+    }
+}
+
+#ifdef ARDUINO
+// ---------- Device glue ----------
+#include <Arduino.h>
+#include <esp_random.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+static Census* g_census = nullptr;              // allocated only when enabled
+// A mutex, not a spinlock: the estimates walk the whole sketch. The scan callback runs in
+// the Bluedroid task, so it may block for that long.
+static SemaphoreHandle_t g_lock = nullptr;
+static uint32_t g_estimates[CENSUS_WINDOWS];
+static uint32_t g_lastTick = 0;
+
+struct CensusLock {
+    CensusLock() { xSemaphoreTake(g_lock, portMAX_DELAY); }
+    ~CensusLock() { xSemaphoreGive(g_lock); }
+};
+
+void census_begin(bool enabled) {
+    if (!enabled || g_census) return;
+    uint64_t salt = ((uint64_t)esp_random() << 32) | esp_random();   // per boot: hashes never link across reboots
+    g_lock = xSemaphoreCreateMutex();
+    g_census = new Census(salt);
+    GLOGI(LOGM_BLE, "Census on: %u registers, %u bytes", 1u << CENSUS_P, (unsigned)sizeof(Census));
+}
+
+bool census_enabled() { return g_census != nullptr; }
+
+void census_observe(const uint8_t mac[6], bool randomAddr, const uint8_t* payload, size_t len) {
+    if (!g_census) return;
+    bool rotating = Census::isRotating(randomAddr, mac);
+    uint32_t fp = Census::fingerprint(payload, len);
+    uint32_t now = millis();
+    {
+        CensusLock lock;
+        g_census->observe(mac, rotating, fp, now);
+    }
+    metric_inc(M_CENSUS_ADVERTS);
+}
+
+void census_tick() {
+    if (!g_census) return;
+    uint32_t now = millis();
+    if (now - g_lastTick < TICK_MS) return;
+    g_lastTick = now;
+    CensusStats st;
+    {
+        CensusLock lock;
+        g_census->expire(now);
+        for (int w = 0; w < CENSUS_WINDOWS; w++) g_estimates[w] = g_census->estimate((CensusWindow)w, now);
+        st = g_census->stats();
+    }
+    metric_set(M_CENSUS_1M, g_estimates[CENSUS_1M]);
+    metric_set(M_CENSUS_15M, g_estimates[CENSUS_15M]);
+    metric_set(M_CENSUS_1H, g_estimates[CENSUS_1H]);
+    metric_set(M_CENSUS_LINKED, st.linked);
+    metric_set(M_CENSUS_UNLINKED, st.unlinked);
+}
+
+uint32_t census_estimate(CensusWindow w) {
+    return w < CENSUS_WINDOWS ? g_estimates[w] : 0;
+}
+
+CensusStats census_stats() {
+    CensusStats st;
+    memset(&st, 0, sizeof(st));
+    if (!g_census) return st;
+    CensusLock lock;
+    return g_census->stats();
+}
+#endif
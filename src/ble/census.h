@@ -0,0 +1,136 @@
+#pragma once
+/*
+  census.h — How many BLE devices are around, from advertisements that are not geogram's.
+
+  The scan callback used to drop every advertisement without '>' text or a binary frame. With
+  the "ble_census" config key set, each of them is also counted here:
+
+  - A HyperLogLog sketch of 2^CENSUS_P registers estimates the distinct advertisers. Sliding
+    windows come from keeping, per register and per rank, the tick (CENSUS_TICK_S) it was last
+    set in, instead of only the largest rank. A window's register is then the largest rank set
+    within its last ticks, so 1 min, 15 min and 1 h are answered from the same 4 KB. The 1 min
+    window is 4 ticks: it spans 45..60 s.
+  - Public and static random addresses are the device. Resolvable and non-resolvable private
+    addresses rotate (typically every 15 min), so the 1 h window would count one phone four
+    times. A new private address is held back for CENSUS_LINK_SETTLE_MS, then taken as the
+    successor of a private address with the same payload fingerprint (AD types, flags, UUIDs,
+    name, company id: the parts that survive a rotation) that fell silent at most
+    CENSUS_LINK_WINDOW_MS before it appeared, and inherits its identity. If the old address
+    speaks again, they were two devices and the new one gets its own identity.
+    Linking is heuristic and needs every private address around to fit CENSUS_ALIASES; with
+    more, the longest-silent ones are forgotten and 15 min / 1 h degrade to counting addresses.
+
+  Privacy: nothing kept holds an address or payload. Addresses are hashed with a random salt
+  chosen at boot; only salted hashes and 32-bit fingerprints of the CENSUS_ALIASES most recent
+  private addresses are kept (for CENSUS_ALIAS_TTL_MS at most), and the sketch itself holds
+  tick stamps only.
+
+  An advertisement from a known address costs one 64-bit hash, a fingerprint over at most 62
+  payload bytes, an index lookup (private addresses only) and one byte store: O(1), no heap.
+  Each new tick adds one pass over the stamps to age them out.
+
+  Census is plain C++ without Arduino; tools/census_sim.cpp checks the estimates and the
+  rotation heuristic against a simulated crowd and measures the per-advertisement cost.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "inflighttable.h"
+
+#ifndef CENSUS_P
+#define CENSUS_P                8           // 256 registers: about 6.5% standard error
+#endif
+#ifndef CENSUS_RANKS
+#define CENSUS_RANKS            16          // ranks kept per register (counts up to ~10^7)
+#endif
+#ifndef CENSUS_TICK_S
+#define CENSUS_TICK_S           15
+#endif
+#ifndef CENSUS_ALIASES
+#define CENSUS_ALIASES          127         // private addresses remembered for rotation linking (~5 KB)
+#endif
+#ifndef CENSUS_ALIAS_TTL_MS
+#define CENSUS_ALIAS_TTL_MS     (10UL * 60 * 1000)
+#endif
+#ifndef CENSUS_LINK_SETTLE_MS
+#define CENSUS_LINK_SETTLE_MS   5000        // a new private address waits this long to be linked
+#endif
+#ifndef CENSUS_LINK_WINDOW_MS
+#define CENSUS_LINK_WINDOW_MS   10000       // largest silence between old and new address
+#endif
+
+enum CensusWindow : uint8_t {
+    CENSUS_1M = 0,
+    CENSUS_15M = 1,
+    CENSUS_1H = 2,
+    CENSUS_WINDOWS = 3,
+};
+
+typedef struct {
+    uint32_t adverts;           // advertisements counted
+    uint32_t rotating;          // of which from private (rotating) addresses
+    uint32_t linked;            // new private addresses that took over an earlier identity
+    uint32_t unlinked;          // links undone because the earlier address spoke again
+    uint32_t aliasFull;         // private addresses forgotten early to make room
+} CensusStats;
+
+class Census {
+public:
+    explicit Census(uint64_t salt);
+
+    // One advertisement. `rotating`: a resolvable or non-resolvable private address.
+    // `fingerprint`: Census::fingerprint() of its payload.
+    void observe(const uint8_t mac[6], bool rotating, uint32_t fingerprint, uint32_t nowMs);
+
+    // Distinct advertisers within the window ending now
+    uint32_t estimate(CensusWindow w, uint32_t nowMs);
+
+    // Ages the sketch and forgets private addresses quiet for CENSUS_ALIAS_TTL_MS
+    void expire(uint32_t nowMs);
+
+    const CensusStats& stats() const { return _st; }
+
+    // Hash of the parts of an advertising payload that survive an address rotation
+    static uint32_t fingerprint(const uint8_t* payload, size_t len);
+    // Private address types: random (addrType != public) with the top bits not 11 (static)
+    static bool isRotating(bool randomAddr, const uint8_t mac[6]);
+    static uint32_t windowTicks(CensusWindow w);
+    static const char* windowName(CensusWindow w);
+
+private:
+    enum : uint8_t { ALIAS_PENDING, ALIAS_OWN, ALIAS_LINKED };
+    struct Alias {
+        uint32_t identity;      // what is counted for this address
+        uint32_t fp;
+        uint64_t heir;          // key of the address that took this identity over (0 = none)
+        uint32_t firstMs;
+        uint8_t  state;
+    };
+    typedef InflightTable<Alias, CENSUS_ALIASES> Aliases;
+
+    static constexpr int kRegisters = 1 << CENSUS_P;
+
+    void advance(uint32_t nowMs);
+    void add(uint32_t identity);
+    // false while a new private address is still settling (not counted yet)
+    bool aliasIdentity(uint64_t addrKey, uint32_t fp, uint32_t nowMs, uint32_t* identity);
+    void resolve(Aliases::Entry* e);
+
+    uint8_t     _stamp[kRegisters][CENSUS_RANKS];   // 1 + tick % 255 when last set, 0 = never
+    uint32_t    _tick;
+    uint64_t    _salt;
+    Aliases     _aliases;
+    CensusStats _st;
+};
+
+#ifdef ARDUINO
+// ---------- Device glue ----------
+void census_begin(bool enabled); // call before ble_start_listening()
+bool census_enabled();
+// From the scan callback, for advertisements that are not geogram's
+void census_observe(const uint8_t mac[6], bool randomAddr, const uint8_t* payload, size_t len);
+void census_tick();              // refreshes the estimates once per tick; call from loop()
+uint32_t census_estimate(CensusWindow w);   // as of the last census_tick()
+CensusStats census_stats();
+#endif
@@ -0,0 +1,152 @@
+#pragma once
+/*
+  inflighttable.h — Partly assembled messages, keyed by (sender address, message id).
+
+  Text message ids are two random letters: 676 values. Keyed by the id alone, two senders that
+  pick the same id at the same time fold their parcels into one message, which then fails its
+  checksum and holds its slot until the TTL. Adding the advertiser's MAC to the key keeps them
+  apart.
+
+  Entries live in a fixed pool of `Slots`. An open-addressing index of at least 2 x Slots
+  buckets (linear probing, backward-shift deletion, so no tombstones) maps a key to its entry:
+  at a load factor of 1/2 or less a lookup is one hash and about one probe. A bucket is one
+  byte up to 254 slots, two above. No heap; a large value can live elsewhere behind a pointer
+  (ble.cpp does so for its 676 message entries).
+
+  Stats count what the keying buys:
+    lookups     find() and insert() calls
+    collisions  extra buckets they probed because two keys hashed alike
+    idShared    entries created while another sender had a message with the same id in
+                flight: the corruptions an id-only key would have caused
+
+  Plain C++ without Arduino; tools/assembler_sim.cpp runs it against many concurrent senders.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+template <class T, int Slots>
+class InflightTable {
+    static_assert(Slots >= 1 && Slots <= 65534, "entry numbers are stored in at most two bytes");
+    typedef typename std::conditional<(Slots < 255), uint8_t, uint16_t>::type Bucket;
+
+public:
+    struct Entry {
+        T value;
+        uint64_t key;
+        uint32_t touchMs;       // caller's last activity, for TTL and eviction
+        bool used;
+    };
+
+    struct Stats {
+        uint32_t lookups;
+        uint32_t collisions;
+        uint32_t idShared;
+    };
+
+    // 48-bit advertiser address above the 16-bit message id
+    static uint64_t makeKey(const uint8_t mac[6], uint16_t id) {
+        uint64_t k = 0;
+        for (int i = 0; i < 6; i++) k = (k << 8) | mac[i];
+        return (k << 16) | id;
+    }
+    static uint16_t keyId(uint64_t key) { return (uint16_t)(key & 0xFFFF); }
+
+    InflightTable() {
+        memset(_index, 0, sizeof(_index));
+        memset(&_stats, 0, sizeof(_stats));
+        _used = 0;
+        for (auto& e : _pool) e.used = false;
+    }
+
+    Entry* find(uint64_t key) {
+        _stats.lookups++;
+        for (size_t b = home(key);; b = (b + 1) & kMask) {
+            Bucket s = _index[b];
+            if (!s) return nullptr;
+            if (_pool[s - 1].key == key) return &_pool[s - 1];
+            _stats.collisions++;
+        }
+    }
+
+    // A fresh entry for `key` (which must not be present); nullptr when the pool is full
+    Entry* insert(uint64_t key, uint32_t nowMs) {
+        Entry* e = nullptr;
+        for (auto& c : _pool) {
+            if (!c.used) {
+                if (!e) e = &c;
+            } else if (keyId(c.key) == keyId(key)) {
+                _stats.idShared++;
+            }
+        }
+        if (!e) return nullptr;
+        _stats.lookups++;
+        size_t b = home(key);
+        while (_index[b]) {
+            _stats.collisions++;
+            b = (b + 1) & kMask;
+        }
+        _index[b] = (Bucket)(e - _pool + 1);
+        e->key = key;
+        e->touchMs = nowMs;
+        e->used = true;
+        _used++;
+        return e;
+    }
+
+    void erase(Entry* e) {
+        if (!e || !e->used) return;
+        Bucket s = (Bucket)(e - _pool + 1);
+        size_t i = home(e->key);
+        while (_index[i] != s) i = (i + 1) & kMask;
+        // Pull later members of the probe run back over the hole
+        for (size_t j = i;;) {
+            j = (j + 1) & kMask;
+            if (!_index[j]) break;
+            size_t k = home(_pool[_index[j] - 1].key);
+            bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (stays) continue;
+            _index[i] = _index[j];
+            i = j;
+        }
+        _index[i] = 0;
+        e->used = false;
+        _used--;
+    }
+
+    // The entry quiet the longest, nullptr when empty
+    Entry* oldest() {
+        Entry* o = nullptr;
+        for (auto& e : _pool) {
+            if (e.used && (!o || (int32_t)(e.touchMs - o->touchMs) < 0)) o = &e;
+        }
+        return o;
+    }
+
+    int  used() const { return _used; }
+    bool full() const { return _used == Slots; }
+    const Stats& stats() const { return _stats; }
+
+    // Every pool entry, used or not
+    Entry* begin() { return _pool; }
+    Entry* end() { return _pool + Slots; }
+    const Entry* begin() const { return _pool; }
+    const Entry* end() const { return _pool + Slots; }
+
+private:
+    static constexpr int pow2AtLeast(int n, int p = 1) { return p >= n ? p : pow2AtLeast(n, p * 2); }
+    static constexpr int log2Of(int p) { return p <= 1 ? 0 : 1 + log2Of(p / 2); }
+    static constexpr int kBuckets = pow2AtLeast(2 * Slots);
+    static constexpr size_t kMask = kBuckets - 1;
+
+    static size_t home(uint64_t key) {
+        return (size_t)((key * 0x9E3779B97F4A7C15ull) >> (64 - log2Of(kBuckets)));
+    }
+
+    Entry   _pool[Slots];
+    Bucket  _index[kBuckets];       // entry number + 1, 0 = empty bucket
+    int     _used;
+    Stats   _stats;
+};
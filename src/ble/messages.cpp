@@ -6,7 +6,7 @@
 // - checksum         : fixed-length hex string (tunable length)
 // - timestamp        : fixed-length "YYYY-MM-DD_HH:MM_SS" (19 chars)
 // - message_type     : exactly 3 chars
-// - message_content  : 0..MSG_MAX_CONTENT_BYTES, may contain ANY chars (including '\n' and '|')
+// - message_content  : 0..MSG_MAX_CONTENT_BYTES of well-formed UTF-8, may contain ANY chars (including '\n' and '|')
 //
 // The library reads records by the declared size prefix (not by newline).
 // Dedupe: per-segment, keyed by checksum. Query order: strict append order (segment seq DESC, then record order DESC).
@@ -17,6 +17,8 @@
 #else
   #include <Arduino.h>
   #include <FS.h>
+  #include "drive/storageio.h"
+  #include "drive/flashwear.h"
 #endif
 
 
@@ -24,6 +26,10 @@
 #include <unordered_set>
 
 #include "messages.h"
+#include "misc/utf8.h"
+#include "diag/metrics.h"
+#include "diag/trace.h"
+#include "diag/heapprof.h"
 #include <algorithm>
 #include <unordered_set>
 
@@ -66,6 +72,7 @@ static size_t  g_curSeq = 0;
 static File    g_curFile;
 static size_t  g_curBytes = 0;
 static size_t  g_sinceFlush = 0;
+static MsgStageSink g_stage = nullptr;   // set while the storage volume is not ours to write
 
 // In-segment dedupe by checksum (rebuilt when opening the tail)
 static std::unordered_set<std::string> g_seenChecksums;
@@ -225,10 +232,12 @@ static bool openOrCreateTail() {
 
 static bool rotateIfNeeded(size_t nextLineBytes) {
   if (g_curBytes + nextLineBytes <= MSG_SEGMENT_BYTES) return true;
+  if (g_stage) return true; // staged records stay in the current segment; rotation resumes later
   return openNewSegment();
 }
 
 static bool parseLine(const String& line, MessageView& out) {
+  HEAPPROF_SCOPE("msg_parseLine");
   // Expect: size|checksum|timestamp|type|content...
   int p1 = line.indexOf('|'); if (p1 < 0) return false;
   int p2 = line.indexOf('|', p1 + 1); if (p2 < 0) return false;
@@ -283,24 +292,43 @@ bool msg_roll_segment() {
   return openNewSegment();
 }
 
+static bool msg_set_stage_sink_impl(MsgStageSink sink) {
+  if (sink && !g_stage && g_curFile) g_curFile.close();
+  bool resume = !sink && g_stage;
+  g_stage = sink;
+  if (resume && g_fs) openOrCreateTail();
+  return true;
+}
+
+void msg_set_stage_sink(MsgStageSink sink) {
+#ifdef MSG_HOST_TEST
+  msg_set_stage_sink_impl(sink);
+#else
+  // Same task as the appends, so none of them sees the tail half switched
+  storio_run(STORIO_LOG, [sink]() { return msg_set_stage_sink_impl(sink); });
+#endif
+}
+
 size_t msg_current_seq()   { return g_curSeq; }
 size_t msg_current_bytes() { return g_curBytes; }
 
-bool msg_write(const String& checksum,
-               const String& timestamp,
-               const String& type3,
-               const String& content)
+static bool msg_write_impl(const String& checksum,
+                           const String& timestamp,
+                           const String& type3,
+                           const String& content)
 {
-  if (!g_fs || !g_curFile) return false;
+  if (!g_fs || (!g_curFile && !g_stage)) return false;
 
   // Validate fixed fields
   if ((int)checksum.length() != MSG_CHECKSUM_HEX_LEN) return false;
   if ((int)timestamp.length() != MSG_TIMESTAMP_LEN)  return false;
   if ((int)type3.length()   != MSG_TYPE_LEN)         return false;
   if ((int)content.length() > MSG_MAX_CONTENT_BYTES) return false;
+  if (!utf8_valid(content.c_str(), content.length())) return false;   // newlines and '|' are fine
 
   // Per-segment dedupe by checksum
   if (g_seenChecksums.find(std::string(checksum.c_str())) != g_seenChecksums.end()) {
+    metric_inc(M_MSG_DUPLICATES);
     return false; // duplicate within current file
   }
 
@@ -314,16 +342,25 @@ bool msg_write(const String& checksum,
       String line; line.reserve(sz);
       line += sDigits; line += "|"; line += body;
 
-      if (!rotateIfNeeded(line.length())) return false;
+      if (!rotateIfNeeded(line.length())) { metric_inc(M_MSG_ERRORS); return false; }
 
-      size_t written = g_curFile.print(line);
-      if (written != line.length()) return false;
+      size_t written;
+      if (g_stage) {
+        String path = seqToName(g_curSeq);
+        written = g_stage(path.c_str(), (const uint8_t*)line.c_str(), line.length()) ? line.length() : 0;
+      } else {
+        TRACE_BEGIN(TR_FLASH_WRITE, line.length(), 0);
+        written = g_curFile.print(line);
+        TRACE_END(TR_FLASH_WRITE, written, 0);
+      }
+      if (written != line.length()) { metric_inc(M_MSG_ERRORS); return false; }
 
       g_curBytes += written;
       g_sinceFlush++;
+      metric_inc(M_MSG_WRITE_BYTES, (uint32_t)written);
       g_seenChecksums.insert(std::string(checksum.c_str()));
 
-      if (g_sinceFlush >= MSG_FLUSH_EVERY_N) {
+      if (g_sinceFlush >= MSG_FLUSH_EVERY_N && g_curFile) {
         g_curFile.flush();
         g_sinceFlush = 0;
       }
@@ -333,7 +370,35 @@ bool msg_write(const String& checksum,
   }
 }
 
+bool msg_write(const String& checksum,
+               const String& timestamp,
+               const String& type3,
+               const String& content)
+{
+  HEAPPROF_SCOPE("msg_write");
+  uint32_t t0 = micros();
+#ifdef MSG_HOST_TEST
+  bool ok = msg_write_impl(checksum, timestamp, type3, content);
+#else
+  // Blocks until the storage task has done the append (at most one request ahead of it), so
+  // this is for task context only. Nothing calls it from the BLE scan callback; a caller there
+  // would have to copy the record and storio_submit() it instead.
+  uint32_t written = 0;
+  bool ok = storio_run(STORIO_LOG, [&]() {
+    uint32_t before = metric_get(M_MSG_WRITE_BYTES);
+    bool r = msg_write_impl(checksum, timestamp, type3, content);
+    written = metric_get(M_MSG_WRITE_BYTES) - before;
+    return r;
+  });
+  if (ok && !g_stage) wear_record_active(WEAR_MESSAGES, written);
+#endif
+  hist_observe(H_MSG_WRITE_US, (uint32_t)(micros() - t0));
+  if (ok) metric_inc(M_MSG_WRITES);
+  return ok;
+}
+
 bool msg_query(const MsgFilter& filter, size_t limit, std::vector<MessageView>& out) {
+  HEAPPROF_SCOPE("msg_query");
   out.clear();
   if (!g_fs) return false;
 
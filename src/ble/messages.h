@@ -28,15 +28,22 @@ bool   msg_init(fs::FS& fs, const char* directory); // mounts folder & opens tai
 void   msg_end();
 
 // Write one message; deduped by checksum within current segment.
-// Returns true on append, false if duplicate/invalid/error.
+// Returns true on append, false if duplicate/invalid/error. Blocks on the storage task: not
+// for the BLE scan callback or other callback contexts.
 bool   msg_write(const String& checksum,
                  const String& timestamp,   // fixed 19 chars
                  const String& type3,       // exactly 3 chars
-                 const String& content);    // up to MSG_MAX_CONTENT_BYTES, may include '\n' and '|'
+                 const String& content);    // up to MSG_MAX_CONTENT_BYTES of valid UTF-8, may include '\n' and '|'
 
 // Query most-recent-first (append order): newest segments first, then newest records inside each segment.
 bool   msg_query(const MsgFilter& filter, size_t limit, std::vector<MessageView>& out);
 
+// While the storage volume is lent out (USB host), records go to `sink(path, data, len)` instead
+// of the tail file, which is closed; dedupe and segment accounting continue as usual. Pass
+// nullptr to reopen the tail and resume direct writes. (StorageManager + staging_capture.)
+typedef bool (*MsgStageSink)(const char* path, const uint8_t* data, size_t len);
+void   msg_set_stage_sink(MsgStageSink sink);
+
 // Rotate to a new segment (sequence always increments).
 bool   msg_roll_segment();
 
@@ -0,0 +1,58 @@
+#include "msgdigest.h"
+
+#include <string.h>
+
+#define CRC32C_POLY 0x82F63B78u      // Castagnoli, reflected
+
+// Slicing-by-4: 4 KB of tables, built on first use
+struct Crc32cTables {
+    uint32_t t[4][256];
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int b = 0; b < 8; b++) c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 4; k++) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+uint32_t crc32c(const void* data, size_t len, uint32_t crc) {
+    static const Crc32cTables s_tab;     // function-local: safe from other static constructors
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    while (len && ((uintptr_t)p & 3)) {
+        crc = (crc >> 8) ^ s_tab.t[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    while (len >= 4) {
+        uint32_t w;
+        memcpy(&w, p, 4);           // little endian on ESP32 and x86
+        crc ^= w;
+        crc = s_tab.t[3][crc & 0xFF] ^ s_tab.t[2][(crc >> 8) & 0xFF] ^
+              s_tab.t[1][(crc >> 16) & 0xFF] ^ s_tab.t[0][crc >> 24];
+        p += 4;
+        len -= 4;
+    }
+    while (len--) crc = (crc >> 8) ^ s_tab.t[0][(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+
+void msg_digest_letters(uint32_t v, char out[MSG_DIGEST_LETTERS + 1]) {
+    for (int i = 0; i < MSG_DIGEST_LETTERS; i++) {
+        out[i] = (char)('A' + v % 26);
+        v /= 26;
+    }
+    out[MSG_DIGEST_LETTERS] = '\0';
+}
+
+void msg_digest_hex(uint32_t v, char out[MSG_DIGEST_HEX + 1]) {
+    static const char kHex[] = "0123456789ABCDEF";
+    for (int i = MSG_DIGEST_HEX - 1; i >= 0; i--) {
+        out[i] = kHex[v & 0xF];
+        v >>= 4;
+    }
+    out[MSG_DIGEST_HEX] = '\0';
+}
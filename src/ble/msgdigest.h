@@ -0,0 +1,46 @@
+#pragma once
+/*
+  msgdigest.h — CRC32C (Castagnoli) message digest, computed incrementally per parcel.
+
+  Replaces the byte sum behind the 4-letter message checksum. A sum misses every reordering
+  (swapped parcels, swapped characters) and most pairs of compensating errors; CRC32C catches
+  every burst up to 32 bits and every odd number of bit errors.
+
+  The digest is exposed in two forms:
+  - msg_digest_letters(): 4 letters A–Z (the digest modulo 26^4, low digit first), the shape
+    of the "AA0:FROM:DEST:CKSM" header field, so the parcel format is unchanged;
+  - msg_digest_hex(): all 32 bits as 8 hex digits, the dedupe key of the message log
+    (MSG_CHECKSUM_HEX_LEN in messages.cpp).
+
+  update() may be called once per parcel, in parcel index order: feeding "ab" then "cd" gives
+  the digest of "abcd". The table-driven loop handles 4 bytes per step (slicing-by-4).
+
+  Plain C++ without Arduino, so tools/checksum_bench.cpp can run it on the host.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MSG_DIGEST_LETTERS  4
+#define MSG_DIGEST_HEX      8
+
+// CRC32C of `data`, continuing from `crc` (0 to start): crc32c(b, crc32c(a)) == crc32c(a + b)
+uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0);
+
+class MsgDigest {
+public:
+    MsgDigest() : _crc(0), _len(0) {}
+    void reset() { _crc = 0; _len = 0; }
+    void update(const char* text, size_t len) { _crc = crc32c(text, len, _crc); _len += len; }
+    uint32_t value() const { return _crc; }
+    size_t length() const { return _len; }     // bytes folded in so far
+
+private:
+    uint32_t _crc;
+    size_t _len;
+};
+
+// `out` receives MSG_DIGEST_LETTERS letters + NUL
+void msg_digest_letters(uint32_t v, char out[MSG_DIGEST_LETTERS + 1]);
+// `out` receives MSG_DIGEST_HEX uppercase hex digits + NUL
+void msg_digest_hex(uint32_t v, char out[MSG_DIGEST_HEX + 1]);
@@ -0,0 +1,279 @@
+#include "proximity.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define LN10    2.302585093f
+
+// Built-in calibration: RSSI of that model's advertisements one metre away in free line of
+// sight, and an indoor path-loss exponent. Override per site with "ble_prox_cal".
+static const ProxModel kBuiltinModels[] = {
+    { "LT1", -58.0f, 2.2f },        // LilyGO T-Dongle S3, default advertising power
+};
+
+static bool nameChar(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+static void copyField(char* dst, size_t cap, const char* src, size_t n) {
+    if (n > cap - 1) n = cap - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+Proximity::Proximity() {
+    memset(_models, 0, sizeof(_models));
+    _modelCount = 0;
+    _replaced = 0;
+    _modelK[PROX_MAX_MODELS] = LN10 / (10.0f * PROX_DEFAULT_EXPONENT);
+    for (const auto& m : kBuiltinModels) setModel(m.code, m.rssiAt1m, m.exponent);
+}
+
+int Proximity::findModel(const char* code) const {
+    for (int i = 0; i < _modelCount; i++) {
+        if (strcmp(_models[i].code, code) == 0) return i;
+    }
+    return -1;
+}
+
+const ProxModel* Proximity::model(const char* code) const {
+    int i = findModel(code);
+    return i < 0 ? nullptr : &_models[i];
+}
+
+bool Proximity::setModel(const char* code, float rssiAt1m, float exponent) {
+    if (!code || !*code || exponent <= 0.5f) return false;
+    int i = findModel(code);
+    if (i < 0) {
+        if (_modelCount == PROX_MAX_MODELS) return false;
+        i = _modelCount++;
+        copyField(_models[i].code, PROX_MODEL_MAX, code, strlen(code));
+    }
+    _models[i].rssiAt1m = rssiAt1m;
+    _models[i].exponent = exponent;
+    _modelK[i] = LN10 / (10.0f * exponent);
+    return true;
+}
+
+int Proximity::setModels(const char* spec) {
+    int taken = 0;
+    const char* p = spec ? spec : "";
+    while (*p) {
+        const char* end = strchr(p, ',');
+        if (!end) end = p + strlen(p);
+        char item[40];
+        copyField(item, sizeof(item), p, (size_t)(end - p));
+        char* a = strchr(item, ':');
+        char* b = a ? strchr(a + 1, ':') : nullptr;
+        if (b) {
+            *a = '\0';
+            char* code = item;
+            while (*code == ' ') code++;
+            char* e1;
+            char* e2;
+            float rssi = strtof(a + 1, &e1);
+            float n = strtof(b + 1, &e2);
+            if (e1 == b && e2 != b + 1 && setModel(code, rssi, n)) taken++;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return taken;
+}
+
+float Proximity::distanceM(float rssi, float rssiAt1m, float exponent) {
+    return expf((rssiAt1m - rssi) * LN10 / (10.0f * exponent));
+}
+
+ProxClass Proximity::classify(float d, ProxClass current) {
+    // Each boundary moves outward while the neighbour is inside it and inward once it is out
+    float inImm = current == PROX_UNKNOWN ? 1.0f : current <= PROX_IMMEDIATE ? 1.0f + PROX_HYSTERESIS : 1.0f - PROX_HYSTERESIS;
+    float inNear = current == PROX_UNKNOWN ? 1.0f : current <= PROX_NEAR ? 1.0f + PROX_HYSTERESIS : 1.0f - PROX_HYSTERESIS;
+    if (d < PROX_IMMEDIATE_M * inImm) return PROX_IMMEDIATE;
+    if (d < PROX_NEAR_M * inNear) return PROX_NEAR;
+    return PROX_FAR;
+}
+
+const char* Proximity::className(ProxClass c) {
+    switch (c) {
+        case PROX_IMMEDIATE: return "immediate";
+        case PROX_NEAR: return "near";
+        case PROX_FAR: return "far";
+        default: return "unknown";
+    }
+}
+
+void Proximity::update(ProxNeighbor* n) {
+    float rssiAt1m = n->modelIdx < PROX_MAX_MODELS ? _models[n->modelIdx].rssiAt1m : PROX_DEFAULT_RSSI_1M;
+    n->distanceM = expf((rssiAt1m - n->rssi) * _modelK[n->modelIdx]);
+    n->cls = classify(n->distanceM, (ProxClass)n->cls);
+}
+
+ProxNeighbor* Proximity::observe(const uint8_t mac[6], int8_t rssi, uint32_t nowMs) {
+    uint64_t key = Table::makeKey(mac, 0);
+    Table::Entry* e = _table.find(key);
+    ProxNeighbor* n;
+    if (e) {
+        // Kalman step: the mean may have moved since the last sample, then blend the new one in
+        n = &e->value;
+        int32_t gap = (int32_t)(nowMs - n->lastMs);
+        float dt = gap > 0 ? (float)gap * 0.001f : 0.0f;
+        n->var += PROX_Q_DB2_PER_S * dt;
+        float k = n->var / (n->var + PROX_R_DB2);
+        n->rssi += k * ((float)rssi - n->rssi);
+        n->var *= 1.0f - k;
+    } else {
+        if (_table.full()) {
+            _table.erase(_table.oldest());
+            _replaced++;
+        }
+        e = _table.insert(key, nowMs);
+        n = &e->value;
+        memset(n, 0, sizeof(*n));
+        memcpy(n->mac, mac, 6);
+        n->modelIdx = PROX_MAX_MODELS;
+        n->rssi = rssi;
+        n->var = PROX_R_DB2;
+        n->firstMs = nowMs;
+    }
+    e->touchMs = nowMs;
+    n->lastMs = nowMs;
+    n->lastRssi = rssi;
+    n->samples++;
+    update(n);
+    return n;
+}
+
+void Proximity::identify(ProxNeighbor* n, const char* callsign, const char* model) {
+    if (strcmp(n->callsign, callsign) != 0) copyField(n->callsign, PROX_CALLSIGN_MAX, callsign, strlen(callsign));
+    if (strcmp(n->model, model) == 0 && n->modelIdx != PROX_MAX_MODELS) return;
+    copyField(n->model, PROX_MODEL_MAX, model, strlen(model));
+    int i = findModel(n->model);
+    uint8_t idx = i < 0 ? PROX_MAX_MODELS : (uint8_t)i;
+    if (idx == n->modelIdx) return;
+    n->modelIdx = idx;
+    n->cls = PROX_UNKNOWN;          // a different calibration, not a move: no hysteresis
+    update(n);
+}
+
+int Proximity::sweep(uint32_t nowMs) {
+    int gone = 0;
+    for (auto& e : _table) {
+        if (e.used && nowMs - e.value.lastMs >= PROX_STALE_MS) {
+            _table.erase(&e);
+            gone++;
+        }
+    }
+    return gone;
+}
+
+int Proximity::snapshot(ProxNeighbor* out, int max) const {
+    int n = 0;
+    for (const auto& e : _table) {
+        if (!e.used || n == max) continue;
+        // Insertion sort on distance: the table is small
+        int i = n++;
+        while (i > 0 && out[i - 1].distanceM > e.value.distanceM) {
+            out[i] = out[i - 1];
+            i--;
+        }
+        out[i] = e.value;
+    }
+    return n;
+}
+
+bool Proximity::parsePing(const char* text, size_t len, char callsign[PROX_CALLSIGN_MAX], char model[PROX_MODEL_MAX]) {
+    if (len < 4 || text[0] != '+') return false;
+    size_t i = 1;
+    while (i < len && nameChar(text[i])) i++;
+    size_t csLen = i - 1;
+    if (csLen == 0 || csLen >= PROX_CALLSIGN_MAX || i == len || text[i] != '#') return false;
+    size_t m = ++i;
+    while (i < len && nameChar(text[i])) i++;
+    size_t modelLen = i - m;
+    if (modelLen == 0 || modelLen >= PROX_MODEL_MAX || (i < len && text[i] != '-')) return false;
+    copyField(callsign, PROX_CALLSIGN_MAX, text + 1, csLen);
+    copyField(model, PROX_MODEL_MAX, text + m, modelLen);
+    return true;
+}
+
+#ifdef ARDUINO
+// ---------- Device glue ----------
+#include <Arduino.h>
+#include <time.h>
+#include "ble.h"
+#include "apps/presence.h"
+#include "wifi/time_get.h"
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+#ifndef PROX_PRESENCE_CLASS
+#define PROX_PRESENCE_CLASS     PROX_NEAR       // neighbours this close count as present
+#endif
+#ifndef PROX_SWEEP_MS
+#define PROX_SWEEP_MS           10000
+#endif
+
+static Proximity g_prox;
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;   // scan events vs. web snapshots
+static uint32_t g_lastSweep = 0;
+
+static void on_ble_event(const BleEvent* e, void*) {
+    if (e->type != BLE_EVT_SINGLE_TEXT || e->data.single.text_len < 1) return;
+    const char* text = e->data.single.text + 1;           // skip '>'
+    size_t len = e->data.single.text_len - 1;
+    char callsign[PROX_CALLSIGN_MAX];
+    char model[PROX_MODEL_MAX];
+    bool ping = Proximity::parsePing(text, len, callsign, model);
+
+    // Wall time before the spinlock: gettimeofday() takes a lock of its own
+    bool present = false;
+    time_t now = timeValid() ? time(nullptr) : 0;
+    uint32_t minute = (uint32_t)(now / 60);
+    portENTER_CRITICAL(&g_mux);
+    uint32_t replaced = g_prox.replaced();
+    ProxNeighbor* n = g_prox.observe(e->data.single.mac, e->data.single.rssi, e->data.single.rx_ms);
+    if (ping) g_prox.identify(n, callsign, model);
+    ProxClass cls = (ProxClass)n->cls;
+    if (now && n->callsign[0] && cls != PROX_UNKNOWN && cls <= PROX_PRESENCE_CLASS && n->presenceMinute != minute) {
+        n->presenceMinute = minute;
+        memcpy(callsign, n->callsign, PROX_CALLSIGN_MAX);
+        present = true;
+    }
+    int count = g_prox.count();
+    replaced = g_prox.replaced() - replaced;
+    portEXIT_CRITICAL(&g_mux);
+
+    metric_inc(M_PROX_SAMPLES);
+    metric_set(M_PROX_NEIGHBORS, (uint32_t)count);
+    if (replaced) metric_inc(M_PROX_REPLACED, replaced);
+    if (present) {
+        metric_inc(M_PROX_PRESENCE);
+        updatePresence(String(callsign), now);
+    }
+}
+
+void proximity_begin(const char* calibration) {
+    int taken = g_prox.setModels(calibration);
+    if (calibration && *calibration) GLOGI(LOGM_BLE, "Proximity calibration: %d model(s) from config", taken);
+    ble_subscribe(on_ble_event, nullptr);
+}
+
+void proximity_tick() {
+    uint32_t now = millis();
+    if (now - g_lastSweep < PROX_SWEEP_MS) return;
+    g_lastSweep = now;
+    portENTER_CRITICAL(&g_mux);
+    g_prox.sweep(now);
+    int count = g_prox.count();
+    portEXIT_CRITICAL(&g_mux);
+    metric_set(M_PROX_NEIGHBORS, (uint32_t)count);
+}
+
+int proximity_snapshot(ProxNeighbor* out, int max) {
+    portENTER_CRITICAL(&g_mux);
+    int n = g_prox.snapshot(out, max);
+    portEXIT_CRITICAL(&g_mux);
+    return n;
+}
+#endif
@@ -0,0 +1,161 @@
+#pragma once
+/*
+  proximity.h — How far away each neighbouring dongle is, from the RSSI of its advertisements.
+
+  Every '>' advertisement that reaches BLE_EVT_SINGLE_TEXT is one RSSI sample for its MAC.
+  Per neighbour:
+
+  - a one-dimensional Kalman filter smooths the RSSI. The state is the mean received power;
+    it may wander by PROX_Q_DB2_PER_S (dBm^2 per second) and each sample is that mean plus
+    PROX_R_DB2 of multipath/body noise. Gaps between samples let the estimate move faster, a
+    burst of samples from a parked dongle pins it down. Q was tuned with the bench below
+    (a walker at 0.5 m/s, one sample every 1..10 s).
+  - a log-distance path-loss model turns the filtered power into metres:
+
+        d = 10 ^ ((rssi@1m - rssi) / (10 n))
+
+    with rssi@1m and the exponent n calibrated per device model code. The code comes from the
+    neighbour's ping (">+CALLSIGN#LT1-0.0.1"); until one is heard, PROX_DEFAULT_* apply.
+    Built-in values are starting points; the "ble_prox_cal" config key overrides them with
+    what a dongle of that model reads at one metre on site.
+  - the distance is classed immediate (< PROX_IMMEDIATE_M), near (< PROX_NEAR_M) or far, with
+    PROX_HYSTERESIS on each boundary so a neighbour standing on one does not flap.
+
+  Neighbours live in a fixed table of PROX_MAX_NEIGHBORS, indexed by MAC with the same pool +
+  open-addressing index as the message assembler (inflighttable.h, message id 0). A sample is
+  one hash lookup, a handful of float operations and one expf(): O(1), no heap. A new MAC in a
+  full table takes the slot of the neighbour heard least recently; sweep() forgets neighbours
+  silent for PROX_STALE_MS.
+
+  Proximity is plain C++ without Arduino; tools/proximity_bench.cpp measures the per-sample
+  cost and the distance error on the host. The device glue feeds it from BLE events, records
+  presence minutes for identified neighbours within PROX_PRESENCE_CLASS, and serves the table
+  at /api/neighbors.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "inflighttable.h"
+
+#ifndef PROX_MAX_NEIGHBORS
+#define PROX_MAX_NEIGHBORS  32
+#endif
+#ifndef PROX_MAX_MODELS
+#define PROX_MAX_MODELS     8
+#endif
+#ifndef PROX_STALE_MS
+#define PROX_STALE_MS       (5UL * 60 * 1000)
+#endif
+
+// RSSI filter
+#ifndef PROX_Q_DB2_PER_S
+#define PROX_Q_DB2_PER_S    0.25f    // process noise: mean power drift, dBm^2 per second
+#endif
+#ifndef PROX_R_DB2
+#define PROX_R_DB2          36.0f    // measurement noise: 6 dB standard deviation
+#endif
+
+// Path loss for neighbours whose model is unknown
+#ifndef PROX_DEFAULT_RSSI_1M
+#define PROX_DEFAULT_RSSI_1M  -60.0f
+#endif
+#ifndef PROX_DEFAULT_EXPONENT
+#define PROX_DEFAULT_EXPONENT 2.5f
+#endif
+
+// Classes
+#ifndef PROX_IMMEDIATE_M
+#define PROX_IMMEDIATE_M    0.5f
+#endif
+#ifndef PROX_NEAR_M
+#define PROX_NEAR_M         3.0f
+#endif
+#ifndef PROX_HYSTERESIS
+#define PROX_HYSTERESIS     0.2f     // a boundary moves by 20% against the current class
+#endif
+
+#define PROX_CALLSIGN_MAX   16       // NUL included
+#define PROX_MODEL_MAX      8
+
+enum ProxClass : uint8_t {
+    PROX_UNKNOWN = 0,
+    PROX_IMMEDIATE = 1,
+    PROX_NEAR = 2,
+    PROX_FAR = 3,
+};
+
+struct ProxNeighbor {
+    uint8_t  mac[6];
+    char     callsign[PROX_CALLSIGN_MAX];   // from its ping, "" until heard
+    char     model[PROX_MODEL_MAX];         // device model code, "" until heard
+    uint8_t  modelIdx;                      // calibration entry, PROX_MAX_MODELS = default
+    uint8_t  cls;                           // ProxClass
+    int8_t   lastRssi;                      // last raw sample
+    float    rssi;                          // filtered dBm
+    float    var;                           // filter variance, dBm^2
+    float    distanceM;
+    uint32_t samples;
+    uint32_t firstMs;
+    uint32_t lastMs;
+    uint32_t presenceMinute;                // glue: last minute passed to updatePresence()
+};
+
+struct ProxModel {
+    char  code[PROX_MODEL_MAX];
+    float rssiAt1m;
+    float exponent;
+};
+
+class Proximity {
+public:
+    typedef InflightTable<ProxNeighbor, PROX_MAX_NEIGHBORS> Table;
+
+    Proximity();
+
+    // One advertisement from `mac`; returns its neighbour entry (never nullptr)
+    ProxNeighbor* observe(const uint8_t mac[6], int8_t rssi, uint32_t nowMs);
+
+    // Callsign and model code from the neighbour's ping. Re-derives the distance when the
+    // calibration changes.
+    void identify(ProxNeighbor* n, const char* callsign, const char* model);
+
+    // Adds or replaces the calibration of a model code; false when the table is full
+    bool setModel(const char* code, float rssiAt1m, float exponent);
+    // "LT1:-58:2.2,T3:-62:2.4" (code:rssi@1m:exponent, comma separated); returns entries taken
+    int  setModels(const char* spec);
+    const ProxModel* model(const char* code) const;
+
+    // Forgets neighbours silent for PROX_STALE_MS; returns how many
+    int sweep(uint32_t nowMs);
+
+    // Copies up to `max` neighbours, nearest first; returns the count
+    int snapshot(ProxNeighbor* out, int max) const;
+
+    int count() const { return _table.used(); }
+    uint32_t replaced() const { return _replaced; }    // neighbours pushed out of a full table
+
+    // ">+CALLSIGN#LT1-0.0.1" (without the '>') -> callsign, model code
+    static bool parsePing(const char* text, size_t len, char callsign[PROX_CALLSIGN_MAX], char model[PROX_MODEL_MAX]);
+
+    static float distanceM(float rssi, float rssiAt1m, float exponent);
+    static ProxClass classify(float distanceM, ProxClass current);
+    static const char* className(ProxClass c);
+
+private:
+    int  findModel(const char* code) const;
+    void update(ProxNeighbor* n);
+
+    Table     _table;
+    ProxModel _models[PROX_MAX_MODELS];
+    float     _modelK[PROX_MAX_MODELS + 1];   // ln(10) / (10 n), last = default
+    int       _modelCount;
+    uint32_t  _replaced;
+};
+
+#ifdef ARDUINO
+// ---------- Device glue ----------
+void proximity_begin(const char* calibration);   // setModels() spec; subscribes to BLE text
+void proximity_tick();                           // forgets stale neighbours; call from loop()
+int  proximity_snapshot(ProxNeighbor* out, int max); // safe from any task
+#endif
@@ -0,0 +1,302 @@
+#include "timesync.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define DRIFT_MAX_RATE   500e-6      // beyond +-500 ppm the estimate is noise, not a crystal
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static bool parseHex(const char* p, size_t n, uint32_t* out) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        int h = hexval(p[i]);
+        if (h < 0) return false;
+        v = (v << 4) | (uint32_t)h;
+    }
+    *out = v;
+    return true;
+}
+
+TimeSync::TimeSync() {
+    memset(&_st, 0, sizeof(_st));
+    _localStratum = 0;
+    _localMono = 0;
+    _srcStratum = 0;
+    _srcSeenMono = 0;
+    _driftStartMono = 0;
+    _driftSumMs = 0;
+    _driftLastMono = 0;
+    _driftCarryMs = 0;
+    _driftRate = 0;
+}
+
+void TimeSync::setLocalStratum(uint8_t s, uint32_t monoMs) {
+    _localStratum = s > TIMESYNC_MAX_STRATUM ? TIMESYNC_MAX_STRATUM : s;
+    _localMono = monoMs;
+    if (_localStratum == 1) {
+        // NTP owns the clock: forget the mesh source and its drift bookkeeping
+        _srcStratum = 0;
+        memset(_st.sourceMac, 0, sizeof(_st.sourceMac));
+        _driftRate = 0;
+        _driftCarryMs = 0;
+        _st.driftPpm = 0;
+    }
+    _st.stratum = stratum(monoMs);
+}
+
+bool TimeSync::hasSource() const {
+    return _srcStratum != 0;
+}
+
+// Best of the local clock and the mesh source, the latter counted while heard within
+// `sourceValidMs`: the source timeout for advertising, the holdover for accepting others.
+uint8_t TimeSync::rank(uint32_t monoMs, uint32_t sourceValidMs) const {
+    uint8_t best = 0;
+    if (_localStratum && monoMs - _localMono < TIMESYNC_HOLDOVER_MS) best = _localStratum;
+    if (hasSource() && monoMs - _srcSeenMono < sourceValidMs) {
+        uint8_t mesh = _srcStratum + 1;
+        if (!best || mesh < best) best = mesh;
+    }
+    return best;
+}
+
+bool TimeSync::isBeacon(const char* text, size_t len) {
+    return text && len == TIMESYNC_TEXT_LEN && text[0] == TIMESYNC_PREFIX[0] && text[1] == TIMESYNC_PREFIX[1];
+}
+
+bool TimeSync::encode(int64_t wallMs, uint32_t monoMs, char* out, size_t cap) {
+    uint8_t s = stratum(monoMs);
+    _st.stratum = s;
+    if (!s || s >= TIMESYNC_MAX_STRATUM || wallMs <= 0 || cap < TIMESYNC_TEXT_LEN + 1) return false;
+    snprintf(out, cap, "%s%u%08lX%03X", TIMESYNC_PREFIX, (unsigned)s,
+             (unsigned long)(uint32_t)(wallMs / 1000), (unsigned)(wallMs % 1000));
+    _st.beaconsTx++;
+    return true;
+}
+
+// Advertising model: the burst starts TIMESYNC_TX_SETUP_MS after the stamp, the first event
+// is pushed back by the random advDelay (0..10 ms), then events repeat every
+// TIMESYNC_ADV_INTERVAL_MS until the burst ends. Each event is heard with probability
+// p = scan duty x link quality; the expected number of missed events is taken over the
+// receptions that still fall inside the burst.
+uint32_t TimeSync::expectedLatencyMs(int8_t rssi) {
+    float q = (rssi + 95) / 25.0f;               // -70 dBm and better: clean link
+    if (q > 1.0f) q = 1.0f;
+    if (q < 0.1f) q = 0.1f;
+    float p = TIMESYNC_SCAN_DUTY * q;
+
+    int events = TIMESYNC_ADV_BURST_MS / TIMESYNC_ADV_INTERVAL_MS + 1;
+    float miss = 1.0f, weight = 0, missed = 0;
+    for (int k = 0; k < events; k++) {
+        float pk = miss * p;                     // first heard at event k
+        weight += pk;
+        missed += pk * k;
+        miss *= 1.0f - p;
+    }
+    float expMissed = weight > 0 ? missed / weight : 0;
+    return (uint32_t)lroundf(TIMESYNC_TX_SETUP_MS + 5.0f + expMissed * TIMESYNC_ADV_INTERVAL_MS + TIMESYNC_RX_PROC_MS);
+}
+
+void TimeSync::restartDrift(uint32_t monoMs) {
+    _driftStartMono = monoMs;
+    _driftLastMono = monoMs;
+    _driftSumMs = 0;
+}
+
+bool TimeSync::receive(const uint8_t mac[6], const char* text, size_t len, int8_t rssi,
+                       uint32_t rxMonoMs, int64_t localWallMs, int64_t* correctionMs) {
+    _st.beaconsRx++;
+    uint32_t secs = 0, ms = 0;
+    if (!isBeacon(text, len) || text[2] < '1' || text[2] > '9' ||
+        !parseHex(text + 3, 8, &secs) || !parseHex(text + 11, 3, &ms) || ms > 999) {
+        _st.rejected++;
+        return false;
+    }
+    uint8_t s = (uint8_t)(text[2] - '0');
+    uint8_t mine = rank(rxMonoMs, TIMESYNC_HOLDOVER_MS);
+    bool fromSource = hasSource() && memcmp(mac, _st.sourceMac, 6) == 0;
+
+    if (_localStratum == 1 && mine == 1) {                       // NTP beats any beacon
+        _st.rejected++;
+        return false;
+    }
+    if (fromSource) {
+        if (s + 1 > TIMESYNC_MAX_STRATUM) {                      // source lost its own upstream
+            _srcStratum = 0;
+            memset(_st.sourceMac, 0, sizeof(_st.sourceMac));
+            _st.stratum = stratum(rxMonoMs);
+            _st.rejected++;
+            return false;
+        }
+    } else {
+        bool quiet = !hasSource() || rxMonoMs - _srcSeenMono > TIMESYNC_SOURCE_TIMEOUT_MS;
+        bool better = !mine || s + 1 < mine || (quiet && s + 1 <= mine);
+        if (s + 1 > TIMESYNC_MAX_STRATUM || !better) {
+            _st.rejected++;
+            return false;
+        }
+    }
+
+    bool adopt = !fromSource;
+    if (adopt) memcpy(_st.sourceMac, mac, 6);
+    _srcStratum = s;
+    _srcSeenMono = rxMonoMs;
+    _st.sourceRssi = rssi;
+
+    uint32_t latency = expectedLatencyMs(rssi);
+    int64_t srcWall = (int64_t)secs * 1000 + ms + latency;
+    int64_t offset = srcWall - localWallMs;
+    _st.lastOffsetMs = (int32_t)offset;
+    _st.lastLatencyMs = (int32_t)latency;
+
+    int64_t corr;
+    if (adopt || llabs(offset) > TIMESYNC_STEP_MS) {
+        // New source or a jump: step, and measure drift from here
+        corr = offset;
+        restartDrift(rxMonoMs);
+        _st.errorEstMs = (int32_t)(latency / 2);
+    } else {
+        corr = offset / 2;
+        _driftSumMs += corr;
+        _st.errorEstMs = (int32_t)((_st.errorEstMs * 3 + llabs(offset)) / 4);
+
+        uint32_t span = rxMonoMs - _driftStartMono;
+        if (span >= TIMESYNC_DRIFT_MIN_MS) {
+            double rate = _driftSumMs / span;
+            if (rate > DRIFT_MAX_RATE) rate = DRIFT_MAX_RATE;
+            if (rate < -DRIFT_MAX_RATE) rate = -DRIFT_MAX_RATE;
+            _driftRate = rate;
+            _st.driftPpm = (float)(-rate * 1e6);
+            if (span > TIMESYNC_DRIFT_WINDOW_MS) {
+                // Keep half the history so a temperature change shows up within a window
+                _driftStartMono = rxMonoMs - span / 2;
+                _driftSumMs /= 2;
+            }
+        }
+    }
+
+    _st.adopted++;
+    _st.lastSyncMono = rxMonoMs ? rxMonoMs : 1;
+    _st.stratum = stratum(rxMonoMs);
+    *correctionMs = corr;
+    return corr != 0;
+}
+
+int64_t TimeSync::driftCorrection(uint32_t monoMs) {
+    if (!hasSource() || _driftRate == 0 || monoMs - _srcSeenMono >= TIMESYNC_HOLDOVER_MS) {
+        _driftLastMono = monoMs;
+        return 0;
+    }
+    uint32_t dt = monoMs - _driftLastMono;
+    _driftLastMono = monoMs;
+    _driftCarryMs += _driftRate * dt;
+    int64_t whole = (int64_t)_driftCarryMs;      // truncates toward zero
+    _driftCarryMs -= (double)whole;
+    _driftSumMs += (double)whole;                // part of what the source demanded
+    return whole;
+}
+
+#ifdef ARDUINO
+// ---------- Device glue ----------
+#include <Arduino.h>
+#include <sys/time.h>
+#include "ble.h"
+#include "wifi/time_get.h"
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+#ifndef TIMESYNC_NTP_VALID_MS
+#define TIMESYNC_NTP_VALID_MS   (3UL * 60 * 60 * 1000)   // SNTP re-syncs hourly; allow two misses
+#endif
+#ifndef TIMESYNC_DRIFT_TICK_MS
+#define TIMESYNC_DRIFT_TICK_MS  10000
+#endif
+
+static TimeSync g_sync;
+static uint32_t g_nextBeacon = 0;
+static uint32_t g_lastDriftTick = 0;
+static bool g_rtcNoted = false;
+
+static int64_t wallNowMs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void on_ble_event(const BleEvent* e, void*) {
+    if (e->type != BLE_EVT_SINGLE_TEXT || e->data.single.text_len < 1) return;
+    const char* text = e->data.single.text + 1;           // skip '>'
+    size_t len = e->data.single.text_len - 1;
+    if (!TimeSync::isBeacon(text, len)) return;
+
+    metric_inc(M_TIMESYNC_RX);
+    // The event waited in the queue since the scan callback; project the wall clock back
+    uint32_t rx = e->data.single.rx_ms;
+    int64_t wallAtRx = wallNowMs() - (int64_t)(millis() - rx);
+    int64_t corr = 0;
+    if (!g_sync.receive(e->data.single.mac, text, len, e->data.single.rssi, rx, wallAtRx, &corr)) return;
+
+    bool first = !timeValid();
+    timeAdjustMs(corr, TIME_SRC_MESH);
+    metric_inc(M_TIMESYNC_ADJUST);
+    metric_set(M_TIMESYNC_STRATUM, g_sync.stats().stratum);
+    metric_set(M_TIMESYNC_ERR_EST_MS, (uint32_t)g_sync.stats().errorEstMs);
+    if (first || llabs(corr) > TIMESYNC_STEP_MS) {
+        const uint8_t* m = e->data.single.mac;
+        GLOGI(LOGM_TIME, "Mesh time from %02X:%02X:%02X:%02X:%02X:%02X (stratum %c, rssi %d): %+lld ms",
+              m[0], m[1], m[2], m[3], m[4], m[5], text[2], e->data.single.rssi, (long long)corr);
+    }
+}
+
+void timesync_begin() {
+    ble_subscribe(on_ble_event, nullptr);
+    g_nextBeacon = millis() + TIMESYNC_BEACON_MS / 2 + random(0, 2000);
+}
+
+void timesync_tick() {
+    uint32_t now = millis();
+
+    uint32_t ntp = timeLastNtpSyncMs();
+    if (ntp && now - ntp < TIMESYNC_NTP_VALID_MS) {
+        g_sync.setLocalStratum(1, now);
+    } else if (!g_rtcNoted && timeSource() == TIME_SRC_RTC) {
+        g_rtcNoted = true;                                  // advertised for one holdover after boot
+        g_sync.setLocalStratum(TIMESYNC_RTC_STRATUM, now);
+    }
+
+    if (now - g_lastDriftTick >= TIMESYNC_DRIFT_TICK_MS) {
+        g_lastDriftTick = now;
+        int64_t d = g_sync.driftCorrection(now);
+        if (d) timeAdjustMs(d, TIME_SRC_MESH);
+    }
+
+    if ((int32_t)(now - g_nextBeacon) < 0) return;
+    g_nextBeacon = now + TIMESYNC_BEACON_MS + random(0, 2000);   // jitter keeps dongles apart
+    char text[TIMESYNC_TEXT_LEN + 1];
+    // Stamp as late as possible: ble_send_text() starts the burst right away
+    if (!g_sync.encode(wallNowMs(), now, text, sizeof(text))) return;
+    if (ble_send_text((const uint8_t*)text, TIMESYNC_TEXT_LEN, true) > 0) metric_inc(M_TIMESYNC_TX);
+    metric_set(M_TIMESYNC_STRATUM, g_sync.stats().stratum);
+}
+
+const TimeSyncStats& timesync_stats() {
+    return g_sync.stats();
+}
+
+const char* timesync_source() {
+    switch (timeSource()) {
+        case TIME_SRC_NTP:  return "ntp";
+        case TIME_SRC_RTC:  return "rtc";
+        case TIME_SRC_MESH: return "mesh";
+        default:            return "none";
+    }
+}
+#endif
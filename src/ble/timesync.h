@@ -0,0 +1,146 @@
+#pragma once
+/*
+  timesync.h — Wall-clock propagation over BLE for deployments without Internet.
+
+  A dongle whose clock came from NTP is stratum 1; a clock that only survived a soft reset
+  counts as TIMESYNC_RTC_STRATUM. Every dongle with valid time advertises a compact beacon in
+  the usual '>' text channel, stamped right before its advertising burst starts:
+
+        >~T<stratum><unix seconds, 8 hex><milliseconds, 3 hex>        e.g. ">~T266F1A2B03E8"
+
+  A receiver:
+  - follows the lowest stratum it hears and becomes that stratum + 1. It keeps its current
+    source until a strictly better one appears, or an equal one once the source has been
+    quiet for TIMESYNC_SOURCE_TIMEOUT_MS;
+  - re-advertises mesh time only while its source is heard (TIMESYNC_SOURCE_TIMEOUT_MS), but
+    refuses worse strata for TIMESYNC_HOLDOVER_MS after losing it. Downstream dongles fall
+    silent hop by hop meanwhile, so a lost NTP node cannot leave a timing loop behind;
+  - compensates the one-way delay with an estimate from the advertising model: TX setup, the
+    random advertising delay, and the advertising events a weak link is likely to miss (the
+    reception probability is estimated from RSSI);
+  - steps the clock for errors above TIMESYNC_STEP_MS and slews half the error otherwise,
+    which filters the reception jitter;
+  - estimates the local drift against the source from the corrections it applied and spreads
+    that correction between beacons.
+
+  TimeSync is plain C++ without Arduino, so tools/timesync_sim.cpp runs a whole mesh on the
+  host and reports the sync error. The device glue (BLE events, settimeofday, beacon TX) is
+  only built for the firmware.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TIMESYNC_MAX_STRATUM
+#define TIMESYNC_MAX_STRATUM        8
+#endif
+#ifndef TIMESYNC_RTC_STRATUM
+#define TIMESYNC_RTC_STRATUM        4                    // clock kept across a reset, origin unknown
+#endif
+#ifndef TIMESYNC_SOURCE_TIMEOUT_MS
+#define TIMESYNC_SOURCE_TIMEOUT_MS  (10UL * 60 * 1000)
+#endif
+#ifndef TIMESYNC_HOLDOVER_MS
+#define TIMESYNC_HOLDOVER_MS        ((TIMESYNC_MAX_STRATUM + 1) * TIMESYNC_SOURCE_TIMEOUT_MS)
+#endif
+#ifndef TIMESYNC_STEP_MS
+#define TIMESYNC_STEP_MS            250
+#endif
+#ifndef TIMESYNC_DRIFT_MIN_MS
+#define TIMESYNC_DRIFT_MIN_MS       (10UL * 60 * 1000)   // observation needed before drift is applied
+#endif
+#ifndef TIMESYNC_DRIFT_WINDOW_MS
+#define TIMESYNC_DRIFT_WINDOW_MS    (60UL * 60 * 1000)   // older corrections fade out past this
+#endif
+#ifndef TIMESYNC_BEACON_MS
+#define TIMESYNC_BEACON_MS          30000
+#endif
+
+// One-way delay model (see TimeSync::expectedLatencyMs)
+#ifndef TIMESYNC_TX_SETUP_MS
+#define TIMESYNC_TX_SETUP_MS        6       // adv stop/set data/start through the host stack
+#endif
+#ifndef TIMESYNC_RX_PROC_MS
+#define TIMESYNC_RX_PROC_MS         3       // controller report -> scan callback
+#endif
+#ifndef TIMESYNC_ADV_INTERVAL_MS
+#define TIMESYNC_ADV_INTERVAL_MS    30      // BLEAdvertising default: 20..40 ms
+#endif
+#ifndef TIMESYNC_ADV_BURST_MS
+#define TIMESYNC_ADV_BURST_MS       100     // ble_send_text() burst length
+#endif
+#ifndef TIMESYNC_SCAN_DUTY
+#define TIMESYNC_SCAN_DUTY          0.75f   // ble_start_listening(): window 60 / interval 80
+#endif
+
+#define TIMESYNC_PREFIX     "~T"
+#define TIMESYNC_TEXT_LEN   14              // "~T" + stratum + 8 + 3
+
+typedef struct {
+    uint8_t  stratum;            // 0 = nothing to offer; 1 = NTP; n = n-1 hops from NTP
+    uint8_t  sourceMac[6];       // current mesh source (zeros when none)
+    int8_t   sourceRssi;
+    int32_t  lastOffsetMs;       // last measured source - local, after delay compensation
+    int32_t  lastLatencyMs;      // delay estimate used for it
+    int32_t  errorEstMs;         // smoothed |offset| seen at corrections (on-device sync error)
+    float    driftPpm;           // local clock rate vs. the source (+ = local runs fast)
+    uint32_t beaconsRx;
+    uint32_t beaconsTx;
+    uint32_t adopted;            // corrections applied from beacons
+    uint32_t rejected;           // beacons ignored (worse stratum, authoritative, malformed)
+    uint32_t lastSyncMono;       // monotonic ms of the last beacon correction (0 = never)
+} TimeSyncStats;
+
+class TimeSync {
+public:
+    TimeSync();
+
+    // Local time source: 0 = none, 1 = NTP (beacons are then ignored), TIMESYNC_RTC_STRATUM
+    // for a clock kept across a reset.
+    void setLocalStratum(uint8_t stratum, uint32_t monoMs);
+
+    // Stratum this node would advertise now (0 = nothing to offer).
+    uint8_t stratum(uint32_t monoMs) const { return rank(monoMs, TIMESYNC_SOURCE_TIMEOUT_MS); }
+
+    // Beacon text (without the leading '>') for local wall time `wallMs`.
+    bool encode(int64_t wallMs, uint32_t monoMs, char* out, size_t cap);
+
+    // Feeds a received beacon. When the local clock should move, returns true and sets
+    // *correctionMs (add to the wall clock). `localWallMs` is the wall clock at reception.
+    bool receive(const uint8_t mac[6], const char* text, size_t len, int8_t rssi,
+                 uint32_t rxMonoMs, int64_t localWallMs, int64_t* correctionMs);
+
+    // Drift compensation due since the last call (ms to add to the wall clock).
+    int64_t driftCorrection(uint32_t monoMs);
+
+    // One-way delay estimate (advertising start -> scan callback) for a link of this RSSI.
+    static uint32_t expectedLatencyMs(int8_t rssi);
+
+    static bool isBeacon(const char* text, size_t len);
+    const TimeSyncStats& stats() const { return _st; }
+
+private:
+    bool hasSource() const;
+    uint8_t rank(uint32_t monoMs, uint32_t sourceValidMs) const;
+    void restartDrift(uint32_t monoMs);
+
+    TimeSyncStats _st;
+    uint8_t  _localStratum;
+    uint32_t _localMono;
+    uint8_t  _srcStratum;        // 0 = no mesh source
+    uint32_t _srcSeenMono;
+    // Drift: corrections applied while following the source, over monotonic time
+    uint32_t _driftStartMono;
+    double   _driftSumMs;
+    uint32_t _driftLastMono;
+    double   _driftCarryMs;
+    double   _driftRate;         // ms of correction per ms of monotonic time
+};
+
+#ifdef ARDUINO
+// ---------- Device glue ----------
+void timesync_begin();           // subscribes to BLE text; call after ble_init()
+void timesync_tick();            // time source, drift compensation, beacon TX; call from loop()
+const TimeSyncStats& timesync_stats();
+const char* timesync_source();   // "ntp", "rtc", "mesh" or "none"
+#endif
@@ -0,0 +1,279 @@
+#include "warmcache.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include <sys/time.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_rom_crc.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+#define WARM_MAGIC   0x314D5257u     // "WRM1"
+#define WARM_VERSION 2            // 2: in-flight records keyed by (MAC, id)
+#define KEY_FREE     0xFFFFFFFFFFFFFFFFull   // no message id reaches 0xFFFF
+
+// Every section starts with the CRC32 of the bytes that follow it
+struct MsgSection {
+    uint32_t crc;
+    uint8_t count;
+    uint8_t head;                    // next line to overwrite once full
+    char lines[WARM_MSG_MAX][WARM_MSG_LEN];
+};
+
+struct SeenSection {
+    uint32_t crc;
+    uint32_t head;
+    uint32_t hash[WARM_SEEN_MAX];
+    uint32_t at[WARM_SEEN_MAX];      // rtcMs() when seen; 0 = empty
+};
+
+struct InflightRec {
+    uint32_t crc;
+    uint16_t used;                   // bytes of `text` in use
+    uint32_t bitmap;                 // parcel indexes 0..31 present
+    uint32_t at;                     // rtcMs() of the last parcel
+    uint64_t key;                    // KEY_FREE when unused
+    char text[WARM_PARCEL_BYTES];
+};
+
+struct Region {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t bootCount;
+    MsgSection msgs;
+    SeenSection seen;
+    InflightRec inflight[WARM_INFLIGHT_MAX];
+};
+
+RTC_NOINIT_ATTR static Region s_rtc;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool s_ready = false;
+static WarmStats s_stats = {};
+
+template <class T>
+static uint32_t crcOf(const T& sec) {
+    return esp_rom_crc32_le(0, (const uint8_t*)&sec + sizeof(uint32_t), sizeof(T) - sizeof(uint32_t));
+}
+
+template <class T>
+static void seal(T& sec) {
+    sec.crc = crcOf(sec);
+}
+
+// Wall clock in ms (low 32 bits): RTC-backed, so it keeps running across a soft reset
+static uint32_t rtcMs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint32_t)((uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+static void clearMsgs() {
+    memset(&s_rtc.msgs, 0, sizeof(s_rtc.msgs));
+    seal(s_rtc.msgs);
+}
+
+static void clearSeen() {
+    memset(&s_rtc.seen, 0, sizeof(s_rtc.seen));
+    seal(s_rtc.seen);
+}
+
+static void clearRec(InflightRec& r) {
+    memset(&r, 0, sizeof(r));
+    r.key = KEY_FREE;
+    seal(r);
+}
+
+static bool warmReason(esp_reset_reason_t r) {
+    switch (r) {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+        case ESP_RST_DEEPSLEEP:
+            return true;
+        default:
+            return false;       // power-on, brownout, reset pin: RTC RAM content is garbage
+    }
+}
+
+bool warm_restore() {
+    if (s_ready) return s_stats.warm;
+    esp_reset_reason_t reason = esp_reset_reason();
+    s_stats = {};
+    s_stats.resetReason = (uint8_t)reason;
+
+    bool valid = warmReason(reason) && s_rtc.magic == WARM_MAGIC &&
+                 s_rtc.version == WARM_VERSION && s_rtc.size == sizeof(Region);
+    if (!valid) {
+        s_rtc.magic = WARM_MAGIC;
+        s_rtc.version = WARM_VERSION;
+        s_rtc.size = sizeof(Region);
+        s_rtc.bootCount = 0;
+        clearMsgs();
+        clearSeen();
+        for (auto& r : s_rtc.inflight) clearRec(r);
+        s_ready = true;
+        metric_set(M_WARM_BOOTS, 0);
+        return false;
+    }
+
+    s_stats.warm = true;
+    s_stats.bootCount = ++s_rtc.bootCount;
+    if (crcOf(s_rtc.msgs) != s_rtc.msgs.crc || s_rtc.msgs.count > WARM_MSG_MAX || s_rtc.msgs.head >= WARM_MSG_MAX) {
+        clearMsgs();
+        s_stats.badSections++;
+    }
+    if (crcOf(s_rtc.seen) != s_rtc.seen.crc || s_rtc.seen.head >= WARM_SEEN_MAX) {
+        clearSeen();
+        s_stats.badSections++;
+    }
+    for (auto& r : s_rtc.inflight) {
+        if (crcOf(r) != r.crc || r.used > sizeof(r.text)) {
+            clearRec(r);
+            s_stats.badSections++;
+        }
+    }
+
+    s_stats.msgs = s_rtc.msgs.count;
+    for (uint32_t at : s_rtc.seen.at) {
+        if (at) s_stats.seen++;
+    }
+    for (auto& r : s_rtc.inflight) {
+        if (r.key == KEY_FREE) continue;
+        s_stats.inflight++;
+        for (uint16_t i = 0; i < r.used; i++) {
+            if (r.text[i] == '\0') s_stats.parcels++;
+        }
+    }
+    s_ready = true;
+    metric_set(M_WARM_BOOTS, s_stats.bootCount);
+    GLOGI(LOGM_APP, "Warm boot #%lu (reset reason %u): %u messages, %u dedupe entries, %u in-flight (%u parcels) restored",
+          (unsigned long)s_stats.bootCount, (unsigned)reason, s_stats.msgs, s_stats.seen,
+          s_stats.inflight, s_stats.parcels);
+    if (s_stats.badSections) {
+        GLOGW(LOGM_APP, "Warm boot: %u cache sections failed their CRC and were dropped", s_stats.badSections);
+    }
+    return true;
+}
+
+void warm_stats(WarmStats* out) {
+    if (out) *out = s_stats;
+}
+
+// ---------- Display lines ----------
+void warm_msg_push(const char* line) {
+    if (!s_ready || !line) return;
+    portENTER_CRITICAL(&s_mux);
+    MsgSection& m = s_rtc.msgs;
+    uint8_t at;
+    if (m.count < WARM_MSG_MAX) {
+        at = (uint8_t)((m.head + m.count) % WARM_MSG_MAX);
+        m.count++;
+    } else {
+        at = m.head;
+        m.head = (uint8_t)((m.head + 1) % WARM_MSG_MAX);
+    }
+    size_t n = strnlen(line, WARM_MSG_LEN - 1);
+    while (n > 0 && ((uint8_t)line[n] & 0xC0) == 0x80) n--;     // never cut a UTF-8 sequence
+    memcpy(m.lines[at], line, n);
+    m.lines[at][n] = '\0';
+    seal(m);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+uint8_t warm_msgs(char out[][WARM_MSG_LEN], uint8_t max) {
+    if (!s_ready || !out) return 0;
+    const MsgSection& m = s_rtc.msgs;
+    uint8_t n = m.count < max ? m.count : max;
+    uint8_t skip = m.count - n;                   // keep the newest `max`
+    for (uint8_t i = 0; i < n; i++) {
+        memcpy(out[i], m.lines[(m.head + skip + i) % WARM_MSG_MAX], WARM_MSG_LEN);
+    }
+    return n;
+}
+
+// ---------- Dedupe window ----------
+void warm_seen_add(uint32_t hash) {
+    if (!s_ready) return;
+    uint32_t now = rtcMs();
+    portENTER_CRITICAL(&s_mux);
+    SeenSection& s = s_rtc.seen;
+    s.hash[s.head] = hash;
+    s.at[s.head] = now ? now : 1;
+    s.head = (s.head + 1) % WARM_SEEN_MAX;
+    seal(s);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void warm_seen_replay(WarmSeenFn fn) {
+    if (!s_ready || !fn) return;
+    uint32_t now = rtcMs();
+    const SeenSection& s = s_rtc.seen;
+    for (int i = 0; i < WARM_SEEN_MAX; i++) {
+        if (s.at[i]) fn(s.hash[i], now - s.at[i]);
+    }
+}
+
+// ---------- In-flight parcels ----------
+static InflightRec* findRec(uint64_t key) {
+    for (auto& r : s_rtc.inflight) {
+        if (r.key == key) return &r;
+    }
+    return nullptr;
+}
+
+void warm_parcel_add(uint64_t key, int index, const char* parcel, size_t len) {
+    if (!s_ready || !parcel || key == KEY_FREE) return;
+    uint32_t now = rtcMs();
+    portENTER_CRITICAL(&s_mux);
+    InflightRec* r = findRec(key);
+    if (!r) {
+        // Free record, else the message that has been quiet the longest
+        for (auto& c : s_rtc.inflight) {
+            if (c.key == KEY_FREE) { r = &c; break; }
+            if (!r || (int32_t)(c.at - r->at) < 0) r = &c;
+        }
+        clearRec(*r);
+        r->key = key;
+    }
+    bool known = index >= 0 && index < 32 && (r->bitmap & (1u << index));
+    if (!known && r->used + len + 1 <= sizeof(r->text)) {
+        memcpy(r->text + r->used, parcel, len);
+        r->text[r->used + len] = '\0';
+        r->used += (uint16_t)(len + 1);
+        if (index >= 0 && index < 32) r->bitmap |= 1u << index;
+    }
+    r->at = now ? now : 1;
+    seal(*r);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void warm_parcel_clear(uint64_t key) {
+    if (!s_ready) return;
+    portENTER_CRITICAL(&s_mux);
+    InflightRec* r = findRec(key);
+    if (r) clearRec(*r);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void warm_parcel_replay(WarmParcelFn fn) {
+    if (!s_ready || !fn) return;
+    uint32_t now = rtcMs();
+    for (auto& r : s_rtc.inflight) {
+        if (r.key == KEY_FREE) continue;
+        uint32_t age = now - r.at;
+        uint64_t key = r.key;
+        char copy[WARM_PARCEL_BYTES];             // `fn` may clear the record
+        uint16_t used = r.used;
+        memcpy(copy, r.text, used);
+        for (uint16_t i = 0; i < used;) {
+            size_t n = strnlen(copy + i, used - i);
+            if (i + n >= used) break;             // unterminated tail
+            fn(key, copy + i, age);
+            i += (uint16_t)(n + 1);
+        }
+    }
+}
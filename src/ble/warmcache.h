@@ -0,0 +1,71 @@
+#pragma once
+/*
+  warmcache.h — Receive state that survives a soft reset, kept in RTC no-init memory.
+
+  A panic, watchdog or esp_restart() used to wipe the shown messages, the dedupe window and
+  every partly assembled multi-parcel message. The hot paths now mirror that state into a
+  small RTC_NOINIT_ATTR region as it changes: plain memory stores, no flash writes. At the next
+  boot warm_restore() checks the region and, when valid, ble_init() and initDisplay() pick the
+  state back up:
+
+  - the last WARM_MSG_MAX display lines;
+  - the last WARM_SEEN_MAX dedupe hashes with their age, so a payload repeated right across
+    the reset is still suppressed;
+  - up to WARM_INFLIGHT_MAX in-flight messages: the parcels received so far (WARM_PARCEL_BYTES
+    of text per message) and a bitmap of the parcel indexes they cover.
+
+  Every section carries its own CRC32, so a reset in the middle of an update costs that
+  section only. The region is ignored after power-on and brownout, where RTC memory is not
+  retained. Ages are taken from the RTC-backed wall clock, which keeps counting across soft
+  resets.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef WARM_MSG_MAX
+#define WARM_MSG_MAX        3
+#endif
+#ifndef WARM_MSG_LEN
+#define WARM_MSG_LEN        128     // display lines are truncated to this (NUL included)
+#endif
+#ifndef WARM_SEEN_MAX
+#define WARM_SEEN_MAX       64
+#endif
+#ifndef WARM_INFLIGHT_MAX
+#define WARM_INFLIGHT_MAX   4
+#endif
+#ifndef WARM_PARCEL_BYTES
+#define WARM_PARCEL_BYTES   448     // NUL-separated parcel text per in-flight message
+#endif
+
+typedef struct {
+    bool warm;              // the region was valid at boot
+    uint8_t resetReason;    // esp_reset_reason() of this boot
+    uint32_t bootCount;     // consecutive warm boots
+    uint8_t msgs;           // restored per section
+    uint8_t seen;
+    uint8_t inflight;
+    uint16_t parcels;
+    uint8_t badSections;    // sections dropped for a CRC mismatch
+} WarmStats;
+
+// Call first in setup(): validates the region (or clears it on a cold boot).
+bool warm_restore();
+void warm_stats(WarmStats* out);
+
+// Display lines, oldest first
+void warm_msg_push(const char* line);
+uint8_t warm_msgs(char out[][WARM_MSG_LEN], uint8_t max);
+
+// Dedupe window
+void warm_seen_add(uint32_t hash);
+typedef void (*WarmSeenFn)(uint32_t hash, uint32_t ageMs);
+void warm_seen_replay(WarmSeenFn fn);
+
+// In-flight assembler: `key` is the assembler key (sender MAC and message id, see
+// inflighttable.h), `index` the parcel index
+void warm_parcel_add(uint64_t key, int index, const char* parcel, size_t len);
+void warm_parcel_clear(uint64_t key);
+typedef void (*WarmParcelFn)(uint64_t key, const char* parcel, uint32_t ageMs);
+void warm_parcel_replay(WarmParcelFn fn);
@@ -0,0 +1,301 @@
+#include "wireformat.h"
+
+#include <string.h>
+
+// 6-bit alphabet: 0 = space, 1..26 a-z, 27..52 A-Z, 53..62 0-9, 63 = escape into kPunct.
+// A trailing escape with nothing after it is padding.
+#define SYM_ESC 63
+static const char kPunct[] = ".,!?-:;'\"/()@#+=&%*_<>[]{}~$^|\\`";
+
+static int symOf(char c) {
+    if (c == ' ') return 0;
+    if (c >= 'a' && c <= 'z') return 1 + (c - 'a');
+    if (c >= 'A' && c <= 'Z') return 27 + (c - 'A');
+    if (c >= '0' && c <= '9') return 53 + (c - '0');
+    return -1;
+}
+
+static int punctOf(char c) {
+    const char* p = c ? strchr(kPunct, c) : nullptr;
+    return p ? (int)(p - kPunct) : -1;
+}
+
+static char charOf(int sym) {
+    if (sym == 0) return ' ';
+    if (sym <= 26) return (char)('a' + sym - 1);
+    if (sym <= 52) return (char)('A' + sym - 27);
+    return (char)('0' + sym - 53);
+}
+
+uint16_t wire_crc16(const uint8_t* data, size_t len, uint16_t crc) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+bool wire_parse(const uint8_t* data, size_t len, WireFrame* out) {
+    if (!data || len < WIRE_HDR_LEN + WIRE_CRC_LEN || len > WIRE_FRAME_MAX || data[0] != WIRE_VERSION_1) return false;
+    uint16_t crc = (uint16_t)(data[len - 2] | (data[len - 1] << 8));
+    if (wire_crc16(data, len - WIRE_CRC_LEN) != crc) return false;
+    out->id = (uint16_t)(data[1] | (data[2] << 8));
+    out->index = data[3];
+    out->count = data[4];
+    out->flags = data[5];
+    out->payloadLen = (uint8_t)(len - WIRE_HDR_LEN - WIRE_CRC_LEN);
+    memcpy(out->payload, data + WIRE_HDR_LEN, out->payloadLen);
+    return out->count > 0 && out->index < out->count;
+}
+
+size_t wire_pack6(const char* text, size_t len, uint8_t* out, size_t cap, size_t* consumed) {
+    size_t maxSyms = cap * 8 / 6;
+    size_t syms = 0, i = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t w = 0;
+    auto put = [&](int s) {
+        acc = (acc << 6) | (uint32_t)s;
+        bits += 6;
+        while (bits >= 8) {
+            bits -= 8;
+            out[w++] = (uint8_t)(acc >> bits);
+        }
+        syms++;
+    };
+    for (; i < len; i++) {
+        int s = symOf(text[i]);
+        if (s >= 0) {
+            if (syms + 1 > maxSyms) break;
+            put(s);
+            continue;
+        }
+        int p = punctOf(text[i]);
+        if (p < 0 || syms + 2 > maxSyms) break;
+        put(SYM_ESC);
+        put(p);
+    }
+    if (bits > 0) {
+        // Pad with ones: a whole 6-bit pad reads back as a trailing escape, a partial one is dropped
+        int pad = 8 - bits;
+        out[w++] = (uint8_t)((acc << pad) | ((1u << pad) - 1));
+    }
+    *consumed = i;
+    return w;
+}
+
+size_t wire_unpack6(const uint8_t* in, size_t n, char* out, size_t cap) {
+    size_t syms = n * 8 / 6, w = 0;
+    bool esc = false;
+    for (size_t k = 0; k < syms; k++) {
+        size_t bit = k * 6;
+        uint32_t word = ((uint32_t)in[bit / 8] << 8) | (bit / 8 + 1 < n ? in[bit / 8 + 1] : 0);
+        int s = (int)((word >> (10 - bit % 8)) & 0x3F);
+        char c;
+        if (esc) {
+            if (s >= (int)sizeof(kPunct) - 1) return (size_t)-1;
+            c = kPunct[s];
+            esc = false;
+        } else if (s == SYM_ESC) {
+            esc = true;
+            continue;
+        } else {
+            c = charOf(s);
+        }
+        if (w + 1 >= cap) return (size_t)-1;
+        out[w++] = c;
+    }
+    out[w] = '\0';
+    return w;
+}
+
+// Raw UTF-8 bytes that fit `cap` without splitting a sequence
+static size_t rawFit(const char* text, size_t len, size_t cap) {
+    if (len <= cap) return len;
+    size_t n = cap;
+    while (n > 0 && ((uint8_t)text[n] & 0xC0) == 0x80) n--;
+    return n;
+}
+
+// Payload for one run of text: packed when that carries more, raw otherwise
+static size_t encodeChunk(const char* text, size_t len, uint8_t* out, size_t cap, uint8_t* flags, size_t* consumed) {
+    uint8_t packed[WIRE_PAYLOAD_MAX];
+    size_t packedUsed = 0;
+    size_t packedLen = wire_pack6(text, len, packed, cap, &packedUsed);
+    size_t raw = rawFit(text, len, cap);
+    if (packedUsed > raw) {
+        memcpy(out, packed, packedLen);
+        *flags |= WIRE_FLAG_PACKED;
+        *consumed = packedUsed;
+        return packedLen;
+    }
+    memcpy(out, text, raw);
+    *consumed = raw;
+    return raw;
+}
+
+static uint8_t finishFrame(uint8_t* f, uint16_t id, uint8_t index, uint8_t count, uint8_t flags, size_t payloadLen) {
+    f[0] = WIRE_VERSION_1;
+    f[1] = (uint8_t)id;
+    f[2] = (uint8_t)(id >> 8);
+    f[3] = index;
+    f[4] = count;
+    f[5] = flags;
+    size_t n = WIRE_HDR_LEN + payloadLen;
+    uint16_t crc = wire_crc16(f, n);
+    f[n] = (uint8_t)crc;
+    f[n + 1] = (uint8_t)(crc >> 8);
+    return (uint8_t)(n + WIRE_CRC_LEN);
+}
+
+int wire_encode_message(uint16_t id, const char* from, const char* to, const char* text, size_t len,
+                        uint8_t frames[][WIRE_FRAME_MAX], uint8_t frameLen[], int maxFrames) {
+    if (!text || maxFrames < 2 || len > 0xFFFF) return 0;
+
+    // Data parcels first; the header needs the count
+    int n = 1;
+    for (size_t pos = 0; pos < len || n == 1;) {
+        if (n >= maxFrames || n > 255) return 0;
+        uint8_t flags = 0;
+        size_t used = 0;
+        size_t pl = encodeChunk(text + pos, len - pos, frames[n] + WIRE_HDR_LEN, WIRE_PAYLOAD_MAX, &flags, &used);
+        if (used == 0 && pos < len) return 0;     // an unencodable byte sequence
+        frameLen[n] = (uint8_t)pl;
+        frames[n][5] = flags;
+        pos += used;
+        n++;
+        if (len == 0) break;
+    }
+    for (int i = 1; i < n; i++) {
+        frameLen[i] = finishFrame(frames[i], id, (uint8_t)i, (uint8_t)n, frames[i][5], frameLen[i]);
+    }
+
+    char route[2 * WIRE_ID_MAX];
+    size_t rl = 0;
+    for (const char* p = from ? from : ""; *p && rl < WIRE_ID_MAX - 1; p++) route[rl++] = *p;
+    route[rl++] = ':';
+    for (const char* p = to ? to : ""; *p && rl < sizeof(route) - 1; p++) route[rl++] = *p;
+
+    uint8_t* h = frames[0] + WIRE_HDR_LEN;
+    uint16_t textCrc = wire_crc16((const uint8_t*)text, len);
+    h[0] = (uint8_t)textCrc;
+    h[1] = (uint8_t)(textCrc >> 8);
+    h[2] = (uint8_t)len;
+    h[3] = (uint8_t)(len >> 8);
+    uint8_t flags = WIRE_FLAG_HEADER;
+    size_t used = 0;
+    size_t pl = encodeChunk(route, rl, h + 4, WIRE_PAYLOAD_MAX - 4, &flags, &used);
+    if (used < rl) return 0;                     // callsigns too long for one header
+    frameLen[0] = finishFrame(frames[0], id, 0, (uint8_t)n, flags, 4 + pl);
+    return n;
+}
+
+// ---------- Assembler ----------
+WireAssembler::WireAssembler() : _crcFail(0) {
+    memset(_slots, 0, sizeof(_slots));
+    _out[0] = '\0';
+}
+
+WireAssembler::Slot* WireAssembler::find(uint64_t peer, uint16_t id, uint8_t count, uint32_t nowMs) {
+    Slot* freeSlot = nullptr;
+    Slot* oldest = nullptr;
+    for (auto& s : _slots) {
+        if (s.count && s.peer == peer && s.id == id && s.count == count) return &s;
+        if (!s.count) {
+            if (!freeSlot) freeSlot = &s;
+        } else if (!oldest || (int32_t)(s.touchMs - oldest->touchMs) < 0) {
+            oldest = &s;
+        }
+    }
+    Slot* s = freeSlot ? freeSlot : oldest;
+    memset(s, 0, sizeof(*s));
+    s->peer = peer;
+    s->id = id;
+    s->count = count;
+    s->touchMs = nowMs;
+    return s;
+}
+
+static void copyId(char* dst, const char* src) {
+    size_t n = strnlen(src, WIRE_ID_MAX - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+static bool decodeChunk(const WireFrame& f, size_t skip, char* out, size_t cap) {
+    const uint8_t* p = f.payload + skip;
+    size_t n = f.payloadLen - skip;
+    if (f.flags & WIRE_FLAG_PACKED) return wire_unpack6(p, n, out, cap) != (size_t)-1;
+    if (n + 1 > cap) return false;
+    memcpy(out, p, n);
+    out[n] = '\0';
+    return true;
+}
+
+bool wire_header_route(const WireFrame& f, char from[WIRE_ID_MAX], char to[WIRE_ID_MAX]) {
+    if (f.index != 0 || !(f.flags & WIRE_FLAG_HEADER) || f.payloadLen < 4) return false;
+    char route[2 * WIRE_ID_MAX + 2];
+    if (!decodeChunk(f, 4, route, sizeof(route))) return false;
+    char* colon = strchr(route, ':');
+    if (colon) *colon = '\0';
+    copyId(from, route);
+    copyId(to, colon ? colon + 1 : "");
+    return true;
+}
+
+bool WireAssembler::add(const WireFrame& f, uint64_t peer, uint32_t nowMs, WireMessage* done) {
+    if (f.count > WIRE_MAX_PARCELS || f.count < 2) return false;
+    Slot* s = find(peer, f.id, f.count, nowMs);
+    s->touchMs = nowMs;
+    if (s->have & (1u << f.index)) return false;
+
+    if (f.index == 0) {
+        if (!wire_header_route(f, s->from, s->to)) return false;
+        s->textCrc = (uint16_t)(f.payload[0] | (f.payload[1] << 8));
+        s->textLen = (uint16_t)(f.payload[2] | (f.payload[3] << 8));
+    } else if (!decodeChunk(f, 0, s->chunk[f.index], WIRE_CHUNK_MAX)) {
+        return false;
+    }
+    s->have |= 1u << f.index;
+
+    uint32_t all = f.count >= 32 ? 0xFFFFFFFFu : ((1u << f.count) - 1);
+    if ((s->have & all) != all) return false;
+
+    size_t w = 0;
+    for (int i = 1; i < s->count; i++) {
+        size_t n = strlen(s->chunk[i]);
+        memcpy(_out + w, s->chunk[i], n);
+        w += n;
+    }
+    _out[w] = '\0';
+    bool ok = w == s->textLen && wire_crc16((const uint8_t*)_out, w) == s->textCrc;
+    if (ok && done) {
+        done->id = s->id;
+        memcpy(done->from, s->from, WIRE_ID_MAX);
+        memcpy(done->to, s->to, WIRE_ID_MAX);
+        done->crc = s->textCrc;
+        done->text = _out;
+        done->len = w;
+    }
+    if (!ok) _crcFail++;
+    memset(s, 0, sizeof(*s));
+    return ok;
+}
+
+void WireAssembler::sweep(uint32_t nowMs) {
+    for (auto& s : _slots) {
+        if (s.count && nowMs - s.touchMs >= WIRE_TTL_MS) memset(&s, 0, sizeof(s));
+    }
+}
+
+size_t WireAssembler::drop(uint64_t peer, uint16_t id) {
+    size_t bytes = 0;
+    for (auto& s : _slots) {
+        if (!s.count || s.peer != peer || s.id != id) continue;
+        for (int i = 1; i < s.count; i++) {
+            if (s.have & (1u << i)) bytes += strlen(s.chunk[i]);
+        }
+        memset(&s, 0, sizeof(s));
+    }
+    return bytes;
+}
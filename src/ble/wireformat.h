@@ -0,0 +1,115 @@
+#pragma once
+/*
+  wireformat.h — Compact binary framing for BLE messages, next to the '>' text format.
+
+  A text parcel spends its service data on ASCII framing: '>', a two-letter id, a decimal
+  index, ':' and, in the header, a 4-letter checksum. The binary frame is
+
+        byte 0     version (0xB1): never '>', so text-only peers drop the frame unseen
+        byte 1..2  message id, little endian
+        byte 3     parcel index (0 = header)
+        byte 4     parcel count, header included
+        byte 5     flags (WIRE_FLAG_*)
+        ...        payload, up to WIRE_PAYLOAD_MAX bytes
+        last 2     CRC-16/CCITT-FALSE of everything before it
+
+  The header parcel carries the CRC-16 and length of the whole text plus "FROM:DEST". Text is
+  packed 6 bits per character when it fits the alphabet (space, a-z, A-Z, 0-9; common
+  punctuation costs an escape symbol): 21 characters in the 16 payload bytes. Anything else,
+  emoji included, goes as raw UTF-8 in that parcel. The encoder picks per parcel whichever
+  carries more text.
+
+  Plain C++ without Arduino, so tools/wire_efficiency.cpp can compare both formats on the host.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef WIRE_FRAME_MAX
+#define WIRE_FRAME_MAX      24      // service data bytes in one advertisement (ADV_TEXT_MAX)
+#endif
+#define WIRE_VERSION_1      0xB1
+#define WIRE_HDR_LEN        6
+#define WIRE_CRC_LEN        2
+#define WIRE_PAYLOAD_MAX    (WIRE_FRAME_MAX - WIRE_HDR_LEN - WIRE_CRC_LEN)
+
+#define WIRE_FLAG_PACKED    0x01    // payload is 6-bit packed text
+#define WIRE_FLAG_HEADER    0x02    // parcel 0: text CRC-16, text length, "FROM:DEST"
+
+#ifndef WIRE_MAX_PARCELS
+#define WIRE_MAX_PARCELS    32      // receive side: longer messages are not assembled
+#endif
+#ifndef WIRE_SLOTS
+#define WIRE_SLOTS          4       // messages assembled at once
+#endif
+#ifndef WIRE_TTL_MS
+#define WIRE_TTL_MS         (10UL * 60 * 1000)
+#endif
+#define WIRE_ID_MAX         16      // callsign buffer, NUL included
+#define WIRE_CHUNK_MAX      24      // decoded text per parcel, NUL included
+
+typedef struct {
+    uint16_t id;
+    uint8_t  index;
+    uint8_t  count;
+    uint8_t  flags;
+    uint8_t  payloadLen;
+    uint8_t  payload[WIRE_PAYLOAD_MAX];
+} WireFrame;
+
+uint16_t wire_crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
+
+// Frame bytes -> fields; false on a wrong version, size or CRC.
+bool wire_parse(const uint8_t* data, size_t len, WireFrame* out);
+
+// Packs as much of `text` as fits `cap` bytes; *consumed = input bytes used. Returns bytes written.
+size_t wire_pack6(const char* text, size_t len, uint8_t* out, size_t cap, size_t* consumed);
+// Returns characters written (NUL-terminated), or SIZE_MAX when the symbols are invalid.
+size_t wire_unpack6(const uint8_t* in, size_t n, char* out, size_t cap);
+
+// Splits a message into frames. Returns the frame count (0 if it does not fit `maxFrames`).
+int wire_encode_message(uint16_t id, const char* from, const char* to, const char* text, size_t len,
+                        uint8_t frames[][WIRE_FRAME_MAX], uint8_t frameLen[], int maxFrames);
+
+// Sender and destination of a header frame (index 0); false for any other frame.
+bool wire_header_route(const WireFrame& f, char from[WIRE_ID_MAX], char to[WIRE_ID_MAX]);
+
+typedef struct {
+    uint16_t id;
+    char from[WIRE_ID_MAX];
+    char to[WIRE_ID_MAX];
+    uint16_t crc;
+    const char* text;       // valid until the next add()
+    size_t len;
+} WireMessage;
+
+class WireAssembler {
+public:
+    WireAssembler();
+    // Feeds one parsed frame from `peer` (the advertiser address, so equal ids from two senders
+    // stay apart). Returns true when it completed a message (CRC checked).
+    bool add(const WireFrame& f, uint64_t peer, uint32_t nowMs, WireMessage* done);
+    void sweep(uint32_t nowMs);
+    // Forgets message `id` of `peer`; returns the text bytes it was holding.
+    size_t drop(uint64_t peer, uint16_t id);
+    uint32_t crcFailures() const { return _crcFail; }
+
+private:
+    struct Slot {
+        uint64_t peer;
+        uint16_t id;
+        uint8_t count;          // 0 = free
+        uint32_t have;          // bitmap of received parcels
+        uint32_t touchMs;
+        uint16_t textCrc;
+        uint16_t textLen;
+        char from[WIRE_ID_MAX];
+        char to[WIRE_ID_MAX];
+        char chunk[WIRE_MAX_PARCELS][WIRE_CHUNK_MAX];
+    };
+    Slot* find(uint64_t peer, uint16_t id, uint8_t count, uint32_t nowMs);
+
+    Slot _slots[WIRE_SLOTS];
+    char _out[WIRE_MAX_PARCELS * (WIRE_CHUNK_MAX - 1) + 1];
+    uint32_t _crcFail;
+};
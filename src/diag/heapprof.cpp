@@ -0,0 +1,295 @@
+// heapprof.cpp — link-time malloc/free wrappers + site table + heap history ring
+#include "heapprof.h"
+#include "metrics.h"
+
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+
+// ---------- Heap history (always on) ----------
+static HeapSample g_hist[HEAPPROF_HISTORY];
+static uint16_t   g_hist_head = 0;
+static uint16_t   g_hist_count = 0;
+
+void heapprof_tick() {
+  static uint32_t last = 0;
+  uint32_t now = millis();
+  if (last != 0 && (uint32_t)(now - last) < HEAPPROF_SAMPLE_MS) return;
+  last = now ? now : 1;
+
+  HeapSample& s = g_hist[g_hist_head];
+  s.uptime_s      = now / 1000;
+  s.free_bytes    = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  s.largest_block = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  g_hist_head = (uint16_t)((g_hist_head + 1) % HEAPPROF_HISTORY);
+  if (g_hist_count < HEAPPROF_HISTORY) ++g_hist_count;
+}
+
+size_t heapprof_history(HeapSample* out, size_t cap) {
+  size_t n = g_hist_count < cap ? g_hist_count : cap;
+  size_t start = (g_hist_head + HEAPPROF_HISTORY - g_hist_count) % HEAPPROF_HISTORY;
+  for (size_t i = 0; i < n; ++i) out[i] = g_hist[(start + i) % HEAPPROF_HISTORY];
+  return n;
+}
+
+#ifdef GEOGRAM_HEAP_PROFILE
+
+#ifndef HEAPPROF_LIVE_SLOTS
+#define HEAPPROF_LIVE_SLOTS 1024   // power of two; 8 bytes each
+#endif
+static_assert((HEAPPROF_LIVE_SLOTS & (HEAPPROF_LIVE_SLOTS - 1)) == 0, "HEAPPROF_LIVE_SLOTS must be a power of two");
+static_assert(HEAPPROF_SITES <= 256, "site index is stored in 8 bits");
+
+__thread const char* g_heapprof_tag = nullptr;
+
+extern "C" {
+  void* __real_malloc(size_t n);
+  void* __real_calloc(size_t n, size_t sz);
+  void* __real_realloc(void* p, size_t n);
+  void  __real_free(void* p);
+}
+
+static portMUX_TYPE  g_mux = portMUX_INITIALIZER_UNLOCKED;
+static HeapSiteStats g_sites[HEAPPROF_SITES];
+static uint32_t      g_site_overflow = 0;   // allocations with no free site slot
+static uint32_t      g_untracked = 0;
+
+// Live pointer -> (site, size). Linear probing with backward-shift deletion; 0 = empty.
+struct LiveEntry { uintptr_t ptr; uint32_t site_and_size; };  // site in top 8 bits, size in low 24
+static LiveEntry g_live[HEAPPROF_LIVE_SLOTS];
+
+static inline uint32_t hash_ptr(uintptr_t p) { return (uint32_t)((p >> 3) * 2654435761u); }
+
+static int site_index(const char* tag, uintptr_t pc) {
+  uintptr_t key = tag ? (uintptr_t)tag : pc;
+  uint32_t h = hash_ptr(key) % HEAPPROF_SITES;
+  for (uint32_t i = 0; i < HEAPPROF_SITES; ++i) {
+    HeapSiteStats& s = g_sites[(h + i) % HEAPPROF_SITES];
+    uintptr_t k = s.tag ? (uintptr_t)s.tag : s.pc;
+    if (k == key && (s.tag == tag)) return (int)((h + i) % HEAPPROF_SITES);
+    if (k == 0) {
+      s.tag = tag; s.pc = tag ? 0 : pc;
+      return (int)((h + i) % HEAPPROF_SITES);
+    }
+  }
+  return -1;
+}
+
+static void live_insert(uintptr_t p, int site, size_t n) {
+  uint32_t i = hash_ptr(p) & (HEAPPROF_LIVE_SLOTS - 1);
+  for (uint32_t probes = 0; probes < HEAPPROF_LIVE_SLOTS; ++probes) {
+    LiveEntry& e = g_live[i];
+    if (e.ptr == 0) {
+      e.ptr = p;
+      e.site_and_size = ((uint32_t)site << 24) | (uint32_t)(n > 0xFFFFFF ? 0xFFFFFF : n);
+      return;
+    }
+    i = (i + 1) & (HEAPPROF_LIVE_SLOTS - 1);
+  }
+  ++g_untracked;
+}
+
+static bool live_remove(uintptr_t p, uint32_t& site_and_size) {
+  uint32_t i = hash_ptr(p) & (HEAPPROF_LIVE_SLOTS - 1);
+  for (uint32_t probes = 0; probes < HEAPPROF_LIVE_SLOTS; ++probes) {
+    LiveEntry& e = g_live[i];
+    if (e.ptr == 0) return false;
+    if (e.ptr == p) {
+      site_and_size = e.site_and_size;
+      // backward-shift deletion keeps probe chains intact without tombstones
+      uint32_t hole = i, j = i;
+      for (;;) {
+        j = (j + 1) & (HEAPPROF_LIVE_SLOTS - 1);
+        if (g_live[j].ptr == 0) break;
+        uint32_t home = hash_ptr(g_live[j].ptr) & (HEAPPROF_LIVE_SLOTS - 1);
+        bool between = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+        if (between) continue;
+        g_live[hole] = g_live[j];
+        hole = j;
+      }
+      g_live[hole].ptr = 0;
+      return true;
+    }
+    i = (i + 1) & (HEAPPROF_LIVE_SLOTS - 1);
+  }
+  return false;
+}
+
+static void record_alloc(void* p, size_t n, uintptr_t pc) {
+  const char* tag = g_heapprof_tag;
+  portENTER_CRITICAL_SAFE(&g_mux);
+  int si = site_index(tag, pc);
+  if (si >= 0) {
+    HeapSiteStats& s = g_sites[si];
+    s.allocs++;
+    s.bytes += (uint32_t)n;
+    s.live_bytes += (uint32_t)n;
+    s.live_count++;
+    if (s.live_bytes > s.peak_live_bytes) s.peak_live_bytes = s.live_bytes;
+    live_insert((uintptr_t)p, si, n);
+  } else {
+    ++g_site_overflow;
+  }
+  portEXIT_CRITICAL_SAFE(&g_mux);
+}
+
+static void record_free(void* p) {
+  uint32_t ss;
+  portENTER_CRITICAL_SAFE(&g_mux);
+  if (live_remove((uintptr_t)p, ss)) {
+    HeapSiteStats& s = g_sites[ss >> 24];
+    uint32_t n = ss & 0xFFFFFF;
+    s.frees++;
+    s.live_bytes = s.live_bytes >= n ? s.live_bytes - n : 0;
+    if (s.live_count) s.live_count--;
+  }
+  portEXIT_CRITICAL_SAFE(&g_mux);
+}
+
+extern "C" void* __wrap_malloc(size_t n) {
+  void* p = __real_malloc(n);
+  if (p) record_alloc(p, n, (uintptr_t)__builtin_return_address(0));
+  return p;
+}
+
+extern "C" void* __wrap_calloc(size_t n, size_t sz) {
+  void* p = __real_calloc(n, sz);
+  if (p) record_alloc(p, n * sz, (uintptr_t)__builtin_return_address(0));
+  return p;
+}
+
+extern "C" void* __wrap_realloc(void* old, size_t n) {
+  void* p = __real_realloc(old, n);
+  if (p || n == 0) {
+    if (old) record_free(old);
+    if (p) record_alloc(p, n, (uintptr_t)__builtin_return_address(0));
+  }
+  return p;
+}
+
+extern "C" void __wrap_free(void* p) {
+  if (p) record_free(p);
+  __real_free(p);
+}
+
+bool heapprof_enabled() { return true; }
+
+void heapprof_reset() {
+  portENTER_CRITICAL_SAFE(&g_mux);
+  for (auto& s : g_sites) {
+    s.allocs = s.frees = s.bytes = 0;
+    s.peak_live_bytes = s.live_bytes;
+  }
+  portEXIT_CRITICAL_SAFE(&g_mux);
+}
+
+uint32_t heapprof_untracked() { return g_untracked + g_site_overflow; }
+
+size_t heapprof_sites(HeapSiteStats* out, size_t cap) {
+  size_t n = 0;
+  portENTER_CRITICAL_SAFE(&g_mux);
+  for (const auto& s : g_sites) {
+    if (n >= cap) break;
+    if (s.tag || s.pc) out[n++] = s;
+  }
+  portEXIT_CRITICAL_SAFE(&g_mux);
+  std::sort(out, out + n, [](const HeapSiteStats& a, const HeapSiteStats& b) { return a.bytes > b.bytes; });
+  return n;
+}
+
+#else  // !GEOGRAM_HEAP_PROFILE
+
+bool     heapprof_enabled()                         { return false; }
+void     heapprof_reset()                           {}
+uint32_t heapprof_untracked()                       { return 0; }
+size_t   heapprof_sites(HeapSiteStats*, size_t)     { return 0; }
+
+#endif
+
+// ---------- Rendering (snapshot first: the renderers themselves allocate) ----------
+// Snapshots are per call: the HTTP handler and the CLI may render at the same time.
+
+static const char* site_label(const HeapSiteStats& s, char* buf, size_t cap) {
+  if (s.tag) return s.tag;
+  snprintf(buf, cap, "pc:0x%08lx", (unsigned long)s.pc);
+  return buf;
+}
+
+enum SiteField : uint8_t { SITE_BYTES, SITE_ALLOCS, SITE_LIVE };
+
+static uint32_t site_field(const HeapSiteStats& s, SiteField f) {
+  switch (f) {
+    case SITE_BYTES:  return s.bytes;
+    case SITE_ALLOCS: return s.allocs;
+    default:          return s.live_bytes;
+  }
+}
+
+void heapprof_render_prometheus(String& out) {
+  static const struct { const char* name; const char* help; const char* type; SiteField field; } k_families[] = {
+    { "heap_site_bytes_total",  "Bytes allocated per call site",            "counter", SITE_BYTES },
+    { "heap_site_allocs_total", "Allocations per call site",                "counter", SITE_ALLOCS },
+    { "heap_site_live_bytes",   "Bytes allocated per call site not yet freed", "gauge", SITE_LIVE },
+  };
+  char label[24];
+
+  HeapSiteStats* sites = new (std::nothrow) HeapSiteStats[HEAPPROF_SITES];
+  size_t n = sites ? heapprof_sites(sites, HEAPPROF_SITES) : 0;
+  if (n) {
+    for (const auto& f : k_families) {
+      metrics_appendf(out, "# HELP geogram_%s %s\n", f.name, f.help);
+      metrics_appendf(out, "# TYPE geogram_%s %s\n", f.name, f.type);
+      for (size_t i = 0; i < n; ++i) {
+        metrics_appendf(out, "geogram_%s{site=\"%s\"} %u\n", f.name,
+                        site_label(sites[i], label, sizeof(label)), (unsigned)site_field(sites[i], f.field));
+      }
+    }
+    out += "# HELP geogram_heap_untracked_total Allocations the live-pointer table had no room for\n"
+           "# TYPE geogram_heap_untracked_total counter\n";
+    metrics_appendf(out, "geogram_heap_untracked_total %u\n", (unsigned)heapprof_untracked());
+  }
+  delete[] sites;
+
+  HeapSample* hist = new (std::nothrow) HeapSample[HEAPPROF_HISTORY];
+  size_t h = hist ? heapprof_history(hist, HEAPPROF_HISTORY) : 0;
+  if (h) {
+    uint32_t minLargest = UINT32_MAX;
+    for (size_t i = 0; i < h; ++i) minLargest = std::min(minLargest, hist[i].largest_block);
+    out += "# HELP geogram_heap_largest_block_window_min_bytes Smallest largest-free-block in the history window\n"
+           "# TYPE geogram_heap_largest_block_window_min_bytes gauge\n";
+    metrics_appendf(out, "geogram_heap_largest_block_window_min_bytes %u\n", (unsigned)minLargest);
+  }
+  delete[] hist;
+}
+
+void heapprof_render_json(String& out) {
+  HeapSiteStats* sites = new (std::nothrow) HeapSiteStats[HEAPPROF_SITES];
+  size_t n = sites ? heapprof_sites(sites, HEAPPROF_SITES) : 0;
+  char buf[192], label[24];
+
+  out += ",\"heap_profile_enabled\":";
+  out += heapprof_enabled() ? "true" : "false";
+  out += ",\"heap_sites\":[";
+  for (size_t i = 0; i < n; ++i) {
+    const HeapSiteStats& s = sites[i];
+    metrics_appendf(out,
+                    "%s{\"site\":\"%s\",\"allocs\":%u,\"frees\":%u,\"bytes\":%u,\"live_bytes\":%u,\"live_count\":%u,\"peak_live_bytes\":%u}",
+                    i ? "," : "", site_label(s, label, sizeof(label)),
+                    (unsigned)s.allocs, (unsigned)s.frees, (unsigned)s.bytes,
+                    (unsigned)s.live_bytes, (unsigned)s.live_count, (unsigned)s.peak_live_bytes);
+  }
+  delete[] sites;
+  out += "],\"heap_history\":[";
+  HeapSample* hist = new (std::nothrow) HeapSample[HEAPPROF_HISTORY];
+  size_t h = hist ? heapprof_history(hist, HEAPPROF_HISTORY) : 0;
+  for (size_t i = 0; i < h; ++i) {
+    snprintf(buf, sizeof(buf), "%s[%u,%u,%u]", i ? "," : "",
+             (unsigned)hist[i].uptime_s, (unsigned)hist[i].free_bytes,
+             (unsigned)hist[i].largest_block);
+    out += buf;
+  }
+  delete[] hist;
+  out += "]";
+}
@@ -0,0 +1,93 @@
+#pragma once
+/*
+  heapprof.h — Opt-in allocation profiler (per-call-site counts/bytes/live) + heap history.
+
+  WHAT THIS DOES
+  - With GEOGRAM_HEAP_PROFILE, malloc/calloc/realloc/free are wrapped at link time
+    (-Wl,--wrap=...; see the "heapprof" env in platformio.ini). Every allocation is
+    attributed to a call site and counted in a fixed 64-entry table; live pointers are
+    tracked in a fixed open-addressing table so frees are charged back to their site.
+  - A call site is the innermost HEAPPROF_SCOPE("tag") active on the current task, or the
+    caller's return address (rendered as pc:0x...; resolve with addr2line) when no scope is set.
+    Scopes matter for Arduino String: its realloc always comes from WString.cpp, so the tag
+    is what tells parseLine apart from the homepage JSON builder.
+  - Independently of the wrap, heapprof_tick() keeps a ring of free-heap / largest-free-block
+    samples so fragmentation can be followed over long uptimes.
+  - Everything is read through the metrics endpoint (/api/metrics, /api/metrics?format=json).
+
+  USAGE
+        void parseLine(...) {
+          HEAPPROF_SCOPE("parseLine");
+          ...String churn...
+        }
+
+  COST
+    Without GEOGRAM_HEAP_PROFILE the scopes compile away; only the history ring remains
+    (one sample every HEAPPROF_SAMPLE_MS). With it, each malloc/free takes a short spinlock.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef GEOGRAM_HEAP_PROFILE
+  extern __thread const char* g_heapprof_tag;
+
+  class HeapProfScope {
+  public:
+    explicit HeapProfScope(const char* tag) : _prev(g_heapprof_tag) { g_heapprof_tag = tag; }
+    ~HeapProfScope() { g_heapprof_tag = _prev; }
+  private:
+    const char* _prev;
+  };
+
+  #define HEAPPROF_CAT2(a, b) a##b
+  #define HEAPPROF_CAT(a, b)  HEAPPROF_CAT2(a, b)
+  #define HEAPPROF_SCOPE(tag) HeapProfScope HEAPPROF_CAT(_heapprof_scope_, __LINE__)(tag)
+#else
+  #define HEAPPROF_SCOPE(tag) do {} while (0)
+#endif
+
+#ifndef HEAPPROF_SITES
+#define HEAPPROF_SITES 64
+#endif
+#ifndef HEAPPROF_HISTORY
+#define HEAPPROF_HISTORY 60        // samples kept
+#endif
+#ifndef HEAPPROF_SAMPLE_MS
+#define HEAPPROF_SAMPLE_MS 10000   // one sample every 10 s -> 10 minutes of history
+#endif
+
+typedef struct {
+  const char* tag;        // scope tag, or nullptr when keyed by pc
+  uintptr_t   pc;         // caller return address (when tag == nullptr)
+  uint32_t    allocs;
+  uint32_t    frees;
+  uint32_t    bytes;      // cumulative bytes requested
+  uint32_t    live_bytes;
+  uint32_t    live_count;
+  uint32_t    peak_live_bytes;
+} HeapSiteStats;
+
+typedef struct {
+  uint32_t uptime_s;
+  uint32_t free_bytes;
+  uint32_t largest_block;
+} HeapSample;
+
+bool   heapprof_enabled();
+void   heapprof_tick();     // call from loop(); samples history every HEAPPROF_SAMPLE_MS
+void   heapprof_reset();    // clear site counters (live pointer table is kept)
+
+// Copies up to `cap` sites sorted by cumulative bytes (descending). Returns the count.
+size_t heapprof_sites(HeapSiteStats* out, size_t cap);
+// Copies history oldest-first. Returns the count.
+size_t heapprof_history(HeapSample* out, size_t cap);
+// Allocations whose pointer could not be tracked (live table full) since boot.
+uint32_t heapprof_untracked();
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+  // Appended to the metrics renderers.
+  void heapprof_render_prometheus(String& out);
+  void heapprof_render_json(String& out);   // emits ,"heap_sites":[...],"heap_history":[...]
+#endif
@@ -0,0 +1,322 @@
+// log.cpp — bounded lock-free ring (Vyukov MPMC) + low-priority drain task
+#include "log.h"
+#include "metrics.h"
+#include "drive/storageio.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifndef GLOG_SLOTS
+#define GLOG_SLOTS 64
+#endif
+#ifndef GLOG_LINE_MAX
+#define GLOG_LINE_MAX 120
+#endif
+#ifndef GLOG_RATE_PER_SEC
+#define GLOG_RATE_PER_SEC 20
+#endif
+#ifndef GLOG_FILE_MAX_BYTES
+#define GLOG_FILE_MAX_BYTES (64 * 1024)
+#endif
+#ifndef GLOG_FILE_KEEP
+#define GLOG_FILE_KEEP 4
+#endif
+#ifndef GLOG_DRAIN_PERIOD_MS
+#define GLOG_DRAIN_PERIOD_MS 20
+#endif
+#ifndef GLOG_TASK_PRIORITY
+#define GLOG_TASK_PRIORITY 1
+#endif
+
+static_assert((GLOG_SLOTS & (GLOG_SLOTS - 1)) == 0, "GLOG_SLOTS must be a power of two");
+
+// ---------- Ring ----------
+// Each slot's sequence is stored relative to its index (seq - index) so the zero-initialised
+// array is already a valid empty ring and producers never depend on an init call.
+struct LogSlot {
+  std::atomic<uint32_t> seq;
+  uint32_t ms;
+  uint8_t  mod;
+  uint8_t  lvl;
+  uint16_t len;
+  char     text[GLOG_LINE_MAX];
+};
+
+static LogSlot               g_slots[GLOG_SLOTS];
+static std::atomic<uint32_t> g_enq{0};
+static uint32_t              g_deq = 0;          // single consumer (drain task)
+
+volatile uint8_t g_glog_levels[LOGM_COUNT] = {
+  GLOG_DEFAULT_LEVEL, GLOG_DEFAULT_LEVEL, GLOG_DEFAULT_LEVEL,
+  GLOG_DEFAULT_LEVEL, GLOG_DEFAULT_LEVEL, GLOG_DEFAULT_LEVEL
+};
+
+static std::atomic<uint32_t> g_lines{0}, g_drop_full{0}, g_drop_rate{0}, g_file_bytes{0};
+
+// Reserve a slot for writing; nullptr when full. `pos` receives the ticket to publish.
+static LogSlot* ring_reserve(uint32_t& pos) {
+  pos = g_enq.load(std::memory_order_relaxed);
+  for (;;) {
+    uint32_t idx = pos & (GLOG_SLOTS - 1);
+    LogSlot& s = g_slots[idx];
+    uint32_t seq = s.seq.load(std::memory_order_acquire) + idx;
+    int32_t dif = (int32_t)(seq - pos);
+    if (dif == 0) {
+      if (g_enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &s;
+    } else if (dif < 0) {
+      return nullptr;
+    } else {
+      pos = g_enq.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+static inline void ring_publish(LogSlot* s, uint32_t pos) {
+  s->seq.store(pos + 1 - (pos & (GLOG_SLOTS - 1)), std::memory_order_release);
+}
+
+static LogSlot* ring_peek() {
+  uint32_t idx = g_deq & (GLOG_SLOTS - 1);
+  LogSlot& s = g_slots[idx];
+  return (s.seq.load(std::memory_order_acquire) + idx == g_deq + 1) ? &s : nullptr;
+}
+
+static inline void ring_release(LogSlot* s) {
+  s->seq.store(g_deq + GLOG_SLOTS - (g_deq & (GLOG_SLOTS - 1)), std::memory_order_release);
+  ++g_deq;
+}
+
+// ---------- Rate limiting (approximate; relaxed atomics) ----------
+static std::atomic<uint32_t> g_rate_window[LOGM_COUNT];
+static std::atomic<uint32_t> g_rate_count[LOGM_COUNT];
+
+static bool rate_admit(LogModule m, LogLevel l, uint32_t now) {
+  if (l == GLOG_ERROR) return true;
+  uint32_t win = now / 1000;
+  if (g_rate_window[m].load(std::memory_order_relaxed) != win) {
+    g_rate_window[m].store(win, std::memory_order_relaxed);
+    g_rate_count[m].store(0, std::memory_order_relaxed);
+  }
+  return g_rate_count[m].fetch_add(1, std::memory_order_relaxed) < GLOG_RATE_PER_SEC;
+}
+
+static LogSlot* admit(LogModule m, LogLevel l, uint32_t& pos) {
+  if ((unsigned)m >= LOGM_COUNT) return nullptr;
+  uint32_t now = millis();
+  if (!rate_admit(m, l, now)) {
+    g_drop_rate.fetch_add(1, std::memory_order_relaxed);
+    metric_inc(M_LOG_DROPPED_RATE);
+    return nullptr;
+  }
+  LogSlot* s = ring_reserve(pos);
+  if (!s) {
+    g_drop_full.fetch_add(1, std::memory_order_relaxed);
+    metric_inc(M_LOG_DROPPED_FULL);
+    return nullptr;
+  }
+  s->ms  = now;
+  s->mod = (uint8_t)m;
+  s->lvl = (uint8_t)l;
+  return s;
+}
+
+static inline void commit(LogSlot* s, uint32_t pos, int n) {
+  if (n < 0) n = 0;
+  if (n >= GLOG_LINE_MAX) n = GLOG_LINE_MAX - 1;
+  // strip trailing newlines; the sink adds its own
+  while (n > 0 && (s->text[n - 1] == '\n' || s->text[n - 1] == '\r')) --n;
+  s->text[n] = '\0';
+  s->len = (uint16_t)n;
+  ring_publish(s, pos);
+  g_lines.fetch_add(1, std::memory_order_relaxed);
+  metric_inc(M_LOG_LINES);
+}
+
+void glog_printf(LogModule m, LogLevel l, const char* fmt, ...) {
+  if (!glog_enabled(m, l)) return;
+  uint32_t pos;
+  LogSlot* s = admit(m, l, pos);
+  if (!s) return;
+  va_list ap; va_start(ap, fmt);
+  int n = vsnprintf(s->text, GLOG_LINE_MAX, fmt, ap);
+  va_end(ap);
+  commit(s, pos, n);
+}
+
+void glog_write(LogModule m, LogLevel l, const char* line) {
+  if (!line || !glog_enabled(m, l)) return;
+  uint32_t pos;
+  LogSlot* s = admit(m, l, pos);
+  if (!s) return;
+  size_t n = strnlen(line, GLOG_LINE_MAX - 1);
+  memcpy(s->text, line, n);
+  commit(s, pos, (int)n);
+}
+
+// ---------- Names ----------
+static const char* const k_mod_names[LOGM_COUNT] = { "app", "ble", "storage", "web", "presence", "time" };
+static const char* const k_lvl_names[]           = { "none", "error", "warn", "info", "debug" };
+
+const char* glog_module_name(LogModule m) { return (unsigned)m < LOGM_COUNT ? k_mod_names[m] : "?"; }
+const char* glog_level_name(LogLevel l)   { return (unsigned)l <= GLOG_DEBUG ? k_lvl_names[l] : "?"; }
+
+int glog_module_from_name(const char* s) {
+  if (!s) return -1;
+  for (int i = 0; i < LOGM_COUNT; ++i) if (strcasecmp(s, k_mod_names[i]) == 0) return i;
+  return -1;
+}
+
+int glog_level_from_name(const char* s) {
+  if (!s) return -1;
+  for (int i = 0; i <= GLOG_DEBUG; ++i) if (strcasecmp(s, k_lvl_names[i]) == 0) return i;
+  return -1;
+}
+
+void glog_set_level(LogModule m, LogLevel l) {
+  if ((unsigned)m < LOGM_COUNT && (unsigned)l <= GLOG_DEBUG) g_glog_levels[m] = (uint8_t)l;
+}
+
+LogLevel glog_get_level(LogModule m) {
+  return (unsigned)m < LOGM_COUNT ? (LogLevel)g_glog_levels[m] : GLOG_NONE;
+}
+
+void glog_stats(LogStats* out) {
+  if (!out) return;
+  out->lines        = g_lines.load(std::memory_order_relaxed);
+  out->dropped_full = g_drop_full.load(std::memory_order_relaxed);
+  out->dropped_rate = g_drop_rate.load(std::memory_order_relaxed);
+  out->file_bytes   = g_file_bytes.load(std::memory_order_relaxed);
+}
+
+// ---------- Sinks (drain task only) ----------
+static volatile bool g_serial_on = true;
+static fs::FS*       g_file_fs = nullptr;
+static String        g_file_dir;
+static File          g_file;
+static size_t        g_file_size = 0;
+static volatile bool g_file_changed = false;
+static portMUX_TYPE  g_sink_mux = portMUX_INITIALIZER_UNLOCKED;
+static LogStageFn    g_file_stage = nullptr;
+static fs::FS*       g_pending_fs = nullptr;
+static const char*   g_pending_dir = nullptr;
+static LogStageFn    g_pending_stage = nullptr;
+
+void glog_set_serial(bool enabled) { g_serial_on = enabled; }
+
+void glog_set_file_sink(fs::FS* fs, const char* dir) {
+  portENTER_CRITICAL(&g_sink_mux);
+  g_pending_fs  = fs;
+  g_pending_dir = dir;
+  g_pending_stage = nullptr;
+  g_file_changed = true;
+  portEXIT_CRITICAL(&g_sink_mux);
+}
+
+void glog_stage_file_sink(LogStageFn stage) {
+  portENTER_CRITICAL(&g_sink_mux);
+  g_pending_fs  = nullptr;
+  g_pending_stage = stage;
+  g_file_changed = true;
+  portEXIT_CRITICAL(&g_sink_mux);
+}
+
+static String file_path(int n) {
+  String p = g_file_dir; p += "/log"; p += n; p += ".txt";
+  return p;
+}
+
+// File sink work runs on the storage I/O service (class STORIO_LOG), never on this task.
+static void file_apply_pending() {
+  if (!g_file_changed) return;
+  portENTER_CRITICAL(&g_sink_mux);
+  fs::FS* fs = g_pending_fs;
+  const char* dir = g_pending_dir;
+  LogStageFn stage = g_pending_stage;
+  g_file_changed = false;
+  portEXIT_CRITICAL(&g_sink_mux);
+
+  storio_run(STORIO_LOG, [fs, dir, stage]() {
+    if (g_file) g_file.close();
+    g_file_stage = stage;
+    g_file_fs = fs;
+    if (stage) return true;   // parked: g_file_dir still names where log0.txt lives
+    g_file_dir = (dir && *dir) ? dir : "/logs";
+    if (!g_file_fs) return true;
+    if (!g_file_fs->exists(g_file_dir)) g_file_fs->mkdir(g_file_dir);
+    g_file = g_file_fs->open(file_path(0), FILE_APPEND);
+    g_file_size = g_file ? g_file.size() : 0;
+    return (bool)g_file;
+  });
+}
+
+static void file_rotate() {
+  g_file.close();
+  g_file_fs->remove(file_path(GLOG_FILE_KEEP - 1));
+  for (int i = GLOG_FILE_KEEP - 2; i >= 0; --i) {
+    String from = file_path(i);
+    if (g_file_fs->exists(from)) g_file_fs->rename(from, file_path(i + 1));
+  }
+  g_file = g_file_fs->open(file_path(0), FILE_WRITE);
+  g_file_size = 0;
+}
+
+static void sink_batch(const char* buf, size_t n, bool flush) {
+  if (n == 0) return;
+  if (g_serial_on) Serial.write((const uint8_t*)buf, n);
+  if (g_file_stage) {
+    storio_run(STORIO_LOG, [buf, n]() {
+      if (!g_file_stage(file_path(0).c_str(), (const uint8_t*)buf, n)) return false;
+      g_file_bytes.fetch_add((uint32_t)n, std::memory_order_relaxed);
+      return true;
+    });
+  } else if (g_file_fs && g_file) {
+    storio_run(STORIO_LOG, [buf, n, flush]() {
+      if (g_file_size + n > GLOG_FILE_MAX_BYTES) file_rotate();
+      if (!g_file) return false;
+      size_t w = g_file.write((const uint8_t*)buf, n);
+      g_file_size += w;
+      g_file_bytes.fetch_add((uint32_t)w, std::memory_order_relaxed);
+      if (flush) g_file.flush();
+      return w == n;
+    });
+  }
+}
+
+static void drain_task(void*) {
+  static const char lvl_ch[] = { '-', 'E', 'W', 'I', 'D' };
+  char batch[1024];
+  for (;;) {
+    file_apply_pending();
+
+    size_t used = 0;
+    LogSlot* s;
+    while ((s = ring_peek()) != nullptr) {
+      char head[32];
+      int hn = snprintf(head, sizeof(head), "[%6lu.%03lu] %c %s: ",
+                        (unsigned long)(s->ms / 1000), (unsigned long)(s->ms % 1000),
+                        lvl_ch[s->lvl <= GLOG_DEBUG ? s->lvl : 0],
+                        glog_module_name((LogModule)s->mod));
+      size_t need = (size_t)hn + s->len + 1;
+      if (used + need > sizeof(batch)) { sink_batch(batch, used, false); used = 0; }
+      memcpy(batch + used, head, hn);          used += hn;
+      memcpy(batch + used, s->text, s->len);   used += s->len;
+      batch[used++] = '\n';
+      ring_release(s);
+    }
+    sink_batch(batch, used, true);
+
+    vTaskDelay(pdMS_TO_TICKS(GLOG_DRAIN_PERIOD_MS));
+  }
+}
+
+void glog_begin() {
+  static bool started = false;
+  if (started) return;
+  started = true;
+  xTaskCreate(drain_task, "glog", 4096, nullptr, GLOG_TASK_PRIORITY, nullptr);
+}
@@ -0,0 +1,103 @@
+#pragma once
+/*
+  log.h — Deferred, rate-limited log pipeline (lock-free ring + low-priority drain task).
+
+  WHAT THIS DOES
+  - Call sites format straight into a slot of a bounded lock-free MPMC ring (no Serial, no
+    locks, no heap). Safe from the BLE callback, the async web task and loop().
+  - A low-priority FreeRTOS task drains the ring to USB-CDC and, optionally, to a rotating
+    log file on the active storage. Only the drain task can ever block on Serial or flash.
+  - Per-module runtime levels; per-module rate limiting (errors are exempt);
+    drop counters for "ring full" and "rate limited" (also exported through diag/metrics).
+
+  USAGE
+        #include "diag/log.h"
+
+        GLOGI(LOGM_WEB, "GET %s", path.c_str());
+        GLOGE(LOGM_STORAGE, "Failed to open %s", path);
+
+        glog_begin();                          // once, early in setup()
+        glog_set_level(LOGM_BLE, GLOG_DEBUG);  // runtime, or "/log/set module=ble level=debug"
+        glog_set_file_sink(&fs, "/logs");      // optional rotating file sink
+
+  NAMING
+    Arduino-ESP32 already owns log_e()/log_printf(); this module uses the glog_ / GLOG prefix.
+
+  TUNABLES (compile-time)
+    - GLOG_SLOTS          (default 64, power of two)
+    - GLOG_LINE_MAX       (default 120 bytes per line incl. NUL)
+    - GLOG_RATE_PER_SEC   (default 20 lines/s per module, bursts up to the same number)
+    - GLOG_FILE_MAX_BYTES (default 64 KB per file before rotation)
+    - GLOG_FILE_KEEP      (default 4 files: log0.txt newest .. log3.txt oldest)
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+  #include <FS.h>
+#endif
+
+typedef enum {
+  LOGM_APP = 0,
+  LOGM_BLE,
+  LOGM_STORAGE,
+  LOGM_WEB,
+  LOGM_PRESENCE,
+  LOGM_TIME,
+  LOGM_COUNT
+} LogModule;
+
+typedef enum {
+  GLOG_NONE  = 0,
+  GLOG_ERROR = 1,
+  GLOG_WARN  = 2,
+  GLOG_INFO  = 3,
+  GLOG_DEBUG = 4
+} LogLevel;
+
+#ifndef GLOG_DEFAULT_LEVEL
+#define GLOG_DEFAULT_LEVEL GLOG_INFO
+#endif
+
+typedef struct {
+  uint32_t lines;          // lines accepted into the ring
+  uint32_t dropped_full;   // lines lost because the ring was full
+  uint32_t dropped_rate;   // lines suppressed by the per-module rate limiter
+  uint32_t file_bytes;     // bytes written to the file sink
+} LogStats;
+
+// Level gate is inline so disabled levels cost one byte compare and no formatting.
+extern volatile uint8_t g_glog_levels[LOGM_COUNT];
+static inline bool glog_enabled(LogModule m, LogLevel l) { return l <= (LogLevel)g_glog_levels[m]; }
+
+void glog_printf(LogModule m, LogLevel l, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+void glog_write(LogModule m, LogLevel l, const char* line);
+
+#define GLOG_AT(m, l, ...) do { if (glog_enabled((m), (l))) glog_printf((m), (l), __VA_ARGS__); } while (0)
+#define GLOGE(m, ...) GLOG_AT((m), GLOG_ERROR, __VA_ARGS__)
+#define GLOGW(m, ...) GLOG_AT((m), GLOG_WARN,  __VA_ARGS__)
+#define GLOGI(m, ...) GLOG_AT((m), GLOG_INFO,  __VA_ARGS__)
+#define GLOGD(m, ...) GLOG_AT((m), GLOG_DEBUG, __VA_ARGS__)
+
+void        glog_begin();                                   // start the drain task (idempotent)
+void        glog_set_level(LogModule m, LogLevel l);
+LogLevel    glog_get_level(LogModule m);
+void        glog_set_serial(bool enabled);                  // USB-CDC sink on/off (default on)
+void        glog_stats(LogStats* out);
+
+// Name helpers for the API/CLI ("ble", "debug", ...). Return -1 when unknown.
+const char* glog_module_name(LogModule m);
+const char* glog_level_name(LogLevel l);
+int         glog_module_from_name(const char* s);
+int         glog_level_from_name(const char* s);
+
+#ifdef ARDUINO
+// Rotating file sink in `dir` (log0.txt newest); `dir` must stay valid. Pass nullptr to disable.
+void glog_set_file_sink(fs::FS* fs, const char* dir);
+// Parks the file sink while its volume is lent out: the file is closed and batches go to
+// `stage(path of log0.txt, data, len)` until glog_set_file_sink() is called again.
+typedef bool (*LogStageFn)(const char* path, const uint8_t* data, size_t len);
+void glog_stage_file_sink(LogStageFn stage);
+#endif
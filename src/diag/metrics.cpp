@@ -0,0 +1,187 @@
+// metrics.cpp — static storage + on-demand rendering for the metrics registry
+#include "metrics.h"
+#include "heapprof.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <esp_heap_caps.h>
+
+#ifndef METRICS_SAMPLE_MS
+#define METRICS_SAMPLE_MS 1000
+#endif
+
+std::atomic<uint32_t> g_metric_vals[M_COUNT];
+MetricHist            g_metric_hists[H_COUNT];
+const uint32_t        g_metric_bounds_us[METRICS_HIST_NBOUNDS] = METRICS_HIST_BOUNDS_US;
+
+enum MetricKind : uint8_t { COUNTER, GAUGE };
+
+struct ScalarInfo { const char* name; const char* help; MetricKind kind; };
+struct HistInfo   { const char* name; const char* help; };
+
+static const ScalarInfo k_scalars[M_COUNT] = {
+#define X_INFO(id, kind, name, help) { name, help, kind },
+  METRICS_SCALARS(X_INFO)
+#undef X_INFO
+};
+
+static const HistInfo k_hists[H_COUNT] = {
+#define X_INFO(id, name, help) { name, help },
+  METRICS_HISTOGRAMS(X_INFO)
+#undef X_INFO
+};
+
+// ---------- Sampling ----------
+void metrics_sample() {
+  static uint32_t last = 0;
+  uint32_t now = millis();
+  if (last != 0 && (uint32_t)(now - last) < METRICS_SAMPLE_MS) return;
+  last = now;
+
+  uint32_t freeB  = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  uint32_t minB   = (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  uint32_t larg   = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  metric_set(M_HEAP_FREE, freeB);
+  metric_set(M_HEAP_MIN_FREE, minB);
+  metric_set(M_HEAP_LARGEST_BLOCK, larg);
+  metric_set(M_HEAP_FRAG_PCT, freeB ? (uint32_t)(100 - (uint64_t)larg * 100 / freeB) : 0);
+  metric_set(M_UPTIME_S, now / 1000);
+
+  heapprof_tick();
+}
+
+// ---------- Queries ----------
+const char* metric_name(MetricId id) { return k_scalars[id].name; }
+const char* hist_name(HistId id)     { return k_hists[id].name; }
+
+uint32_t hist_quantile_us(HistId id, float q) {
+  const MetricHist& h = g_metric_hists[id];
+  uint32_t total = h.count.load(std::memory_order_relaxed);
+  if (total == 0) return 0;
+  uint32_t target = (uint32_t)(q * (float)total);
+  if (target == 0) target = 1;
+  uint32_t acc = 0;
+  for (uint8_t b = 0; b < METRICS_HIST_NBOUNDS; ++b) {
+    acc += h.buckets[b].load(std::memory_order_relaxed);
+    if (acc >= target) return g_metric_bounds_us[b];
+  }
+  return UINT32_MAX;
+}
+
+static uint64_t hist_sum(const MetricHist& h) {
+  return ((uint64_t)h.sum_hi.load(std::memory_order_relaxed) << 32) |
+         h.sum_lo.load(std::memory_order_relaxed);
+}
+
+// ---------- Rendering ----------
+static void appendU64(String& out, uint64_t v) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v);
+  out += buf;
+}
+
+void metrics_appendf(String& out, const char* fmt, ...) {
+  char line[128];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (n < 0) return;
+  if ((size_t)n < sizeof(line)) {
+    out += line;
+    return;
+  }
+  char* big = (char*)malloc((size_t)n + 1);
+  if (!big) return;
+  va_start(ap, fmt);
+  vsnprintf(big, (size_t)n + 1, fmt, ap);
+  va_end(ap);
+  out += big;
+  free(big);
+}
+
+// One family: HELP and TYPE, each on its own line
+static void appendFamily(String& out, const char* name, const char* help, const char* type) {
+  metrics_appendf(out, "# HELP geogram_%s %s\n", name, help);
+  metrics_appendf(out, "# TYPE geogram_%s %s\n", name, type);
+}
+
+void metrics_render_prometheus(String& out) {
+  out.reserve(out.length() + 8192);
+
+  for (int i = 0; i < M_COUNT; ++i) {
+    const ScalarInfo& s = k_scalars[i];
+    appendFamily(out, s.name, s.help, s.kind == COUNTER ? "counter" : "gauge");
+    metrics_appendf(out, "geogram_%s %u\n", s.name, (unsigned)metric_get((MetricId)i));
+  }
+
+  for (int i = 0; i < H_COUNT; ++i) {
+    const HistInfo& hi = k_hists[i];
+    const MetricHist& h = g_metric_hists[i];
+    appendFamily(out, hi.name, hi.help, "histogram");
+
+    uint32_t cum = 0;
+    for (uint8_t b = 0; b < METRICS_HIST_NBOUNDS; ++b) {
+      cum += h.buckets[b].load(std::memory_order_relaxed);
+      metrics_appendf(out, "geogram_%s_bucket{le=\"%u\"} %u\n",
+                      hi.name, (unsigned)g_metric_bounds_us[b], (unsigned)cum);
+    }
+    cum += h.buckets[METRICS_HIST_NBOUNDS].load(std::memory_order_relaxed);
+    metrics_appendf(out, "geogram_%s_bucket{le=\"+Inf\"} %u\n", hi.name, (unsigned)cum);
+    metrics_appendf(out, "geogram_%s_sum %llu\n", hi.name, (unsigned long long)hist_sum(h));
+    metrics_appendf(out, "geogram_%s_count %u\n",
+                    hi.name, (unsigned)h.count.load(std::memory_order_relaxed));
+  }
+
+  heapprof_render_prometheus(out);
+}
+
+void metrics_render_json(String& out) {
+  out.reserve(out.length() + 3072);
+  char buf[96];
+
+  out += "{\"counters\":{";
+  bool first = true;
+  for (int i = 0; i < M_COUNT; ++i) {
+    if (k_scalars[i].kind != COUNTER) continue;
+    snprintf(buf, sizeof(buf), "%s\"%s\":%u", first ? "" : ",",
+             k_scalars[i].name, (unsigned)metric_get((MetricId)i));
+    out += buf; first = false;
+  }
+
+  out += "},\"gauges\":{";
+  first = true;
+  for (int i = 0; i < M_COUNT; ++i) {
+    if (k_scalars[i].kind != GAUGE) continue;
+    snprintf(buf, sizeof(buf), "%s\"%s\":%u", first ? "" : ",",
+             k_scalars[i].name, (unsigned)metric_get((MetricId)i));
+    out += buf; first = false;
+  }
+
+  out += "},\"histograms\":{";
+  for (int i = 0; i < H_COUNT; ++i) {
+    const MetricHist& h = g_metric_hists[i];
+    snprintf(buf, sizeof(buf), "%s\"%s\":{\"le\":[", i ? "," : "", k_hists[i].name);
+    out += buf;
+    for (uint8_t b = 0; b < METRICS_HIST_NBOUNDS; ++b) {
+      snprintf(buf, sizeof(buf), "%s%u", b ? "," : "", (unsigned)g_metric_bounds_us[b]);
+      out += buf;
+    }
+    out += "],\"counts\":[";
+    for (uint8_t b = 0; b <= METRICS_HIST_NBOUNDS; ++b) {
+      snprintf(buf, sizeof(buf), "%s%u", b ? "," : "",
+               (unsigned)h.buckets[b].load(std::memory_order_relaxed));
+      out += buf;
+    }
+    out += "],\"sum\":";
+    appendU64(out, hist_sum(h));
+    snprintf(buf, sizeof(buf), ",\"count\":%u,\"p50\":%u,\"p99\":%u}",
+             (unsigned)h.count.load(std::memory_order_relaxed),
+             (unsigned)hist_quantile_us((HistId)i, 0.50f),
+             (unsigned)hist_quantile_us((HistId)i, 0.99f));
+    out += buf;
+  }
+  out += "}";
+  heapprof_render_json(out);
+  out += "}";
+}
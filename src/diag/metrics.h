@@ -0,0 +1,234 @@
+#pragma once
+/*
+  metrics.h — Lightweight on-device metrics registry (counters, gauges, fixed-bucket histograms).
+
+  WHAT THIS DOES
+  - Every metric is declared once in the X-macro tables below; storage is a static array of
+    relaxed atomics, so updates are a single fetch_add/store and safe from any task/callback.
+  - Histograms share one fixed bucket layout in microseconds (METRICS_HIST_BOUNDS_US).
+  - Rendering (Prometheus text / JSON) happens only on request, never on the hot path.
+
+  USAGE
+        #include "diag/metrics.h"
+
+        metric_inc(M_BLE_ADV_SEEN);                 // counter += 1
+        metric_set(M_BLE_QUEUE_DEPTH, depth);       // gauge = value
+        hist_observe(H_BLE_ONRESULT_US, dt_us);     // histogram sample
+
+        { MetricTimer t(H_LOOP_US); ...work... }    // scoped timing
+
+  ADDING A METRIC
+    Append one line to METRICS_SCALARS or METRICS_HISTOGRAMS; names are exported as "geogram_<name>".
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#endif
+
+// ---------- Declarations: X(id, kind, name, help) ----------
+#define METRICS_SCALARS(X) \
+  X(M_BLE_ADV_SEEN,        COUNTER, "ble_adv_seen_total",          "BLE advertisements delivered by the scanner") \
+  X(M_BLE_ADV_TEXT,        COUNTER, "ble_adv_text_total",          "Advertisements carrying '>' service data") \
+  X(M_BLE_ADV_WIRE,        COUNTER, "ble_adv_wire_total",          "Advertisements carrying binary frames") \
+  X(M_BLE_ADV_REJECTED,    COUNTER, "ble_adv_rejected_total",      "'>' payloads rejected (UTF-8/length)") \
+  X(M_BLE_DEDUPE_HIT,      COUNTER, "ble_dedupe_hit_total",        "Payloads suppressed by the dedupe window") \
+  X(M_BLE_DEDUPE_MISS,     COUNTER, "ble_dedupe_miss_total",       "Payloads accepted by the dedupe window") \
+  X(M_BLE_PARCELS,         COUNTER, "ble_parcels_total",           "Parcels fed to the assembler") \
+  X(M_BLE_MSG_DONE,        COUNTER, "ble_messages_done_total",     "Multi-parcel messages completed") \
+  X(M_BLE_MSG_LEGACY_CKSUM,COUNTER, "ble_messages_legacy_checksum_total", "Messages accepted on the old byte-sum checksum") \
+  X(M_BLE_INFLIGHT_EXPIRED,COUNTER, "ble_inflight_expired_total",  "In-flight messages dropped by TTL") \
+  X(M_BLE_INFLIGHT_EVICTED,COUNTER, "ble_inflight_evicted_total",  "In-flight messages dropped for a newer one (pool full)") \
+  X(M_BLE_MSG_OTHER,       COUNTER, "ble_messages_other_total",    "Completed messages addressed elsewhere (relay mode)") \
+  X(M_BLE_SKIP_MSG,        COUNTER, "ble_ingest_skipped_messages_total", "Messages dropped at the header: not addressed here, relay off") \
+  X(M_BLE_SKIP_PARCELS,    COUNTER, "ble_ingest_skipped_parcels_total",  "Parcels of skipped messages, header included, not assembled") \
+  X(M_BLE_SKIP_BYTES,      COUNTER, "ble_ingest_skipped_bytes_total",    "Text bytes of skipped messages kept out of or released from the assemblers") \
+  X(M_BLE_INFLIGHT_FULL,   COUNTER, "ble_inflight_full_total",     "Parcels of new messages turned away: no message left and every entry still receiving") \
+  X(M_BLE_INFLIGHT_PARKED, COUNTER, "ble_inflight_parked_total",   "Turned-away parcels held until their message gets an entry") \
+  X(M_BLE_INFLIGHT_HEAP,   COUNTER, "ble_inflight_heap_total",     "Messages assembled on the heap, past the static reserve") \
+  X(M_BLE_INFLIGHT_COLLISIONS,COUNTER, "ble_inflight_probe_collisions_total", "Extra hash buckets probed by the (MAC, id) assembler index") \
+  X(M_BLE_INFLIGHT_ID_SHARED,COUNTER, "ble_inflight_id_shared_total", "Messages started while another sender's message had the same id (kept apart by the MAC key)") \
+  X(M_BLE_EVT_DROPPED,     COUNTER, "ble_events_dropped_total",    "Events dropped because the queue was full") \
+  X(M_BLE_TX,              COUNTER, "ble_tx_total",                "ADV text bursts sent") \
+  X(M_BLE_INFLIGHT,        GAUGE,   "ble_inflight_slots",          "Assembler entries currently in use") \
+  X(M_BLE_QUEUE_DEPTH,     GAUGE,   "ble_event_queue_depth",       "Events waiting for ble_tick()") \
+  X(M_WIRE_TEXT_ADV_BYTES, COUNTER, "wire_text_adv_bytes_total",   "Service data capacity of completed text-format messages (parcels x 24)") \
+  X(M_WIRE_TEXT_MSG_BYTES, COUNTER, "wire_text_msg_bytes_total",   "Message bytes of completed text-format messages") \
+  X(M_WIRE_BIN_ADV_BYTES,  COUNTER, "wire_binary_adv_bytes_total", "Service data capacity of completed binary messages (frames x 24)") \
+  X(M_WIRE_BIN_MSG_BYTES,  COUNTER, "wire_binary_msg_bytes_total", "Message bytes of completed binary messages") \
+  X(M_WIRE_CRC_FAIL,       COUNTER, "wire_crc_fail_total",         "Binary messages dropped on the whole-text CRC") \
+  X(M_MSG_WRITES,          COUNTER, "msg_writes_total",            "Records appended to the message log") \
+  X(M_MSG_WRITE_BYTES,     COUNTER, "msg_write_bytes_total",       "Bytes appended to the message log") \
+  X(M_MSG_DUPLICATES,      COUNTER, "msg_duplicates_total",        "Message log appends rejected as duplicates") \
+  X(M_MSG_ERRORS,          COUNTER, "msg_errors_total",            "Message log appends that failed") \
+  X(M_DISPLAY_REFRESH,     COUNTER, "display_msg_refresh_total",   "Message area redraws") \
+  X(M_STORAGE_OPEN_FAIL,   COUNTER, "storage_open_fail_total",     "StorageManager::open failures") \
+  X(M_MSC_READ_BYTES,      COUNTER, "msc_read_bytes_total",        "Bytes read by the USB host") \
+  X(M_MSC_WRITE_BYTES,     COUNTER, "msc_write_bytes_total",       "Bytes written by the USB host") \
+  X(M_WEB_REQUESTS,        COUNTER, "web_requests_total",          "HTTP requests handled") \
+  X(M_WEB_NOT_FOUND,       COUNTER, "web_not_found_total",         "HTTP requests answered with 404") \
+  X(M_UPLOAD_BYTES,        COUNTER, "upload_bytes_total",          "Bytes received by /api/files/upload") \
+  X(M_UPLOAD_DONE,         COUNTER, "upload_completed_total",      "Uploads renamed into place") \
+  X(M_UPLOAD_FAILED,       COUNTER, "upload_failed_total",         "Uploads rejected or failed while writing") \
+  X(M_UPLOAD_LAST_KBPS,    GAUGE,   "upload_last_kbps",            "Throughput of the last completed upload (KiB/s)") \
+  X(M_DOWNLOAD_BYTES,      COUNTER, "download_bytes_total",        "Bytes sent by /api/files/read") \
+  X(M_DOWNLOAD_LAST_KBPS,  GAUGE,   "download_last_kbps",          "Network throughput of the last download (KiB/s)") \
+  X(M_DOWNLOAD_SD_KBPS,    GAUGE,   "download_sd_read_kbps",       "SD read throughput seen by the last download (KiB/s)") \
+  X(M_DIRLIST_CACHE_HIT,   COUNTER, "dirlist_cache_hit_total",     "Directory pages served from the listing cache") \
+  X(M_DIRLIST_CACHE_MISS,  COUNTER, "dirlist_cache_miss_total",    "Directory pages that required a scan") \
+  X(M_STAGING_BYTES,       COUNTER, "staging_bytes_total",         "Bytes staged while the USB host owned the SD card") \
+  X(M_STAGING_DROPPED,     COUNTER, "staging_dropped_total",       "Staged writes lost to a full journal") \
+  X(M_STAGING_REPLAY_MS,   GAUGE,   "staging_last_replay_ms",      "Duration of the last journal replay") \
+  X(M_MSC_HOST_OWNS,       GAUGE,   "msc_host_owns_volume",        "1 while the USB host owns the SD card") \
+  X(M_MSC_CACHE_HIT,       COUNTER, "msc_cache_hits_total",        "USB host reads served from the read-ahead window") \
+  X(M_MSC_CACHE_MISS,      COUNTER, "msc_cache_misses_total",      "USB host reads that needed a card transfer") \
+  X(M_MSC_WRITE_COALESCED, COUNTER, "msc_write_coalesced_total",   "USB host writes merged into a pending transfer") \
+  X(M_MSC_ERRORS,          COUNTER, "msc_errors_total",            "Failed SD transfers on the USB MSC path") \
+  X(M_SD_SEQ_READ_KBPS,    GAUGE,   "sd_seq_read_kbps",            "Sequential SD read throughput measured at mount (KiB/s)") \
+  X(M_SD_SEQ_WRITE_KBPS,   GAUGE,   "sd_seq_write_kbps",           "Sequential SD write throughput measured at mount (KiB/s)") \
+  X(M_BOOT_LISTEN_MS,      GAUGE,   "boot_to_ble_listen_ms",       "Milliseconds from reset until BLE scanning started") \
+  X(M_BOOT_WEB_MS,         GAUGE,   "boot_to_web_ms",              "Milliseconds from reset until the web portal listened") \
+  X(M_BOOT_WIFI_MS,        GAUGE,   "boot_to_wifi_ip_ms",          "Milliseconds from reset until the STA link got an IP (0 = not yet)") \
+  X(M_BOOT_TIME_VALID_MS,  GAUGE,   "boot_to_time_valid_ms",       "Milliseconds from reset until wall time was valid (0 = not yet)") \
+  X(M_WARM_BOOTS,          GAUGE,   "warm_boot_count",             "Consecutive soft resets that restored the RTC receive cache (0 = cold boot)") \
+  X(M_BOOT_COMPLETE_MS,    GAUGE,   "boot_complete_ms",            "Milliseconds from reset until every boot stage had finished") \
+  X(M_BOOT_STAGE_BLE_MS,   GAUGE,   "boot_stage_ble_ms",           "Boot stage duration: BLE init and scan start") \
+  X(M_BOOT_STAGE_STORAGE_MS, GAUGE, "boot_stage_storage_ms",       "Boot stage duration: storage mount and probe") \
+  X(M_BOOT_STAGE_WEB_MS,   GAUGE,   "boot_stage_web_ms",           "Boot stage duration: Wi-Fi and web portal start") \
+  X(M_BOOT_STAGE_TIME_MS,  GAUGE,   "boot_stage_time_ms",          "Boot stage duration: SNTP start") \
+  X(M_BOOT_STAGE_DISPLAY_MS, GAUGE, "boot_stage_display_ms",       "Boot stage duration: TFT and LVGL init") \
+  X(M_TIMESYNC_RX,         COUNTER, "timesync_beacons_rx_total",   "BLE time beacons received") \
+  X(M_TIMESYNC_TX,         COUNTER, "timesync_beacons_tx_total",   "BLE time beacons advertised") \
+  X(M_TIMESYNC_ADJUST,     COUNTER, "timesync_adjust_total",       "Clock corrections taken from BLE time beacons") \
+  X(M_TIMESYNC_STRATUM,    GAUGE,   "timesync_stratum",            "Advertised time stratum (0 = none, 1 = NTP)") \
+  X(M_TIMESYNC_ERR_EST_MS, GAUGE,   "timesync_error_estimate_ms",  "Smoothed offset seen at mesh time corrections") \
+  X(M_PROX_SAMPLES,        COUNTER, "proximity_samples_total",     "RSSI samples fed to the neighbour distance filters") \
+  X(M_PROX_NEIGHBORS,      GAUGE,   "proximity_neighbors",         "Neighbours currently tracked") \
+  X(M_PROX_REPLACED,       COUNTER, "proximity_replaced_total",    "Neighbours pushed out of the full table by a new MAC") \
+  X(M_PROX_PRESENCE,       COUNTER, "proximity_presence_minutes_total", "Presence minutes recorded for identified neighbours in range") \
+  X(M_CENSUS_ADVERTS,      COUNTER, "census_adverts_total",        "Non-geogram advertisements fed to the device census") \
+  X(M_CENSUS_1M,           GAUGE,   "census_devices_1m",           "Distinct advertisers estimated over the last minute") \
+  X(M_CENSUS_15M,          GAUGE,   "census_devices_15m",          "Distinct advertisers estimated over the last 15 minutes") \
+  X(M_CENSUS_1H,           GAUGE,   "census_devices_1h",           "Distinct advertisers estimated over the last hour") \
+  X(M_CENSUS_LINKED,       COUNTER, "census_rotations_linked_total", "New private addresses counted as an earlier device after a rotation") \
+  X(M_CENSUS_UNLINKED,     COUNTER, "census_rotations_unlinked_total", "Rotation links undone because the earlier address spoke again") \
+  X(M_WEAR_FLASH_BYTES,    COUNTER, "flash_write_bytes_total",     "Payload bytes written to internal-flash LittleFS") \
+  X(M_WEAR_OVER_BUDGET,    GAUGE,   "flash_write_over_budget",     "1 while a daily flash write budget is exceeded") \
+  X(M_WEAR_LIFETIME_DAYS,  GAUGE,   "flash_lifetime_days",         "Projected flash lifetime at the observed write rate (0 = unknown)") \
+  X(M_WEAR_PRESENCE_BATCHED, COUNTER, "flash_presence_batched_total", "Presence minutes folded into a batched day-file rewrite") \
+  X(M_STORAGE_WB_BYTES,    COUNTER, "storage_writebehind_bytes_total", "Bytes written by the write-behind storage task") \
+  X(M_LOG_LINES,           COUNTER, "log_lines_total",             "Log lines queued for the drain task") \
+  X(M_LOG_DROPPED_FULL,    COUNTER, "log_dropped_full_total",      "Log lines lost because the ring was full") \
+  X(M_LOG_DROPPED_RATE,    COUNTER, "log_dropped_rate_total",      "Log lines suppressed by rate limiting") \
+  X(M_HEAP_FREE,           GAUGE,   "heap_free_bytes",             "Free internal heap") \
+  X(M_HEAP_MIN_FREE,       GAUGE,   "heap_min_free_bytes",         "Lowest free heap since boot") \
+  X(M_HEAP_LARGEST_BLOCK,  GAUGE,   "heap_largest_free_block_bytes","Largest allocatable block") \
+  X(M_HEAP_FRAG_PCT,       GAUGE,   "heap_fragmentation_percent",  "100 - largest_block*100/free") \
+  X(M_UPTIME_S,            GAUGE,   "uptime_seconds",              "Seconds since boot")
+
+#define METRICS_HISTOGRAMS(X) \
+  X(H_LOOP_US,             "loop_duration_us",              "Main loop iteration (excluding idle delay)") \
+  X(H_BLE_ONRESULT_US,     "ble_onresult_duration_us",      "AdvCb::onResult processing time") \
+  X(H_DISPLAY_UPDATE_US,   "display_update_duration_us",    "updateDisplay() duration") \
+  X(H_MSG_WRITE_US,        "msg_write_duration_us",         "msg_write() duration") \
+  X(H_STORAGE_OPEN_US,     "storage_open_duration_us",      "StorageManager::open() duration") \
+  X(H_MSC_READ_US,         "msc_read_duration_us",          "USB MSC sector read latency") \
+  X(H_MSC_WRITE_US,        "msc_write_duration_us",         "USB MSC sector write latency") \
+  X(H_MSC_SD_XFER_US,      "msc_sd_transfer_duration_us",   "SD multi-block transfer latency behind the MSC cache") \
+  X(H_WEB_HANDLER_US,      "web_handler_duration_us",       "HTTP handler time on the async server") \
+  X(H_DOWNLOAD_READ_US,    "download_read_us",              "One read-ahead block read for a download") \
+  X(H_DIRLIST_US,          "dirlist_page_us",               "One /api/files/list page (cache hit or scan)") \
+  X(H_STORAGE_WB_WRITE_US, "storage_writebehind_write_us",  "One buffered block write on the storage task") \
+  X(H_STORIO_WEB_READ_US,  "storio_web_read_latency_us",    "Storage service: web read, queue wait + service") \
+  X(H_STORIO_LOG_US,       "storio_log_latency_us",         "Storage service: log append, queue wait + service") \
+  X(H_STORIO_UPLOAD_US,    "storio_upload_latency_us",      "Storage service: upload block, queue wait + service") \
+  X(H_STORIO_PRESENCE_US,  "storio_presence_latency_us",    "Storage service: presence flush, queue wait + service") \
+  X(H_STORIO_BACKGROUND_US,"storio_background_latency_us",  "Storage service: background job, queue wait + service")
+
+// Shared upper bounds (inclusive) for every histogram; an implicit +Inf bucket follows.
+#define METRICS_HIST_BOUNDS_US { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 500000 }
+#define METRICS_HIST_NBOUNDS   12
+
+typedef enum {
+#define X_ENUM(id, kind, name, help) id,
+  METRICS_SCALARS(X_ENUM)
+#undef X_ENUM
+  M_COUNT
+} MetricId;
+
+typedef enum {
+#define X_ENUM(id, name, help) id,
+  METRICS_HISTOGRAMS(X_ENUM)
+#undef X_ENUM
+  H_COUNT
+} HistId;
+
+struct MetricHist {
+  std::atomic<uint32_t> buckets[METRICS_HIST_NBOUNDS + 1];
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> sum_lo;   // 64-bit sum split in two words (carry on wrap)
+  std::atomic<uint32_t> sum_hi;
+};
+
+extern std::atomic<uint32_t> g_metric_vals[M_COUNT];
+extern MetricHist            g_metric_hists[H_COUNT];
+extern const uint32_t        g_metric_bounds_us[METRICS_HIST_NBOUNDS];
+
+// ---------- Hot-path API (inline, lock-free) ----------
+static inline void metric_inc(MetricId id, uint32_t n = 1) {
+  g_metric_vals[id].fetch_add(n, std::memory_order_relaxed);
+}
+static inline void metric_set(MetricId id, uint32_t v) {
+  g_metric_vals[id].store(v, std::memory_order_relaxed);
+}
+static inline uint32_t metric_get(MetricId id) {
+  return g_metric_vals[id].load(std::memory_order_relaxed);
+}
+
+static inline void hist_observe(HistId id, uint32_t us) {
+  MetricHist& h = g_metric_hists[id];
+  uint8_t b = 0;
+  while (b < METRICS_HIST_NBOUNDS && us > g_metric_bounds_us[b]) ++b;
+  h.buckets[b].fetch_add(1, std::memory_order_relaxed);
+  h.count.fetch_add(1, std::memory_order_relaxed);
+  uint32_t old = h.sum_lo.fetch_add(us, std::memory_order_relaxed);
+  if ((uint32_t)(old + us) < old) h.sum_hi.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef ARDUINO
+// Scoped timer: observes the elapsed micros() into a histogram on destruction.
+class MetricTimer {
+public:
+  explicit MetricTimer(HistId id) : _id(id), _t0(micros()) {}
+  ~MetricTimer() { hist_observe(_id, (uint32_t)(micros() - _t0)); }
+  uint32_t elapsedUs() const { return (uint32_t)(micros() - _t0); }
+private:
+  HistId   _id;
+  uint32_t _t0;
+};
+
+// Refresh sampled gauges (heap, uptime). Cheap; call from loop().
+// Internally rate-limited to once per METRICS_SAMPLE_MS.
+void metrics_sample();
+
+// Render the full registry. Allocates; call only from request handlers.
+void metrics_render_prometheus(String& out);
+void metrics_render_json(String& out);
+
+// printf onto `out`. Lines longer than the stack buffer are formatted again on the heap
+// rather than cut, so an exposition line always ends in its value and newline.
+void metrics_appendf(String& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+#endif
+
+// Approximate quantile (0..1) from a histogram; returns the upper bound of the bucket holding it.
+uint32_t hist_quantile_us(HistId id, float q);
+static inline uint32_t hist_count(HistId id) {
+  return g_metric_hists[id].count.load(std::memory_order_relaxed);
+}
+
+// Exported names (without the "geogram_" prefix).
+const char* metric_name(MetricId id);
+const char* hist_name(HistId id);
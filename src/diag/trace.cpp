@@ -0,0 +1,109 @@
+// trace.cpp — binary RAM ring for TRACE_* records (compiled out unless GEOGRAM_TRACE)
+#include "trace.h"
+
+#include <string.h>
+#include <atomic>
+
+#ifdef GEOGRAM_TRACE
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static_assert((TRACE_RING_RECORDS & (TRACE_RING_RECORDS - 1)) == 0, "TRACE_RING_RECORDS must be a power of two");
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord layout is part of the dump format");
+
+static TraceRecord           g_ring[TRACE_RING_RECORDS];
+static std::atomic<uint32_t> g_head{0};     // total records ever reserved since clear
+static std::atomic<bool>     g_paused{false};
+
+void trace_record(uint8_t event, uint8_t phase, uint32_t arg0, uint32_t arg1) {
+  if (g_paused.load(std::memory_order_relaxed)) return;
+  uint32_t i = g_head.fetch_add(1, std::memory_order_relaxed);
+  TraceRecord& r = g_ring[i & (TRACE_RING_RECORDS - 1)];
+  r.ts_us    = (uint32_t)esp_timer_get_time();
+  r.event    = event;
+  r.phase    = phase;
+  r.core     = (uint8_t)xPortGetCoreID();
+  r.reserved = 0;
+  r.arg0     = arg0;
+  r.arg1     = arg1;
+}
+
+bool trace_enabled() { return true; }
+
+void trace_clear() {
+  g_paused.store(true);
+  g_head.store(0);
+  g_paused.store(false);
+}
+
+uint32_t trace_count() {
+  uint32_t h = g_head.load(std::memory_order_relaxed);
+  return h < TRACE_RING_RECORDS ? h : TRACE_RING_RECORDS;
+}
+
+size_t trace_snapshot_size() {
+  return sizeof(TraceDumpHeader) + sizeof(g_ring);
+}
+
+size_t trace_snapshot(uint8_t* out, size_t cap) {
+  if (!out || cap < sizeof(TraceDumpHeader)) return 0;
+
+  g_paused.store(true);
+  uint32_t head  = g_head.load();
+  uint32_t n     = head < TRACE_RING_RECORDS ? head : TRACE_RING_RECORDS;
+  uint32_t fit   = (uint32_t)((cap - sizeof(TraceDumpHeader)) / sizeof(TraceRecord));
+  if (n > fit) n = fit;
+
+  TraceDumpHeader h;
+  memcpy(h.magic, "GTRC", 4);
+  h.version     = 1;
+  h.record_size = sizeof(TraceRecord);
+  h.count       = n;
+  h.overwritten = head > TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : 0;
+  h.now_us      = (uint32_t)esp_timer_get_time();
+  memcpy(out, &h, sizeof(h));
+
+  uint8_t* dst = out + sizeof(h);
+  for (uint32_t k = head - n; k != head; ++k) {
+    memcpy(dst, &g_ring[k & (TRACE_RING_RECORDS - 1)], sizeof(TraceRecord));
+    dst += sizeof(TraceRecord);
+  }
+  g_paused.store(false);
+  return (size_t)(dst - out);
+}
+
+void trace_dump_hex(Print& out) {
+  size_t cap = trace_snapshot_size();
+  uint8_t* buf = (uint8_t*)malloc(cap);
+  if (!buf) { out.println("[trace] out of memory"); return; }
+  size_t n = trace_snapshot(buf, cap);
+
+  static const char hex[] = "0123456789abcdef";
+  char line[2 * 32 + 1];
+  out.println("-----BEGIN GEOGRAM TRACE-----");
+  for (size_t i = 0; i < n; i += 32) {
+    size_t m = (n - i) < 32 ? (n - i) : 32;
+    for (size_t j = 0; j < m; ++j) {
+      line[2 * j]     = hex[buf[i + j] >> 4];
+      line[2 * j + 1] = hex[buf[i + j] & 0x0F];
+    }
+    line[2 * m] = '\0';
+    out.println(line);
+  }
+  out.println("-----END GEOGRAM TRACE-----");
+  free(buf);
+}
+
+#else  // !GEOGRAM_TRACE
+
+bool     trace_enabled()                          { return false; }
+void     trace_clear()                            {}
+uint32_t trace_count()                            { return 0; }
+size_t   trace_snapshot_size()                    { return 0; }
+size_t   trace_snapshot(uint8_t*, size_t)         { return 0; }
+#ifdef ARDUINO
+void     trace_dump_hex(Print& out)               { out.println("[trace] disabled (build with -DGEOGRAM_TRACE)"); }
+#endif
+
+#endif
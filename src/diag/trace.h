@@ -0,0 +1,97 @@
+#pragma once
+/*
+  trace.h — Compile-time gated hot-path trace recorder (binary RAM ring + host-side decoder).
+
+  WHAT THIS DOES
+  - Records fixed-size 16-byte binary records {timestamp_us, event, phase, core, arg0, arg1}
+    into a power-of-two RAM ring. Recording is one atomic fetch_add plus a 16-byte store;
+    nothing is formatted or printed on the hot path.
+  - When GEOGRAM_TRACE is not defined, every TRACE_* macro compiles to nothing and the
+    ring is not allocated.
+
+  ENABLE (platformio.ini)
+        build_flags = ... -DGEOGRAM_TRACE
+
+  DUMP
+  - HTTP : GET /api/trace            -> binary dump (application/octet-stream)
+  - USB  : type "/trace/dump" on the serial console -> hex dump between BEGIN/END markers
+  - Decode on Linux:
+        python3 tools/trace_decode.py dump.bin > trace.json
+    and open trace.json in chrome://tracing or https://ui.perfetto.dev
+
+  DUMP FORMAT (little-endian)
+    TraceDumpHeader, then `count` TraceRecord entries, oldest first.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Event ids are part of the dump format; keep tools/trace_decode.py in sync when adding.
+typedef enum {
+  TR_NONE          = 0,
+  TR_ADV_RX        = 1,   // arg0 = payload length, arg1 = rssi (int8 widened)
+  TR_DEDUPE_HIT    = 2,   // arg0 = payload length
+  TR_PARCEL_STORED = 3,   // arg0 = assembler slot, arg1 = payload length
+  TR_EVT_QUEUED    = 4,   // arg0 = BleEventType, arg1 = queue depth after push
+  TR_MSG_DONE      = 5,   // arg0 = assembler slot, arg1 = message length
+  TR_TX            = 6,   // B/E pair; arg0 = payload length
+  TR_FLASH_WRITE   = 7,   // B/E pair; arg0 = bytes
+  TR_MSC_READ      = 8,   // B/E pair; arg0 = lba, arg1 = bytes
+  TR_MSC_WRITE     = 9,   // B/E pair; arg0 = lba, arg1 = bytes
+  TR_LOOP          = 10,  // B/E pair around loop() work
+  TR_WEB_REQUEST   = 11,  // instant; arg0 = url length
+  TR_EVENT_COUNT
+} TraceEvent;
+
+typedef enum {
+  TR_PH_INSTANT = 'i',
+  TR_PH_BEGIN   = 'B',
+  TR_PH_END     = 'E'
+} TracePhase;
+
+typedef struct {
+  uint32_t ts_us;     // esp_timer low 32 bits
+  uint8_t  event;     // TraceEvent
+  uint8_t  phase;     // TracePhase
+  uint8_t  core;      // CPU core that recorded it
+  uint8_t  reserved;
+  uint32_t arg0;
+  uint32_t arg1;
+} TraceRecord;
+
+typedef struct {
+  char     magic[4];      // "GTRC"
+  uint16_t version;       // 1
+  uint16_t record_size;   // sizeof(TraceRecord)
+  uint32_t count;         // records that follow
+  uint32_t overwritten;   // records lost to ring wrap since last clear
+  uint32_t now_us;        // timestamp at dump time
+} TraceDumpHeader;
+
+#ifndef TRACE_RING_RECORDS
+#define TRACE_RING_RECORDS 1024   // power of two; 16 KB of RAM
+#endif
+
+#ifdef GEOGRAM_TRACE
+  void trace_record(uint8_t event, uint8_t phase, uint32_t arg0, uint32_t arg1);
+  #define TRACE_INSTANT(ev, a0, a1) trace_record((ev), TR_PH_INSTANT, (uint32_t)(a0), (uint32_t)(a1))
+  #define TRACE_BEGIN(ev, a0, a1)   trace_record((ev), TR_PH_BEGIN,   (uint32_t)(a0), (uint32_t)(a1))
+  #define TRACE_END(ev, a0, a1)     trace_record((ev), TR_PH_END,     (uint32_t)(a0), (uint32_t)(a1))
+#else
+  #define TRACE_INSTANT(ev, a0, a1) do {} while (0)
+  #define TRACE_BEGIN(ev, a0, a1)   do {} while (0)
+  #define TRACE_END(ev, a0, a1)     do {} while (0)
+#endif
+
+// Always available so API handlers link in both configurations.
+bool   trace_enabled();
+void   trace_clear();
+size_t trace_snapshot_size();                     // bytes a full snapshot needs (header + records)
+size_t trace_snapshot(uint8_t* out, size_t cap);  // copies header + records oldest-first; returns bytes
+uint32_t trace_count();                           // records currently held
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+  // Hex dump framed by "-----BEGIN GEOGRAM TRACE-----" / "-----END GEOGRAM TRACE-----".
+  void trace_dump_hex(Print& out);
+#endif
@@ -1,12 +1,15 @@
 #include <TFT_eSPI.h>
 #include <lvgl.h>
 #include <WiFi.h>
-#include <Preferences.h>
 #include "lv_driver.h"
 #include "misc/pinconfig.h"
 
 // BLE event interface (loose coupling)
 #include "ble/ble.h"
+#include "diag/metrics.h"
+#include "ble/warmcache.h"
+#include "ble/addressing.h"
+#include "ble/census.h"
 
 TFT_eSPI screen = TFT_eSPI();
 
@@ -29,6 +32,7 @@ static void on_ble_event(const BleEvent* e, void* /*ctx*/) {
 
     switch (e->type) {
         case BLE_EVT_MESSAGE_DONE: {
+            if (e->data.done.addr == ADDR_OTHER) break;     // assembled for relaying only
             const char* from     = e->data.done.from;
             const char* snippet  = e->data.done.snippet;
             const uint32_t mlen  = e->data.done.msg_len;
@@ -58,6 +62,7 @@ static void on_ble_event(const BleEvent* e, void* /*ctx*/) {
                 s_msgs[MSG_SHOW_MAX - 1][MSG_LINE_CAP - 1] = '\0';
             }
 
+            warm_msg_push(line);
             s_msgs_dirty = true;
             break;
         }
@@ -77,10 +82,6 @@ void initDisplay() {
 
     screen.setTextFont(1);
     screen.setTextColor(TFT_GREEN, TFT_BLACK);
-    delay(1000);
-
-    // Serial may already be started in main; keeping this is harmless
-    Serial.begin(115200);
 
     lvgl_init();
 
@@ -157,13 +158,17 @@ void initDisplay() {
     // Subscribe to BLE events AFTER UI is ready
     ble_subscribe(on_ble_event, nullptr);
 
-    // Clear buffers
+    // Clear buffers, then bring back what was shown before a soft reset
     for (uint8_t i = 0; i < MSG_SHOW_MAX; ++i) s_msgs[i][0] = '\0';
-    s_msgs_cnt = 0;
-    s_msgs_dirty = false;
+    char warm[MSG_SHOW_MAX][WARM_MSG_LEN];
+    s_msgs_cnt = warm_msgs(warm, MSG_SHOW_MAX);
+    for (uint8_t i = 0; i < s_msgs_cnt; ++i) memcpy(s_msgs[i], warm[i], WARM_MSG_LEN);
+    s_msgs_dirty = s_msgs_cnt > 0;
 }
 
 void updateDisplay() {
+    MetricTimer timer(H_DISPLAY_UPDATE_US);
+
     // Pump LVGL
     lv_timer_handler();
 
@@ -188,11 +193,8 @@ void updateDisplay() {
         lv_label_set_text(status_label, buf);
     }
 
-    // Devices count (from Preferences)
-    Preferences prefs;
-    prefs.begin("stats", true);
-    int count = prefs.getInt("users_detected", 0);
-    prefs.end();
+    // Devices around over the last 15 minutes (passive census, see ble/census.h)
+    int count = census_enabled() ? (int)census_estimate(CENSUS_15M) : 0;
 
     if (device_count_label) {
         if (count > 0) {
@@ -207,6 +209,7 @@ void updateDisplay() {
     // Apply messages to UI
     if (s_msgs_dirty) {
         s_msgs_dirty = false;
+        metric_inc(M_DISPLAY_REFRESH);
 
         if (msg_label) {
             // Combine up to last 3 messages into one wrapped label (newest first)
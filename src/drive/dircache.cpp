@@ -0,0 +1,362 @@
+#include "dircache.h"
+#include "storage.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "ff.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "diag/metrics.h"
+
+extern StorageManager storage;
+
+#ifndef DIRCACHE_SLOTS
+#define DIRCACHE_SLOTS 4                    // directories kept, LRU
+#endif
+#ifndef DIRCACHE_MAX_ENTRIES
+#define DIRCACHE_MAX_ENTRIES 1024           // larger directories are paged by scanning
+#endif
+#ifndef DIRCACHE_MAX_NAME_BYTES
+#define DIRCACHE_MAX_NAME_BYTES (16 * 1024)
+#endif
+#ifndef DIRCACHE_TTL_MS
+#define DIRCACHE_TTL_MS 30000
+#endif
+
+static_assert(DIRCACHE_MAX_ENTRIES <= 65535 && DIRCACHE_MAX_NAME_BYTES <= 65535, "cache indices are 16-bit");
+
+// ---------- Filesystem iteration ----------
+struct RawEntry {
+    const char* name;
+    uint32_t size;
+    uint32_t mtime;
+    bool isDir;
+};
+
+static uint32_t fatTime(WORD d, WORD t) {
+    if (d == 0) return 0;
+    struct tm tmv = {};
+    tmv.tm_year = ((d >> 9) & 0x7F) + 80;
+    tmv.tm_mon  = ((d >> 5) & 0x0F) - 1;
+    tmv.tm_mday = d & 0x1F;
+    tmv.tm_hour = t >> 11;
+    tmv.tm_min  = (t >> 5) & 0x3F;
+    tmv.tm_sec  = (t & 0x1F) * 2;
+    tmv.tm_isdst = -1;
+    return (uint32_t)mktime(&tmv);
+}
+
+// Calls fn(const RawEntry&) for every entry of `dir`. `name` is only valid during the call.
+template <typename F>
+static bool scanDir(const String& dir, F fn) {
+    if (storage.isUsingSD()) {
+        // FatFs hands out size/date with each entry; going through VFS readdir would need an
+        // f_stat per entry, which rescans the directory (quadratic on big directories).
+        FF_DIR d;
+        FILINFO fi;
+        String p = String(STORAGE_SD_FAT_DRIVE) + dir;
+        if (f_opendir(&d, p.c_str()) != FR_OK) return false;
+        while (f_readdir(&d, &fi) == FR_OK && fi.fname[0]) {
+            RawEntry e = { fi.fname, (uint32_t)fi.fsize, fatTime(fi.fdate, fi.ftime), (fi.fattrib & AM_DIR) != 0 };
+            fn(e);
+        }
+        f_closedir(&d);
+        return true;
+    }
+
+    String base = storage.vfsPath(dir);
+    DIR* d = opendir(base.c_str());
+    if (!d) return false;
+    if (!base.endsWith("/")) base += "/";
+    String full;
+    struct dirent* de;
+    while ((de = readdir(d)) != nullptr) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        full = base;
+        full += de->d_name;
+        RawEntry e = { de->d_name, 0, 0, de->d_type == DT_DIR };
+        struct stat st;
+        if (stat(full.c_str(), &st) == 0) {
+            e.size = (uint32_t)st.st_size;
+            e.mtime = (uint32_t)st.st_mtime;
+            e.isDir = S_ISDIR(st.st_mode);
+        }
+        fn(e);
+    }
+    closedir(d);
+    return true;
+}
+
+// ---------- Ordering ----------
+struct Key {
+    uint32_t num;        // size or mtime; 0 for name order
+    const char* name;    // tie-break, so keys are unique within a directory
+};
+
+static inline uint32_t keyNum(DirSort s, uint32_t size, uint32_t mtime) {
+    return s == DIRSORT_SIZE ? size : s == DIRSORT_MTIME ? mtime : 0;
+}
+
+static inline int keyCmp(const Key& a, const Key& b) {
+    if (a.num != b.num) return a.num < b.num ? -1 : 1;
+    return strcmp(a.name, b.name);
+}
+
+// True if `a` comes first in the requested order.
+static inline bool before(const Key& a, const Key& b, bool desc) {
+    int c = keyCmp(a, b);
+    return desc ? c > 0 : c < 0;
+}
+
+static String encodeCursor(DirSort s, const DirEntry& e) {
+    if (s == DIRSORT_NAME) return e.name;
+    return String(keyNum(s, e.size, e.mtime)) + ":" + e.name;
+}
+
+// Cursor strings are "<name>" (name order) or "<num>:<name>"; `name` points into `cursor`.
+static Key decodeCursor(DirSort s, const String& cursor) {
+    Key k = { 0, cursor.c_str() };
+    if (s != DIRSORT_NAME) {
+        char* colon = nullptr;
+        k.num = (uint32_t)strtoul(cursor.c_str(), &colon, 10);
+        k.name = (colon && *colon == ':') ? colon + 1 : "";
+    }
+    return k;
+}
+
+// ---------- Cache ----------
+struct CEntry {
+    uint32_t size;
+    uint32_t mtime;
+    uint16_t nameOff;
+    uint8_t isDir;
+};
+
+struct CachedDir {
+    String dir;
+    uint32_t builtMs = 0;
+    uint32_t lastUse = 0;
+    std::vector<CEntry> entries;              // sorted by name
+    std::vector<char> names;                  // NUL-terminated, packed
+    std::vector<uint16_t> order[3];           // size/mtime permutations, built on first use
+};
+
+static CachedDir s_cache[DIRCACHE_SLOTS];
+static SemaphoreHandle_t s_lock = nullptr;
+
+struct CacheLock {
+    CacheLock() {
+        if (!s_lock) s_lock = xSemaphoreCreateMutex();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    ~CacheLock() { xSemaphoreGive(s_lock); }
+};
+
+static void dropSlot(CachedDir& c) {
+    c.dir = "";
+    std::vector<CEntry>().swap(c.entries);
+    std::vector<char>().swap(c.names);
+    for (auto& o : c.order) std::vector<uint16_t>().swap(o);
+}
+
+static CachedDir* findCached(const String& dir) {
+    uint32_t now = millis();
+    for (auto& c : s_cache) {
+        if (c.dir.length() == 0 || c.dir != dir) continue;
+        if (now - c.builtMs > DIRCACHE_TTL_MS) {
+            dropSlot(c);
+            return nullptr;
+        }
+        c.lastUse = now;
+        return &c;
+    }
+    return nullptr;
+}
+
+static void installCached(const String& dir, std::vector<CEntry>& entries, std::vector<char>& names) {
+    CachedDir* victim = &s_cache[0];
+    for (auto& c : s_cache) {
+        if (c.dir == dir) { victim = &c; break; }
+        if (c.dir.length() == 0) { victim = &c; break; }
+        if (c.lastUse < victim->lastUse) victim = &c;
+    }
+    dropSlot(*victim);
+
+    const char* base = names.data();
+    std::sort(entries.begin(), entries.end(), [base](const CEntry& a, const CEntry& b) {
+        return strcmp(base + a.nameOff, base + b.nameOff) < 0;
+    });
+    victim->dir = dir;
+    victim->entries.swap(entries);
+    victim->names.swap(names);
+    victim->builtMs = victim->lastUse = millis();
+}
+
+static const std::vector<uint16_t>* orderFor(CachedDir& c, DirSort s) {
+    if (s == DIRSORT_NAME) return nullptr;
+    std::vector<uint16_t>& o = c.order[s];
+    if (o.size() != c.entries.size()) {
+        o.resize(c.entries.size());
+        for (size_t i = 0; i < o.size(); ++i) o[i] = (uint16_t)i;
+        const CEntry* e = c.entries.data();
+        const char* base = c.names.data();
+        std::sort(o.begin(), o.end(), [e, base, s](uint16_t a, uint16_t b) {
+            Key ka = { keyNum(s, e[a].size, e[a].mtime), base + e[a].nameOff };
+            Key kb = { keyNum(s, e[b].size, e[b].mtime), base + e[b].nameOff };
+            return keyCmp(ka, kb) < 0;
+        });
+    }
+    return &o;
+}
+
+static void pageFromCache(CachedDir& c, DirSort sort, bool desc, const String& cursor, size_t limit, DirPage& out) {
+    const std::vector<uint16_t>* order = orderFor(c, sort);
+    const size_t n = c.entries.size();
+    auto at = [&](size_t i) -> const CEntry& { return c.entries[order ? (*order)[i] : i]; };
+    auto keyAt = [&](size_t i) -> Key {
+        const CEntry& e = at(i);
+        return Key{ keyNum(sort, e.size, e.mtime), c.names.data() + e.nameOff };
+    };
+
+    // First position (in ascending index space) whose key is >= / > the cursor
+    size_t lo = 0;
+    if (cursor.length()) {
+        Key ck = decodeCursor(sort, cursor);
+        size_t a = 0, b = n;
+        while (a < b) {
+            size_t m = (a + b) / 2;
+            int cmp = keyCmp(keyAt(m), ck);
+            if (desc ? cmp < 0 : cmp <= 0) a = m + 1; else b = m;
+        }
+        lo = a;
+    }
+
+    // asc walks [lo, n); desc walks (lo-1 .. 0] when a cursor is set, else from n-1
+    size_t remaining = desc ? (cursor.length() ? lo : n) : n - lo;
+    size_t take = remaining < limit ? remaining : limit;
+    out.entries.reserve(take);
+    for (size_t k = 0; k < take; ++k) {
+        size_t i = desc ? (cursor.length() ? lo : n) - 1 - k : lo + k;
+        const CEntry& e = at(i);
+        out.entries.push_back(DirEntry{ String(c.names.data() + e.nameOff), e.size, e.mtime, e.isDir != 0 });
+    }
+    out.total = (uint32_t)n;
+    out.cached = true;
+    if (take < remaining && take > 0) out.next = encodeCursor(sort, out.entries.back());
+}
+
+// ---------- Public ----------
+static String normalizeDir(const String& dir) {
+    String d = dir.startsWith("/") ? dir : "/" + dir;
+    while (d.length() > 1 && d.endsWith("/")) d.remove(d.length() - 1);
+    return d;
+}
+
+bool dir_list_page(const String& dirIn, DirSort sort, bool desc, const String& cursor, size_t limit, DirPage& out) {
+    MetricTimer timer(H_DIRLIST_US);
+    String dir = normalizeDir(dirIn);
+    out.entries.clear();
+    out.next = "";
+    out.total = 0;
+    out.cached = false;
+    if (limit == 0) limit = 1;
+
+    {
+        CacheLock lock;
+        CachedDir* c = findCached(dir);
+        if (c) {
+            metric_inc(M_DIRLIST_CACHE_HIT);
+            pageFromCache(*c, sort, desc, cursor, limit, out);
+            return true;
+        }
+    }
+    metric_inc(M_DIRLIST_CACHE_MISS);
+
+    // One pass: keep the `limit` first entries after the cursor in a bounded heap whose top is
+    // the last of them, and collect a cache candidate while the directory stays within budget.
+    bool hasCursor = cursor.length() > 0;
+    Key ck = decodeCursor(sort, cursor);
+    auto keyOf = [sort](const DirEntry& e) { return Key{ keyNum(sort, e.size, e.mtime), e.name.c_str() }; };
+    auto heapLess = [&](const DirEntry& a, const DirEntry& b) { return before(keyOf(a), keyOf(b), desc); };
+
+    std::vector<DirEntry>& heap = out.entries;
+    heap.reserve(limit);
+    uint32_t after = 0;
+    std::vector<CEntry> centries;
+    std::vector<char> cnames;
+    bool cacheable = true;
+
+    bool ok = scanDir(dir, [&](const RawEntry& e) {
+        out.total++;
+        if (cacheable) {
+            size_t len = strlen(e.name) + 1;
+            if (centries.size() >= DIRCACHE_MAX_ENTRIES || cnames.size() + len > DIRCACHE_MAX_NAME_BYTES) {
+                cacheable = false;
+                std::vector<CEntry>().swap(centries);
+                std::vector<char>().swap(cnames);
+            } else {
+                centries.push_back(CEntry{ e.size, e.mtime, (uint16_t)cnames.size(), (uint8_t)e.isDir });
+                cnames.insert(cnames.end(), e.name, e.name + len);
+            }
+        }
+
+        Key k = { keyNum(sort, e.size, e.mtime), e.name };
+        if (hasCursor && !before(ck, k, desc)) return;
+        after++;
+        if (heap.size() < limit) {
+            heap.push_back(DirEntry{ String(e.name), e.size, e.mtime, e.isDir });
+            std::push_heap(heap.begin(), heap.end(), heapLess);
+        } else if (before(k, keyOf(heap.front()), desc)) {
+            std::pop_heap(heap.begin(), heap.end(), heapLess);
+            DirEntry& slot = heap.back();
+            slot.name = e.name;
+            slot.size = e.size;
+            slot.mtime = e.mtime;
+            slot.isDir = e.isDir;
+            std::push_heap(heap.begin(), heap.end(), heapLess);
+        }
+    });
+    if (!ok) return false;
+
+    std::sort_heap(heap.begin(), heap.end(), heapLess);
+    if (after > heap.size() && !heap.empty()) out.next = encodeCursor(sort, heap.back());
+
+    if (cacheable) {
+        CacheLock lock;
+        installCached(dir, centries, cnames);
+    }
+    return true;
+}
+
+void dir_cache_invalidate(const String& pathIn) {
+    String path = normalizeDir(pathIn);
+    int slash = path.lastIndexOf('/');
+    String parent = slash <= 0 ? "/" : path.substring(0, slash);
+    String prefix = path + "/";
+
+    CacheLock lock;
+    for (auto& c : s_cache) {
+        if (c.dir.length() == 0) continue;
+        if (c.dir == parent || c.dir == path || c.dir.startsWith(prefix)) dropSlot(c);
+    }
+}
+
+void dir_cache_invalidate_all() {
+    CacheLock lock;
+    for (auto& c : s_cache) dropSlot(c);
+}
+
+const char* dir_sort_name(DirSort s) {
+    return s == DIRSORT_SIZE ? "size" : s == DIRSORT_MTIME ? "mtime" : "name";
+}
+
+int dir_sort_from_name(const String& s) {
+    if (s == "name") return DIRSORT_NAME;
+    if (s == "size") return DIRSORT_SIZE;
+    if (s == "mtime") return DIRSORT_MTIME;
+    return -1;
+}
@@ -0,0 +1,51 @@
+#pragma once
+/*
+  dircache.h — Paginated directory listing with a small per-directory cache.
+
+  Entries are read straight from the filesystem iterator (FatFs f_readdir on the SD card,
+  VFS readdir + stat on LittleFS): no fs::File per entry, no per-entry heap churn.
+
+  - A directory whose listing fits the cache budget is kept (names packed into one buffer,
+    sorted by name; size/mtime orders are built lazily as index permutations) and pages are
+    served by binary search on the cursor.
+  - Larger directories are never materialised: each page is one scan that keeps only the
+    `limit` smallest entries after the cursor (bounded heap), so memory is O(limit).
+  - The cursor is the sort key of the last entry returned; it stays valid across inserts and
+    deletes, unlike an offset.
+
+  Writers that go through the API call dir_cache_invalidate(path); entries also expire after
+  DIRCACHE_TTL_MS to cover writers that do not (message log, USB host).
+*/
+
+#include <Arduino.h>
+#include <vector>
+
+typedef enum {
+    DIRSORT_NAME = 0,
+    DIRSORT_SIZE,
+    DIRSORT_MTIME
+} DirSort;
+
+struct DirEntry {
+    String name;
+    uint32_t size;
+    uint32_t mtime;     // seconds since epoch (local time on FAT)
+    bool isDir;
+};
+
+struct DirPage {
+    std::vector<DirEntry> entries;
+    String next;        // cursor for the following page; empty on the last page
+    uint32_t total;     // entries in the directory
+    bool cached;        // served from the cache
+};
+
+// `dir` is an FS path ("/", "/presence"). Returns false if it is not a readable directory.
+bool dir_list_page(const String& dir, DirSort sort, bool desc, const String& cursor, size_t limit, DirPage& out);
+
+// Drops the cached listing of `path`'s parent directory (and of `path` itself if it is a directory).
+void dir_cache_invalidate(const String& path);
+void dir_cache_invalidate_all();
+
+const char* dir_sort_name(DirSort s);
+int dir_sort_from_name(const String& s);   // -1 if unknown
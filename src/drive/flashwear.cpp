@@ -0,0 +1,174 @@
+#include "flashwear.h"
+#include "storage.h"
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+extern StorageManager storage;
+
+#ifndef WEAR_BUDGET_MESSAGES_KB
+#define WEAR_BUDGET_MESSAGES_KB  2048
+#endif
+#ifndef WEAR_BUDGET_PRESENCE_KB
+#define WEAR_BUDGET_PRESENCE_KB  1024
+#endif
+#ifndef WEAR_BUDGET_UPLOAD_KB
+#define WEAR_BUDGET_UPLOAD_KB    8192
+#endif
+#ifndef WEAR_BUDGET_STAGING_KB
+#define WEAR_BUDGET_STAGING_KB   1024
+#endif
+#ifndef WEAR_BUDGET_OTHER_KB
+#define WEAR_BUDGET_OTHER_KB     512
+#endif
+#ifndef WEAR_BUDGET_TOTAL_KB
+#define WEAR_BUDGET_TOTAL_KB     8192
+#endif
+#ifndef WEAR_ENDURANCE_CYCLES
+#define WEAR_ENDURANCE_CYCLES    100000      // typical NOR flash erase endurance
+#endif
+#ifndef WEAR_AMPLIFICATION
+#define WEAR_AMPLIFICATION       2           // LittleFS metadata + copy-on-write overhead estimate
+#endif
+#ifndef WEAR_PERSIST_MS
+#define WEAR_PERSIST_MS          (60UL * 60 * 1000)
+#endif
+
+#define WEAR_DAY_MS              (24UL * 60 * 60 * 1000)
+#define WEAR_MIN_SAMPLE_MS       (10UL * 60 * 1000)   // no projection before this much uptime
+
+static const uint32_t kBudgetKb[WEAR_SUBSYS_COUNT] = {
+    WEAR_BUDGET_MESSAGES_KB, WEAR_BUDGET_PRESENCE_KB, WEAR_BUDGET_UPLOAD_KB,
+    WEAR_BUDGET_STAGING_KB, WEAR_BUDGET_OTHER_KB
+};
+static const char* const kNames[WEAR_SUBSYS_COUNT] = {
+    "messages", "presence", "upload", "staging", "other"
+};
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool s_loaded = false;
+static uint32_t s_budgetTotal = 0;
+static uint32_t s_dayStart = 0;
+static uint32_t s_today[WEAR_SUBSYS_COUNT] = {};
+static uint32_t s_todayTotal = 0;
+static bool s_overBudget = false;
+static uint64_t s_sinceBoot = 0;
+static uint64_t s_lifetimeBase = 0;        // persisted total at boot
+static uint64_t s_persisted = 0;           // lifetime total last written to NVS
+static uint32_t s_lastPersist = 0;
+
+static void load() {
+    if (s_loaded) return;
+    Preferences prefs;
+    prefs.begin("config", true);
+    uint32_t kb = prefs.getString("flash_budget_kb", "").toInt();
+    prefs.end();
+    s_budgetTotal = (kb ? kb : WEAR_BUDGET_TOTAL_KB) * 1024;
+
+    prefs.begin("wear", true);
+    s_lifetimeBase = prefs.getULong64("total", 0);
+    prefs.end();
+    s_persisted = s_lifetimeBase;
+    s_dayStart = millis();
+    s_lastPersist = millis();
+    s_loaded = true;
+}
+
+static void persist() {
+    uint64_t total = s_lifetimeBase + s_sinceBoot;
+    if (total == s_persisted) return;
+    Preferences prefs;
+    prefs.begin("wear", false);
+    prefs.putULong64("total", total);
+    prefs.end();
+    s_persisted = total;
+}
+
+void wear_record(WearSubsystem s, uint32_t bytes) {
+    if ((unsigned)s >= WEAR_SUBSYS_COUNT || bytes == 0) return;
+    load();
+    uint32_t now = millis();
+    bool crossed = false, save = false, newDay = false;
+    portENTER_CRITICAL(&s_mux);
+    if (now - s_dayStart >= WEAR_DAY_MS) {
+        s_dayStart = now;
+        memset(s_today, 0, sizeof(s_today));
+        s_todayTotal = 0;
+        s_overBudget = false;
+        newDay = true;
+    }
+    s_today[s] += bytes;
+    s_todayTotal += bytes;
+    s_sinceBoot += bytes;
+    if (!s_overBudget && (s_today[s] > kBudgetKb[s] * 1024 || s_todayTotal > s_budgetTotal)) {
+        s_overBudget = crossed = true;
+    }
+    if (now - s_lastPersist >= WEAR_PERSIST_MS) {
+        s_lastPersist = now;
+        save = true;
+    }
+    portEXIT_CRITICAL(&s_mux);
+
+    metric_inc(M_WEAR_FLASH_BYTES, bytes);
+    if (newDay) metric_set(M_WEAR_OVER_BUDGET, 0);
+    if (crossed) {
+        metric_set(M_WEAR_OVER_BUDGET, 1);
+        GLOGW(LOGM_STORAGE, "Flash write budget exceeded (%s: %u KB today, total %u KB)",
+              kNames[s], (unsigned)(s_today[s] / 1024), (unsigned)(s_todayTotal / 1024));
+    }
+    if (save) persist();
+}
+
+void wear_record_active(WearSubsystem s, uint32_t bytes) {
+    if (storage.isUsingLittleFS()) wear_record(s, bytes);
+}
+
+bool wear_throttle(WearSubsystem s) {
+    if (!storage.isUsingLittleFS() || (unsigned)s >= WEAR_SUBSYS_COUNT) return false;
+    load();
+    portENTER_CRITICAL(&s_mux);
+    bool over = millis() - s_dayStart < WEAR_DAY_MS &&   // a new day starts with the next write
+                (s_today[s] > kBudgetKb[s] * 1024 || s_todayTotal > s_budgetTotal);
+    portEXIT_CRITICAL(&s_mux);
+    return over;
+}
+
+bool wear_over_budget() {
+    return s_overBudget && millis() - s_dayStart < WEAR_DAY_MS;
+}
+
+const char* wear_subsys_name(WearSubsystem s) {
+    return (unsigned)s < WEAR_SUBSYS_COUNT ? kNames[s] : "?";
+}
+
+void wear_stats(WearStats* out) {
+    if (!out) return;
+    load();
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < WEAR_SUBSYS_COUNT; i++) {
+        out->todayBytes[i] = s_today[i];
+        out->budgetBytes[i] = kBudgetKb[i] * 1024;
+    }
+    out->todayTotal = s_todayTotal;
+    out->budgetTotal = s_budgetTotal;
+    out->lifetimeBytes = s_lifetimeBase + s_sinceBoot;
+    uint64_t sinceBoot = s_sinceBoot;
+    portEXIT_CRITICAL(&s_mux);
+    out->overBudget = wear_over_budget();
+
+    uint32_t up = millis();
+    out->ratePerDay = up >= WEAR_MIN_SAMPLE_MS ? (uint32_t)(sinceBoot * WEAR_DAY_MS / up) : 0;
+    out->lifetimeDays = UINT32_MAX;
+    size_t partition = storage.isUsingLittleFS() ? LittleFS.totalBytes() : 0;
+    if (partition && out->ratePerDay) {
+        uint64_t endurance = (uint64_t)partition * WEAR_ENDURANCE_CYCLES;
+        uint64_t worn = out->lifetimeBytes * WEAR_AMPLIFICATION;
+        uint64_t left = endurance > worn ? endurance - worn : 0;
+        uint64_t days = left / ((uint64_t)out->ratePerDay * WEAR_AMPLIFICATION);
+        out->lifetimeDays = days > UINT32_MAX - 1 ? UINT32_MAX - 1 : (uint32_t)days;
+    }
+    metric_set(M_WEAR_LIFETIME_DAYS, out->lifetimeDays == UINT32_MAX ? 0 : out->lifetimeDays);
+}
@@ -0,0 +1,56 @@
+#pragma once
+/*
+  flashwear.h — Write budget for the internal-flash LittleFS volume.
+
+  Without an SD card every message segment, presence rewrite and upload lands on the ESP32's
+  own flash, which wears out. Writers report the bytes they put on flash, per subsystem;
+  the module keeps per-day totals against budgets and projects the flash lifetime from the
+  observed rate.
+
+  - Budgets: WEAR_BUDGET_<SUBSYSTEM>_KB per day, plus an overall daily budget (config key
+    "flash_budget_kb", KB/day, 0 = WEAR_BUDGET_TOTAL_KB).
+  - Enforcement is left to low-value writers: they ask wear_throttle() and batch or
+    downsample (presence flushes less often) while it returns true. Messages and uploads are
+    only accounted.
+  - Over budget raises a sticky-for-the-day flag shown in /status/get and in metrics.
+  - Lifetime = (partition bytes x WEAR_ENDURANCE_CYCLES - bytes written so far, amplified by
+    WEAR_AMPLIFICATION) / observed daily rate. The lifetime total is kept in NVS.
+
+  "Day" is a 24 h window of uptime, so the budget works before (or without) valid wall time.
+*/
+
+#include <stdint.h>
+
+typedef enum {
+    WEAR_MESSAGES = 0,
+    WEAR_PRESENCE,
+    WEAR_UPLOAD,
+    WEAR_STAGING,
+    WEAR_OTHER,
+    WEAR_SUBSYS_COUNT
+} WearSubsystem;
+
+typedef struct {
+    uint32_t todayBytes[WEAR_SUBSYS_COUNT];
+    uint32_t budgetBytes[WEAR_SUBSYS_COUNT];
+    uint32_t todayTotal;
+    uint32_t budgetTotal;
+    uint64_t lifetimeBytes;       // payload bytes written to flash over the device's life
+    uint32_t ratePerDay;          // observed since boot, bytes/day
+    uint32_t lifetimeDays;        // projected remaining life at that rate (UINT32_MAX = no data)
+    bool overBudget;              // some budget was exceeded in the current day
+} WearStats;
+
+// Bytes written to internal flash (e.g. the staging spill file).
+void wear_record(WearSubsystem s, uint32_t bytes);
+
+// Bytes written to the active volume; counted only when that volume is LittleFS.
+void wear_record_active(WearSubsystem s, uint32_t bytes);
+
+// True while `s` (or the device as a whole) is over today's budget on flash. Low-value writers
+// should batch or downsample while this holds. Always false when SD is the active volume.
+bool wear_throttle(WearSubsystem s);
+
+bool wear_over_budget();
+const char* wear_subsys_name(WearSubsystem s);
+void wear_stats(WearStats* out);
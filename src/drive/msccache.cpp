@@ -0,0 +1,213 @@
+#include "msccache.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <soc/soc_memory_layout.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+static sdmmc_card_t* s_card = nullptr;
+static uint32_t s_ss = 512;                 // sector size
+static SemaphoreHandle_t s_lock = nullptr;
+
+// Read-ahead window
+static uint8_t* s_ra = nullptr;
+static uint32_t s_raLba = 0, s_raCount = 0;
+static uint32_t s_nextSeq = UINT32_MAX;     // lba right after the previous host read
+
+// Write-coalescing window
+static uint8_t* s_wb = nullptr;
+static uint32_t s_wbLba = 0, s_wbCount = 0;
+static uint32_t s_lastWriteMs = 0;
+static bool     s_deferredError = false;    // a background flush failed; tell the host next time
+
+static MscCacheStats s_stats = {};
+
+struct MscLock {
+    MscLock() { xSemaphoreTake(s_lock, portMAX_DELAY); }
+    ~MscLock() { xSemaphoreGive(s_lock); }
+};
+
+static bool dmaOk(const void* p) {
+    return esp_ptr_dma_capable(p) && ((uintptr_t)p & 3) == 0;
+}
+
+static bool cardRead(uint8_t* dst, uint32_t lba, uint32_t count) {
+    uint32_t t0 = micros();
+    esp_err_t err = sdmmc_read_sectors(s_card, dst, lba, count);
+    hist_observe(H_MSC_SD_XFER_US, (uint32_t)(micros() - t0));
+    if (err != ESP_OK) {
+        s_stats.errors++;
+        metric_inc(M_MSC_ERRORS);
+        GLOGE(LOGM_STORAGE, "MSC read lba %u x%u failed: %s", (unsigned)lba, (unsigned)count, esp_err_to_name(err));
+    }
+    return err == ESP_OK;
+}
+
+static bool cardWrite(const uint8_t* src, uint32_t lba, uint32_t count) {
+    uint32_t t0 = micros();
+    esp_err_t err = sdmmc_write_sectors(s_card, src, lba, count);
+    hist_observe(H_MSC_SD_XFER_US, (uint32_t)(micros() - t0));
+    s_stats.flushes++;
+    if (err != ESP_OK) {
+        s_stats.errors++;
+        metric_inc(M_MSC_ERRORS);
+        GLOGE(LOGM_STORAGE, "MSC write lba %u x%u failed: %s", (unsigned)lba, (unsigned)count, esp_err_to_name(err));
+    }
+    return err == ESP_OK;
+}
+
+static void invalidateRead(uint32_t lba, uint32_t count) {
+    if (s_raCount && lba < s_raLba + s_raCount && s_raLba < lba + count) s_raCount = 0;
+}
+
+// The read-ahead window may have been filled before these sectors reached the card
+static bool flushLocked() {
+    if (s_wbCount == 0) return true;
+    bool ok = cardWrite(s_wb, s_wbLba, s_wbCount);
+    invalidateRead(s_wbLba, s_wbCount);
+    s_wbCount = 0;
+    return ok;
+}
+
+static bool wbOverlaps(uint32_t lba, uint32_t count) {
+    return s_wbCount && lba < s_wbLba + s_wbCount && s_wbLba < lba + count;
+}
+
+bool msc_cache_begin(sdmmc_card_t* card) {
+    if (!s_lock) s_lock = xSemaphoreCreateMutex();
+    MscLock lock;
+    s_card = card;
+    s_ss = card->csd.sector_size;
+    s_raCount = s_wbCount = 0;
+    s_nextSeq = UINT32_MAX;
+    s_deferredError = false;
+    size_t bytes = (size_t)MSC_CACHE_SECTORS * s_ss;
+    if (!s_ra) s_ra = (uint8_t*)heap_caps_aligned_alloc(32, bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!s_wb) s_wb = (uint8_t*)heap_caps_aligned_alloc(32, bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!s_ra || !s_wb) {
+        GLOGW(LOGM_STORAGE, "MSC cache: no DMA memory, using direct transfers");
+        return false;
+    }
+    return true;
+}
+
+void msc_cache_end() {
+    if (!s_lock) return;
+    MscLock lock;
+    flushLocked();
+    if (s_ra) heap_caps_free(s_ra);
+    if (s_wb) heap_caps_free(s_wb);
+    s_ra = s_wb = nullptr;
+    s_raCount = s_wbCount = 0;
+}
+
+int32_t msc_cache_read(uint32_t lba, uint32_t offset, uint8_t* dst, uint32_t bytes) {
+    if (!s_card || offset % s_ss || bytes % s_ss) return -1;
+    MscLock lock;
+    lba += offset / s_ss;
+    uint32_t count = bytes / s_ss;
+    bool sequential = (lba == s_nextSeq);
+    s_nextSeq = lba + count;
+
+    if (s_deferredError) {
+        s_deferredError = false;
+        return -1;
+    }
+    // Pending writes must reach the card before anything overlapping is read back
+    if (wbOverlaps(lba, count) && !flushLocked()) return -1;
+
+    if (!s_ra) {
+        return cardRead(dst, lba, count) ? (int32_t)bytes : -1;
+    }
+
+    if (s_raCount && lba >= s_raLba && lba + count <= s_raLba + s_raCount) {
+        memcpy(dst, s_ra + (lba - s_raLba) * s_ss, bytes);
+        s_stats.readHits++;
+        metric_inc(M_MSC_CACHE_HIT);
+        return (int32_t)bytes;
+    }
+
+    s_stats.readMisses++;
+    metric_inc(M_MSC_CACHE_MISS);
+    if (count > MSC_CACHE_SECTORS) {
+        // Bigger than the window: straight into the caller's buffer when the DMA allows it
+        if (dmaOk(dst)) return cardRead(dst, lba, count) ? (int32_t)bytes : -1;
+        for (uint32_t done = 0; done < count; done += MSC_CACHE_SECTORS) {
+            uint32_t n = count - done < MSC_CACHE_SECTORS ? count - done : MSC_CACHE_SECTORS;
+            if (!cardRead(s_ra, lba + done, n)) { s_raCount = 0; return -1; }
+            memcpy(dst + done * s_ss, s_ra, n * s_ss);
+        }
+        s_raCount = 0;
+        return (int32_t)bytes;
+    }
+
+    uint32_t fill = sequential ? MSC_CACHE_SECTORS : count;
+    uint32_t capacity = (uint32_t)s_card->csd.capacity;
+    if (lba + fill > capacity) fill = capacity - lba;
+    // The read-ahead reaches past the request: it must not cache sectors still in s_wb
+    if (wbOverlaps(lba, fill) && !flushLocked()) return -1;
+    if (fill < count || !cardRead(s_ra, lba, fill)) {
+        s_raCount = 0;
+        return -1;
+    }
+    s_raLba = lba;
+    s_raCount = fill;
+    memcpy(dst, s_ra, bytes);
+    return (int32_t)bytes;
+}
+
+int32_t msc_cache_write(uint32_t lba, uint32_t offset, const uint8_t* src, uint32_t bytes) {
+    if (!s_card || offset % s_ss || bytes % s_ss) return -1;
+    MscLock lock;
+    lba += offset / s_ss;
+    uint32_t count = bytes / s_ss;
+    s_lastWriteMs = millis();
+    invalidateRead(lba, count);
+
+    if (s_deferredError) {
+        s_deferredError = false;
+        return -1;
+    }
+    if (!s_wb) {
+        return cardWrite(src, lba, count) ? (int32_t)bytes : -1;
+    }
+
+    // A write that does not continue the pending run closes it
+    if (s_wbCount && lba != s_wbLba + s_wbCount && !flushLocked()) return -1;
+
+    if (s_wbCount == 0 && count >= MSC_CACHE_SECTORS && dmaOk(src)) {
+        return cardWrite(src, lba, count) ? (int32_t)bytes : -1;
+    }
+
+    for (uint32_t done = 0; done < count; ) {
+        if (s_wbCount == 0) s_wbLba = lba + done;
+        else s_stats.writesCoalesced++;
+        uint32_t room = MSC_CACHE_SECTORS - s_wbCount;
+        uint32_t n = count - done < room ? count - done : room;
+        memcpy(s_wb + s_wbCount * s_ss, src + done * s_ss, n * s_ss);
+        s_wbCount += n;
+        done += n;
+        if (s_wbCount == MSC_CACHE_SECTORS && !flushLocked()) return -1;
+    }
+    return (int32_t)bytes;
+}
+
+bool msc_cache_flush() {
+    if (!s_lock) return true;
+    MscLock lock;
+    return flushLocked();
+}
+
+void msc_cache_tick() {
+    if (!s_lock || s_wbCount == 0 || millis() - s_lastWriteMs < MSC_CACHE_IDLE_FLUSH_MS) return;
+    MscLock lock;
+    if (s_wbCount && !flushLocked()) s_deferredError = true;
+}
+
+void msc_cache_stats(MscCacheStats* out) {
+    if (out) *out = s_stats;
+}
@@ -0,0 +1,51 @@
+#pragma once
+/*
+  msccache.h — Sector cache between TinyUSB MSC callbacks and the SD card.
+
+  - Read-ahead: a sequential host read (lba == end of the previous one) fills a DMA-aligned
+    window of MSC_CACHE_SECTORS with one multi-block transfer; later reads are memcpy hits.
+    Random reads load just what was asked for, so FAT lookups are not amplified.
+  - Write coalescing: contiguous host writes are gathered into a second window and written
+    with one multi-block transfer when it is full, when the stream breaks, when a read or
+    the read-ahead behind it overlaps it, after MSC_CACHE_IDLE_FLUSH_MS of inactivity, or on
+    hand-over. A flush drops any read-ahead sectors it rewrote.
+  - Both windows live in internal DMA memory, so the SDMMC driver never falls back to its
+    per-sector bounce copy (which it does for TinyUSB's unaligned endpoint buffer).
+  - Errors: a failed transfer makes the callback return -1 (SCSI check condition). A failed
+    deferred flush is reported on the next host command.
+
+  Buffers exist only while the host owns the card (msc_cache_begin .. msc_cache_end).
+
+  No throughput figure is claimed yet: tools/msc_bench.sh (O_DIRECT dd from a Linux host) is
+  the comparison against the one-callback-per-transfer path, and has not been run on hardware.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdmmc_cmd.h"
+
+#ifndef MSC_CACHE_SECTORS
+#define MSC_CACHE_SECTORS 32          // per window: 16 KB with 512-byte sectors
+#endif
+#ifndef MSC_CACHE_IDLE_FLUSH_MS
+#define MSC_CACHE_IDLE_FLUSH_MS 20
+#endif
+
+typedef struct {
+    uint32_t readHits;        // host reads served from the read-ahead window
+    uint32_t readMisses;      // host reads that needed a card transfer
+    uint32_t writesCoalesced; // host writes appended to a pending window
+    uint32_t flushes;         // card write transfers issued
+    uint32_t errors;          // failed card transfers
+} MscCacheStats;
+
+bool    msc_cache_begin(sdmmc_card_t* card);   // allocate windows; false if out of DMA memory
+void    msc_cache_end();                       // flush and free
+
+// TinyUSB callback bodies: return `bytes` on success, -1 on error.
+int32_t msc_cache_read(uint32_t lba, uint32_t offset, uint8_t* dst, uint32_t bytes);
+int32_t msc_cache_write(uint32_t lba, uint32_t offset, const uint8_t* src, uint32_t bytes);
+
+bool    msc_cache_flush();
+void    msc_cache_tick();                      // idle flush; call from the loop task
+void    msc_cache_stats(MscCacheStats* out);
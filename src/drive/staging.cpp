@@ -0,0 +1,248 @@
+#include "staging.h"
+#include "storage.h"
+#include "flashwear.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+extern StorageManager storage;
+
+#ifndef STAGING_RAM_BYTES
+#define STAGING_RAM_BYTES (16 * 1024)
+#endif
+#ifndef STAGING_FLASH_BYTES
+#define STAGING_FLASH_BYTES (256 * 1024)
+#endif
+#ifndef STAGING_FLASH_PATH
+#define STAGING_FLASH_PATH "/staging.jnl"
+#endif
+
+#define STAGE_MAGIC  0xA5
+#define STAGE_APPEND 1           // the only record type: append data to path
+
+struct StageHdr {
+    uint8_t magic;
+    uint8_t op;
+    uint8_t pathLen;
+    uint8_t reserved;
+    uint32_t len;
+    uint32_t crc;            // over path + data
+};
+
+static uint8_t*  s_ram = nullptr;        // allocated on first capture, freed after replay
+static size_t    s_ramUsed = 0;
+static bool      s_spilling = false;     // once set, every record goes to flash (keeps order)
+static uint32_t  s_flashBytes = 0;
+static bool      s_lfsMounted = false;
+static bool      s_dropLogged = false;
+static StagingStats s_stats = {};
+static SemaphoreHandle_t s_lock = nullptr;
+
+struct StagingLock {
+    StagingLock() {
+        if (!s_lock) s_lock = xSemaphoreCreateMutex();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    ~StagingLock() { xSemaphoreGive(s_lock); }
+};
+
+static uint32_t recordCrc(const char* path, size_t pathLen, const uint8_t* data, size_t len) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)path, pathLen);
+    return esp_rom_crc32_le(crc, data, len);
+}
+
+static void setPersisted(bool on) {
+    Preferences prefs;
+    prefs.begin("storage", false);
+    prefs.putBool("jnl", on);
+    prefs.end();
+}
+
+static bool mountLittleFS() {
+    if (!s_lfsMounted) s_lfsMounted = storage.isUsingLittleFS() || LittleFS.begin(false);
+    return s_lfsMounted;
+}
+
+// ---------- RAM journal ----------
+static bool ramAppend(const StageHdr& h, const char* path, const uint8_t* data) {
+    size_t need = sizeof(h) + h.pathLen + h.len;
+    if (!s_ram) s_ram = (uint8_t*)malloc(STAGING_RAM_BYTES);
+    if (!s_ram) return false;
+    if (s_ramUsed + need > STAGING_RAM_BYTES) return false;
+    memcpy(s_ram + s_ramUsed, &h, sizeof(h));
+    memcpy(s_ram + s_ramUsed + sizeof(h), path, h.pathLen);
+    memcpy(s_ram + s_ramUsed + sizeof(h) + h.pathLen, data, h.len);
+    s_ramUsed += need;
+    return true;
+}
+
+// ---------- Flash journal ----------
+static bool flashAppend(const StageHdr& h, const char* path, const uint8_t* data) {
+    size_t need = sizeof(h) + h.pathLen + h.len;
+    if (s_flashBytes + need > STAGING_FLASH_BYTES || !mountLittleFS()) return false;
+    if (!s_spilling) {
+        setPersisted(true);
+        s_spilling = true;
+        GLOGW(LOGM_STORAGE, "Staging RAM full, spilling to LittleFS");
+    }
+    File f = LittleFS.open(STAGING_FLASH_PATH, FILE_APPEND);
+    if (!f) return false;
+    bool ok = f.write((const uint8_t*)&h, sizeof(h)) == sizeof(h) &&
+              f.write((const uint8_t*)path, h.pathLen) == h.pathLen &&
+              f.write(data, h.len) == h.len;
+    f.close();
+    if (ok) {
+        s_flashBytes += need;
+        s_stats.spilledBytes += need;
+        wear_record(WEAR_STAGING, need);
+    }
+    return ok;
+}
+
+bool staging_capture(const char* path, const uint8_t* data, size_t len) {
+    StagingLock lock;
+    if (storage.deviceOwnsVolume()) return false;
+
+    size_t pathLen = strlen(path);
+    StageHdr h = { STAGE_MAGIC, STAGE_APPEND, (uint8_t)pathLen, 0, (uint32_t)len, recordCrc(path, pathLen, data, len) };
+    bool ok = pathLen <= 255 &&
+              ((!s_spilling && ramAppend(h, path, data)) || flashAppend(h, path, data));
+    if (ok) {
+        s_stats.records++;
+        s_stats.bytes += len;
+        metric_inc(M_STAGING_BYTES, (uint32_t)len);
+    } else {
+        // Logged once per host session: the log file sink itself writes through here
+        if (!s_dropLogged) GLOGE(LOGM_STORAGE, "Staging journal full, dropping writes (first: %s)", path);
+        s_dropLogged = true;
+        s_stats.dropped++;
+        metric_inc(M_STAGING_DROPPED);
+    }
+    // Always "handled": the card is not ours to write while the host owns it.
+    return true;
+}
+
+// ---------- Replay ----------
+struct Applier {
+    String root;
+    String openPath;
+    FILE* f = nullptr;
+    uint32_t bytes = 0;
+    uint32_t errors = 0;
+
+    static void mkdirs(const String& full, size_t from) {
+        for (int i = full.indexOf('/', from); i > 0; i = full.indexOf('/', i + 1)) {
+            mkdir(full.substring(0, i).c_str(), 0777);
+        }
+    }
+
+    void close() {
+        if (f) fclose(f);
+        f = nullptr;
+        openPath = "";
+    }
+
+    void apply(uint8_t op, const char* path, size_t pathLen, const uint8_t* data, uint32_t len, uint32_t crc) {
+        if (op != STAGE_APPEND || recordCrc(path, pathLen, data, len) != crc) { errors++; return; }
+        String full = root;
+        full.concat(path, pathLen);
+        // Consecutive appends to the same file (log, message tail) reuse one open handle
+        if (full != openPath) {
+            close();
+            mkdirs(full, root.length() + 1);
+            f = fopen(full.c_str(), "ab");
+            if (!f) { errors++; return; }
+            openPath = full;
+        }
+        if (fwrite(data, 1, len, f) != len) errors++;
+        else bytes += len;
+    }
+};
+
+static void replayFlash(Applier& a) {
+    if (!mountLittleFS()) return;
+    File f = LittleFS.open(STAGING_FLASH_PATH, FILE_READ);
+    if (!f) return;
+    char path[256];
+    uint8_t* buf = nullptr;
+    size_t cap = 0;
+    StageHdr h;
+    while (f.read((uint8_t*)&h, sizeof(h)) == sizeof(h)) {
+        if (h.magic != STAGE_MAGIC) { a.errors++; break; }   // torn tail after a reset
+        if (h.len > cap) {
+            free(buf);
+            cap = h.len;
+            buf = (uint8_t*)malloc(cap);
+            if (!buf) { a.errors++; cap = 0; break; }
+        }
+        if (f.read((uint8_t*)path, h.pathLen) != h.pathLen || f.read(buf, h.len) != h.len) { a.errors++; break; }
+        a.apply(h.op, path, h.pathLen, buf, h.len, h.crc);
+    }
+    free(buf);
+    f.close();
+    LittleFS.remove(STAGING_FLASH_PATH);
+}
+
+bool staging_replay(const char* mountRoot, void (*release)()) {
+    StagingLock lock;
+    uint32_t t0 = millis();
+    Applier a;
+    a.root = mountRoot;
+
+    // RAM records are always older than flash records (spilling is sticky until replay)
+    for (size_t r = 0; s_ram && r < s_ramUsed; ) {
+        const StageHdr* h = (const StageHdr*)(s_ram + r);
+        const char* p = (const char*)(s_ram + r + sizeof(StageHdr));
+        a.apply(h->op, p, h->pathLen, (const uint8_t*)p + h->pathLen, h->len, h->crc);
+        r += sizeof(StageHdr) + h->pathLen + h->len;
+    }
+    if (s_spilling || staging_has_persisted()) {
+        replayFlash(a);
+        setPersisted(false);
+    }
+    a.close();
+
+    free(s_ram);
+    s_ram = nullptr;
+    s_ramUsed = 0;
+    s_spilling = false;
+    s_flashBytes = 0;
+    s_dropLogged = false;
+
+    s_stats.replays++;
+    s_stats.replayErrors += a.errors;
+    s_stats.lastReplayMs = millis() - t0;
+    s_stats.lastReplayBytes = a.bytes;
+    metric_set(M_STAGING_REPLAY_MS, s_stats.lastReplayMs);
+    if (a.bytes || a.errors) {
+        GLOGI(LOGM_STORAGE, "Staging replay: %u bytes in %u ms, %u errors",
+              (unsigned)a.bytes, (unsigned)s_stats.lastReplayMs, (unsigned)a.errors);
+    }
+
+    if (release) release();
+    return a.errors == 0;
+}
+
+bool staging_has_persisted() {
+    Preferences prefs;
+    prefs.begin("storage", true);
+    bool on = prefs.getBool("jnl", false);
+    prefs.end();
+    return on;
+}
+
+void staging_stats(StagingStats* out) {
+    if (!out) return;
+    StagingLock lock;
+    *out = s_stats;
+    out->pendingBytes = (uint32_t)s_ramUsed + s_flashBytes;
+}
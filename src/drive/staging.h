@@ -0,0 +1,46 @@
+#pragma once
+/*
+  staging.h — Write journal used while a USB host owns the SD card.
+
+  While the card is exported over USB MSC, FATFS is unmounted on the device and nothing may
+  touch it. Appending writers call staging_capture() first: if the host owns the volume the
+  append is recorded in the journal (RAM first, spilling to a LittleFS file when RAM is full)
+  and the call returns true; otherwise it returns false and the caller writes the card directly.
+  The log file sink and the message log are switched over by the ownership listener in
+  main.cpp. Uploads are not staged (they are answered 423 instead: a file of any size does not
+  fit the journal), and presence defers its read-modify-writes in RAM.
+
+  When the host ejects the volume, StorageManager remounts FATFS and replays the journal in
+  order before handing the card back to on-device writers (under the journal lock, so no
+  record can slip in between). A spilled journal survives a reboot and is replayed at boot.
+
+        if (staging_capture(path, data, len)) return true;   // staged
+        ...write directly...
+*/
+
+#include <Arduino.h>
+
+typedef struct {
+    uint32_t records;        // records captured since boot
+    uint32_t bytes;          // payload bytes captured since boot
+    uint32_t dropped;        // records lost because RAM and flash budgets were exhausted
+    uint32_t pendingBytes;   // journal bytes waiting for replay (RAM + flash)
+    uint32_t spilledBytes;   // bytes written to the LittleFS journal since boot
+    uint32_t replays;        // completed replays
+    uint32_t replayErrors;   // records that could not be applied
+    uint32_t lastReplayMs;   // duration of the last replay
+    uint32_t lastReplayBytes;
+} StagingStats;
+
+// Records an append of `data` to `path` (created if missing) if the USB host owns the volume.
+// Returns false when the caller should write directly (device owns the volume).
+bool staging_capture(const char* path, const uint8_t* data, size_t len);
+
+// Applies the journal below `mountRoot` (e.g. "/sdcard"), clears it, then calls `release`
+// while still holding the journal lock. Returns false if any record failed.
+bool staging_replay(const char* mountRoot, void (*release)());
+
+// True if a journal left over from a previous boot is waiting in LittleFS.
+bool staging_has_persisted();
+
+void staging_stats(StagingStats* out);
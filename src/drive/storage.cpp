@@ -1,9 +1,19 @@
 #include "storage.h"
 #include "pin_config.h"
 
-#include <SPI.h>
-#include <SD.h>
 #include <LittleFS.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory>
+#include <atomic>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <sys/stat.h>
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include "vfs_api.h"
 #include "USB.h"
 #include "USBMSC.h"
 #include "driver/sdmmc_host.h"
@@ -11,56 +21,179 @@
 #include "driver/gpio.h"
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
+#include "diskio_impl.h"
+#include "diskio_sdmmc.h"
+#include "ff.h"
+#include "staging.h"
+#include "msccache.h"
+#include "storageio.h"
+#include "diag/metrics.h"
+#include "diag/trace.h"
+#include "diag/log.h"
 
 USBMSC MSC;
 USBCDC USBSerial;
-#define HWSerial    Serial0
-#define MOUNT_POINT "/sdcard"
-sdmmc_card_t *card;
+sdmmc_card_t *card = nullptr;
 
-#ifndef SD_CS_PIN
-#define SD_CS_PIN 13
-#endif
+// fs::FS view of the FATFS VFS mount. The Arduino SD object is never begun (it would mount
+// a second time over SPI), so file access goes through this one.
+static std::shared_ptr<VFSImpl> s_sdImpl = std::make_shared<VFSImpl>();
+static fs::FS s_sdFS(s_sdImpl);
+static SemaphoreHandle_t s_mountLock = nullptr;
 
 StorageManager::StorageManager() :
+    _refs(0),
     _usingSD(false),
     _sdInitialized(false),
-    _littleFSInitialized(false)
+    _littleFSInitialized(false),
+    _ownershipCbs{},
+    _card{}
 {
 }
 
+// ---------- USB MSC arbitration ----------
+// The card has one owner at a time. DEVICE: FATFS is mounted for on-device writers. HOST:
+// FATFS is unmounted, the host gets raw sectors, and on-device writers go to the staging
+// journal (staging.h). Enumeration alone does not hand the card over (every PC port and many
+// chargers enumerate the dongle): the medium is offered while USB is up, and the host's first
+// READ10/WRITE10 asks for it. That command is answered busy while the hand-over runs:
+//   DRAINING    tick() has parked the writers; open file sessions end themselves (at most
+//               STORAGE_QUIESCE_MS, checked on every tick, loop() is never held up)
+//   UNMOUNTING  FATFS is unmounted on the storage task once its queues are empty, so no
+//               f_write() can be cut in half
+//   HOST        the host reads and writes through the sector cache
+// Eject or unplug gives the card back; after an eject the medium stays withdrawn until the
+// next plug.
+enum Handover : uint8_t { HO_DEVICE, HO_DRAINING, HO_UNMOUNTING, HO_HOST };
+static volatile uint8_t s_handover = HO_DEVICE;
+static uint32_t s_drainStart = 0;
+static std::atomic<int> s_sessions(0);
+static volatile bool s_hostOwns = false;
+static volatile bool s_wantHost = false;
+static volatile bool s_offered = false;   // medium shown to an enumerated host
+static volatile bool s_hostIo = false;    // MSC reads/writes reach the card (FATFS is down)
+static SemaphoreHandle_t s_hostIoLock = nullptr;   // held by a callback while it uses the cache
+static FATFS* s_fatfs = nullptr;
+static const BYTE kPdrv = STORAGE_SD_FAT_DRIVE[0] - '0';
+
+static bool fatMount() {
+    if (s_fatfs) return true;
+    FATFS* fs = nullptr;
+    if (ff_diskio_register_sdmmc(kPdrv, card) != ESP_OK) return false;
+    if (esp_vfs_fat_register(STORAGE_SD_MOUNT, STORAGE_SD_FAT_DRIVE, STORAGE_MAX_FILES, &fs) != ESP_OK) {
+        ff_diskio_unregister(kPdrv);
+        return false;
+    }
+    if (f_mount(fs, STORAGE_SD_FAT_DRIVE, 1) != FR_OK) {
+        esp_vfs_fat_unregister_path(STORAGE_SD_MOUNT);
+        ff_diskio_unregister(kPdrv);
+        return false;
+    }
+    s_fatfs = fs;
+    s_sdImpl->mountpoint(STORAGE_SD_MOUNT);
+    return true;
+}
+
+static void fatUnmount() {
+    if (!s_fatfs) return;
+    s_sdImpl->mountpoint(nullptr);   // fs::FS calls fail cleanly instead of reaching FATFS
+    f_mount(nullptr, STORAGE_SD_FAT_DRIVE, 0);
+    esp_vfs_fat_unregister_path(STORAGE_SD_MOUNT);
+    ff_diskio_unregister(kPdrv);
+    s_fatfs = nullptr;
+}
+
+// Host I/O before the hand-over: request it and answer busy (0), which makes TinyUSB call
+// again. The delay keeps the USB task from spinning against the loop task doing the work.
+static int32_t awaitHandover() {
+    if (!s_offered) return -1;
+    s_wantHost = true;
+    vTaskDelay(pdMS_TO_TICKS(10));
+    return 0;
+}
+
+// Host I/O to the cache, or nothing: tick() takes the lock to close the path before it frees
+// the cache and remounts FATFS, so a late callback cannot slip through to the raw card.
+struct HostIo {
+    bool open;
+    HostIo() : open(false) {
+        if (!s_hostIo) return;
+        xSemaphoreTake(s_hostIoLock, portMAX_DELAY);
+        open = s_hostIo;
+        if (!open) xSemaphoreGive(s_hostIoLock);
+    }
+    ~HostIo() { if (open) xSemaphoreGive(s_hostIoLock); }
+};
+
+static void closeHostIo() {
+    xSemaphoreTake(s_hostIoLock, portMAX_DELAY);
+    s_hostIo = false;
+    xSemaphoreGive(s_hostIoLock);
+}
+
 static int32_t onRead(uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize) {
-    uint32_t count = (bufsize / card->csd.sector_size);
-    sdmmc_read_sectors(card, reinterpret_cast<uint8_t *>(buffer) + offset, lba, count);
-    return bufsize;
+    HostIo io;
+    if (!io.open) return awaitHandover();
+    MetricTimer timer(H_MSC_READ_US);
+    TRACE_BEGIN(TR_MSC_READ, lba, bufsize);
+    int32_t ret = msc_cache_read(lba, offset, reinterpret_cast<uint8_t *>(buffer), bufsize);
+    TRACE_END(TR_MSC_READ, lba, bufsize);
+    if (ret > 0) metric_inc(M_MSC_READ_BYTES, bufsize);
+    return ret;
 }
 
 static int32_t onWrite(uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize) {
-    uint32_t count = (bufsize / card->csd.sector_size);
-    sdmmc_write_sectors(card, buffer + offset, lba, count);
-    return bufsize;
+    HostIo io;
+    if (!io.open) return awaitHandover();
+    MetricTimer timer(H_MSC_WRITE_US);
+    TRACE_BEGIN(TR_MSC_WRITE, lba, bufsize);
+    int32_t ret = msc_cache_write(lba, offset, buffer, bufsize);
+    TRACE_END(TR_MSC_WRITE, lba, bufsize);
+    if (ret > 0) metric_inc(M_MSC_WRITE_BYTES, bufsize);
+    return ret;
 }
 
 static bool onStartStop(uint8_t power_condition, bool start, bool load_eject) {
-    HWSerial.printf("MSC START/STOP: power: %u, start: %u, eject: %u\n", power_condition, start, load_eject);
+    GLOGI(LOGM_STORAGE, "MSC START/STOP: power: %u, start: %u, eject: %u", power_condition, start, load_eject);
+    if (!start && load_eject) {
+        s_offered = false;   // not shown again until the next plug
+        s_wantHost = false;
+    }
     return true;
 }
 
+// Storage task, behind every request queued before it: nothing is mid-write on FATFS here
+static StorIoStatus unmountJob(void*) {
+    if (s_handover != HO_UNMOUNTING || !card) return STORIO_DONE;   // unmountSD() came first
+    if (storio_backlog()) return STORIO_AGAIN;
+    fatUnmount();
+    msc_cache_begin(card);
+    s_hostIo = true;
+    s_handover = HO_HOST;
+    GLOGI(LOGM_STORAGE, "SD card handed to USB host; on-device writes are staged");
+    return STORIO_DONE;
+}
+
 static void usbEventCallback(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     if (event_base == ARDUINO_USB_EVENTS) {
         arduino_usb_event_data_t *data = (arduino_usb_event_data_t *)event_data;
         switch (event_id) {
             case ARDUINO_USB_STARTED_EVENT:
-                HWSerial.println("USB PLUGGED");
+                // Offered only: the card changes hands when the host first reads or writes it
+                GLOGI(LOGM_STORAGE, "USB PLUGGED");
+                s_offered = true;
                 break;
             case ARDUINO_USB_STOPPED_EVENT:
-                HWSerial.println("USB UNPLUGGED");
+                GLOGI(LOGM_STORAGE, "USB UNPLUGGED");
+                s_offered = false;
+                s_wantHost = false;
                 break;
             case ARDUINO_USB_SUSPEND_EVENT:
-                HWSerial.printf("USB SUSPENDED: remote_wakeup_en: %u\n", data->suspend.remote_wakeup_en);
+                // The host may still have the volume mounted: keep ownership until eject/unplug
+                GLOGI(LOGM_STORAGE, "USB SUSPENDED: remote_wakeup_en: %u", data->suspend.remote_wakeup_en);
                 break;
             case ARDUINO_USB_RESUME_EVENT:
-                HWSerial.println("USB RESUMED");
+                GLOGI(LOGM_STORAGE, "USB RESUMED");
                 break;
             default:
                 break;
@@ -69,15 +202,72 @@ static void usbEventCallback(void *arg, esp_event_base_t event_base, int32_t eve
 }
 
 bool StorageManager::begin() {
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = false,
-        .max_files = 5,
-        .allocation_unit_size = 16 * 1024
-    };
+    if (!s_mountLock) s_mountLock = xSemaphoreCreateMutex();
+    xSemaphoreTake(s_mountLock, portMAX_DELAY);
+    bool ok = true;
+    if (_refs == 0) {
+        if (mountSD()) {
+            _usingSD = true;
+        } else if (LittleFS.begin(true)) {
+            _littleFSInitialized = true;
+            _usingSD = false;
+            GLOGI(LOGM_STORAGE, "Using LittleFS (SD card not available)");
+        } else {
+            GLOGE(LOGM_STORAGE, "Failed to initialize any storage system");
+            ok = false;
+        }
+        if (ok) storio_begin();
+    }
+    if (ok) _refs++;
+    xSemaphoreGive(s_mountLock);
+    return ok;
+}
 
+void StorageManager::end() {
+    if (!s_mountLock) return;
+    xSemaphoreTake(s_mountLock, portMAX_DELAY);
+    if (_refs > 0 && --_refs == 0) {
+        if (_sdInitialized) unmountSD();
+        if (_littleFSInitialized) LittleFS.end();
+        _littleFSInitialized = false;
+        _usingSD = false;
+        GLOGI(LOGM_STORAGE, "Storage unmounted");
+    }
+    xSemaphoreGive(s_mountLock);
+}
+
+// ---------- Bus tuning ----------
+// Cards differ in what they sustain on this board's wiring: some refuse DDR, some take it and
+// then throw CRC errors. mountSD() walks down this ladder until a profile passes a raw read
+// check and a verified write/read of the reserved probe file. The result is remembered per
+// card (NVS key derived from the CID), so later boots start at the known-good profile and
+// only step down again if it stops passing.
+struct SdProfile {
+    uint8_t width;
+    bool ddr;
+    uint32_t khz;
+    const char* name;
+};
+
+static const SdProfile kProfiles[] = {
+    { 4, true,  SDMMC_FREQ_HIGHSPEED, "4bit-ddr-40M" },
+    { 4, false, SDMMC_FREQ_HIGHSPEED, "4bit-40M" },
+    { 4, false, SDMMC_FREQ_DEFAULT,   "4bit-20M" },
+    { 1, false, SDMMC_FREQ_DEFAULT,   "1bit-20M" },
+    { 1, false, 5000,                 "1bit-5M" },
+};
+static const int kProfileCount = sizeof(kProfiles) / sizeof(kProfiles[0]);
+
+#ifndef STORAGE_PROBE_RAW_SECTORS
+#define STORAGE_PROBE_RAW_SECTORS 64        // read twice from LBA 0 and compared
+#endif
+#define STORAGE_PROBE_FILE "/.sdprobe"       // reserved, rewritten in place at every mount
+
+static esp_err_t cardInit(const SdProfile& p) {
     sdmmc_host_t host = SDMMC_HOST_DEFAULT();
-    host.flags = SDMMC_HOST_FLAG_4BIT | SDMMC_HOST_FLAG_DDR;
+    host.flags = (p.width == 4 ? SDMMC_HOST_FLAG_4BIT : SDMMC_HOST_FLAG_1BIT) | (p.ddr ? SDMMC_HOST_FLAG_DDR : 0);
     host.slot = SDMMC_HOST_SLOT_1;
+    host.max_freq_khz = p.khz;
     host.io_voltage = 3.3f;
 
     sdmmc_slot_config_t slot_config = {
@@ -89,7 +279,7 @@ bool StorageManager::begin() {
         .d3 = (gpio_num_t)SD_MMC_D3_PIN,
         .cd = SDMMC_SLOT_NO_CD,
         .wp = SDMMC_SLOT_NO_WP,
-        .width = 4,
+        .width = p.width,
         .flags = SDMMC_SLOT_FLAG_INTERNAL_PULLUP
     };
 
@@ -99,13 +289,134 @@ bool StorageManager::begin() {
     gpio_set_pull_mode(slot_config.d2, GPIO_PULLUP_ONLY);
     gpio_set_pull_mode(slot_config.d3, GPIO_PULLUP_ONLY);
 
-    esp_err_t ret = esp_vfs_fat_sdmmc_mount(MOUNT_POINT, &host, &slot_config, &mount_config, &card);
+    // Card bring-up and the FATFS mount are separate steps (what esp_vfs_fat_sdmmc_mount
+    // does in one go) so FATFS can be dropped and remounted around USB host sessions.
+    esp_err_t ret = host.init();
+    if (ret == ESP_OK) ret = sdmmc_host_init_slot(host.slot, &slot_config);
+    if (ret == ESP_OK) {
+        card = (sdmmc_card_t *)calloc(1, sizeof(sdmmc_card_t));
+        ret = card ? sdmmc_card_init(&host, card) : ESP_ERR_NO_MEM;
+    }
+    if (ret != ESP_OK) {
+        free(card);
+        card = nullptr;
+        sdmmc_host_deinit();
+    }
+    return ret;
+}
+
+static void cardRelease() {
+    free(card);
+    card = nullptr;
+    sdmmc_host_deinit();
+}
 
-    if (ret == ESP_OK && card != nullptr) {
-        _sdInitialized = true;
-        _usingSD = true;
-        Serial.println("Storage: SD card mounted via SDMMC");
+static String cidKey(const sdmmc_cid_t& cid) {
+    uint32_t h = esp_rom_crc32_le(0, (const uint8_t*)&cid.mfg_id, sizeof(cid.mfg_id));
+    h = esp_rom_crc32_le(h, (const uint8_t*)&cid.oem_id, sizeof(cid.oem_id));
+    h = esp_rom_crc32_le(h, (const uint8_t*)cid.name, sizeof(cid.name));
+    h = esp_rom_crc32_le(h, (const uint8_t*)&cid.serial, sizeof(cid.serial));
+    char key[12];
+    snprintf(key, sizeof(key), "sd%08x", (unsigned)h);
+    return String(key);
+}
+
+static int loadProfile(const String& key) {
+    Preferences prefs;
+    prefs.begin("storage", true);
+    int idx = prefs.getUChar(key.c_str(), 0xFF);
+    prefs.end();
+    return idx;
+}
+
+static void saveProfile(const String& key, int idx) {
+    Preferences prefs;
+    prefs.begin("storage", false);
+    prefs.putUChar(key.c_str(), (uint8_t)idx);
+    prefs.end();
+}
+
+// Two multi-block reads of the same sectors must succeed and agree.
+static esp_err_t rawReadCheck() {
+    size_t bytes = (size_t)STORAGE_PROBE_RAW_SECTORS * card->csd.sector_size;
+    uint8_t* a = (uint8_t*)heap_caps_aligned_alloc(32, bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    uint8_t* b = (uint8_t*)heap_caps_aligned_alloc(32, bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    esp_err_t err = (a && b) ? ESP_OK : ESP_ERR_NO_MEM;
+    if (err == ESP_OK) err = sdmmc_read_sectors(card, a, 0, STORAGE_PROBE_RAW_SECTORS);
+    if (err == ESP_OK) err = sdmmc_read_sectors(card, b, 0, STORAGE_PROBE_RAW_SECTORS);
+    if (err == ESP_OK && memcmp(a, b, bytes) != 0) err = ESP_ERR_INVALID_CRC;
+    heap_caps_free(a);
+    heap_caps_free(b);
+    return err == ESP_ERR_NO_MEM ? ESP_OK : err;   // no memory for the check is not the bus's fault
+}
+
+bool StorageManager::mountSD() {
+    uint32_t t0 = millis();
+    storio_begin();   // the probe runs on the storage task like any other file work
+
+    _card = {};
+    String key;
+    bool persisted = false;
+    uint8_t fallbacks = 0;
+    int idx = 0;
+    while (idx < kProfileCount) {
+        const SdProfile& p = kProfiles[idx];
+        esp_err_t err = cardInit(p);
+        if (err == ESP_OK && key.length() == 0) {
+            // First time the card answers: jump to its remembered profile, if any
+            key = cidKey(card->cid);
+            int saved = loadProfile(key);
+            if (saved > idx && saved < kProfileCount) {
+                cardRelease();
+                idx = saved;
+                persisted = true;
+                continue;
+            }
+            persisted = saved == idx;
+        }
+        if (err == ESP_OK) err = rawReadCheck();
+        if (err == ESP_OK && !fatMount()) err = ESP_FAIL;
+        if (err == ESP_OK && !benchmarkSD()) err = ESP_ERR_INVALID_RESPONSE;
+        if (err == ESP_OK) break;
 
+        GLOGW(LOGM_STORAGE, "SD profile %s failed (%s), stepping down", p.name, esp_err_to_name(err));
+        fatUnmount();
+        if (card) cardRelease();
+        idx++;
+        fallbacks++;
+        persisted = false;
+    }
+    if (idx >= kProfileCount) return false;
+    _sdInitialized = true;
+
+    if (key.length() && loadProfile(key) != idx) saveProfile(key, idx);
+    strlcpy(_card.name, card->cid.name, sizeof(_card.name));
+    strlcpy(_card.profile, kProfiles[idx].name, sizeof(_card.profile));
+    _card.profilePersisted = persisted;
+    _card.fallbacks = fallbacks;
+    _card.freqKhz = card->max_freq_khz;
+    _card.busWidth = 1 << card->log_bus_width;
+    _card.ddr = card->is_ddr;
+    _card.capacityBytes = (uint64_t)card->csd.capacity * card->csd.sector_size;
+    _card.mountMs = millis() - t0;
+    metric_set(M_SD_SEQ_WRITE_KBPS, _card.seqWriteKBps);
+    metric_set(M_SD_SEQ_READ_KBPS, _card.seqReadKBps);
+    GLOGI(LOGM_STORAGE, "SD card %s mounted via SDMMC: %u MB, %s (%s), negotiated %u-bit %s %u kHz",
+          _card.name, (unsigned)(_card.capacityBytes >> 20), _card.profile, persisted ? "remembered" : "probed",
+          _card.busWidth, _card.ddr ? "DDR" : "SDR", (unsigned)_card.freqKhz);
+    GLOGI(LOGM_STORAGE, "SD sequential write %u KB/s, read %u KB/s (%u KB probe)",
+          (unsigned)_card.seqWriteKBps, (unsigned)_card.seqReadKBps, (unsigned)(STORAGE_BENCH_BYTES / 1024));
+
+    if (staging_has_persisted()) {
+        // journal spilled before the last reset
+        storio_run(STORIO_BACKGROUND, []() { return staging_replay(STORAGE_SD_MOUNT, nullptr); });
+    }
+
+    // USB can only be started once per boot; a later remount just hands MSC the new card
+    static bool usbStarted = false;
+    if (!usbStarted) {
+        usbStarted = true;
+        s_hostIoLock = xSemaphoreCreateMutex();
         USB.onEvent(usbEventCallback);
         MSC.vendorID("geogram");
         MSC.productID("USB");
@@ -113,29 +424,167 @@ bool StorageManager::begin() {
         MSC.onStartStop(onStartStop);
         MSC.onRead(onRead);
         MSC.onWrite(onWrite);
-        MSC.mediaPresent(true);
+        MSC.mediaPresent(false);   // offered by tick() once the host has enumerated
         MSC.begin(card->csd.capacity, card->csd.sector_size);
         USBSerial.begin();
         USB.begin();
-        return true;
     }
+    return true;
+}
 
-    if (LittleFS.begin(true)) {
-        _littleFSInitialized = true;
-        _usingSD = false;
-        Serial.println("Storage: Using LittleFS (SD card not available)");
-        return true;
-    }
+void StorageManager::unmountSD() {
+    MSC.mediaPresent(false);
+    if (s_hostIo) closeHostIo();
+    msc_cache_end();
+    s_hostOwns = false;
+    s_handover = HO_DEVICE;
+    s_wantHost = false;
+    s_offered = false;
+    fatUnmount();
+    cardRelease();
+    _sdInitialized = false;
+    _card = {};
+}
+
+// Verified sequential write then read of STORAGE_BENCH_BYTES through FATFS, in allocation-unit
+// blocks from DMA memory (the same path uploads and downloads take). The probe file is
+// rewritten in place, so after the first mount no clusters are allocated or freed. Returns
+// false on any I/O error or data mismatch.
+static_assert(STORAGE_BENCH_BYTES % STORAGE_ALLOC_UNIT == 0,
+              "STORAGE_BENCH_BYTES must be 0 or a multiple of STORAGE_ALLOC_UNIT");
 
-    Serial.println("Storage: Failed to initialize any storage system");
+bool StorageManager::benchmarkSD() {
+    _card.seqReadKBps = _card.seqWriteKBps = 0;
+    if (STORAGE_BENCH_BYTES == 0) return true;
+    static const size_t kBlocks = STORAGE_BENCH_BYTES / STORAGE_ALLOC_UNIT;
+    uint8_t* buf = (uint8_t*)heap_caps_aligned_alloc(32, STORAGE_ALLOC_UNIT, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!buf) return true;   // cannot measure, but nothing says the bus is bad
+    uint32_t crcs[kBlocks];
+    uint32_t writeUs = 0, readUs = 0;
+    bool ok = storio_run(STORIO_BACKGROUND, [&]() {
+        const char* path = STORAGE_SD_MOUNT STORAGE_PROBE_FILE;
+        struct stat st;
+        bool fresh = stat(path, &st) != 0;
+        int fd = ::open(path, O_RDWR | O_CREAT, 0666);
+        if (fd < 0) return false;
+        uint32_t seed = esp_random();
+        uint32_t t0 = micros();
+        size_t i = 0;
+        for (; i < kBlocks; i++) {
+            uint32_t* w = (uint32_t*)buf;
+            for (size_t k = 0; k < STORAGE_ALLOC_UNIT / 4; k++) w[k] = seed + (uint32_t)(i * STORAGE_ALLOC_UNIT / 4 + k) * 2654435761u;
+            crcs[i] = esp_rom_crc32_le(0, buf, STORAGE_ALLOC_UNIT);
+            if (::write(fd, buf, STORAGE_ALLOC_UNIT) != STORAGE_ALLOC_UNIT) break;
+        }
+        bool synced = fsync(fd) == 0;
+        writeUs = micros() - t0;
+        if (i < kBlocks || !synced || lseek(fd, 0, SEEK_SET) != 0) { ::close(fd); return false; }
+
+        t0 = micros();
+        for (i = 0; i < kBlocks; i++) {
+            if (::read(fd, buf, STORAGE_ALLOC_UNIT) != STORAGE_ALLOC_UNIT) break;
+            if (esp_rom_crc32_le(0, buf, STORAGE_ALLOC_UNIT) != crcs[i]) break;
+        }
+        readUs = micros() - t0;
+        ::close(fd);
+        // Hidden + system so the USB host's file browser leaves it alone
+        if (fresh) f_chmod(STORAGE_SD_FAT_DRIVE STORAGE_PROBE_FILE, AM_HID | AM_SYS, AM_HID | AM_SYS);
+        return i == kBlocks;
+    });
+    heap_caps_free(buf);
+    if (!ok) return false;
+    if (writeUs) _card.seqWriteKBps = (uint32_t)((uint64_t)STORAGE_BENCH_BYTES * 1000000 / 1024 / writeUs);
+    if (readUs) _card.seqReadKBps = (uint32_t)((uint64_t)STORAGE_BENCH_BYTES * 1000000 / 1024 / readUs);
+    return true;
+}
+
+bool StorageManager::deviceOwnsVolume() const {
+    return !s_hostOwns;
+}
+
+bool StorageManager::beginSession() {
+    s_sessions++;
+    if (!s_hostOwns) return true;
+    s_sessions--;
     return false;
 }
 
+void StorageManager::endSession() {
+    s_sessions--;
+}
+
+void StorageManager::onOwnershipChange(void (*cb)(bool deviceOwns)) {
+    for (auto& slot : _ownershipCbs) {
+        if (!slot) {
+            slot = cb;
+            return;
+        }
+    }
+}
+
+void StorageManager::notifyOwnership(bool deviceOwns) {
+    for (auto cb : _ownershipCbs) {
+        if (cb) cb(deviceOwns);
+    }
+}
+
+void StorageManager::tick() {
+    if (s_handover == HO_HOST) msc_cache_tick();
+    if (!_sdInitialized) return;
+    if (!s_hostOwns) MSC.mediaPresent(s_offered);
+
+    if (s_handover == HO_DRAINING) {
+        int open = s_sessions;
+        if (open > 0 && millis() - s_drainStart < STORAGE_QUIESCE_MS) return;
+        if (open > 0) GLOGW(LOGM_STORAGE, "%d file session(s) still open at USB hand-over", open);
+        s_handover = HO_UNMOUNTING;
+        storio_submit(STORIO_BACKGROUND, unmountJob, nullptr, nullptr);
+        return;
+    }
+    if (s_handover == HO_UNMOUNTING) return;
+    if (s_wantHost == s_hostOwns) return;
+
+    if (s_wantHost) {
+        // device -> host: writers start staging and open sessions wind down (DRAINING above)
+        s_hostOwns = true;
+        metric_set(M_MSC_HOST_OWNS, 1);
+        notifyOwnership(false);
+        s_drainStart = millis();
+        s_handover = HO_DRAINING;
+        return;
+    }
+
+    // host -> device: remount (drops every cached sector the host may have changed), replay
+    static uint32_t lastAttempt = 0;
+    if (lastAttempt && millis() - lastAttempt < 1000) return;
+    lastAttempt = millis();
+    MSC.mediaPresent(false);
+    if (s_hostIo) closeHostIo();   // waits out a callback still in the cache
+    msc_cache_end();
+    if (!fatMount()) {
+        GLOGE(LOGM_STORAGE, "SD remount after USB eject failed; retrying");
+        return;
+    }
+    lastAttempt = 0;
+    storio_run(STORIO_BACKGROUND, []() { return staging_replay(STORAGE_SD_MOUNT, []() { s_hostOwns = false; }); });
+    s_handover = HO_DEVICE;
+    metric_set(M_MSC_HOST_OWNS, 0);
+    notifyOwnership(true);
+    GLOGI(LOGM_STORAGE, "SD card back on device");
+}
+
 fs::FS& StorageManager::getActiveFS() {
     if (_usingSD && _sdInitialized) {
-        return *((fs::FS *)&SD);
+        return s_sdFS;
     }
-    return *((fs::FS *)&LittleFS);
+    return LittleFS;
+}
+
+String StorageManager::vfsPath(const String& path) const {
+    String full = _usingSD ? STORAGE_SD_MOUNT : STORAGE_LITTLEFS_MOUNT;
+    if (!path.startsWith("/")) full += "/";
+    full += path;
+    return full;
 }
 
 bool StorageManager::isSDCardAvailable() const {
@@ -151,10 +600,12 @@ bool StorageManager::isUsingLittleFS() const {
 }
 
 File StorageManager::open(const char* path, const char* mode) {
+    MetricTimer timer(H_STORAGE_OPEN_US);
     fs::FS& fs = getActiveFS();
     File file = fs.open(path, mode);
     if (!file) {
-        Serial.printf("Failed to open file: %s\n", path);
+        metric_inc(M_STORAGE_OPEN_FAIL);
+        GLOGW(LOGM_STORAGE, "Failed to open file: %s", path);
     }
     return file;
 }
@@ -166,7 +617,7 @@ bool StorageManager::exists(const char* path) {
 bool StorageManager::remove(const char* path) {
     bool success = getActiveFS().remove(path);
     if (!success) {
-        Serial.printf("Failed to remove: %s\n", path);
+        GLOGW(LOGM_STORAGE, "Failed to remove: %s", path);
     }
     return success;
 }
@@ -174,7 +625,7 @@ bool StorageManager::remove(const char* path) {
 bool StorageManager::mkdir(const char* path) {
     bool success = getActiveFS().mkdir(path);
     if (!success) {
-        Serial.printf("Failed to create directory: %s\n", path);
+        GLOGW(LOGM_STORAGE, "Failed to create directory: %s", path);
     }
     return success;
 }
@@ -182,22 +633,39 @@ bool StorageManager::mkdir(const char* path) {
 bool StorageManager::rmdir(const char* path) {
     bool success = getActiveFS().rmdir(path);
     if (!success) {
-        Serial.printf("Failed to remove directory: %s\n", path);
+        GLOGW(LOGM_STORAGE, "Failed to remove directory: %s", path);
     }
     return success;
 }
 
-size_t StorageManager::totalBytes() {
-    return _usingSD ? SD.cardSize() : LittleFS.totalBytes();
+// FATFS geometry rather than the card size: what the volume can actually hold. The free
+// cluster count is cached by FATFS after the first (slow) scan. While the USB host owns the
+// card the last known values are returned.
+static uint64_t s_fatTotal = 0, s_fatFree = 0;
+
+static void fatUsage() {
+    DWORD freeClusters = 0;
+    FATFS* fs = nullptr;
+    if (!s_fatfs || f_getfree(STORAGE_SD_FAT_DRIVE, &freeClusters, &fs) != FR_OK) return;
+#if FF_MAX_SS != FF_MIN_SS
+    uint64_t clusterBytes = (uint64_t)fs->csize * fs->ssize;
+#else
+    uint64_t clusterBytes = (uint64_t)fs->csize * FF_MAX_SS;
+#endif
+    s_fatTotal = (uint64_t)(fs->n_fatent - 2) * clusterBytes;
+    s_fatFree = (uint64_t)freeClusters * clusterBytes;
 }
 
-size_t StorageManager::usedBytes() {
-    if (_usingSD) {
-        uint64_t cardSize = SD.cardSize();
-        uint64_t usedSize = cardSize - SD.totalBytes();
-        return (size_t)usedSize;
-    }
-    return LittleFS.usedBytes();
+uint64_t StorageManager::totalBytes() {
+    if (!_usingSD) return LittleFS.totalBytes();
+    fatUsage();
+    return s_fatTotal;
+}
+
+uint64_t StorageManager::usedBytes() {
+    if (!_usingSD) return LittleFS.usedBytes();
+    fatUsage();
+    return s_fatTotal - s_fatFree;
 }
 
 void StorageManager::listDir(const char* dirname, uint8_t levels) {
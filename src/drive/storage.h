@@ -1,30 +1,80 @@
 #pragma once
 
 #include <FS.h>
-#include <SD.h>
 #include <LittleFS.h>
 
+#define STORAGE_SD_MOUNT        "/sdcard"
+#define STORAGE_LITTLEFS_MOUNT  "/littlefs"
+#define STORAGE_ALLOC_UNIT      (16 * 1024)   // FAT cluster size of the SD card; unit for buffered I/O
+#define STORAGE_SD_FAT_DRIVE    "0:"          // FatFs logical drive of the SD card (the only FAT volume)
+#define STORAGE_MAX_FILES       8             // uploads + downloads + log/message tails open at once
+#define STORAGE_QUIESCE_MS      1000          // longest wait for open file sessions before the host gets the card
+#ifndef STORAGE_BENCH_BYTES
+#define STORAGE_BENCH_BYTES     (256 * 1024)  // sequential read/write probe at mount, whole
+                                              // STORAGE_ALLOC_UNITs; 0 disables
+#endif
+
+// What the SD card negotiated at mount and how fast it actually moved data.
+struct StorageCardInfo {
+    char name[8];              // CID product name
+    char profile[16];          // bus profile that passed the mount-time probe
+    bool profilePersisted;     // started from the profile remembered for this card
+    uint8_t fallbacks;         // profiles that failed (init, CRC, verify) before this one
+    uint32_t freqKhz;          // bus clock
+    uint8_t busWidth;          // data lines: 1 or 4
+    bool ddr;
+    uint64_t capacityBytes;
+    uint32_t seqReadKBps;      // verified probe through FATFS at mount (0 = not measured)
+    uint32_t seqWriteKBps;
+    uint32_t mountMs;          // card init + FATFS mount
+};
+
 class StorageManager {
 public:
     StorageManager();
 
-    bool begin();                      // Initializes SD or falls back to LittleFS
+    // Reference-counted: the first begin() mounts SD (or falls back to LittleFS), later calls
+    // only take a reference. The last end() unmounts.
+    bool begin();
+    void end();
     bool isSDCardAvailable() const;    // True if SD is physically detected
     bool isUsingSD() const;            // True if SD is currently used
     bool isUsingLittleFS() const;      // True if LittleFS is used
 
-    fs::FS& getActiveFS();             // Returns the active file system
+    fs::FS& getActiveFS();             // SD: bound to the FATFS VFS mount at /sdcard; else LittleFS
+    String vfsPath(const String& path) const; // Absolute VFS path (for POSIX open/rename) of an FS path
     File open(const char* path, const char* mode);
     bool exists(const char* path);
     bool remove(const char* path);
     bool mkdir(const char* path);
     bool rmdir(const char* path);
-    size_t totalBytes();
-    size_t usedBytes();
+    uint64_t totalBytes();
+    uint64_t usedBytes();
+    const StorageCardInfo& cardInfo() const { return _card; }   // zeroed when SD is not in use
     void listDir(const char* dirname, uint8_t levels = 1);
 
+    // USB MSC arbitration: the SD card belongs either to on-device writers or to the USB host
+    bool deviceOwnsVolume() const;     // false while the host has it: write through staging.h
+    void onOwnershipChange(void (*cb)(bool deviceOwns)); // up to 4 listeners, called from tick()
+    void tick();                       // call from loop(); carries out pending hand-overs
+
+    // Files held open across calls (downloads, uploads) are sessions. A hand-over to the host
+    // waits up to STORAGE_QUIESCE_MS for them to end; holders end themselves as soon as
+    // deviceOwnsVolume() turns false. FATFS is then unmounted on the storage task, behind
+    // every queued request.
+    bool beginSession();               // false while the host owns or is taking the card
+    void endSession();
+
 private:
+    void notifyOwnership(bool deviceOwns);
+    bool mountSD();
+    void unmountSD();
+    bool benchmarkSD();
+
+    int _refs;
     bool _usingSD;
     bool _sdInitialized;
     bool _littleFSInitialized;
+    void (*_ownershipCbs[4])(bool);
+    StorageCardInfo _card;
 };
@@ -0,0 +1,169 @@
+#include "storageio.h"
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+#ifndef STORIO_QUEUE_DEPTH
+#define STORIO_QUEUE_DEPTH 8          // per class
+#endif
+#ifndef STORIO_TASK_PRIORITY
+#define STORIO_TASK_PRIORITY 2
+#endif
+#ifndef STORIO_STACK
+#define STORIO_STACK 6144             // presence rewrites run ArduinoJson on this stack
+#endif
+#ifndef STORIO_MAX_WAIT_MS
+#define STORIO_MAX_WAIT_MS 500
+#endif
+
+struct StorIoReq {
+    StorIoWork work;
+    void* ctx;
+    StorIoDone done;
+    SemaphoreHandle_t waiter;   // storio_call: given on completion
+    bool* ok;                   // storio_call: result
+    uint32_t queuedMs;
+    uint32_t t0Us;              // first submit (kept across STORIO_AGAIN)
+};
+
+static const HistId kLatency[STORIO_CLASS_COUNT] = {
+    H_STORIO_WEB_READ_US, H_STORIO_LOG_US, H_STORIO_UPLOAD_US, H_STORIO_PRESENCE_US, H_STORIO_BACKGROUND_US
+};
+static const char* const kNames[STORIO_CLASS_COUNT] = {
+    "web_read", "log", "upload", "presence", "background"
+};
+
+static QueueHandle_t s_queues[STORIO_CLASS_COUNT] = {};
+static SemaphoreHandle_t s_pending = nullptr;    // one count per queued request
+static TaskHandle_t s_task = nullptr;
+static StorIoStats s_stats = {};
+
+// Most urgent class with work; a head that has waited too long wins regardless of class.
+static int pickClass() {
+    int best = -1;
+    uint32_t now = millis();
+    for (int c = 0; c < STORIO_CLASS_COUNT; c++) {
+        StorIoReq head;
+        if (xQueuePeek(s_queues[c], &head, 0) != pdTRUE) continue;
+        if (best < 0) best = c;
+        if (c > best && now - head.queuedMs >= STORIO_MAX_WAIT_MS) {
+            s_stats.aged++;
+            return c;
+        }
+    }
+    return best;
+}
+
+static void finish(StorIoClass cls, const StorIoReq& r, bool ok) {
+    hist_observe(kLatency[cls], (uint32_t)(micros() - r.t0Us));
+    if (ok) s_stats.completed[cls]++;
+    else s_stats.failed[cls]++;
+    if (r.done) r.done(r.ctx, ok);
+    if (r.waiter) {
+        *r.ok = ok;
+        xSemaphoreGive(r.waiter);
+    }
+}
+
+static void taskMain(void*) {
+    for (;;) {
+        xSemaphoreTake(s_pending, portMAX_DELAY);
+        int c = pickClass();
+        StorIoReq r;
+        if (c < 0 || xQueueReceive(s_queues[c], &r, 0) != pdTRUE) continue;
+        StorIoClass cls = (StorIoClass)c;
+
+        StorIoStatus st = r.work(r.ctx);
+        // A sliced job goes back to the tail with a fresh age, so it cannot jump the queue
+        // forever. If producers have filled the class meanwhile it simply keeps running.
+        while (st == STORIO_AGAIN) {
+            r.queuedMs = millis();
+            if (xQueueSendToBack(s_queues[c], &r, 0) == pdTRUE) {
+                xSemaphoreGive(s_pending);
+                break;
+            }
+            st = r.work(r.ctx);
+        }
+        if (st == STORIO_AGAIN) continue;
+        finish(cls, r, st == STORIO_DONE);
+    }
+}
+
+bool storio_begin() {
+    if (s_task) return true;
+    for (auto& q : s_queues) {
+        if (!q) q = xQueueCreate(STORIO_QUEUE_DEPTH, sizeof(StorIoReq));
+        if (!q) return false;
+    }
+    if (!s_pending) s_pending = xSemaphoreCreateCounting(STORIO_CLASS_COUNT * STORIO_QUEUE_DEPTH, 0);
+    if (!s_pending) return false;
+    if (xTaskCreate(taskMain, "storio", STORIO_STACK, nullptr, STORIO_TASK_PRIORITY, &s_task) != pdPASS) {
+        s_task = nullptr;
+        GLOGE(LOGM_STORAGE, "Storage I/O task could not start; file access stays inline");
+        return false;
+    }
+    return true;
+}
+
+bool storio_on_task() {
+    return s_task && xTaskGetCurrentTaskHandle() == s_task;
+}
+
+static bool enqueue(StorIoClass cls, const StorIoReq& r) {
+    if (xQueueSendToBack(s_queues[cls], &r, portMAX_DELAY) != pdTRUE) return false;
+    xSemaphoreGive(s_pending);
+    return true;
+}
+
+bool storio_submit(StorIoClass cls, StorIoWork work, void* ctx, StorIoDone done) {
+    if (!s_task || storio_on_task()) {
+        StorIoStatus st;
+        while ((st = work(ctx)) == STORIO_AGAIN) {}
+        if (done) done(ctx, st == STORIO_DONE);
+        return true;
+    }
+    StorIoReq r = { work, ctx, done, nullptr, nullptr, millis(), micros() };
+    return enqueue(cls, r);
+}
+
+bool storio_call(StorIoClass cls, StorIoWork work, void* ctx) {
+    if (!s_task || storio_on_task()) {
+        StorIoStatus st;
+        while ((st = work(ctx)) == STORIO_AGAIN) {}
+        return st == STORIO_DONE;
+    }
+    StaticSemaphore_t sbuf;
+    bool ok = false;
+    StorIoReq r = { work, ctx, nullptr, xSemaphoreCreateBinaryStatic(&sbuf), &ok, millis(), micros() };
+    if (!enqueue(cls, r)) return false;
+    // No timeout: `ctx` lives on this stack and must outlive the request.
+    xSemaphoreTake(r.waiter, portMAX_DELAY);
+    vSemaphoreDelete(r.waiter);
+    return ok;
+}
+
+const char* storio_class_name(StorIoClass cls) {
+    return (unsigned)cls < STORIO_CLASS_COUNT ? kNames[cls] : "?";
+}
+
+void storio_stats(StorIoStats* out) {
+    if (!out) return;
+    *out = s_stats;
+    for (int c = 0; c < STORIO_CLASS_COUNT; c++) {
+        out->queued[c] = s_queues[c] ? (uint32_t)uxQueueMessagesWaiting(s_queues[c]) : 0;
+        out->p99Us[c] = hist_quantile_us(kLatency[c], 0.99f);
+    }
+}
+
+uint32_t storio_backlog() {
+    uint32_t n = 0;
+    for (auto q : s_queues) {
+        if (q) n += (uint32_t)uxQueueMessagesWaiting(q);
+    }
+    return n;
+}
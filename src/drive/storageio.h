@@ -0,0 +1,74 @@
+#pragma once
+/*
+  storageio.h — Storage I/O service: one task performs every file operation on the active volume.
+
+  SD and LittleFS used to be touched from the loop, the BLE callback path, the async web task
+  and the log drain task at once, so a slow SD write stalled whichever context issued it and
+  FATFS serialised them in arbitrary order. Now callers hand work to the "storio" task:
+
+        storio_run(STORIO_WEB_READ, [&]() { n = ::read(fd, buf, len); return n >= 0; });
+
+  - Requests are queued per class. The task always serves the most urgent class first, so an
+    interactive web read waits for at most one running request, never for a backlog of log
+    flushes or background jobs. A request that has waited STORIO_MAX_WAIT_MS is served next
+    regardless of class, so lower classes are not starved either.
+  - Long jobs return STORIO_AGAIN after a slice of work; they go back to the tail of their
+    class and anything more urgent runs in between.
+  - storio_submit() is asynchronous with a completion callback (runs on the storage task).
+    storio_run()/storio_call() block the caller until the work has run. Called on the storage
+    task itself, or before storio_begin(), the work runs inline.
+  - Queue wait + service time is recorded per class (storio_<class>_latency_us histograms).
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+typedef enum {
+    STORIO_WEB_READ = 0,    // downloads and listings for an HTTP client that is waiting
+    STORIO_LOG,             // message log and diagnostic log appends
+    STORIO_UPLOAD,          // write-behind blocks of uploads
+    STORIO_PRESENCE,        // presence bitmap rewrites
+    STORIO_BACKGROUND,      // journal replay, compaction, anything nobody waits for
+    STORIO_CLASS_COUNT
+} StorIoClass;
+
+typedef enum {
+    STORIO_DONE = 0,
+    STORIO_FAILED,
+    STORIO_AGAIN            // not finished: requeue at the tail of the class
+} StorIoStatus;
+
+typedef StorIoStatus (*StorIoWork)(void* ctx);
+typedef void (*StorIoDone)(void* ctx, bool ok);
+
+typedef struct {
+    uint32_t completed[STORIO_CLASS_COUNT];
+    uint32_t failed[STORIO_CLASS_COUNT];
+    uint32_t queued[STORIO_CLASS_COUNT];     // waiting right now
+    uint32_t p99Us[STORIO_CLASS_COUNT];      // queue wait + service, from the latency histograms
+    uint32_t aged;                           // requests promoted by STORIO_MAX_WAIT_MS
+} StorIoStats;
+
+bool storio_begin();
+bool storio_on_task();      // true when called from the storage task
+
+// Queues `work`; `done` (optional) runs on the storage task when it has finished.
+// Blocks only while the class queue is full.
+bool storio_submit(StorIoClass cls, StorIoWork work, void* ctx, StorIoDone done);
+
+// Runs `work` on the storage task and waits for it. Returns false if it failed.
+bool storio_call(StorIoClass cls, StorIoWork work, void* ctx);
+
+template <class F>
+static inline bool storio_run(StorIoClass cls, F&& fn) {
+    typedef typename std::remove_reference<F>::type Fn;
+    struct Thunk {
+        static StorIoStatus run(void* p) { return (*static_cast<Fn*>(p))() ? STORIO_DONE : STORIO_FAILED; }
+    };
+    return storio_call(cls, &Thunk::run, (void*)&fn);
+}
+
+const char* storio_class_name(StorIoClass cls);
+void storio_stats(StorIoStats* out);
+uint32_t storio_backlog();  // requests waiting in all classes (not counting the one running)
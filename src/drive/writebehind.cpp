@@ -0,0 +1,191 @@
+#include "writebehind.h"
+#include "storage.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <esp_heap_caps.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+StorIoStatus WriteBehindFile::writeJob(void* ctx) {
+    Job* job = (Job*)ctx;
+    WriteBehindFile* f = job->owner;
+    if (f->_error) return STORIO_FAILED;
+    uint32_t t0 = micros();
+    ssize_t n = ::write(job->fd, job->data, job->len);
+    hist_observe(H_STORAGE_WB_WRITE_US, (uint32_t)(micros() - t0));
+    if (n != (ssize_t)job->len) {
+        f->_error = true;
+        GLOGE(LOGM_STORAGE, "Write-behind: short write (%d of %u)", (int)n, (unsigned)job->len);
+        return STORIO_FAILED;
+    }
+    metric_inc(M_STORAGE_WB_BYTES, (uint32_t)n);
+    return STORIO_DONE;
+}
+
+void WriteBehindFile::jobDone(void* ctx, bool) {
+    xSemaphoreGive(((Job*)ctx)->owner->_free);
+}
+
+// Queued behind the write jobs of the same class, so every block is on the card by now
+StorIoStatus WriteBehindFile::closeJob(void* ctx) {
+    WriteBehindFile* f = (WriteBehindFile*)ctx;
+    bool synced = fsync(f->_closingFd) == 0;
+    bool closed = ::close(f->_closingFd) == 0;
+    f->_closingFd = -1;
+    return closed && synced && !f->_error ? STORIO_DONE : STORIO_FAILED;
+}
+
+void WriteBehindFile::closeDone(void* ctx, bool ok) {
+    WriteBehindFile* f = (WriteBehindFile*)ctx;
+    if (f->_closeDone) f->_closeDone(f->_closeCtx, ok);
+}
+
+WriteBehindFile::WriteBehindFile() :
+    _fd(-1),
+    _buf{nullptr, nullptr},
+    _bufSize(0),
+    _cur(0),
+    _holding(false),
+    _fill(0),
+    _target(0),
+    _offset(0),
+    _stallUs(0),
+    _error(false),
+    _free(nullptr),
+    _jobs{},
+    _closingFd(-1),
+    _closeDone(nullptr),
+    _closeCtx(nullptr)
+{
+}
+
+WriteBehindFile::~WriteBehindFile() {
+    if (_fd >= 0) finish();
+    for (auto& b : _buf) {
+        if (b) heap_caps_free(b);
+        b = nullptr;
+    }
+    if (_free) vSemaphoreDelete(_free);
+}
+
+bool WriteBehindFile::open(const char* vfsPath, uint32_t offset, bool truncate) {
+    if (_fd >= 0) return false;
+
+    // DMA-capable internal RAM lets the SDMMC driver transfer straight from the buffer
+    // instead of bouncing every sector through its own scratch copy.
+    if (!_buf[0]) {
+        for (size_t size = STORAGE_ALLOC_UNIT; size >= 4096 && !_buf[1]; size /= 2) {
+            _buf[0] = (uint8_t*)heap_caps_aligned_alloc(32, size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+            _buf[1] = (uint8_t*)heap_caps_aligned_alloc(32, size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+            _bufSize = size;
+            if (!_buf[1] && _buf[0]) { heap_caps_free(_buf[0]); _buf[0] = nullptr; }
+        }
+        if (!_buf[1]) {
+            GLOGE(LOGM_STORAGE, "Write-behind: no DMA memory for buffers");
+            return false;
+        }
+    }
+    if (!_free) _free = xSemaphoreCreateCounting(2, 2);
+    if (!_free) return false;
+
+    int flags = O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0);
+    _fd = ::open(vfsPath, flags, 0666);
+    if (_fd < 0) {
+        GLOGW(LOGM_STORAGE, "Write-behind: cannot open %s", vfsPath);
+        return false;
+    }
+    off_t end = truncate ? 0 : lseek(_fd, 0, SEEK_END);
+    if (end != (off_t)offset) {
+        GLOGW(LOGM_STORAGE, "Write-behind: %s is %ld bytes, expected %u", vfsPath, (long)end, (unsigned)offset);
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    _offset = offset;
+    _target = _bufSize - (offset % _bufSize);
+    _fill = 0;
+    _cur = 0;
+    _holding = false;
+    _stallUs = 0;
+    _error = false;
+    return true;
+}
+
+bool WriteBehindFile::acquire() {
+    if (_holding) return true;
+    uint32_t t0 = micros();
+    if (xSemaphoreTake(_free, pdMS_TO_TICKS(WB_STALL_TIMEOUT_MS)) != pdTRUE) {
+        _error = true;
+        GLOGE(LOGM_STORAGE, "Write-behind: storage task stalled");
+        return false;
+    }
+    _stallUs += (uint32_t)(micros() - t0);
+    _holding = true;
+    return true;
+}
+
+bool WriteBehindFile::submit() {
+    _jobs[_cur] = { this, _fd, _buf[_cur], _fill };
+    storio_submit(STORIO_UPLOAD, writeJob, &_jobs[_cur], jobDone);
+    _holding = false;
+    _cur ^= 1;
+    _fill = 0;
+    _target = _bufSize;
+    return !_error;
+}
+
+bool WriteBehindFile::write(const uint8_t* data, size_t len) {
+    if (_fd < 0 || _error) return false;
+    while (len > 0) {
+        if (!acquire()) return false;
+        size_t n = _target - _fill;
+        if (n > len) n = len;
+        memcpy(_buf[_cur] + _fill, data, n);
+        _fill += n;
+        _offset += n;
+        data += n;
+        len -= n;
+        if (_fill == _target && !submit()) return false;
+    }
+    return true;
+}
+
+void WriteBehindFile::flushPartial() {
+    if (!_holding) return;
+    if (_fill > 0) {
+        submit();
+    } else {
+        xSemaphoreGive(_free);
+        _holding = false;
+    }
+}
+
+bool WriteBehindFile::finish() {
+    if (_fd < 0) return false;
+    flushPartial();
+    // Wait until both buffers are back, i.e. every queued job has been written.
+    xSemaphoreTake(_free, portMAX_DELAY);
+    xSemaphoreTake(_free, portMAX_DELAY);
+    xSemaphoreGive(_free);
+    xSemaphoreGive(_free);
+
+    bool ok = !_error;
+    int fd = _fd;
+    if (!storio_run(STORIO_UPLOAD, [fd]() { bool synced = fsync(fd) == 0; return ::close(fd) == 0 && synced; })) ok = false;
+    _fd = -1;
+    return ok;
+}
+
+bool WriteBehindFile::close(StorIoDone done, void* ctx) {
+    if (_fd < 0) return false;
+    flushPartial();
+    _closingFd = _fd;
+    _closeDone = done;
+    _closeCtx = ctx;
+    _fd = -1;
+    return storio_submit(STORIO_UPLOAD, closeJob, this, closeDone);
+}
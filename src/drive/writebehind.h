@@ -0,0 +1,86 @@
+#pragma once
+/*
+  writebehind.h — Double-buffered, cluster-aligned file writer drained by the storage I/O service.
+
+  The producer (e.g. the async web task receiving an upload) copies incoming chunks into one
+  of two DMA-capable buffers sized to the FAT allocation unit. A full buffer is queued on the
+  storage service (storageio.h, class STORIO_UPLOAD), which issues a single POSIX write() for
+  it while the producer fills the other one. Small TCP-sized chunks therefore turn into 16 KB cluster writes on the card
+  instead of hundreds of tiny f.write() calls.
+
+  When writing starts at a non-aligned offset (resumed upload), the first block is shortened
+  so every following write lands on an allocation-unit boundary.
+
+  Errors from the storage task are sticky: once a write fails, write()/finish() return false.
+
+  Nothing here waits without bound: write() gives up after WB_STALL_TIMEOUT_MS without a free
+  buffer, and close() hands the last block, fsync and close to the storage service and returns
+  at once, so the async web task never sits behind a slow card.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "storageio.h"
+
+#ifndef WB_STALL_TIMEOUT_MS
+#define WB_STALL_TIMEOUT_MS 1000   // longest the producer (async_tcp) waits for a free buffer
+#endif
+
+class WriteBehindFile {
+public:
+    WriteBehindFile();
+    ~WriteBehindFile();
+
+    // Opens `vfsPath` (absolute, e.g. /sdcard/x.part) for writing at `offset`.
+    // truncate=true starts a fresh file; otherwise the file must already be `offset` bytes long.
+    bool open(const char* vfsPath, uint32_t offset, bool truncate);
+
+    // Copies `len` bytes; blocks only while both buffers are queued on the storage service.
+    bool write(const uint8_t* data, size_t len);
+
+    // Flushes the partial buffer, fsyncs and closes; waits for it. Returns false if any write failed.
+    bool finish();
+
+    // Same without waiting: the partial buffer and an fsync + close are queued behind the blocks
+    // already submitted. `done` runs on the storage task once the file is closed (ok=false if
+    // any write failed); the object must stay alive until then.
+    bool close(StorIoDone done, void* ctx);
+
+    bool isOpen() const { return _fd >= 0; }
+    uint32_t offset() const { return _offset; }      // bytes accepted so far (file position)
+    uint32_t stallUs() const { return _stallUs; }    // time the producer spent waiting for a buffer
+
+private:
+    struct Job {
+        WriteBehindFile* owner;
+        int fd;                 // close() gives up _fd while blocks are still queued
+        const uint8_t* data;
+        size_t len;
+    };
+    static StorIoStatus writeJob(void* ctx);
+    static void jobDone(void* ctx, bool ok);
+    static StorIoStatus closeJob(void* ctx);
+    static void closeDone(void* ctx, bool ok);
+
+    bool submit();
+    bool acquire();
+    void flushPartial();
+
+    int _fd;
+    uint8_t* _buf[2];
+    size_t _bufSize;
+    uint8_t _cur;             // buffer being filled
+    bool _holding;            // producer owns _buf[_cur]
+    size_t _fill;
+    size_t _target;           // bytes to collect before submitting (shorter for the first, unaligned block)
+    uint32_t _offset;
+    uint32_t _stallUs;
+    volatile bool _error;
+    SemaphoreHandle_t _free;  // counts buffers not queued on the storage service
+    Job _jobs[2];
+    int _closingFd;           // close(): fd the close job owns
+    StorIoDone _closeDone;
+    void* _closeCtx;
+};
@@ -14,10 +14,24 @@
 #include <Preferences.h>
 #include <EEPROM.h>
 #include "ble/ble.h"
+#include "ble/timesync.h"
+#include "ble/proximity.h"
+#include "ble/census.h"
+#include "ble/warmcache.h"
+#include "ble/addressing.h"
+#include "ble/messages.h"
+#include "ble/bluetoothmessage.h"
 #include "display/display.h"
 #include "display/inspiration.h"
 #include "wifi/time_get.h"
 #include "drive/storage.h"
+#include "apps/presence.h"
+#include "drive/staging.h"
+#include "diag/metrics.h"
+#include "diag/trace.h"
+#include "diag/log.h"
+#include "API/API.h"
+#include "misc/boot.h"
 
 extern void startWebPortal();
 StorageManager storage;
@@ -55,11 +69,9 @@ String getOrCreateCallsign() {
     if (callsign.length() == 0 || callsign == "geogram") {
         callsign = generateRandomCallsign();
         prefs.putString("callsign", callsign);
-        Serial.print("Generated new callsign: ");
-        Serial.println(callsign);
+        GLOGI(LOGM_APP, "Generated new callsign: %s", callsign.c_str());
     } else {
-        Serial.print("Using existing callsign: ");
-        Serial.println(callsign);
+        GLOGI(LOGM_APP, "Using existing callsign: %s", callsign.c_str());
     }
 
     prefs.end();
@@ -81,17 +93,86 @@ void sendBluetoothPing() {
     if (pingMsg.length() <= 30) { // BLE payload limit for compact device codes
         int result = ble_send_text((const uint8_t*)pingMsg.c_str(), pingMsg.length(), true);
         if (result > 0) {
-            Serial.print("Ping sent: >");
-            Serial.println(pingMsg);
+            GLOGI(LOGM_APP, "Ping sent: >%s", pingMsg.c_str());
             blinkLED(); // Visual feedback
         } else {
-            Serial.println("Failed to send ping");
+            GLOGW(LOGM_APP, "Failed to send ping");
         }
     } else {
-        Serial.println("Ping message too long");
+        GLOGW(LOGM_APP, "Ping message too long");
     }
 }
 
+// While the USB host owns the SD card, appends go to the staging journal (drive/staging.h)
+static bool stageAppend(const char* path, const uint8_t* data, size_t len) {
+    return staging_capture(path, data, len);
+}
+
+static void onStorageOwnership(bool deviceOwns) {
+    if (deviceOwns) glog_set_file_sink(&storage.getActiveFS(), "/logs");
+    else glog_stage_file_sink(stageAppend);
+    msg_set_stage_sink(deviceOwns ? nullptr : stageAppend);
+}
+
+// Route the BLE library's optional diagnostics into the deferred log pipeline
+static void bleLogSink(const char* line) {
+    glog_write(LOGM_BLE, GLOG_INFO, line);
+}
+
+// ---------- Boot stages (see misc/boot.h) ----------
+static bool bootBle() {
+    ble_set_logger(bleLogSink);
+    Preferences prefs;
+    prefs.begin("config", true);
+    ble_set_wire_format(prefs.getString("ble_binary", "") == "1");   // opt-in, see ble/wireformat.h
+    String crc = prefs.getString("ble_crc", "");                     // empty = build default, see ble/bluetoothmessage.h
+    if (crc.length()) msg_set_crc_tx(crc == "1");
+    addr_set_groups(prefs.getString("ble_groups", "").c_str());       // see ble/addressing.h
+    addr_set_relay(prefs.getString("ble_relay", "") == "1");
+    String proxCal = prefs.getString("ble_prox_cal", "");             // see ble/proximity.h
+    census_begin(prefs.getString("ble_census", "") == "1");           // see ble/census.h
+    prefs.end();
+    addr_set_callsign(getOrCreateCallsign().c_str());
+    ble_init("ESP32-TDongle");
+    ble_start_listening(true);
+    metric_set(M_BOOT_LISTEN_MS, millis());
+    timesync_begin();
+    proximity_begin(proxCal.c_str());
+    return true;
+}
+
+static bool bootStorage() {
+    if (!storage.begin()) {
+        GLOGE(LOGM_APP, "Storage initialization failed.");
+        return false;
+    }
+    GLOGI(LOGM_APP, "Storage ready.");
+#ifdef BOOT_LIST_DIR
+    storage.listDir("/", 2);    // debug aid: prints the tree, slow on a full card
+#endif
+    if (storage.isUsingSD()) {
+        glog_set_file_sink(&storage.getActiveFS(), "/logs"); // LittleFS is spared the wear
+        storage.onOwnershipChange(onStorageOwnership);
+    }
+    return true;
+}
+
+static bool bootWeb() {
+    startWebPortal();
+    return true;
+}
+
+static bool bootTime() {
+    initTime();
+    return true;
+}
+
+static bool bootDisplay() {
+    initDisplay();
+    generateInspiration();
+    return true;
+}
+
 void blinkLED()
 {
     leds = CRGB::White;
@@ -112,57 +193,28 @@ void setup()
     digitalWrite(TFT_LEDA_PIN, 1);
 
     Serial.begin(115200);
+    glog_begin();
+    warm_restore();     // before BLE and display pick up their state from it
     EEPROM.begin(1);
 
-    initDisplay();
-
     leds = CRGB(0, 0, 0);
     FastLED.addLeds<APA102, LED_DI_PIN, LED_CI_PIN, BGR>(&leds, 1);
     FastLED.show();
 
     button.attachClick(nextPosition);
-    digitalWrite(TFT_LEDA_PIN, 0);
 
-    // Mount the SD card
-    if (storage.begin())
-    {
-        Serial.println("Storage ready.");
-        storage.listDir("/", 2); // Optional: show root directory
-    }
-    else
-    {
-        Serial.println("Storage initialization failed.");
-    }
-
-    startWebPortal();
-
-    Preferences prefs;
-    prefs.begin("config", true);
-    String suffix = prefs.getString("wifi_hotspot_name", "geogram");
-    prefs.end();
-
-    String id = suffix;
-    String beaconName = //"geogram-" + 
-        suffix;
-   
-    String msg = "";
-
-    // Generate proper namespace and instance IDs from your suffix
-    String namespaceId = "0000000000"; // 10-byte namespace (adjust as needed)
-    String instanceId = "000001";      // 6-byte instance (adjust as needed)
-
-    //startBeacon(beaconName.c_str(), namespaceId.c_str(), instanceId.c_str());
-
-    initTime();
+    // BLE listens first; storage -> web -> SNTP come up on their own tasks while the display
+    // initialises here. The web portal needs the mounted volume, SNTP the network interface.
+    boot_stage(BOOT_BLE, bootBle, 0, 0);
+    boot_stage(BOOT_STORAGE, bootStorage, 0, 8192);
+    boot_stage(BOOT_WEB, bootWeb, BOOT_AFTER(BOOT_STORAGE), 8192);
+    boot_stage(BOOT_TIME, bootTime, BOOT_AFTER(BOOT_WEB), 4096);
+    boot_stage(BOOT_DISPLAY, bootDisplay, 0, 0);
+    boot_start();
 
     blinkLED();
     lastRestart = millis();
 
-    generateInspiration();
-
-    ble_init("ESP32-TDongle");
-    ble_start_listening(true);
-
     // Initialize callsign and set first ping to happen 10 seconds after boot
     getOrCreateCallsign();
     lastPingTime = millis() - pingInterval + 10000; // First ping in 10 seconds
@@ -171,10 +223,23 @@ void setup()
 
 void loop()
 {
+    uint32_t loopStart = micros();
+    TRACE_BEGIN(TR_LOOP, 0, 0);
+
+    // Storage mounts on its own task while loop() already runs (misc/boot.h)
+    bool storageUp = boot_ok(BOOT_STORAGE);
+
     button.tick();
+    if (storageUp) storage.tick();
     ble_tick();
     updateDisplay();
     updateTime();
+    timesync_tick();
+    proximity_tick();
+    if (storageUp) presence_tick();
+    census_tick();
+    pollCLI(Serial);
+    metrics_sample();
 
     // Send Bluetooth ping every 10 seconds with random delay to avoid collisions
     unsigned long now = millis();
@@ -185,6 +250,8 @@ void loop()
         sendBluetoothPing();
     }
 
+    TRACE_END(TR_LOOP, 0, 0);
+    hist_observe(H_LOOP_US, (uint32_t)(micros() - loopStart));
     delay(5);
 
     /*
@@ -0,0 +1,117 @@
+#include "boot.h"
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include "diag/metrics.h"
+#include "diag/log.h"
+
+#ifndef BOOT_TASK_PRIORITY
+#define BOOT_TASK_PRIORITY 1        // same as the Arduino loop task
+#endif
+
+struct Stage {
+    BootStageFn fn;
+    uint32_t after;
+    uint32_t stack;
+    BootStageInfo info;
+};
+
+static const char* const kNames[BOOT_STAGE_COUNT] = {
+    "ble", "storage", "web", "time", "display"
+};
+static const MetricId kMetric[BOOT_STAGE_COUNT] = {
+    M_BOOT_STAGE_BLE_MS, M_BOOT_STAGE_STORAGE_MS, M_BOOT_STAGE_WEB_MS, M_BOOT_STAGE_TIME_MS,
+    M_BOOT_STAGE_DISPLAY_MS
+};
+
+static Stage s_stages[BOOT_STAGE_COUNT] = {};
+static EventGroupHandle_t s_done = nullptr;
+static uint32_t s_registered = 0;
+static volatile uint32_t s_completeMs = 0;
+
+static void runStage(BootStage s) {
+    Stage& st = s_stages[s];
+    if (st.after) xEventGroupWaitBits(s_done, st.after, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    st.info.startMs = millis();
+    st.info.ok = st.fn();
+    st.info.durationMs = millis() - st.info.startMs;
+    st.info.done = true;
+    metric_set(kMetric[s], st.info.durationMs);
+    GLOGI(LOGM_APP, "Boot stage %s %s: %lu ms (started at %lu ms)", kNames[s],
+          st.info.ok ? "done" : "FAILED", (unsigned long)st.info.durationMs, (unsigned long)st.info.startMs);
+
+    EventBits_t bits = xEventGroupSetBits(s_done, BOOT_AFTER(s));
+    if ((bits & s_registered) == s_registered && !s_completeMs) {
+        s_completeMs = millis();
+        metric_set(M_BOOT_COMPLETE_MS, s_completeMs);
+        GLOGI(LOGM_APP, "Boot complete after %lu ms", (unsigned long)s_completeMs);
+    }
+}
+
+static void stageTask(void* arg) {
+    runStage((BootStage)(uintptr_t)arg);
+    vTaskDelete(nullptr);
+}
+
+void boot_stage(BootStage s, BootStageFn fn, uint32_t after, uint32_t stackBytes) {
+    if ((unsigned)s >= BOOT_STAGE_COUNT || !fn) return;
+    Stage& st = s_stages[s];
+    st.fn = fn;
+    st.after = after & ~BOOT_AFTER(s);
+    st.stack = stackBytes;
+    st.info = {};
+    st.info.name = kNames[s];
+    st.info.onTask = stackBytes != 0;
+    s_registered |= BOOT_AFTER(s);
+}
+
+void boot_start() {
+    if (!s_done) s_done = xEventGroupCreate();
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        Stage& st = s_stages[i];
+        if (!st.fn) continue;
+        if (st.stack &&
+            xTaskCreate(stageTask, kNames[i], st.stack, (void*)(uintptr_t)i, BOOT_TASK_PRIORITY, nullptr) == pdPASS) {
+            continue;
+        }
+        if (st.stack) {
+            GLOGW(LOGM_APP, "Boot stage %s could not get a task; running inline", kNames[i]);
+            st.info.onTask = false;
+        }
+        runStage((BootStage)i);
+    }
+
+    uint32_t listen = metric_get(M_BOOT_LISTEN_MS);
+    if (listen > BOOT_LISTEN_TARGET_MS) {
+        GLOGW(LOGM_APP, "BLE listening after %lu ms (target %u ms)", (unsigned long)listen, BOOT_LISTEN_TARGET_MS);
+    }
+}
+
+// Through the event group, not info.done: its critical section orders everything the stage
+// wrote before the bit (StorageManager state, for one) ahead of this read on another core.
+bool boot_done(BootStage s) {
+    return (unsigned)s < BOOT_STAGE_COUNT && s_done && (xEventGroupGetBits(s_done) & BOOT_AFTER(s));
+}
+
+bool boot_ok(BootStage s) {
+    return boot_done(s) && s_stages[s].info.ok;
+}
+
+bool boot_wait(BootStage s, uint32_t timeoutMs) {
+    if ((unsigned)s >= BOOT_STAGE_COUNT || !s_done) return false;
+    EventBits_t bits = xEventGroupWaitBits(s_done, BOOT_AFTER(s), pdFALSE, pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    return (bits & BOOT_AFTER(s)) != 0;
+}
+
+void boot_stage_info(BootStage s, BootStageInfo* out) {
+    if (!out || (unsigned)s >= BOOT_STAGE_COUNT) return;
+    *out = s_stages[s].info;
+    if (!out->name) out->name = kNames[s];
+}
+
+uint32_t boot_complete_ms() {
+    return s_completeMs;
+}
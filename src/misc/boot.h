@@ -0,0 +1,62 @@
+#pragma once
+/*
+  boot.h — Staged boot: BLE listens first, the slow subsystems come up concurrently.
+
+  setup() used to run display, storage mount, web portal and SNTP strictly in sequence and
+  only then start scanning, so messages sent in the first seconds after power-on were lost.
+  Now setup() registers stages with their dependencies and calls boot_start():
+
+        boot_stage(BOOT_BLE,     bootBle,     0,                      0);     // inline, first
+        boot_stage(BOOT_STORAGE, bootStorage, 0,                      8192);  // own task
+        boot_stage(BOOT_WEB,     bootWeb,     BOOT_AFTER(BOOT_STORAGE), 8192);
+        boot_start();
+
+  - Stages start in BootStage order. A stage with a stack size runs on its own short-lived
+    task once every stage in its `after` mask has finished; one with stack 0 runs on the
+    caller (and waits for its dependencies there).
+  - A stage that fails still counts as finished, so dependents run and decide for themselves
+    (boot_ok()).
+  - Work in loop() that touches what a task stage sets up waits for it: loop() runs as soon as
+    setup() returns, while storage is still mounting. Storage ticks and presence writes check
+    boot_ok(BOOT_STORAGE) first.
+  - Start and duration of every stage are recorded (boot_stage_<name>_ms gauges, "boot_stages"
+    in /status/get). Reaching BLE listening later than BOOT_LISTEN_TARGET_MS is logged.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    BOOT_BLE = 0,           // scan + event bus: first, so nothing on air is missed
+    BOOT_STORAGE,           // SD/LittleFS mount and probe
+    BOOT_WEB,               // Wi-Fi + async web portal (needs the mounted volume)
+    BOOT_TIME,              // SNTP (needs the network interface)
+    BOOT_DISPLAY,           // TFT + LVGL
+    BOOT_STAGE_COUNT
+} BootStage;
+
+#define BOOT_AFTER(s) (1u << (s))
+
+#ifndef BOOT_LISTEN_TARGET_MS
+#define BOOT_LISTEN_TARGET_MS 500
+#endif
+
+typedef bool (*BootStageFn)();
+
+typedef struct {
+    const char* name;
+    uint32_t startMs;       // millis() when the stage began
+    uint32_t durationMs;
+    bool onTask;
+    bool done;
+    bool ok;
+} BootStageInfo;
+
+void boot_stage(BootStage s, BootStageFn fn, uint32_t after, uint32_t stackBytes);
+void boot_start();
+
+bool boot_done(BootStage s);    // also a barrier: what the stage set up is visible after true
+bool boot_ok(BootStage s);
+bool boot_wait(BootStage s, uint32_t timeoutMs);
+void boot_stage_info(BootStage s, BootStageInfo* out);
+uint32_t boot_complete_ms();    // millis() when the last stage finished, 0 = still booting
@@ -0,0 +1,95 @@
+#include "utf8.h"
+
+#include <string.h>
+
+// Byte classes: 0 ASCII, 1 80-8F, 2 90-9F, 3 A0-BF (continuations), 4 never valid,
+// 5 C2-DF, 6 E0, 7 E1-EC/EE-EF, 8 ED, 9 F0, 10 F1-F3, 11 F4 (leads), 12 C0 control or DEL
+#define NCLASS 13
+static const uint8_t kClass[256] = {
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,  // 00
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,  // 10
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 20
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 30
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 40
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 50
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 60
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 12,  // 70
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  // 80
+     2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  // 90
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // A0
+     3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // B0
+     4,  4,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  // C0
+     5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  // D0
+     6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  7,  // E0
+     9, 10, 10, 10, 11,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  // F0
+};
+
+// States: 0 accept; 1, 2, 5 = one, two, three continuations to go; 3, 4, 6, 7 = the next
+// continuation has a narrower range; 8 reject. Entries hold the next state premultiplied by
+// NCLASS, so a step is one byte load: st = kTrans[st + class]. The line table differs only
+// in rejecting class 12 from the accept state.
+#define S(x) ((x) * NCLASS)
+#define S_ACCEPT 0
+#define S_REJECT (8 * NCLASS)
+#define R S_REJECT
+#define TRANS_ROWS(ctrl)                                                                          \
+    S(0), R, R, R, R, S(1), S(3), S(2), S(4), S(6), S(5), S(7), ctrl,  /* 0 accept */             \
+    R, S(0), S(0), S(0), R, R, R, R, R, R, R, R, R,                    /* 1 need 1 */             \
+    R, S(1), S(1), S(1), R, R, R, R, R, R, R, R, R,                    /* 2 need 2 */             \
+    R, R, R, S(1), R, R, R, R, R, R, R, R, R,                          /* 3 after E0: A0-BF */    \
+    R, S(1), S(1), R, R, R, R, R, R, R, R, R, R,                       /* 4 after ED: 80-9F */    \
+    R, S(2), S(2), S(2), R, R, R, R, R, R, R, R, R,                    /* 5 need 3 */             \
+    R, R, S(2), S(2), R, R, R, R, R, R, R, R, R,                       /* 6 after F0: 90-BF */    \
+    R, S(2), R, R, R, R, R, R, R, R, R, R, R,                          /* 7 after F4: 80-8F */    \
+    R, R, R, R, R, R, R, R, R, R, R, R, R                              /* 8 reject */
+static const uint8_t kTrans[9 * NCLASS]     = { TRANS_ROWS(S(0)) };
+static const uint8_t kTransLine[9 * NCLASS] = { TRANS_ROWS(R) };
+#undef TRANS_ROWS
+#undef R
+#undef S
+
+typedef size_t Word;                                     // native register width
+static const Word kOnes = (Word)-1 / 0xFF;              // 0x0101...
+static const Word kHigh = kOnes * 0x80;                 // 0x8080...
+
+// True when every byte of `w` is ASCII (and, for a line, none is below 0x20 or DEL)
+template <bool kLine>
+static inline bool asciiWord(Word w) {
+    if (w & kHigh) return false;
+    if (!kLine) return true;
+    Word below20 = (w - kOnes * 0x20) & ~w & kHigh;      // exact once bit 7 is clear everywhere
+    Word x = w ^ (kOnes * 0x7F);
+    Word del = (x - kOnes) & ~x & kHigh;
+    return !(below20 | del);
+}
+
+#define DFA_STRETCH 16      // bytes run through the DFA before looking for ASCII words again
+
+template <bool kLine>
+static bool validate(const uint8_t* s, size_t n) {
+    const uint8_t* trans = kLine ? kTransLine : kTrans;
+    uint32_t st = S_ACCEPT;
+    size_t i = 0;
+    while (i < n) {
+        if (st == S_ACCEPT) {
+            while (i + sizeof(Word) <= n) {
+                Word w;
+                memcpy(&w, s + i, sizeof(w));
+                if (!asciiWord<kLine>(w)) break;
+                i += sizeof(w);
+            }
+        }
+        size_t end = n - i > DFA_STRETCH ? i + DFA_STRETCH : n;
+        for (; i < end; i++) st = trans[st + kClass[s[i]]];
+        if (st == S_REJECT) return false;
+    }
+    return st == S_ACCEPT;
+}
+
+bool utf8_valid(const char* s, size_t n) {
+    return s ? validate<false>((const uint8_t*)s, n) : n == 0;
+}
+
+bool utf8_valid_line(const char* s, size_t n) {
+    return s ? validate<true>((const uint8_t*)s, n) : n == 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+/*
+  utf8.h — UTF-8 validation shared by BLE ingest, the message log and web-submitted text.
+
+  Well-formed means: no overlong forms, no surrogates (U+D800..DFFF), nothing above U+10FFFF,
+  no truncated sequence at the end. Emoji and other 4-byte sequences are fine.
+
+  Runs of ASCII are checked a machine word at a time (4 bytes on the ESP32, 8 on a 64-bit
+  host) with bit masks; the first non-ASCII byte drops into a table-driven DFA (one class
+  lookup and one transition lookup per byte) until the sequence is finished.
+
+  Plain C++ without Arduino; tools/utf8_bench.cpp checks it against the old byte-by-byte
+  validator and times both.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Well-formed UTF-8; any code point, control characters included.
+bool utf8_valid(const char* s, size_t n);
+
+// Well-formed UTF-8 that is one printable line: also rejects C0 controls (NUL, TAB, CR, LF...)
+// and DEL. The rule for '>' advertisement text.
+bool utf8_valid_line(const char* s, size_t n);
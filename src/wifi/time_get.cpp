@@ -1,43 +1,61 @@
 #include "time_get.h"
-#include <WiFi.h>
 #include <time.h>
+#include <sys/time.h>
+#include "esp_sntp.h"
+#include "diag/metrics.h"
+#include "diag/log.h"
 
-static bool timeInitialized = false;
-static unsigned long lastAttempt = 0;
-static const unsigned long retryIntervalMs = 5 * 60 * 1000; // 5 minutes
+// Anything before this is an unset clock (1970 after a cold boot)
+static const time_t validAfter = 1704067200;   // 2024-01-01
+// Larger corrections step the clock; adjtime() slews at 1/64 of elapsed time
+static const int64_t slewMaxMs = 500;
+
+static volatile bool synced = false;     // set by the SNTP callback (tcpip task)
+static bool timeIsValid = false;         // loop task view; listeners have been told
+static void (*listeners[4])() = {};
+static volatile uint32_t ntpSyncMs = 0;  // millis() of the last SNTP sync
+static volatile TimeSource source = TIME_SRC_NONE;
+
+static void onSntpSync(struct timeval*) {
+    uint32_t now = millis();
+    ntpSyncMs = now ? now : 1;
+    source = TIME_SRC_NTP;
+    synced = true;
+}
 
 void initTime() {
+    sntp_set_time_sync_notification_cb(onSntpSync);
+    // SNTP waits for the STA link on its own and retries; nothing here waits for it
     configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-
-    Serial.println("[time] Waiting for time sync...");
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-        Serial.println("[time] Time synchronized.");
-        timeInitialized = true;
-    } else {
-        Serial.println("[time] Failed to get time.");
-        lastAttempt = millis();
+    if (time(nullptr) > validAfter) {                // clock kept across a soft reset
+        source = TIME_SRC_RTC;
+        synced = true;
     }
 }
 
 void updateTime() {
-    if (timeInitialized) return;
-
-    if (WiFi.status() != WL_CONNECTED) return;
-
-    unsigned long now = millis();
-    if (now - lastAttempt >= retryIntervalMs || lastAttempt == 0) {
-        lastAttempt = now;
+    if (timeIsValid || !synced) return;
+    timeIsValid = true;
+    metric_set(M_BOOT_TIME_VALID_MS, millis());
+    GLOGI(LOGM_TIME, "Time synchronized after %lu ms.", millis());
+    for (auto cb : listeners) {
+        if (cb) cb();
+    }
+}
 
-        Serial.println("[time] Retrying time sync...");
-        configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+bool timeValid() {
+    return timeIsValid;
+}
 
-        struct tm timeinfo;
-        if (getLocalTime(&timeinfo)) {
-            Serial.println("[time] Time synchronized.");
-            timeInitialized = true;
-        } else {
-            Serial.println("[time] Time sync failed.");
+void onTimeValid(void (*cb)()) {
+    if (timeIsValid) {
+        cb();
+        return;
+    }
+    for (auto& slot : listeners) {
+        if (!slot) {
+            slot = cb;
+            return;
         }
     }
 }
@@ -45,3 +63,32 @@ void updateTime() {
 time_t getCurrentTimestamp() {
     return time(nullptr);
 }
+
+TimeSource timeSource() {
+    return source;
+}
+
+uint32_t timeLastNtpSyncMs() {
+    return ntpSyncMs;
+}
+
+void timeAdjustMs(int64_t deltaMs, TimeSource src) {
+    if (deltaMs != 0) {
+        struct timeval pending = {};
+        adjtime(nullptr, &pending);                  // an unfinished slew is carried over
+        int64_t total = deltaMs + (int64_t)pending.tv_sec * 1000 + pending.tv_usec / 1000;
+        if (total > -slewMaxMs && total < slewMaxMs) {
+            struct timeval d = { (time_t)(total / 1000), (suseconds_t)((total % 1000) * 1000) };
+            adjtime(&d, nullptr);
+        } else {
+            struct timeval tv;
+            gettimeofday(&tv, nullptr);
+            int64_t us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec + total * 1000;
+            tv.tv_sec = (time_t)(us / 1000000);
+            tv.tv_usec = (suseconds_t)(us % 1000000);
+            settimeofday(&tv, nullptr);              // also cancels the pending slew
+        }
+    }
+    source = src;
+    if (time(nullptr) > validAfter) synced = true;
+}
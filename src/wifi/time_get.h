@@ -3,6 +3,24 @@
 #include <Arduino.h>
 #include <time.h>
 
+// Starts SNTP in the background; never blocks. The first sync (or a wall clock that survived
+// a soft reset) raises the "time valid" event, delivered from updateTime() on the loop task.
 void initTime();
-void updateTime();
+void updateTime();                        // call from loop(); dispatches the time-valid event
+bool timeValid();
+void onTimeValid(void (*cb)());           // up to 4 listeners; called at once if already valid
 time_t getCurrentTimestamp();
+
+typedef enum {
+    TIME_SRC_NONE = 0,
+    TIME_SRC_NTP,                         // SNTP has synced at least once
+    TIME_SRC_RTC,                         // clock kept across a soft reset
+    TIME_SRC_MESH                         // set from BLE time beacons (ble/timesync.h)
+} TimeSource;
+
+TimeSource timeSource();
+uint32_t timeLastNtpSyncMs();             // millis() of the last SNTP sync, 0 = never
+
+// Moves the wall clock by `deltaMs`: slewed (adjtime) when small, stepped otherwise. Marks the
+// time valid on behalf of `src` if nothing else has.
+void timeAdjustMs(int64_t deltaMs, TimeSource src);
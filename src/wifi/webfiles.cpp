@@ -1,99 +1,677 @@
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <memory>
+#include <esp_heap_caps.h>
+#include "webfiles.h"
 #include "drive/storage.h"
+#include "drive/writebehind.h"
+#include "drive/dircache.h"
+#include "drive/storageio.h"
+#include "drive/flashwear.h"
+#include "diag/metrics.h"
+#include "diag/log.h"
 
-extern WebServer server;
 extern StorageManager storage;
 
-void handleFileList() {
-    String dir = server.arg("dir");
+#ifndef UPLOAD_MAX_SESSIONS
+#define UPLOAD_MAX_SESSIONS 2    // each session holds two STORAGE_ALLOC_UNIT buffers
+#endif
+
+#define UPLOAD_TEMP_SUFFIX ".part"
+
+#ifndef FILELIST_DEFAULT_LIMIT
+#define FILELIST_DEFAULT_LIMIT 100
+#endif
+#ifndef FILELIST_MAX_LIMIT
+#define FILELIST_MAX_LIMIT 500
+#endif
+
+static bool isSafePath(const String& path) {
+    return path.startsWith("/") && path.indexOf("..") < 0;
+}
+
+// While the USB host owns the SD card FATFS is unmounted on the device (see StorageManager::tick)
+static bool hostBusy(AsyncWebServerRequest* request) {
+    if (storage.deviceOwnsVolume()) return false;
+    request->send(423, "application/json", "{\"error\":\"storage is in use by the USB host\"}");
+    return true;
+}
+
+// Query (or form, with post=true) parameter as an absolute FS path; the web UI sends bare names.
+static String pathParam(AsyncWebServerRequest* request, const char* key, bool post = false) {
+    if (!request->hasParam(key, post)) return "";
+    String v = request->getParam(key, post)->value();
+    if (v.length() && !v.startsWith("/")) v = "/" + v;
+    return v;
+}
+
+static void printJsonString(Print& out, const char* s) {
+    out.print('"');
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out.print('\\');
+            out.print((char)c);
+        } else if (c < 0x20) {
+            out.printf("\\u%04x", c);
+        } else {
+            out.print((char)c);
+        }
+    }
+    out.print('"');
+}
+
+// GET /api/files/list?dir=/x&sort=name|size|mtime&order=asc|desc&limit=100&cursor=<next>
+// -> {"dir","sort","order","total","cached","entries":[{"name","type","size","mtime"}],"next"}
+void handleFileList(AsyncWebServerRequest* request) {
+    metric_inc(M_WEB_REQUESTS);
+    if (hostBusy(request)) return;
+    String dir = pathParam(request, "dir");
     if (dir.length() == 0) dir = "/";
-    fs::FS& fs = storage.getActiveFS();
+    int sort = dir_sort_from_name(request->hasParam("sort") ? request->getParam("sort")->value() : "name");
+    bool desc = request->hasParam("order") && request->getParam("order")->value() == "desc";
+    String cursor = request->hasParam("cursor") ? request->getParam("cursor")->value() : "";
+    long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : FILELIST_DEFAULT_LIMIT;
+    if (limit <= 0 || limit > FILELIST_MAX_LIMIT) limit = FILELIST_MAX_LIMIT;
 
-    File root = fs.open(dir);
-    if (!root || !root.isDirectory()) {
-        server.send(400, "application/json", "{\"error\":\"Invalid path\"}");
+    DirPage page;
+    bool ok = isSafePath(dir) && sort >= 0 && storio_run(STORIO_WEB_READ, [&]() {
+        return dir_list_page(dir, (DirSort)sort, desc, cursor, (size_t)limit, page);
+    });
+    if (!ok) {
+        request->send(400, "application/json", "{\"error\":\"Invalid path\"}");
         return;
     }
 
-    File file = root.openNextFile();
-    String output = "[";
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    response->print("{\"dir\":");
+    printJsonString(*response, dir.c_str());
+    response->printf(",\"sort\":\"%s\",\"order\":\"%s\",\"total\":%u,\"cached\":%s,\"entries\":[",
+                     dir_sort_name((DirSort)sort), desc ? "desc" : "asc", (unsigned)page.total,
+                     page.cached ? "true" : "false");
     bool first = true;
-
-    while (file) {
-        if (!first) output += ",";
+    for (const auto& e : page.entries) {
+        response->print(first ? "{\"name\":" : ",{\"name\":");
         first = false;
+        printJsonString(*response, e.name.c_str());
+        response->printf(",\"type\":\"%s\",\"size\":%u,\"mtime\":%u}",
+                         e.isDir ? "dir" : "file", (unsigned)e.size, (unsigned)e.mtime);
+    }
+    response->print("],\"next\":");
+    if (page.next.length()) printJsonString(*response, page.next.c_str());
+    else response->print("null");
+    response->print("}");
+    request->send(response);
+}
+
+// ---------- Uploads ----------
+//
+// Two ways in, one write path:
+//   POST /api/files/upload?dir=/x       multipart/form-data (the web UI)
+//   PUT  /api/files/upload?name=/x/f    raw body; optional "Content-Range: bytes <start>-<end>/<total>"
+//   GET  /api/files/upload/status?name=/x/f   -> {"offset":N} to resume an interrupted PUT
+//
+// Data goes through a WriteBehindFile into "<name>.part" and is renamed over <name> once the
+// last byte is on the card, so a reader never sees a half-written file. An interrupted upload
+// keeps its .part file; the client asks for the offset and resumes with Content-Range.
+// A Content-Range whose span differs from the body length is refused with 400.
+//
+// The final flush, fsync and rename run on the storage task. The response waits for them at
+// most WB_STALL_TIMEOUT_MS; past that it is 202 and the client polls the status URL, so a slow
+// card never holds the async web task (and every other connection) for long.
+
+struct UploadSession {
+    AsyncWebServerRequest* request;
+    WriteBehindFile file;
+    String name;
+    String temp;
+    uint32_t start;          // offset of the first byte of this request within the file
+    uint32_t total;          // final file size, 0 if unknown (multipart)
+    uint32_t t0;
+    int status;              // 0 while streaming; HTTP status once decided
+    String error;
+    bool complete;           // last byte received: rename over `name` once closed
+    bool closing;            // close handed to the storage task
+    volatile int closedStatus;   // set by the storage task when the close (and rename) has run
+    const char* closedError;
+    SemaphoreHandle_t closed;    // given by the storage task at the same time
+    uint8_t refs;            // the HTTP side and, while closing, the storage task
+    bool storageHeld;        // counted as a storage session while the file is open
+};
+
+static UploadSession* s_sessions[UPLOAD_MAX_SESSIONS];
+static portMUX_TYPE s_sessionMux = portMUX_INITIALIZER_UNLOCKED;
+
+static UploadSession* findSession(AsyncWebServerRequest* request) {
+    for (auto* s : s_sessions) {
+        if (s && s->request == request) return s;
+    }
+    return nullptr;
+}
+
+// The session goes away once neither the HTTP side nor a pending close holds it
+static void releaseSession(UploadSession* s) {
+    portENTER_CRITICAL(&s_sessionMux);
+    bool last = --s->refs == 0;
+    portEXIT_CRITICAL(&s_sessionMux);
+    if (!last) return;
+    if (s->closed) vSemaphoreDelete(s->closed);
+    delete s;
+}
+
+static bool closeSession(UploadSession* s, bool complete);
+
+static void endSession(UploadSession* s) {
+    for (auto& slot : s_sessions) {
+        if (slot == s) slot = nullptr;
+    }
+    // A failed or interrupted upload still has its file open; close it without waiting
+    if (s->file.isOpen()) closeSession(s, false);
+    releaseSession(s);
+}
 
-        String fullPath = String(file.name());
-        String trimmed = fullPath;
-        if (dir != "/" && fullPath.startsWith(dir)) {
-            trimmed = fullPath.substring(dir.length());
+// Storage task: the file is closed; move a complete upload into place.
+static void onSessionClosed(void* ctx, bool ok) {
+    UploadSession* s = (UploadSession*)ctx;
+    int status = ok ? 202 : 500;
+    const char* error = ok ? "" : "write failed";
+    if (ok && s->complete) {
+        String from = storage.vfsPath(s->temp);
+        String to = storage.vfsPath(s->name);
+        // FAT cannot rename over an existing file; the old copy stays readable until this point.
+        ::remove(to.c_str());
+        if (::rename(from.c_str(), to.c_str()) == 0) {
+            status = 201;
+        } else {
+            status = 500;
+            error = "rename failed";
         }
+    }
+    dir_cache_invalidate(s->name);
+    if (s->storageHeld) storage.endSession();
+    if (s->complete) metric_inc(status == 201 ? M_UPLOAD_DONE : M_UPLOAD_FAILED);
+    s->closedStatus = status;
+    s->closedError = error;
+    xSemaphoreGive(s->closed);
+    releaseSession(s);
+}
+
+// Hands the close to the storage task; the async web task does not wait for the card here.
+static bool closeSession(UploadSession* s, bool complete) {
+    s->complete = complete;
+    portENTER_CRITICAL(&s_sessionMux);
+    s->refs++;
+    portEXIT_CRITICAL(&s_sessionMux);
+    if (!s->file.close(onSessionClosed, s)) {
+        releaseSession(s);
+        return false;
+    }
+    s->closing = true;
+    return true;
+}
 
-        output += "{\"name\":\"" + trimmed + "\",";
-        output += "\"size\":" + String(file.size()) + "}";
+// Keeps whatever reached the card so the client can resume from /api/files/upload/status.
+static void abandonSession(AsyncWebServerRequest* request) {
+    UploadSession* s = findSession(request);
+    if (!s) return;
+    GLOGW(LOGM_WEB, "Upload of %s interrupted at %u bytes", s->name.c_str(), (unsigned)s->file.offset());
+    metric_inc(M_UPLOAD_FAILED);
+    endSession(s);
+}
 
-        file = root.openNextFile();
+static UploadSession* beginSession(AsyncWebServerRequest* request, const String& name, uint32_t start, uint32_t total,
+                                   const char* reject = nullptr) {
+    UploadSession** slot = nullptr;
+    for (auto& s : s_sessions) {
+        if (!s) { slot = &s; break; }
     }
+    if (!slot) return nullptr;
+
+    UploadSession* s = new UploadSession();
+    s->request = request;
+    s->name = name;
+    s->temp = name + UPLOAD_TEMP_SUFFIX;
+    s->start = start;
+    s->total = total;
+    s->t0 = millis();
+    s->status = 0;
+    s->complete = false;
+    s->closing = false;
+    s->closedStatus = 0;
+    s->closedError = "";
+    s->closed = xSemaphoreCreateBinary();
+    s->refs = 1;
+    s->storageHeld = false;
+    *slot = s;
+    request->onDisconnect([request]() { abandonSession(request); });
 
-    output += "]";
-    server.send(200, "application/json", output);
+    if (!s->closed) {
+        s->status = 503;
+        s->error = "out of memory";
+    } else if (reject) {
+        s->status = 400;
+        s->error = reject;
+    } else if (!isSafePath(name)) {
+        s->status = 400;
+        s->error = "invalid name";
+    } else if (!storage.beginSession()) {
+        s->status = 423;
+        s->error = "storage is in use by the USB host";
+    } else if (!s->file.open(storage.vfsPath(s->temp).c_str(), start, start == 0)) {
+        storage.endSession();
+        // For a resume this means the .part file does not end where the client thinks it does
+        s->status = start == 0 ? 500 : 416;
+        s->error = start == 0 ? "cannot create file" : "offset mismatch";
+    } else {
+        s->storageHeld = true;
+    }
+    if (s->status) metric_inc(M_UPLOAD_FAILED);
+    return s;
 }
 
-void handleFileUpload() {
-    static File f;
-    fs::FS& fs = storage.getActiveFS();
-    HTTPUpload& upload = server.upload();
+static void appendSession(UploadSession* s, const uint8_t* data, size_t len) {
+    if (s->status) return;
+    if (!storage.deviceOwnsVolume()) {
+        // The USB host is taking the card: close now so the hand-over does not wait for us
+        s->status = 423;
+        s->error = "storage was handed to the USB host";
+        metric_inc(M_UPLOAD_FAILED);
+        closeSession(s, false);
+        return;
+    }
+    metric_inc(M_UPLOAD_BYTES, len);
+    wear_record_active(WEAR_UPLOAD, len);
+    if (!s->file.write(data, len)) {
+        s->status = 500;
+        s->error = "write failed";
+        metric_inc(M_UPLOAD_FAILED);
+    }
+}
 
-    if (upload.status == UPLOAD_FILE_START) {
-        f = fs.open("/" + upload.filename, "w");
-    } else if (upload.status == UPLOAD_FILE_WRITE) {
-        if (f) f.write(upload.buf, upload.currentSize);
-    } else if (upload.status == UPLOAD_FILE_END) {
-        if (f) f.close();
+// Last byte received: flush, close and, if the file is complete, move it into place. All of
+// that runs on the storage task; respondSession() waits a bounded time for the outcome.
+static void commitSession(UploadSession* s, bool complete) {
+    if (s->status) return;
+    if (!closeSession(s, complete)) {
+        s->status = 500;
+        s->error = "write failed";
+        metric_inc(M_UPLOAD_FAILED);
     }
 }
 
-void handleFileDownload() {
-    String name = server.arg("name");
+static void respondSession(AsyncWebServerRequest* request) {
+    UploadSession* s = findSession(request);
+    if (!s) {
+        // Empty body, or every upload slot was busy when the first chunk arrived
+        request->send(503, "application/json", "{\"error\":\"upload not accepted\"}");
+        return;
+    }
+
+    if (!s->status && s->closing) {
+        // Closing on the storage task: a slow card answers 202 and the client polls /status
+        if (xSemaphoreTake(s->closed, pdMS_TO_TICKS(WB_STALL_TIMEOUT_MS)) == pdTRUE) {
+            s->status = s->closedStatus;
+            s->error = s->closedError;
+        } else {
+            s->status = 202;
+            s->error = "still writing, poll /api/files/upload/status";
+        }
+    }
+
+    uint32_t ms = millis() - s->t0;
+    uint32_t bytes = s->file.offset() - s->start;
+    uint32_t kbps = ms ? (uint32_t)((uint64_t)bytes * 1000 / 1024 / ms) : 0;
+    String json = "{\"name\":\"" + s->name + "\"";
+    if (s->error.length()) json += ",\"error\":\"" + s->error + "\"";
+    json += ",\"offset\":" + String(s->file.offset());
+    json += ",\"bytes\":" + String(bytes);
+    json += ",\"ms\":" + String(ms);
+    json += ",\"kbps\":" + String(kbps);
+    json += ",\"stall_ms\":" + String(s->file.stallUs() / 1000);
+    json += "}";
+
+    if (s->status == 201) {
+        metric_set(M_UPLOAD_LAST_KBPS, kbps);
+        GLOGI(LOGM_WEB, "Uploaded %s: %u bytes in %u ms (%u KiB/s)", s->name.c_str(), (unsigned)bytes, (unsigned)ms, (unsigned)kbps);
+    }
+    request->send(s->status ? s->status : 500, "application/json", json);
+    endSession(s);
+}
+
+// Multipart body chunk (POST)
+static void onMultipartUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
+    UploadSession* s = findSession(request);
+    if (index == 0 && !s) {
+        String dir = pathParam(request, "dir");
+        if (!dir.endsWith("/")) dir += "/";
+        s = beginSession(request, dir + filename, 0, 0);
+    }
+    if (!s) return;
+    appendSession(s, data, len);
+    if (final) commitSession(s, true);
+}
+
+// Parses "bytes <start>-<end>/<total>"; false when absent or malformed.
+static bool parseContentRange(const String& v, uint32_t& start, uint32_t& end, uint32_t& total) {
+    unsigned long a, b, t;
+    if (sscanf(v.c_str(), "bytes %lu-%lu/%lu", &a, &b, &t) != 3 || b < a || b >= t) return false;
+    start = (uint32_t)a;
+    end = (uint32_t)b;
+    total = (uint32_t)t;
+    return true;
+}
+
+// Raw body chunk (PUT)
+static void onRawUpload(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    UploadSession* s = findSession(request);
+    if (index == 0 && !s) {
+        String name = pathParam(request, "name");
+        uint32_t start = 0, end = total ? total - 1 : 0, fileTotal = total;
+        const char* reject = nullptr;
+        if (request->hasHeader("Content-Range")) {
+            if (!parseContentRange(request->header("Content-Range"), start, end, fileTotal)) reject = "invalid Content-Range";
+            else if (end - start + 1 != total) reject = "Content-Range does not match the body length";
+        }
+        s = beginSession(request, name, start, fileTotal, reject);
+    }
+    if (!s) return;
+    appendSession(s, data, len);
+    if (index + len == total) commitSession(s, s->start + total == s->total);
+}
+
+void handleUploadStatus(AsyncWebServerRequest* request) {
+    metric_inc(M_WEB_REQUESTS);
+    if (hostBusy(request)) return;
+    String name = pathParam(request, "name");
+    if (!isSafePath(name)) {
+        request->send(400, "application/json", "{\"error\":\"invalid name\"}");
+        return;
+    }
     fs::FS& fs = storage.getActiveFS();
+    File part = fs.open(name + UPLOAD_TEMP_SUFFIX, "r");
+    uint32_t offset = part ? part.size() : 0;
+    if (part) part.close();
+    String json = "{\"name\":\"" + name + "\",\"offset\":" + String(offset) +
+                  ",\"complete\":" + (fs.exists(name) && offset == 0 ? "true" : "false") + "}";
+    request->send(200, "application/json", json);
+}
+
+// ---------- Downloads ----------
+//
+// GET /api/files/read?name=/x/f honours "Range: bytes=a-b | a- | -n" (single range) and
+// "If-Range" (ETag or Last-Modified). The body is produced by a filler callback that copies
+// from a STORAGE_ALLOC_UNIT read-ahead buffer into the TCP send buffer; the SD card only ever
+// sees cluster-sized, cluster-aligned read() calls. Read-ahead buffers come from a fixed pool
+// allocated once, so concurrent downloads never grow the heap; when the pool is exhausted the
+// client gets 503 + Retry-After instead of a fragmented heap.
+
+#ifndef DOWNLOAD_MAX_CONCURRENT
+#define DOWNLOAD_MAX_CONCURRENT 3
+#endif
+
+static uint8_t*    s_dlPool[DOWNLOAD_MAX_CONCURRENT];
+static bool        s_dlBusy[DOWNLOAD_MAX_CONCURRENT];
+static portMUX_TYPE s_dlMux = portMUX_INITIALIZER_UNLOCKED;
 
-    if (!fs.exists(name)) {
-        server.send(404, "text/plain", "Not found");
+static void dlRelease(int slot) {
+    portENTER_CRITICAL(&s_dlMux);
+    s_dlBusy[slot] = false;
+    portEXIT_CRITICAL(&s_dlMux);
+}
+
+static int dlAcquire() {
+    int slot = -1;
+    portENTER_CRITICAL(&s_dlMux);
+    for (int i = 0; i < DOWNLOAD_MAX_CONCURRENT; ++i) {
+        if (!s_dlBusy[i]) { s_dlBusy[i] = true; slot = i; break; }
+    }
+    portEXIT_CRITICAL(&s_dlMux);
+    if (slot >= 0 && !s_dlPool[slot]) {
+        s_dlPool[slot] = (uint8_t*)heap_caps_aligned_alloc(32, STORAGE_ALLOC_UNIT, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (!s_dlPool[slot]) {
+            dlRelease(slot);
+            slot = -1;
+        }
+    }
+    return slot;
+}
+
+struct DownloadStream {
+    int fd = -1;
+    int slot = -1;
+    uint32_t pos = 0;          // file offset of buf[0]
+    uint32_t have = 0;         // valid bytes in buf
+    uint32_t next = 0;         // next file offset to send
+    uint32_t end = 0;          // one past the last byte to send
+    uint32_t t0 = 0;
+    uint32_t readUs = 0;
+    uint32_t readBytes = 0;
+    uint32_t sent = 0;
+    bool failed = false;       // short of the announced Content-Length, or the card was handed away
+    bool session = false;      // counted as a storage session (StorageManager::beginSession)
+
+    ~DownloadStream() {
+        if (fd >= 0) storio_run(STORIO_WEB_READ, [this]() { return ::close(fd) == 0; });
+        if (session) storage.endSession();
+        if (slot >= 0) dlRelease(slot);
+        uint32_t ms = millis() - t0;
+        metric_inc(M_DOWNLOAD_BYTES, sent);
+        if (sent && ms) metric_set(M_DOWNLOAD_LAST_KBPS, (uint32_t)((uint64_t)sent * 1000 / 1024 / ms));
+        if (readUs) metric_set(M_DOWNLOAD_SD_KBPS, (uint32_t)((uint64_t)readBytes * 1000000 / 1024 / readUs));
+    }
+
+    size_t fill(uint8_t* out, size_t maxLen) {
+        if (failed || next >= end) return 0;
+        if (!storage.deviceOwnsVolume()) {
+            failed = true;
+            return 0;
+        }
+        if (next < pos || next >= pos + have) {
+            uint8_t* buf = s_dlPool[slot];
+            pos = next - (next % STORAGE_ALLOC_UNIT);
+            ssize_t n = -1;
+            uint32_t dt = 0;
+            storio_run(STORIO_WEB_READ, [&]() {
+                uint32_t t = micros();   // card time only; queue wait is in storio_web_read_latency_us
+                if (lseek(fd, pos, SEEK_SET) >= 0) n = ::read(fd, buf, STORAGE_ALLOC_UNIT);
+                dt = (uint32_t)(micros() - t);
+                return n >= 0;
+            });
+            hist_observe(H_DOWNLOAD_READ_US, dt);
+            readUs += dt;
+            if (n <= 0 || (uint32_t)n <= next - pos) {
+                // Read error or the file shrank: Content-Length can no longer be met
+                failed = true;
+                return 0;
+            }
+            have = (uint32_t)n;
+            readBytes += have;
+        }
+        size_t n = pos + have - next;
+        if (n > end - next) n = end - next;
+        if (n > maxLen) n = maxLen;
+        memcpy(out, s_dlPool[slot] + (next - pos), n);
+        next += n;
+        sent += n;
+        return n;
+    }
+};
+
+// Digits only, no sign, no overflow: "abc" or "12x" must not quietly read as a number.
+static bool parseOffset(const String& v, uint32_t& out) {
+    if (v.length() == 0 || v.length() > 10) return false;
+    uint64_t n = 0;
+    for (size_t i = 0; i < v.length(); ++i) {
+        char c = v[i];
+        if (c < '0' || c > '9') return false;
+        n = n * 10 + (uint32_t)(c - '0');
+    }
+    if (n > UINT32_MAX) return false;
+    out = (uint32_t)n;
+    return true;
+}
+
+// Parses a single "bytes=" range against `size`. Returns false when the header is not usable
+// (other unit or multi-range: serve the whole file), sets `unsatisfiable` for ranges past EOF
+// and for malformed byte ranges.
+static bool parseRange(const String& v, uint32_t size, uint32_t& first, uint32_t& last, bool& unsatisfiable) {
+    unsatisfiable = false;
+    if (!v.startsWith("bytes=") || v.indexOf(',') >= 0) return false;
+    String spec = v.substring(6);
+    spec.trim();
+    int dash = spec.indexOf('-');
+    String a = dash < 0 ? spec : spec.substring(0, dash);
+    String b = dash < 0 ? String() : spec.substring(dash + 1);
+    uint32_t n = 0;
+    if (dash < 0 || (a.length() == 0 && !parseOffset(b, n)) ||
+        (a.length() && (!parseOffset(a, first) || (b.length() && !parseOffset(b, last))))) {
+        unsatisfiable = true;
+        return true;
+    }
+    if (a.length() == 0) {
+        // suffix range: last N bytes
+        if (n == 0) { unsatisfiable = true; return true; }
+        first = n >= size ? 0 : size - n;
+        last = size - 1;
+    } else {
+        if (b.length() == 0 || last >= size) last = size - 1;
+        if (first > last || first >= size) { unsatisfiable = true; return true; }
+    }
+    if (size == 0) unsatisfiable = true;
+    return true;
+}
+
+void handleFileDownload(AsyncWebServerRequest* request) {
+    metric_inc(M_WEB_REQUESTS);
+    if (hostBusy(request)) return;
+    String name = pathParam(request, "name");
+    String path = storage.vfsPath(name);
+    struct stat st;
+
+    if (!isSafePath(name) || ::stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode)) {
+        metric_inc(M_WEB_NOT_FOUND);
+        request->send(404, "text/plain", "Not found");
+        return;
+    }
+
+    uint32_t size = (uint32_t)st.st_size;
+    char etag[32], lastModified[40];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)size, (unsigned long)st.st_mtime);
+    struct tm tmv;
+    gmtime_r(&st.st_mtime, &tmv);
+    strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tmv);
+
+    uint32_t first = 0, last = size ? size - 1 : 0;
+    bool partial = false, unsatisfiable = false;
+    if (request->hasHeader("Range")) {
+        // If-Range: only honour the range when the client's copy is still the current one
+        bool current = true;
+        if (request->hasHeader("If-Range")) {
+            String v = request->header("If-Range");
+            current = (v == etag || v == lastModified);
+        }
+        if (current) partial = parseRange(request->header("Range"), size, first, last, unsatisfiable);
+    }
+
+    if (unsatisfiable) {
+        AsyncWebServerResponse* response = request->beginResponse(416, "text/plain", "Range not satisfiable");
+        response->addHeader("Content-Range", "bytes */" + String(size));
+        request->send(response);
+        return;
+    }
+
+    int slot = dlAcquire();
+    if (slot < 0) {
+        AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Too many downloads");
+        response->addHeader("Retry-After", "2");
+        request->send(response);
         return;
     }
 
-    File f = fs.open(name, "r");
-    server.streamFile(f, "application/octet-stream");
-    f.close();
+    auto stream = std::make_shared<DownloadStream>();
+    stream->slot = slot;
+    stream->session = storage.beginSession();
+    if (!stream->session) {
+        request->send(423, "application/json", "{\"error\":\"storage is in use by the USB host\"}");
+        return;
+    }
+    stream->fd = ::open(path.c_str(), O_RDONLY);
+    stream->next = first;
+    stream->end = size ? last + 1 : 0;
+    stream->t0 = millis();
+    if (stream->fd < 0) {
+        request->send(500, "text/plain", "Cannot open file");
+        return;
+    }
+
+    AsyncWebServerResponse* response = request->beginResponse("application/octet-stream", stream->end - first,
+        [stream, request](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+            size_t n = stream->fill(buffer, maxLen);
+            if (stream->failed) {
+                // A truncated body with a fixed length would leave the client waiting
+                GLOGW(LOGM_WEB, "Download aborted at %u of %u bytes", (unsigned)stream->next, (unsigned)stream->end);
+                request->client()->close(true);
+            }
+            return n;
+        });
+    if (partial) {
+        response->setCode(206);
+        response->addHeader("Content-Range", "bytes " + String(first) + "-" + String(last) + "/" + String(size));
+    }
+    int slash = name.lastIndexOf('/');
+    response->addHeader("Content-Disposition", "attachment; filename=\"" + name.substring(slash + 1) + "\"");
+    response->addHeader("Accept-Ranges", "bytes");
+    response->addHeader("ETag", etag);
+    response->addHeader("Last-Modified", lastModified);
+    request->send(response);
 }
 
-void handleFileDelete() {
-    String name = server.arg("name");
+void handleFileDelete(AsyncWebServerRequest* request) {
+    metric_inc(M_WEB_REQUESTS);
+    if (hostBusy(request)) return;
+    String name = pathParam(request, "name");
     fs::FS& fs = storage.getActiveFS();
 
-    if (fs.exists(name)) {
+    if (isSafePath(name) && fs.exists(name)) {
         fs.remove(name);
+        dir_cache_invalidate(name);
     }
-    server.send(200, "text/plain", "OK");
+    request->send(200, "text/plain", "OK");
 }
 
-void handleFileRename() {
-    String oldName = server.arg("old");
-    String newName = server.arg("new");
+void handleFileRename(AsyncWebServerRequest* request) {
+    metric_inc(M_WEB_REQUESTS);
+    if (hostBusy(request)) return;
+    String oldName = request->hasParam("old", true) ? pathParam(request, "old", true) : pathParam(request, "old");
+    String newName = request->hasParam("new", true) ? pathParam(request, "new", true) : pathParam(request, "new");
     fs::FS& fs = storage.getActiveFS();
 
-    if (fs.exists(oldName)) {
+    if (isSafePath(oldName) && isSafePath(newName) && fs.exists(oldName)) {
         fs.rename(oldName, newName);
-        server.send(200, "text/plain", "OK");
+        dir_cache_invalidate(oldName);
+        dir_cache_invalidate(newName);
+        request->send(200, "text/plain", "OK");
     } else {
-        server.send(404, "text/plain", "Not found");
+        request->send(404, "text/plain", "Not found");
     }
 }
 
-void setupFileBrowserRoutes() {
+void setupFileBrowserRoutes(AsyncWebServer& server) {
     server.on("/api/files/list", HTTP_GET, handleFileList);
     server.on("/api/files/read", HTTP_GET, handleFileDownload);
     server.on("/api/files/delete", HTTP_GET, handleFileDelete);
     server.on("/api/files/rename", HTTP_POST, handleFileRename);
-    server.on("/api/files/upload", HTTP_POST, []() { server.send(200); }, handleFileUpload);
+    server.on("/api/files/upload/status", HTTP_GET, handleUploadStatus);
+    server.on("/api/files/upload", HTTP_POST, [](AsyncWebServerRequest* request) {
+        metric_inc(M_WEB_REQUESTS);
+        respondSession(request);
+    }, onMultipartUpload);
+    server.on("/api/files/upload", HTTP_PUT, [](AsyncWebServerRequest* request) {
+        metric_inc(M_WEB_REQUESTS);
+        respondSession(request);
+    }, nullptr, onRawUpload);
 }
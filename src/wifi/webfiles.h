@@ -1,3 +1,6 @@
 #pragma once
 
-void setupFileBrowserRoutes();
+class AsyncWebServer;
+
+// Registers /api/files/* (list, read, delete, rename, streaming/resumable upload)
+void setupFileBrowserRoutes(AsyncWebServer& server);
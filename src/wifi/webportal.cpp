@@ -7,10 +7,16 @@
  #include <Preferences.h>
  #include <AsyncTCP.h>
  #include <ESPAsyncWebServer.h>
+ #include <memory>
  #include "time_get.h"
+ #include "webfiles.h"
  #include <esp_bt_device.h>
  #include "../API/API.h"
  #include "drive/storage.h"
+ #include "diag/metrics.h"
+ #include "diag/trace.h"
+ #include "diag/log.h"
+ #include "diag/heapprof.h"
  
  extern StorageManager storage;
  static AsyncWebServer server(80);
@@ -54,6 +60,8 @@
   */
  void setupStaticFileHandler() {
      server.onNotFound([](AsyncWebServerRequest* request) {
+         MetricTimer timer(H_WEB_HANDLER_US);
+         metric_inc(M_WEB_REQUESTS);
          fs::FS& fs = storage.getActiveFS();
  
          if (request->host() == "captive.apple.com") {
@@ -63,13 +71,15 @@
  
          String path = request->url();
          if (path.endsWith("/")) path += "index.html";
+         TRACE_INSTANT(TR_WEB_REQUEST, path.length(), 0);
  
-         Serial.printf("[Web] Looking for: %s in %s\n", path.c_str(), storage.isUsingSD() ? "SD" : "LittleFS");
+         GLOGD(LOGM_WEB, "Looking for: %s in %s", path.c_str(), storage.isUsingSD() ? "SD" : "LittleFS");
  
          if (fs.exists(path)) {
              String contentType = getContentType(path);
              request->send(fs, path, contentType);
          } else {
+             metric_inc(M_WEB_NOT_FOUND);
              request->send(404, "text/plain", "File Not Found");
          }
      });
@@ -80,6 +90,9 @@
   */
  void setupStatusHandler() {
      server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest* request) {
+         MetricTimer timer(H_WEB_HANDLER_US);
+         metric_inc(M_WEB_REQUESTS);
+         HEAPPROF_SCOPE("web_status");
          auto pairs = handleRequest("/status/get", {});
  
          String jsonResponse = "{";
@@ -121,6 +134,8 @@
   */
  void setupHomepageHandler() {
      server.on("/api/homepage", HTTP_GET, [](AsyncWebServerRequest* request) {
+         MetricTimer timer(H_WEB_HANDLER_US);
+         metric_inc(M_WEB_REQUESTS);
          auto pairs = handleRequest("/homepage", {});
          for (const auto& pair : pairs) {
              if (pair.first == "json") {
@@ -132,12 +147,76 @@
      });
  }
  
+ /**
+  * @brief Exposes the metrics registry at /api/metrics (Prometheus text, or JSON with ?format=json)
+  */
+ void setupMetricsHandler() {
+     server.on("/api/metrics", HTTP_GET, [](AsyncWebServerRequest* request) {
+         metric_inc(M_WEB_REQUESTS);
+         bool json = request->hasParam("format") && request->getParam("format")->value() == "json";
+         auto pairs = handleRequest(json ? "/metrics/json" : "/metrics/prometheus", {});
+         for (const auto& pair : pairs) {
+             if (pair.first == "json") {
+                 request->send(200, "application/json", pair.second);
+                 return;
+             }
+             if (pair.first == "text") {
+                 request->send(200, "text/plain; version=0.0.4", pair.second);
+                 return;
+             }
+         }
+         request->send(500, "application/json", "{\"error\":\"failed to render metrics\"}");
+     });
+ }
+ 
+ /**
+  * @brief Lists BLE neighbours with their RSSI-derived distance at /api/neighbors (see ble/proximity.h)
+  */
+ void setupNeighborsHandler() {
+     server.on("/api/neighbors", HTTP_GET, [](AsyncWebServerRequest* request) {
+         MetricTimer timer(H_WEB_HANDLER_US);
+         metric_inc(M_WEB_REQUESTS);
+         auto pairs = handleRequest("/neighbors", {});
+         for (const auto& pair : pairs) {
+             if (pair.first == "json") {
+                 request->send(200, "application/json", pair.second);
+                 return;
+             }
+         }
+         request->send(500, "application/json", "{\"error\":\"failed to list neighbors\"}");
+     });
+ }
+ 
+ /**
+  * @brief Serves a binary snapshot of the trace ring at /api/trace (decode with tools/trace_decode.py)
+  */
+ void setupTraceHandler() {
+     server.on("/api/trace", HTTP_GET, [](AsyncWebServerRequest* request) {
+         if (!trace_enabled()) {
+             request->send(404, "text/plain", "Trace disabled (build with -DGEOGRAM_TRACE)");
+             return;
+         }
+         auto snap = std::make_shared<std::vector<uint8_t>>(trace_snapshot_size());
+         snap->resize(trace_snapshot(snap->data(), snap->size()));
+         AsyncWebServerResponse* response = request->beginResponse("application/octet-stream", snap->size(),
+             [snap](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+                 size_t n = snap->size() - index;
+                 if (n > maxLen) n = maxLen;
+                 memcpy(buffer, snap->data() + index, n);
+                 return n;
+             });
+         response->addHeader("Content-Disposition", "attachment; filename=\"trace.bin\"");
+         request->send(response);
+     });
+ }
+ 
  /**
   * @brief Starts the web portal, initializes FS, Wi-Fi, and Async server.
   */
  void startWebPortal() {
+     // Takes a reference on the mount made in setup(); nothing is mounted twice
      if (!storage.begin()) {
-         Serial.println("Storage init failed.");
+         GLOGE(LOGM_WEB, "Storage init failed.");
          return;
      }
  
@@ -154,30 +233,30 @@
      WiFi.softAP(hotspotSSID.c_str(), "");
  
      if (wifi_ssid.length() > 0) {
-         Serial.print("Connecting to Wi-Fi: ");
-         Serial.println(wifi_ssid);
+         // Event-driven: boot goes on while the STA link comes up; SNTP syncs once it has an IP
+         WiFi.onEvent([](WiFiEvent_t, WiFiEventInfo_t) {
+             if (metric_get(M_BOOT_WIFI_MS) == 0) metric_set(M_BOOT_WIFI_MS, millis());   // first IP only
+             GLOGI(LOGM_WEB, "Connected, IP: %s", WiFi.localIP().toString().c_str());
+         }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+         WiFi.onEvent([](WiFiEvent_t, WiFiEventInfo_t info) {
+             GLOGW(LOGM_WEB, "Wi-Fi disconnected (reason %u), retrying", info.wifi_sta_disconnected.reason);
+         }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+         WiFi.setAutoReconnect(true);
+         GLOGI(LOGM_WEB, "Connecting to Wi-Fi: %s", wifi_ssid.c_str());
          WiFi.begin(wifi_ssid.c_str(), wifi_password.c_str());
- 
-         unsigned long start = millis();
-         while (WiFi.status() != WL_CONNECTED && millis() - start < 5000) {
-             delay(100);
-         }
- 
-         if (WiFi.status() == WL_CONNECTED) {
-             Serial.print("Connected, IP: ");
-             Serial.println(WiFi.localIP());
-             updateTime();
-         } else {
-             Serial.println("Wi-Fi connection failed.");
-         }
      }
  
      setupCaptivePortalRoutes();
      setupStaticFileHandler();
      setupStatusHandler();
      setupHomepageHandler();
+     setupMetricsHandler();
+     setupNeighborsHandler();
+     setupTraceHandler();
+     setupFileBrowserRoutes(server);
  
      server.begin();
-     Serial.println("Async Web portal active at: http://192.168.4.1");
+     metric_set(M_BOOT_WEB_MS, millis());
+     GLOGI(LOGM_WEB, "Async Web portal active at: http://192.168.4.1");
  }
  
\ No newline at end of file
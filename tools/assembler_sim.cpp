@@ -0,0 +1,247 @@
+// assembler_sim.cpp - host simulation of the in-flight assembler (src/ble/inflighttable.h)
+// with many senders on the air at once.
+//
+// Every sender has its own MAC and sends text-format messages the way send_message_text()
+// does: the header, then one parcel per BLE_PARCEL_BURST_MS, each parcel heard (after the
+// dedupe window) with probability `p` somewhere inside its burst. Bursts of different senders
+// interleave. The receive side mirrors ble.cpp: find or start the message's entry, add the
+// parcel, and drop entries past INFLIGHT_TTL_MS. A new entry needs a message; with none left
+// (the table is full, or reserve and heap are used up) the entry quiet the longest gives up
+// its own, unless it got a parcel within BLE_INFLIGHT_BUSY_MS: then the new parcel is parked
+// (BLE_PARKED_PARCELS) and replayed once its message gets an entry.
+//
+// Each table compares, on the same reception trace:
+//   baseline   the id-indexed pool ble.cpp had before: one slot per two-letter id (676),
+//              never full, but two senders with the same id fold into one message
+//   "*" rows   what ble.cpp ships: 676 entries keyed by MAC + id (and by id only, to show
+//              what the MAC buys), messages from the heap as needed, then the same with only
+//              16 + 128 messages, as if the heap were nearly exhausted
+//   pools      the earlier fixed pools of 16 / 64 / 127 messages, MAC + id
+// and reports the completion ratio: messages assembled with the right text over messages
+// whose parcels all arrived.
+//
+// Scenarios: "burst" has every sender start a message within the same second; "steady" has
+// them send one every 5..60 s for 30 minutes. At the default 100 senders the shipped pool
+// completes every fully heard burst message (the baseline loses the ones that share an id);
+// a fixed 16-message pool completed about 20%.
+//
+// Usage:
+//   g++ -O2 -std=c++17 -Isrc tools/assembler_sim.cpp src/ble/bluetoothmessage.cpp src/ble/msgdigest.cpp -o /tmp/assembler_sim
+//   /tmp/assembler_sim [senders=100] [p=0.95] [seed=1]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ble/bluetoothmessage.h"
+#include "ble/inflighttable.h"
+
+#define ADV_TEXT_MAX        24
+#define BLE_PARCEL_BURST_MS 100
+#define INFLIGHT_TTL_MS     (10UL * 60UL * 1000UL)
+#define BLE_INFLIGHT_BUSY_MS 1000
+#define BLE_INFLIGHT_SLOTS  (26 * 26)
+#define BLE_INFLIGHT_RESERVE 16
+#define BLE_PARKED_PARCELS  16
+
+struct Rx {
+    uint32_t t;
+    int msg;                    // index into the sent messages
+    std::string parcel;         // without the leading '>'
+};
+
+struct Sent {
+    uint8_t mac[6];
+    std::string text;
+    int parcels;                // header included
+    int heard = 0;
+};
+
+// send_message_text(): header, then as much text per parcel as fits ADV_TEXT_MAX
+static void send(int msgIdx, Sent& m, uint32_t t0, double p, std::mt19937& rng, std::vector<Rx>& trace) {
+    BluetoothMessage bm("X1SIM", "ANY", m.text.c_str(), false);
+    std::vector<std::string> parcels;
+    parcels.push_back(std::string(bm.getId()) + "0:X1SIM:ANY:" + bm.getChecksum());
+    size_t pos = 0;
+    for (int n = 1; pos < m.text.size(); ++n) {
+        std::string prefix = std::string(bm.getId()) + std::to_string(n) + ":";
+        size_t chunk = std::min(ADV_TEXT_MAX - 1 - prefix.size(), m.text.size() - pos);
+        parcels.push_back(prefix + m.text.substr(pos, chunk));
+        pos += chunk;
+    }
+    m.parcels = (int)parcels.size();
+    std::uniform_real_distribution<double> u(0, 1);
+    for (size_t i = 0; i < parcels.size(); i++) {
+        if (u(rng) >= p) continue;
+        uint32_t t = t0 + (uint32_t)(i * BLE_PARCEL_BURST_MS) + rng() % BLE_PARCEL_BURST_MS;
+        trace.push_back({t, msgIdx, parcels[i]});
+        m.heard++;
+    }
+}
+
+struct Result {
+    int receivable = 0, completed = 0, wrong = 0;
+    uint32_t full = 0, evicted = 0, expired = 0, idShared = 0, collisions = 0, lookups = 0;
+};
+
+static uint16_t parcelId(const std::string& parcel) {
+    return (uint16_t)((parcel[0] - 'A') * 26 + (parcel[1] - 'A'));
+}
+
+// The right text, once per message; anything else is a wrong completion
+static void completed(Result& r, std::vector<bool>& done, const Sent& m, int msg, const char* text) {
+    if (m.text == text && !done[msg]) {
+        r.completed++;
+        done[msg] = true;
+    } else {
+        r.wrong++;
+    }
+}
+
+// The id-indexed pool from before: slot = id, no eviction, no MAC
+static Result runBaseline(const std::vector<Sent>& sent, const std::vector<Rx>& trace) {
+    struct Slot { BluetoothMessage bm; uint32_t touchMs = 0; bool used = false; };
+    std::vector<Slot> slots(26 * 26);
+    Result r;
+    for (auto& m : sent) r.receivable += m.heard == m.parcels;
+    std::vector<bool> done(sent.size());
+    for (const Rx& rx : trace) {
+        Slot& s = slots[parcelId(rx.parcel)];
+        if (s.used && !s.bm.isMessageCompleted() && rx.t - s.touchMs >= INFLIGHT_TTL_MS) {
+            r.expired++;
+            s.bm.clear();
+        }
+        s.bm.addMessageParcel(rx.parcel.data(), rx.parcel.size());
+        s.touchMs = rx.t;
+        s.used = true;
+        if (s.bm.isMessageCompleted()) {
+            completed(r, done, sent[rx.msg], rx.msg, s.bm.getMessage());
+            s.bm.clear();
+            s.used = false;
+        }
+    }
+    return r;
+}
+
+// ble.cpp's assembler with `messages` message buffers for its `Slots` entries
+template <int Slots>
+static Result run(const std::vector<Sent>& sent, const std::vector<Rx>& trace, bool withMac, int messages) {
+    typedef InflightTable<BluetoothMessage, Slots> Table;
+    static Table* table;            // ~800 B per entry on the host: keep it off the stack
+    delete table;
+    table = new Table();
+    struct Parked { uint64_t key; std::string parcel; bool used; };
+    Parked parked[BLE_PARKED_PARCELS] = {};
+    int parkedHead = 0;
+    Result r;
+    for (auto& m : sent) r.receivable += m.heard == m.parcels;
+    static const uint8_t kNoMac[6] = {0};
+    std::vector<bool> done(sent.size());
+
+    for (const Rx& rx : trace) {
+        const Sent& m = sent[rx.msg];
+        uint64_t key = Table::makeKey(withMac ? m.mac : kNoMac, parcelId(rx.parcel));
+        for (auto& e : *table) {
+            if (e.used && rx.t - e.touchMs >= INFLIGHT_TTL_MS) {
+                r.expired++;
+                e.value.clear();
+                table->erase(&e);
+            }
+        }
+        auto* e = table->find(key);
+        if (!e) {
+            if (table->full() || table->used() >= messages) {
+                auto* o = table->oldest();
+                if (rx.t - o->touchMs < BLE_INFLIGHT_BUSY_MS) {
+                    r.full++;
+                    parked[parkedHead] = {key, rx.parcel, true};
+                    parkedHead = (parkedHead + 1) % BLE_PARKED_PARCELS;
+                    continue;
+                }
+                r.evicted++;
+                o->value.clear();
+                table->erase(o);
+            }
+            e = table->insert(key, rx.t);
+            for (auto& pp : parked) {
+                if (!pp.used || pp.key != key) continue;
+                e->value.addMessageParcel(pp.parcel.data(), pp.parcel.size());
+                pp.used = false;
+            }
+        }
+        e->value.addMessageParcel(rx.parcel.data(), rx.parcel.size());
+        e->touchMs = rx.t;
+        if (e->value.isMessageCompleted()) {
+            completed(r, done, m, rx.msg, e->value.getMessage());
+            e->value.clear();
+            table->erase(e);
+        }
+    }
+    r.idShared = table->stats().idShared;
+    r.collisions = table->stats().collisions;
+    r.lookups = table->stats().lookups;
+    return r;
+}
+
+static void row(char mark, const char* pool, const char* key, const Result& r) {
+    printf("%c %-20s  %-8s  %6.1f%%  %5d/%-5d  %4d  %6u  %6u  %6u  %6u  %5.2f\n", mark, pool, key,
+           100.0 * r.completed / (r.receivable ? r.receivable : 1), r.completed, r.receivable, r.wrong, r.full, r.evicted,
+           r.expired, r.idShared, 1.0 + (double)r.collisions / (r.lookups ? r.lookups : 1));
+}
+
+template <int Slots>
+static void report(const std::vector<Sent>& sent, const std::vector<Rx>& trace, const char* pool, int messages,
+                   bool idOnlyToo, char mark = ' ') {
+    if (idOnlyToo) row(mark, pool, "id only", run<Slots>(sent, trace, false, messages));
+    row(mark, pool, "MAC + id", run<Slots>(sent, trace, true, messages));
+}
+
+static void scenario(const char* name, int senders, double p, unsigned seed, bool burst) {
+    std::mt19937 rng(seed);
+    srand(seed);                    // BluetoothMessage picks its ids with rand() on the host
+    std::vector<Sent> sent;
+    std::vector<Rx> trace;
+    std::vector<std::array<uint8_t, 6>> macs(senders);
+    for (auto& mac : macs) for (auto& b : mac) b = (uint8_t)rng();
+
+    for (int s = 0; s < senders; s++) {
+        uint32_t t = burst ? rng() % 1000 : rng() % 60000;
+        uint32_t endMs = burst ? 1 : 30u * 60 * 1000;
+        while (t < endMs || (burst && sent.size() < (size_t)senders)) {
+            Sent m;
+            memcpy(m.mac, macs[s].data(), 6);
+            size_t len = 20 + rng() % 140;
+            for (size_t i = 0; i < len; i++) m.text += (char)('a' + rng() % 26);
+            sent.push_back(m);
+            send((int)sent.size() - 1, sent.back(), t, p, rng, trace);
+            if (burst) break;
+            t += 5000 + rng() % 55000;
+        }
+    }
+    std::stable_sort(trace.begin(), trace.end(), [](const Rx& a, const Rx& b) { return a.t < b.t; });
+
+    printf("\n%s: %d senders, %zu messages, %zu parcels heard (p = %.2f)\n", name, senders, sent.size(), trace.size(), p);
+    printf("  %-20s  %-8s  %7s  %11s  %4s  %6s  %6s  %6s  %6s  %5s\n", "pool", "key", "done", "ok/heard", "bad", "full",
+           "evict", "expire", "idshr", "probe");
+    row(' ', "baseline 676 by id", "id", runBaseline(sent, trace));
+    report<BLE_INFLIGHT_SLOTS>(sent, trace, "676 entries, heap", BLE_INFLIGHT_SLOTS, true, '*');
+    report<BLE_INFLIGHT_SLOTS>(sent, trace, "676 entries, 16+128", BLE_INFLIGHT_RESERVE + 128, false, '*');
+    report<16>(sent, trace, "fixed 16", 16, false);
+    report<64>(sent, trace, "fixed 64", 64, false);
+    report<127>(sent, trace, "fixed 127", 127, false);
+}
+
+
+int main(int argc, char** argv) {
+    int senders = argc > 1 ? atoi(argv[1]) : 100;
+    double p = argc > 2 ? atof(argv[2]) : 0.95;
+    unsigned seed = argc > 3 ? (unsigned)atoi(argv[3]) : 1;
+    scenario("burst", senders, p, seed, true);
+    scenario("steady", senders, p, seed, false);
+    return 0;
+}
@@ -0,0 +1,154 @@
+// message_bench.cpp - memory footprint and reassembly speed of BluetoothMessage
+// (src/ble/bluetoothmessage.h) against the String/std::map version it replaced.
+//
+// The old class cannot be built on the host any more (its String substitute was never
+// complete), so its receive path is reproduced below with std::string standing in for String:
+// same members, same std::map of parcel id -> parcel, same in-order fold. Heap use is counted
+// by replacing the global operator new (and new[], so every delete pairs with its own new).
+//
+// Each message is 5 data parcels of 19 characters plus the header, delivered in a shuffled
+// order, the way a scan hears them.
+//
+// Usage:
+//   g++ -O2 -std=c++17 -Isrc tools/message_bench.cpp src/ble/bluetoothmessage.cpp src/ble/msgdigest.cpp -o /tmp/message_bench
+//   /tmp/message_bench [messages=200000]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ble/bluetoothmessage.h"
+#include "ble/inflighttable.h"
+
+static size_t g_allocs = 0, g_allocBytes = 0;
+
+#define BLE_INFLIGHT_SLOTS (26 * 26)    // ble.cpp defaults
+#define BLE_INFLIGHT_RESERVE 16
+
+static void* countedAlloc(size_t n) {
+    g_allocs++;
+    g_allocBytes += n;
+    if (void* p = malloc(n)) return p;
+    throw std::bad_alloc();
+}
+static void countedFree(void* p) { free(p); }
+
+void* operator new(size_t n) { return countedAlloc(n); }
+void* operator new[](size_t n) { return countedAlloc(n); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+// The receive path of the previous BluetoothMessage, String -> std::string
+class OldMessage {
+public:
+    void addMessageParcel(const std::string& parcel) {
+        if (completed) return;
+        size_t colon = parcel.find(':');
+        if (colon == std::string::npos) return;
+        std::string parcelId = parcel.substr(0, colon);
+        if (box.find(parcelId) != box.end()) return;
+        box.insert({parcelId, parcel});
+        if (parcelId.size() < 3) return;
+        int index = atoi(parcelId.substr(2).c_str());
+        if (id.empty()) id = parcelId.substr(0, 2);
+        if (index == 0) {
+            size_t p2 = parcel.find(':', colon + 1), p3 = parcel.find(':', p2 + 1);
+            if (p2 != std::string::npos && p3 != std::string::npos) {
+                from = parcel.substr(colon + 1, p2 - colon - 1);
+                to = parcel.substr(p2 + 1, p3 - p2 - 1);
+                checksum = parcel.substr(p3 + 1);
+            }
+        }
+        for (;;) {
+            auto it = box.find(id + std::to_string(folded + 1));
+            if (it == box.end()) break;
+            size_t a = it->second.find(':');
+            digest.update(it->second.data() + a + 1, it->second.size() - a - 1);
+            assembled += it->second.substr(a + 1);
+            ++folded;
+        }
+        if (checksum.empty() || folded == 0 || folded + 1 != (int)box.size()) return;
+        char cs[5];
+        msg_digest_letters(digest.value(), cs);
+        for (int k = 0; k < 4; ++k) cs[k] = (char)(cs[k] - 'A' + 'a');   // CRC32C is sent lowercase
+        if (checksum == cs) {
+            message = assembled;
+            completed = true;
+        }
+    }
+    bool completed = false;
+    std::string id, from, to, message, checksum, assembled;
+    std::map<std::string, std::string> box;
+    MsgDigest digest;
+    int folded = 0;
+};
+
+int main(int argc, char** argv) {
+    long messages = argc > 1 ? atol(argv[1]) : 200000;
+    std::mt19937 rng(1);
+    msg_set_crc_tx(true);       // the old receive path above only checks CRC32C letters
+
+    // One set of parcels per message id, shuffled
+    std::vector<std::vector<std::string>> sets;
+    for (int m = 0; m < 64; m++) {
+        std::string text;
+        for (int i = 0; i < 5 * 19; i++) text += (char)(' ' + rng() % 95);
+        BluetoothMessage tx("X1ABCD", "ANY", text.c_str(), false);
+        std::vector<std::string> parcels;
+        parcels.push_back(std::string(tx.getId()) + "0:X1ABCD:ANY:" + tx.getChecksum());
+        for (int i = 0; i < 5; i++) parcels.push_back(std::string(tx.getId()) + std::to_string(i + 1) + ":" + text.substr(i * 19, 19));
+        std::shuffle(parcels.begin(), parcels.end(), rng);
+        sets.push_back(parcels);
+    }
+
+    printf("footprint (host, %zu-bit)\n", sizeof(void*) * 8);
+    printf("  sizeof old message       %6zu bytes + heap per message (below)\n", sizeof(OldMessage));
+    printf("  sizeof BluetoothMessage  %6zu bytes, no heap (%d parcels x %d chars)\n", sizeof(BluetoothMessage),
+           BluetoothMessage::kMaxParcels, BluetoothMessage::kParcelLen);
+    printf("  old assembler  26*26 slots: %7zu bytes static\n", 26 * 26 * sizeof(OldMessage));
+    printf("  new assembler  %3d entries: %7zu bytes static (table + %d reserved messages),\n", BLE_INFLIGHT_SLOTS,
+           sizeof(InflightTable<BluetoothMessage*, BLE_INFLIGHT_SLOTS>) + BLE_INFLIGHT_RESERVE * sizeof(BluetoothMessage),
+           BLE_INFLIGHT_RESERVE);
+    printf("                              + one %zu-byte heap block per message past those\n", sizeof(BluetoothMessage));
+
+    // Old
+    size_t allocs0 = g_allocs, bytes0 = g_allocBytes;
+    long done = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long m = 0; m < messages; m++) {
+        OldMessage msg;
+        for (auto& p : sets[m % sets.size()]) msg.addMessageParcel(p);
+        done += msg.completed;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double oldPps = messages * 6.0 / std::chrono::duration<double>(t1 - t0).count();
+    printf("\nold:  %ld/%ld completed, %.0f parcels/s, %.1f heap allocations (%.0f bytes) per message\n", done, messages,
+           oldPps, (double)(g_allocs - allocs0) / messages, (double)(g_allocBytes - bytes0) / messages);
+
+    // New: one pooled instance, cleared between messages like ble.cpp does
+    static BluetoothMessage msg;
+    allocs0 = g_allocs;
+    bytes0 = g_allocBytes;
+    done = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (long m = 0; m < messages; m++) {
+        msg.clear();
+        for (auto& p : sets[m % sets.size()]) msg.addMessageParcel(p.data(), p.size());
+        done += msg.isMessageCompleted();
+    }
+    t1 = std::chrono::steady_clock::now();
+    double newPps = messages * 6.0 / std::chrono::duration<double>(t1 - t0).count();
+    printf("new:  %ld/%ld completed, %.0f parcels/s, %.1f heap allocations (%.0f bytes) per message\n", done, messages,
+           newPps, (double)(g_allocs - allocs0) / messages, (double)(g_allocBytes - bytes0) / messages);
+    printf("speedup %.1fx\n", newPps / oldPps);
+    return done == messages && g_allocs == allocs0 ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# msc_bench.sh - measure USB mass-storage throughput of a geogram T-Dongle from a Linux host.
+#
+# Usage:
+#   sudo tools/msc_bench.sh /dev/sdX [/media/user/SDCARD] [size_mb]
+#
+#   /dev/sdX     the dongle's block device (see `lsblk`); only READ from, never written
+#   mountpoint   optional; when given, a file is written there with O_DIRECT + fsync
+#   size_mb      transfer size per test (default 64)
+#
+# Reads use O_DIRECT so the host page cache does not hide the device. Compare runs before and
+# after a firmware change, and check msc_cache_* / msc_sd_transfer_duration_us on /metrics.
+set -eu
+
+DEV=${1:?usage: $0 /dev/sdX [mountpoint] [size_mb]}
+MNT=${2:-}
+MB=${3:-64}
+
+rate() {
+    # dd's summary line ends in "..., <secs> s, <rate> <unit>"
+    tail -n 1 | sed 's/.*, //'
+}
+
+echo "sequential read  ($MB MB, 64 KB blocks): $(dd if="$DEV" of=/dev/null bs=64k count=$((MB * 16)) iflag=direct 2>&1 | rate)"
+echo "sequential read  ($MB MB, 4 KB blocks):  $(dd if="$DEV" of=/dev/null bs=4k count=$((MB * 256)) iflag=direct 2>&1 | rate)"
+
+if [ -n "$MNT" ]; then
+    F="$MNT/.msc_bench.tmp"
+    echo "sequential write ($MB MB, 64 KB blocks): $(dd if=/dev/zero of="$F" bs=64k count=$((MB * 16)) oflag=direct conv=fsync 2>&1 | rate)"
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo "file read back   ($MB MB, 64 KB blocks): $(dd if="$F" of=/dev/null bs=64k iflag=direct 2>&1 | rate)"
+    rm -f "$F"
+    sync
+fi
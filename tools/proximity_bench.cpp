@@ -0,0 +1,152 @@
+// proximity_bench.cpp - per-sample cost and distance accuracy of the neighbour engine
+// (src/ble/proximity.h).
+//
+// Cost: PROX_MAX_NEIGHBORS neighbours advertise in random order and every advertisement goes
+// through Proximity::observe(), the only work the scan event handler does per packet. A second
+// run adds a new MAC every 16 samples so the table keeps replacing its stalest neighbour.
+//
+// Accuracy: one neighbour of model LT1 is moved along a scripted path (parked at 2 m, then
+// walking 0.3 m -> 8 m -> 0.3 m at 0.5 m/s, then parked at 0.4 m). Its RSSI follows the
+// built-in LT1 path-loss model plus Gaussian shadowing of `sigma` dB, sampled every `interval`
+// ms (10000 = pings only). Reported for the raw per-sample estimate, an EWMA (alpha 0.3) and
+// the Kalman filter the engine uses:
+//   err50/err90  median / 90th percentile of |log2(estimated / true distance)| as a factor
+//   class        samples whose class matches the true distance's class
+//   flips        class changes (the true path has 4)
+//
+// Usage:
+//   g++ -O2 -std=c++17 -Isrc tools/proximity_bench.cpp src/ble/proximity.cpp -o /tmp/proximity_bench
+//   /tmp/proximity_bench [sigma=6] [interval=1000] [seed=1]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "ble/proximity.h"
+
+struct Sample {
+    uint32_t t;
+    float trueM;
+    int8_t rssi;
+};
+
+static float pathM(uint32_t t) {
+    float s = t / 1000.0f;
+    if (s < 300) return 2.0f;
+    s -= 300;
+    float walk = (8.0f - 0.3f) / 0.5f;              // seconds per leg
+    if (s < walk) return 0.3f + 0.5f * s;
+    s -= walk;
+    if (s < walk) return 8.0f - 0.5f * s;
+    return 0.4f;
+}
+
+static ProxClass trueClass(float d) {
+    return d < PROX_IMMEDIATE_M ? PROX_IMMEDIATE : d < PROX_NEAR_M ? PROX_NEAR : PROX_FAR;
+}
+
+struct Score {
+    std::vector<float> err;
+    int match = 0, flips = 0;
+    ProxClass last = PROX_UNKNOWN;
+
+    void add(float estM, float trueM, ProxClass c) {
+        err.push_back(fabsf(log2f(estM / trueM)));
+        match += c == trueClass(trueM);
+        if (last != PROX_UNKNOWN && c != last) flips++;
+        last = c;
+    }
+    void print(const char* name) {
+        std::sort(err.begin(), err.end());
+        printf("  %-8s  x%5.2f  x%5.2f  %6.1f%%  %5d\n", name, exp2f(err[err.size() / 2]), exp2f(err[err.size() * 9 / 10]),
+               100.0 * match / err.size(), flips);
+    }
+};
+
+static void accuracy(float sigma, uint32_t interval, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> shadow(0, sigma);
+    Proximity prox;
+    const ProxModel* lt1 = prox.model("LT1");
+    uint32_t endMs = (uint32_t)((300 + 2 * (8.0f - 0.3f) / 0.5f + 300) * 1000);
+
+    std::vector<Sample> trace;
+    for (uint32_t t = 0; t < endMs; t += interval) {
+        float d = pathM(t);
+        float r = lt1->rssiAt1m - 10.0f * lt1->exponent * log10f(d) + shadow(rng);
+        trace.push_back({t, d, (int8_t)std::max(-127.0f, std::min(0.0f, roundf(r)))});
+    }
+
+    static const uint8_t mac[6] = {0x24, 0x58, 0x7C, 0x01, 0x02, 0x03};
+    Score raw, ewma, kalman;
+    float avg = 0;
+    ProxClass rawCls = PROX_UNKNOWN, ewmaCls = PROX_UNKNOWN;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const Sample& s = trace[i];
+        ProxNeighbor* n = prox.observe(mac, s.rssi, s.t);
+        if (i == 0) prox.identify(n, "X1BENCH", "LT1");
+        kalman.add(n->distanceM, s.trueM, (ProxClass)n->cls);
+
+        float d = Proximity::distanceM(s.rssi, lt1->rssiAt1m, lt1->exponent);
+        rawCls = Proximity::classify(d, rawCls);
+        raw.add(d, s.trueM, rawCls);
+
+        avg = i ? avg + 0.3f * (s.rssi - avg) : s.rssi;
+        d = Proximity::distanceM(avg, lt1->rssiAt1m, lt1->exponent);
+        ewmaCls = Proximity::classify(d, ewmaCls);
+        ewma.add(d, s.trueM, ewmaCls);
+    }
+
+    printf("\naccuracy: sigma %.1f dB, one sample every %u ms, %zu samples\n", sigma, interval, trace.size());
+    printf("  %-8s  %6s  %6s  %7s  %5s\n", "filter", "err50", "err90", "class", "flips");
+    raw.print("raw");
+    ewma.print("ewma");
+    kalman.print("kalman");
+}
+
+static double cost(long samples, bool churn, unsigned seed) {
+    std::mt19937 rng(seed);
+    static Proximity prox;
+    prox = Proximity();
+    std::vector<uint8_t> macs(PROX_MAX_NEIGHBORS * 6);
+    for (auto& b : macs) b = (uint8_t)rng();
+    std::vector<uint16_t> order(1 << 16);
+    std::vector<int8_t> rssi(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = (uint16_t)(rng() % PROX_MAX_NEIGHBORS);
+        rssi[i] = (int8_t)(-40 - (int)(rng() % 60));
+    }
+
+    float sink = 0;
+    uint32_t now = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < samples; i++) {
+        size_t k = (size_t)i & (order.size() - 1);
+        uint8_t* mac = &macs[order[k] * 6];
+        if (churn && (i & 15) == 0) mac[5]++;           // a neighbour the table has never seen
+        now += 7;
+        sink += prox.observe(mac, rssi[k], now)->distanceM;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    if (sink < 0) printf("%f\n", sink);
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / samples;
+}
+
+int main(int argc, char** argv) {
+    float sigma = argc > 1 ? (float)atof(argv[1]) : 6.0f;
+    uint32_t interval = argc > 2 ? (uint32_t)atoi(argv[2]) : 1000;
+    unsigned seed = argc > 3 ? (unsigned)atoi(argv[3]) : 1;
+
+    const long samples = 20000000;
+    printf("cost (host): %d neighbours, sizeof(Proximity) %zu bytes\n", PROX_MAX_NEIGHBORS, sizeof(Proximity));
+    printf("  known neighbours        %6.1f ns/sample\n", cost(samples, false, seed));
+    printf("  1 in 16 new (replace)   %6.1f ns/sample\n", cost(samples, true, seed));
+
+    accuracy(sigma, interval, seed);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// timesync_sim.cpp - host simulation of BLE mesh time sync (src/ble/timesync.*).
+//
+// Runs the firmware's TimeSync class on a chain of simulated dongles and reports how far each
+// wall clock is from true time. Node 0 has NTP; every other node only hears its neighbours and
+// starts with a random clock error and a random crystal drift.
+//
+// The radio is modelled independently of the receiver's latency estimate: TX setup 3..10 ms,
+// advDelay 0..10 ms, advertising events every 20..40 ms for the 100 ms burst, per-event
+// reception = scan duty x link quality of the true RSSI, receiver processing 1..6 ms, and the
+// receiver only sees the RSSI with +-3 dB of noise.
+//
+// Usage:
+//   g++ -O2 -std=c++17 -Isrc tools/timesync_sim.cpp src/ble/timesync.cpp -o /tmp/timesync_sim
+//   /tmp/timesync_sim [nodes=6] [hours=6] [seed=1] [ntp_off_hour=0]
+//
+// ntp_off_hour > 0 removes the NTP node at that hour, to watch holdover on the rest.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "ble/timesync.h"
+
+struct Node {
+    TimeSync sync;
+    double driftPpm;        // true crystal error
+    double base;            // wall = mono + base (ms)
+    double nextBeacon;      // true time (ms)
+    double nextDriftTick;
+    bool alive = true;
+    std::vector<double> err;
+    uint8_t mac[6];
+
+    double mono(double t) const { return t * (1.0 + driftPpm * 1e-6); }
+    double wall(double t) const { return mono(t) + base; }
+};
+
+static const double kEpochMs = 1760000000000.0;      // true wall time at t = 0
+
+int main(int argc, char** argv) {
+    int nodes = argc > 1 ? atoi(argv[1]) : 6;
+    double hours = argc > 2 ? atof(argv[2]) : 6;
+    unsigned seed = argc > 3 ? (unsigned)atoi(argv[3]) : 1;
+    double ntpOffH = argc > 4 ? atof(argv[4]) : 0;
+    if (nodes < 2) nodes = 2;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> U(0, 1);
+    std::normal_distribution<double> rssiNoise(0, 3);
+
+    std::vector<Node> net(nodes);
+    std::vector<int> linkRssi(nodes);                 // link i-1 <-> i
+    for (int i = 0; i < nodes; i++) {
+        Node& n = net[i];
+        n.driftPpm = i == 0 ? 0 : (U(rng) * 80 - 40);
+        // Half the nodes boot with a roughly right clock, the rest with an unset one
+        n.base = i == 0 ? kEpochMs : (i % 2 ? kEpochMs + (U(rng) - 0.5) * 120000 : 0);
+        n.nextBeacon = 15000 + U(rng) * 2000;
+        n.nextDriftTick = 10000;
+        for (int b = 0; b < 6; b++) n.mac[b] = (uint8_t)(0x10 * b + i);
+        linkRssi[i] = -55 - (int)(U(rng) * 35);       // -55 .. -90 dBm
+    }
+    net[0].sync.setLocalStratum(1, 0);
+
+    const double endMs = hours * 3600e3, warmupMs = 30 * 60e3, step = 10;
+    uint64_t sent = 0, heard = 0;
+    for (double t = 0; t < endMs; t += step) {
+        if (ntpOffH > 0 && t >= ntpOffH * 3600e3) net[0].alive = false;
+        if (net[0].alive) net[0].sync.setLocalStratum(1, (uint32_t)net[0].mono(t));
+
+        for (int i = 0; i < nodes; i++) {
+            Node& n = net[i];
+            if (!n.alive) continue;
+            if (t >= n.nextDriftTick) {
+                n.nextDriftTick += 10000;
+                n.base += (double)n.sync.driftCorrection((uint32_t)n.mono(t));
+            }
+            if (t < n.nextBeacon) continue;
+            n.nextBeacon = t + TIMESYNC_BEACON_MS + U(rng) * 2000;
+
+            char text[TIMESYNC_TEXT_LEN + 1];
+            int64_t stamp = (int64_t)floor(n.wall(t));
+            if (!n.sync.encode(stamp, (uint32_t)n.mono(t), text, sizeof(text))) continue;
+            sent++;
+            for (int j : { i - 1, i + 1 }) {
+                if (j < 0 || j >= nodes || !net[j].alive) continue;
+                int trueRssi = linkRssi[std::max(i, j)];
+                double q = std::min(1.0, std::max(0.1, (trueRssi + 95) / 25.0));
+                double p = TIMESYNC_SCAN_DUTY * q;
+                double at = 3 + U(rng) * 7 + U(rng) * 10;     // setup + advDelay
+                bool got = false;
+                while (at < 3 + TIMESYNC_ADV_BURST_MS) {
+                    if (U(rng) < p) { got = true; break; }
+                    at += 20 + U(rng) * 20;
+                }
+                if (!got) continue;
+                heard++;
+                double rx = t + at + 1 + U(rng) * 5;
+                Node& r = net[j];
+                int8_t rssi = (int8_t)lround(trueRssi + rssiNoise(rng));
+                int64_t corr = 0;
+                if (r.sync.receive(n.mac, text, TIMESYNC_TEXT_LEN, rssi, (uint32_t)r.mono(rx),
+                                   (int64_t)floor(r.wall(rx)), &corr))
+                    r.base += (double)corr;
+            }
+        }
+
+        if (t >= warmupMs && fmod(t, 1000) < step) {
+            for (int i = 1; i < nodes; i++)
+                if (net[i].alive) net[i].err.push_back(net[i].wall(t) - (kEpochMs + t));
+        }
+    }
+
+    printf("nodes=%d hours=%.1f seed=%u ntp_off_hour=%.1f beacons=%llu heard=%llu\n",
+           nodes, hours, seed, ntpOffH, (unsigned long long)sent, (unsigned long long)heard);
+    printf("node stratum  rssi  drift_ppm  est_ppm  mean_abs_ms  p95_abs_ms  max_abs_ms  est_err_ms\n");
+    double worst = 0;
+    for (int i = 1; i < nodes; i++) {
+        std::vector<double> a;
+        for (double e : net[i].err) a.push_back(fabs(e));
+        if (a.empty()) continue;
+        std::sort(a.begin(), a.end());
+        double mean = 0;
+        for (double e : a) mean += e;
+        mean /= a.size();
+        double p95 = a[(size_t)(a.size() * 0.95)], mx = a.back();
+        worst = std::max(worst, p95);
+        const TimeSyncStats& st = net[i].sync.stats();
+        printf("%4d %7u %5d %10.1f %8.1f %12.1f %11.1f %11.1f %11d\n", i, st.stratum, linkRssi[i],
+               net[i].driftPpm, st.driftPpm, mean, p95, mx, st.errorEstMs);
+    }
+    printf("worst p95 sync error: %.1f ms\n", worst);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+trace_decode.py - convert a geogram T-Dongle trace dump into a Chrome trace / Perfetto JSON timeline.
+
+Input is either
+  - the binary dump from  GET http://<device>/api/trace   (starts with "GTRC"), or
+  - a serial console capture containing the hex block printed by the "/trace/dump" command.
+
+Usage:
+  curl -o dump.bin http://192.168.4.1/api/trace
+  python3 tools/trace_decode.py dump.bin > trace.json
+  # open trace.json in chrome://tracing or https://ui.perfetto.dev
+
+Keep EVENTS in sync with TraceEvent in src/diag/trace.h.
+"""
+import json
+import struct
+import sys
+
+HEADER = struct.Struct("<4sHHIII")
+RECORD = struct.Struct("<IBBBBII")
+
+EVENTS = {
+    1: ("adv_rx", ("len", "rssi")),
+    2: ("dedupe_hit", ("len", None)),
+    3: ("parcel_stored", ("slot", "len")),
+    4: ("event_queued", ("type", "depth")),
+    5: ("message_done", ("slot", "msg_len")),
+    6: ("ble_tx", ("len", None)),
+    7: ("flash_write", ("bytes", None)),
+    8: ("msc_read", ("lba", "bytes")),
+    9: ("msc_write", ("lba", "bytes")),
+    10: ("loop", (None, None)),
+    11: ("web_request", ("url_len", None)),
+}
+
+SIGNED_ARGS = {"rssi"}
+
+BEGIN_MARK = "-----BEGIN GEOGRAM TRACE-----"
+END_MARK = "-----END GEOGRAM TRACE-----"
+
+
+def load(path):
+    with open(path, "rb") as f:
+        raw = f.read()
+    if raw[:4] == b"GTRC":
+        return raw
+    text = raw.decode("utf-8", errors="replace")
+    start = text.find(BEGIN_MARK)
+    end = text.find(END_MARK, start)
+    if start < 0 or end < 0:
+        sys.exit("no GTRC binary header or hex block found in %s" % path)
+    body = text[start + len(BEGIN_MARK):end]
+    return bytes.fromhex("".join(body.split()))
+
+
+def decode(raw):
+    magic, version, rec_size, count, overwritten, now_us = HEADER.unpack_from(raw, 0)
+    if magic != b"GTRC" or version != 1 or rec_size != RECORD.size:
+        sys.exit("unsupported dump (magic=%r version=%d record_size=%d)" % (magic, version, rec_size))
+
+    events = []
+    base = None
+    prev = None
+    wrap = 0
+    off = HEADER.size
+    for _ in range(count):
+        if off + RECORD.size > len(raw):
+            break
+        ts, ev, phase, core, _res, a0, a1 = RECORD.unpack_from(raw, off)
+        off += RECORD.size
+
+        # Timestamps are the low 32 bits of esp_timer; unwrap assuming records are roughly ordered.
+        if prev is not None and ts + (1 << 31) < prev:
+            wrap += 1 << 32
+        prev = ts
+        abs_ts = ts + wrap
+        if base is None:
+            base = abs_ts
+
+        name, argnames = EVENTS.get(ev, ("event_%d" % ev, ("arg0", "arg1")))
+        args = {}
+        for key, val in zip(argnames, (a0, a1)):
+            if key is None:
+                continue
+            if key in SIGNED_ARGS and val >= 1 << 31:
+                val -= 1 << 32
+            args[key] = val
+
+        entry = {
+            "name": name,
+            "ph": chr(phase) if phase in (ord("B"), ord("E"), ord("i")) else "i",
+            "ts": abs_ts - base,
+            "pid": 1,
+            "tid": core,
+            "args": args,
+        }
+        if entry["ph"] == "i":
+            entry["s"] = "t"
+        events.append(entry)
+
+    meta = [
+        {"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "geogram-tdongle"}},
+        {"name": "thread_name", "ph": "M", "pid": 1, "tid": 0, "args": {"name": "core0 (BLE/WiFi)"}},
+        {"name": "thread_name", "ph": "M", "pid": 1, "tid": 1, "args": {"name": "core1 (loop)"}},
+    ]
+    return {
+        "traceEvents": meta + events,
+        "displayTimeUnit": "ms",
+        "otherData": {"records": count, "overwritten": overwritten, "dump_time_us": now_us},
+    }
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: %s <dump.bin|console.log>" % sys.argv[0])
+    json.dump(decode(load(sys.argv[1])), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,171 @@
+// utf8_bench.cpp - check and time the shared UTF-8 validator (src/misc/utf8.*).
+//
+// 1. Agreement: utf8_valid_line() must give the same answer as the byte-by-byte validator it
+//    replaced in ble.cpp (copied below) on a fuzz corpus of random and mutated strings, and
+//    utf8_valid() the same answer with the control-character rule left out.
+// 2. Throughput of both on ASCII-heavy text, emoji-heavy text and 23-byte advertisement
+//    payloads.
+//
+// Usage:
+//   g++ -O2 -std=c++17 -Isrc tools/utf8_bench.cpp src/misc/utf8.cpp -o /tmp/utf8_bench
+//   /tmp/utf8_bench [fuzz=2000000] [seed=1]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "misc/utf8.h"
+
+// The validator from ble.cpp before the shared one; `controls` = reject C0 and DEL
+static bool referenceValid(const char* p, size_t n, bool controls) {
+    const uint8_t* s = (const uint8_t*)p;
+    size_t i = 0;
+    while (i < n) {
+        uint8_t c = s[i];
+        if (controls && (c < 0x20 || c == 0x7F)) return false;
+        if (c < 0x80) { ++i; continue; }
+        if ((c & 0xE0) == 0xC0) {
+            if (i + 1 >= n) return false;
+            uint8_t c1 = s[i + 1];
+            if ((c1 & 0xC0) != 0x80) return false;
+            uint32_t cp = ((c & 0x1F) << 6) | (c1 & 0x3F);
+            if (cp < 0x80) return false;
+            i += 2; continue;
+        }
+        if ((c & 0xF0) == 0xE0) {
+            if (i + 2 >= n) return false;
+            uint8_t c1 = s[i + 1], c2 = s[i + 2];
+            if ((c1 & 0xC0) != 0x80 || (c2 & 0xC0) != 0x80) return false;
+            uint32_t cp = ((c & 0x0F) << 12) | ((c1 & 0x3F) << 6) | (c2 & 0x3F);
+            if (cp < 0x800) return false;
+            if (cp >= 0xD800 && cp <= 0xDFFF) return false;
+            i += 3; continue;
+        }
+        if ((c & 0xF8) == 0xF0) {
+            if (i + 3 >= n) return false;
+            uint8_t c1 = s[i + 1], c2 = s[i + 2], c3 = s[i + 3];
+            if ((c1 & 0xC0) != 0x80 || (c2 & 0xC0) != 0x80 || (c3 & 0xC0) != 0x80) return false;
+            uint32_t cp = ((c & 0x07) << 18) | ((c1 & 0x3F) << 12) | ((c2 & 0x3F) << 6) | (c3 & 0x3F);
+            if (cp < 0x10000 || cp > 0x10FFFF) return false;
+            i += 4; continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+static void appendCodePoint(std::string& s, uint32_t cp) {
+    if (cp < 0x80) {
+        s += (char)cp;
+    } else if (cp < 0x800) {
+        s += (char)(0xC0 | (cp >> 6));
+        s += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        s += (char)(0xE0 | (cp >> 12));
+        s += (char)(0x80 | ((cp >> 6) & 0x3F));
+        s += (char)(0x80 | (cp & 0x3F));
+    } else {
+        s += (char)(0xF0 | (cp >> 18));
+        s += (char)(0x80 | ((cp >> 12) & 0x3F));
+        s += (char)(0x80 | ((cp >> 6) & 0x3F));
+        s += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+// Mostly valid text with a given share of multibyte characters
+static std::string makeText(std::mt19937& rng, size_t bytes, int multibytePct) {
+    static const uint32_t kWide[] = {0xE9, 0xE3, 0x20AC, 0x4E2D, 0x1F44D, 0x1F600, 0x1F680, 0x2764};
+    std::string s;
+    while (s.size() < bytes) {
+        if ((int)(rng() % 100) < multibytePct) appendCodePoint(s, kWide[rng() % 8]);
+        else s += (char)(' ' + rng() % 95);
+    }
+    return s;
+}
+
+// Best of 7 rounds, to keep scheduler noise out
+template <class F>
+static double mbps(F fn, size_t bytes, int reps) {
+    double best = 0;
+    for (int round = 0; round < 7; round++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++) fn();
+        auto t1 = std::chrono::steady_clock::now();
+        double r = (double)bytes * reps / std::chrono::duration<double, std::micro>(t1 - t0).count();
+        if (r > best) best = r;
+    }
+    return best;
+}
+
+static volatile bool g_sink;
+
+int main(int argc, char** argv) {
+    long fuzz = argc > 1 ? atol(argv[1]) : 2000000;
+    unsigned seed = argc > 2 ? (unsigned)atoi(argv[2]) : 1;
+    std::mt19937 rng(seed);
+
+    // 1. Agreement
+    long mismatches = 0, valid = 0;
+    for (long t = 0; t < fuzz; t++) {
+        std::string s;
+        size_t len = 1 + rng() % 40;
+        switch (t % 3) {
+            case 0:     // random bytes, biased toward the interesting ranges
+                for (size_t i = 0; i < len; i++) {
+                    static const uint8_t kEdges[] = {0x00, 0x1F, 0x20, 0x7E, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0,
+                                                     0xBF, 0xC0, 0xC1, 0xC2, 0xDF, 0xE0, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF};
+                    s += (char)(rng() % 2 ? kEdges[rng() % sizeof(kEdges)] : rng() % 256);
+                }
+                break;
+            case 1:     // any code point, surrogates included, encoded
+                while (s.size() < len) appendCodePoint(s, rng() % 0x110000);
+                break;
+            default: {  // valid text with one byte flipped, dropped or cut short
+                s = makeText(rng, len, 30);
+                size_t at = rng() % s.size();
+                int m = rng() % 3;
+                if (m == 0) s[at] = (char)(rng() % 256);
+                else if (m == 1) s.erase(at, 1);
+                else s.resize(at);
+                break;
+            }
+        }
+        bool line = utf8_valid_line(s.data(), s.size());
+        bool any = utf8_valid(s.data(), s.size());
+        if (line != referenceValid(s.data(), s.size(), true)) mismatches++;
+        if (any != referenceValid(s.data(), s.size(), false)) mismatches++;
+        valid += any;
+    }
+    printf("agreement with the old validator: %ld strings (%ld valid), %ld mismatches\n", fuzz, valid, mismatches);
+
+    // 2. Throughput
+    struct Corpus { const char* name; std::vector<std::string> items; };
+    std::vector<Corpus> corpora = {
+        {"ASCII-heavy 4 KB", {makeText(rng, 4096, 1)}},
+        {"emoji-heavy 4 KB", {makeText(rng, 4096, 40)}},
+        {"adverts ~22 B", {}},
+    };
+    for (int k = 0; k < 4096; k++) corpora[2].items.push_back(makeText(rng, 20, 5));
+    printf("\n%-18s %14s %16s %8s\n", "corpus (MB/s)", "old validator", "utf8_valid_line", "speedup");
+    for (auto& c : corpora) {
+        size_t n = 0;
+        for (auto& s : c.items) n += s.size();
+        int reps = (int)(4000000 / n) + 1;
+        double tOld = mbps([&] {
+            bool ok = true;
+            for (auto& s : c.items) ok &= referenceValid(s.data(), s.size(), true);
+            g_sink = ok;
+        }, n, reps);
+        double tNew = mbps([&] {
+            bool ok = true;
+            for (auto& s : c.items) ok &= utf8_valid_line(s.data(), s.size());
+            g_sink = ok;
+        }, n, reps);
+        printf("%-18s %14.0f %16.0f %7.2fx\n", c.name, tOld, tNew, tNew / tOld);
+    }
+    return mismatches ? 1 : 0;
+}
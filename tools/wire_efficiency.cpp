@@ -0,0 +1,83 @@
+// wire_efficiency.cpp - compare the '>' text parcels with the binary frames (src/ble/wireformat.*).
+//
+// For each sample message, prints how many advertisements each format needs and the payload
+// efficiency per advertisement: message bytes / (advertisements x WIRE_FRAME_MAX). Binary
+// messages are also decoded again and checked against the input. The text format is sized the way ble_send_message() builds it:
+// ">AA0:FROM:DEST:CKSM", then ">AA<n>:" + text up to the 24-byte service data.
+//
+// Usage:
+//   g++ -O2 -std=c++17 -Isrc tools/wire_efficiency.cpp src/ble/wireformat.cpp -o /tmp/wire_efficiency
+//   /tmp/wire_efficiency ["message" ...]
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "ble/wireformat.h"
+
+static const char* kSamples[] = {
+    "Meet at the north gate at 18h",
+    "All good here. Battery 80 percent, moving to checkpoint 3 now.",
+    "ALERT: road closed near km 12, use the river path!",
+    "Olá, está tudo bem? 👍",
+    "The quick brown fox jumps over the lazy dog while the dongles relay every word across the valley",
+};
+
+static void textFormat(size_t len, const char* from, const char* to, int* advs, size_t* bytes) {
+    size_t header = 1 + 4 + strlen(from) + 1 + strlen(to) + 1 + 4;    // ">AA0:" FROM ":" DEST ":" CKSM
+    *advs = 1;
+    *bytes = header;
+    for (size_t pos = 0, n = 1; pos < len; n++) {
+        size_t prefix = 1 + 2 + std::to_string(n).size() + 1;       // ">AA<n>:"
+        size_t chunk = WIRE_FRAME_MAX - prefix;
+        if (chunk > len - pos) chunk = len - pos;
+        pos += chunk;
+        *bytes += prefix + chunk;
+        (*advs)++;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* from = "X1ABCD";
+    const char* to = "ANY";
+    int count = argc > 1 ? argc - 1 : (int)(sizeof(kSamples) / sizeof(kSamples[0]));
+    size_t sumLen = 0;
+    int sumTextAdvs = 0, sumBinAdvs = 0;
+    int failures = 0;
+
+    printf("%5s %7s %7s %7s %7s  %-5s %s\n", "len", "t_advs", "t_eff", "b_advs", "b_eff", "check", "message");
+    for (int m = 0; m < count; m++) {
+        const char* msg = argc > 1 ? argv[m + 1] : kSamples[m];
+        size_t len = strlen(msg);
+
+        int tAdvs;
+        size_t tBytes;
+        textFormat(len, from, to, &tAdvs, &tBytes);
+        (void)tBytes;
+
+        static uint8_t frames[256][WIRE_FRAME_MAX];
+        static uint8_t lens[256];
+        int n = wire_encode_message((uint16_t)(0x1234 + m), from, to, msg, len, frames, lens, 256);
+        WireAssembler asmb;
+        WireMessage done = {};
+        bool ok = false;
+        // Deliver in reverse to exercise out-of-order assembly
+        for (int i = n - 1; i >= 0; i--) {
+            WireFrame f;
+            if (!wire_parse(frames[i], lens[i], &f)) break;
+            if (asmb.add(f, 0, 0, &done)) ok = done.len == len && memcmp(done.text, msg, len) == 0 &&
+                                          !strcmp(done.from, from) && !strcmp(done.to, to);
+        }
+        if (!ok) failures++;
+
+        printf("%5zu %7d %6.1f%% %7d %6.1f%%  %-5s %.40s\n", len, tAdvs, 100.0 * len / (tAdvs * WIRE_FRAME_MAX),
+               n, 100.0 * len / (n * WIRE_FRAME_MAX), ok ? "ok" : "FAIL", msg);
+        sumLen += len;
+        sumTextAdvs += tAdvs;
+        sumBinAdvs += n;
+    }
+    printf("overall: text %d advertisements (%.1f%%), binary %d advertisements (%.1f%%)\n",
+           sumTextAdvs, 100.0 * sumLen / (sumTextAdvs * WIRE_FRAME_MAX),
+           sumBinAdvs, 100.0 * sumLen / (sumBinAdvs * WIRE_FRAME_MAX));
+    return failures ? 1 : 0;
+}